@@ -0,0 +1,1304 @@
+/**
+ ** @file checkpoint.c
+ ** Engine state checkpoints and warm restart.
+ **
+ ** A checkpoint is a binary snapshot of the analysis engine: rule
+ ** instances and their state instance trees, environments, waiting
+ ** threads and the events they reference.  It is written periodically
+ ** (in a child process, so the main loop does not stall) and on
+ ** SIGTERM, and reloaded at startup, so that a restart does not lose
+ ** the partially matched scenarios.
+ **
+ ** The format is native (byte order, word sizes): a checkpoint is
+ ** meant to be read back by the same binary, on the same host.
+ **
+ **   header     magic, version, sizeof (long), sizeof (time_t), date
+ **   fields     field names (field ids are remapped by name)
+ **   rules      id, name, signature, dynamic environment size
+ **   events     list of (field id, value)
+ **   sketches   shared sketches, by name
+ **   instances  rule instances, each with its state instances in
+ **              creation order, their environments and sync locks
+ **   threads    the new and retrig thread queues
+ **   trailer    magic
+ **
+ ** Values are written once, the first time they are met, then
+ ** referenced by id: sharing between events and environments, and
+ ** between inherited environments, is preserved.  References to
+ ** rule constants (static environment of the rule) are restored as
+ ** references to the constants of the newly compiled rule.  Shared
+ ** sketches are registered again under their names, so that rules
+ ** and restored environments keep sharing them.
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h> /* for PATH_MAX */
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "orchids.h"
+#include "lang.h"
+#include "engine.h"
+#include "evt_mgr.h"
+#include "orchids_api.h"
+#include "mem_governor.h"
+#include "ohash.h"
+#include "strhash.h"
+
+#include "checkpoint.h"
+
+/* Value codes, in event fields and environment slots.  Other codes
+ * are ids of values already written. */
+#define CKPT_VAL_NULL       0x00000000U
+#define CKPT_VAL_STATIC     0x80000000U /* | static index, then value */
+#define CKPT_VAL_NOT_NEEDED 0xfffffffeU
+#define CKPT_VAL_NEW        0xffffffffU /* then value */
+#define CKPT_VAL_STATIC_IDX 0x7fffffffU
+
+/* Restored value flags */
+#define CKPT_VALUE_USED   0x01
+#define CKPT_VALUE_STATIC 0x02
+
+/* Sanity limit on string lengths in the file */
+#define CKPT_MAX_STR 4096
+
+#define PTR_HCODE(p) ((ohcode_t)(uintptr_t)(p))
+
+static volatile sig_atomic_t checkpoint_sigterm_g = 0;
+static time_t checkpoint_next_g = 0;
+static pid_t checkpoint_child_g = 0;
+
+
+typedef struct ckpt_writer_s ckpt_writer_t;
+struct ckpt_writer_s
+{
+  orchids_t *ctx;
+  FILE      *fp;
+  ohash_t    vals;      /* value -> value id */
+  uint32_t   vals_nb;
+  ohash_t    events;    /* active event -> event id */
+  ohash_t    states;    /* state instance -> global state id */
+  uint32_t   states_nb;
+};
+
+
+typedef struct ckpt_reader_s ckpt_reader_t;
+struct ckpt_reader_s
+{
+  orchids_t         *ctx;
+  FILE              *fp;
+  int                err;
+  int32_t           *field_map;
+  uint32_t           fields_nb;
+  rule_t           **rules;
+  int32_t           *rules_env_sz;
+  uint32_t           rules_nb;
+  ovm_var_t        **vals;
+  unsigned char     *vals_flags;
+  uint32_t           vals_nb;
+  uint32_t           vals_sz;
+  active_event_t   **events;
+  uint32_t           events_nb;
+  state_instance_t **states;
+  uint32_t           states_nb;
+};
+
+
+/*
+** Pointer maps
+*/
+
+static int
+ptr_keycmp(void *cmpdata, ohash_slot_t *slot, void *key, size_t keylen)
+{
+  return (slot->key != key);
+}
+
+static void
+ptrmap_add(ohash_t *h, void *ptr, uint32_t id)
+{
+  ohash_insert(h, PTR_HCODE(ptr), ptr, 0, (void *)(uintptr_t) id);
+}
+
+static uint32_t
+ptrmap_get(ohash_t *h, void *ptr)
+{
+  ohash_slot_t *slot;
+
+  slot = ohash_lookup(h, PTR_HCODE(ptr), ptr, 0);
+
+  return (slot ? (uint32_t)(uintptr_t) slot->data : 0);
+}
+
+
+/*
+** Writer
+*/
+
+#define PUT(fp, x) fwrite(&(x), sizeof (x), 1, (fp))
+
+static void
+put_u32(FILE *fp, uint32_t v)
+{
+  PUT(fp, v);
+}
+
+static void
+put_i32(FILE *fp, int32_t v)
+{
+  PUT(fp, v);
+}
+
+static void
+put_str(FILE *fp, const char *s)
+{
+  uint32_t len;
+
+  len = strlen(s);
+  PUT(fp, len);
+  fwrite(s, len, 1, fp);
+}
+
+/**
+ ** Write a value.  Constants are looked up in the static environment
+ ** of the rule the value belongs to (rule may be NULL for events).
+ **/
+static void
+put_value(ckpt_writer_t *w, ovm_var_t *var, rule_t *rule)
+{
+  uint32_t id;
+  int32_t s;
+
+  if (var == NULL) {
+    put_u32(w->fp, CKPT_VAL_NULL);
+    return ;
+  }
+  if (var == F_NOT_NEEDED) {
+    put_u32(w->fp, CKPT_VAL_NOT_NEEDED);
+    return ;
+  }
+
+  id = ptrmap_get(&w->vals, var);
+  if (id) {
+    put_u32(w->fp, id);
+    return ;
+  }
+
+  ptrmap_add(&w->vals, var, ++w->vals_nb);
+  s = 0;
+  if (rule && !CAN_FREE_VAR(var))
+    for (s = 0; s < rule->static_env_sz && rule->static_env[s] != var; s++)
+      ;
+  if (rule && s < rule->static_env_sz)
+    put_u32(w->fp, CKPT_VAL_STATIC | s);
+  else
+    put_u32(w->fp, CKPT_VAL_NEW);
+  issdl_save(w->fp, var);
+}
+
+
+/**
+ ** Structural signature of a rule: a checkpointed rule instance can
+ ** only be restored into a rule with the same states, transitions
+ ** and environment layout, compiled from the same source (the
+ ** compiler checksum also covers byte code and constants).
+ **/
+static uint32_t
+rule_signature(rule_t *rule)
+{
+  unsigned int crc;
+  int32_t dest;
+  int s;
+  int t;
+
+  crc = crc32(0, rule->name, strlen(rule->name));
+  crc = crc32(crc, (char *) &rule->state_nb, sizeof (rule->state_nb));
+  crc = crc32(crc, (char *) &rule->trans_nb, sizeof (rule->trans_nb));
+  crc = crc32(crc, (char *) &rule->dynamic_env_sz,
+              sizeof (rule->dynamic_env_sz));
+  crc = crc32(crc, (char *) &rule->checksum, sizeof (rule->checksum));
+  for (s = 0; s < rule->state_nb; s++) {
+    crc = crc32(crc, rule->state[s].name, strlen(rule->state[s].name));
+    for (t = 0; t < rule->state[s].trans_nb; t++) {
+      dest = rule->state[s].trans[t].dest - rule->state;
+      crc = crc32(crc, (char *) &dest, sizeof (dest));
+    }
+  }
+
+  return (crc);
+}
+
+
+/**
+ ** Rules retired by a reload (id -1) that still have instances are
+ ** written after the current rules, numbered from
+ ** rule_compiler->rules on.  Their signature no longer matches the
+ ** rule of the same name, if any, so their instances are dropped
+ ** on restore.
+ **/
+static int32_t
+checkpoint_rule_id(orchids_t *ctx, rule_t *rule)
+{
+  rule_t *r;
+  int32_t id;
+
+  if (rule->id >= 0)
+    return (rule->id);
+
+  id = ctx->rule_compiler->rules;
+  for (r = ctx->retired_rules; r != NULL && r != rule; r = r->next)
+    id++;
+
+  return (id);
+}
+
+
+static void
+write_rule_instance(ckpt_writer_t *w, rule_instance_t *ri)
+{
+  state_instance_t **tbl;
+  state_instance_t *si;
+  sync_lock_list_t *lock;
+  uint32_t base;
+  uint32_t n;
+  uint32_t i;
+  int env_sz;
+  int k;
+
+  put_i32(w->fp, checkpoint_rule_id(w->ctx, ri->rule));
+  put_u32(w->fp, ri->flags);
+  PUT(w->fp, ri->creation_date);
+  PUT(w->fp, ri->new_creation_date);
+  PUT(w->fp, ri->new_last_act);
+  put_i32(w->fp, ri->max_depth);
+  put_i32(w->fp, ri->state_instances);
+
+  /* State instances in creation order (state_list is in reverse
+   * chronological order): parents are always written before their
+   * children, and re-linking them at load time rebuilds the same
+   * tree and the same retrig list. */
+  n = 1;
+  for (si = ri->state_list; si; si = si->retrig_next)
+    n++;
+  tbl = Xmalloc(n * sizeof (state_instance_t *));
+  tbl[0] = ri->first_state;
+  i = n;
+  for (si = ri->state_list; si; si = si->retrig_next)
+    tbl[--i] = si;
+
+  put_u32(w->fp, n);
+  base = w->states_nb;
+  env_sz = ri->rule->dynamic_env_sz;
+  for (i = 0; i < n; i++) {
+    si = tbl[i];
+    ptrmap_add(&w->states, si, ++w->states_nb);
+    put_i32(w->fp, si->state - ri->rule->state);
+    if (si->parent)
+      put_i32(w->fp, ptrmap_get(&w->states, si->parent) - base - 1);
+    else
+      put_i32(w->fp, -1);
+    put_u32(w->fp, si->event ? ptrmap_get(&w->events, si->event) : 0);
+    put_i32(w->fp, si->event_level);
+    put_u32(w->fp, si->flags);
+    put_i32(w->fp, si->depth);
+    for (k = 0; k < env_sz; k++)
+      put_value(w, si->current_env[k], ri->rule);
+    for (k = 0; k < env_sz; k++)
+      put_value(w, si->inherit_env[k], ri->rule);
+  }
+  Xfree(tbl);
+
+  n = 0;
+  for (lock = ri->sync_lock_list; lock; lock = lock->next)
+    n++;
+  put_u32(w->fp, n);
+  for (lock = ri->sync_lock_list; lock; lock = lock->next)
+    put_u32(w->fp, ptrmap_get(&w->states, lock->state) - base - 1);
+}
+
+
+static void
+write_thread_queue(ckpt_writer_t *w, wait_thread_t *q)
+{
+  wait_thread_t *t;
+  uint32_t n;
+
+  n = 0;
+  for (t = q; t; t = t->next)
+    n++;
+  put_u32(w->fp, n);
+
+  for (t = q; t; t = t->next) {
+    put_u32(w->fp, ptrmap_get(&w->states, t->state_instance));
+    put_i32(w->fp, t->trans - t->state_instance->state->trans);
+    put_u32(w->fp, t->flags);
+    put_u32(w->fp, t->pass);
+    PUT(w->fp, t->timeout);
+  }
+}
+
+
+static int
+write_sketch(ohash_slot_t *slot, void *data)
+{
+  ckpt_writer_t *w = data;
+
+  put_str(w->fp, slot->key);
+  put_value(w, slot->data, NULL);
+
+  return (0);
+}
+
+
+int
+checkpoint_save(orchids_t *ctx, const char *path)
+{
+  ckpt_writer_t w;
+  char tmp[PATH_MAX];
+  struct timeval start;
+  struct timeval end;
+  rule_instance_t *ri;
+  state_instance_t *si;
+  active_event_t *ae;
+  event_t *e;
+  rule_t *r;
+  time_t now;
+  uint32_t n;
+  uint32_t states_nb;
+  int i;
+  int err;
+
+  gettimeofday(&start, NULL);
+
+  /* The periodic writer (a child) and a save on SIGTERM may overlap:
+   * each writes its own temporary file. */
+  snprintf(tmp, sizeof (tmp), "%s.%d.tmp", path, (int)getpid());
+  w.fp = Xfopen(tmp, "w");
+  if (w.fp == NULL) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "checkpoint: can't open '%s': %s\n", tmp, strerror(errno));
+    return (-1);
+  }
+  setvbuf(w.fp, NULL, _IOFBF, CHECKPOINT_IOBUF_SZ);
+
+  w.ctx = ctx;
+  w.vals_nb = 0;
+  w.states_nb = 0;
+  ohash_init(&w.vals, ctx->state_instances + 1024, ptr_keycmp, NULL);
+  ohash_init(&w.events, ctx->active_events + 16, ptr_keycmp, NULL);
+  ohash_init(&w.states, ctx->state_instances + 16, ptr_keycmp, NULL);
+
+  /* header */
+  put_u32(w.fp, CHECKPOINT_MAGIC);
+  put_u32(w.fp, CHECKPOINT_VERSION);
+  put_u32(w.fp, sizeof (long));
+  put_u32(w.fp, sizeof (time_t));
+  now = time(NULL);
+  PUT(w.fp, now);
+
+  /* fields */
+  put_u32(w.fp, ctx->num_fields);
+  for (i = 0; i < ctx->num_fields; i++)
+    put_str(w.fp, ctx->global_fields[i].name);
+
+  /* rules */
+  n = ctx->rule_compiler->rules;
+  for (r = ctx->retired_rules; r; r = r->next)
+    n++;
+  put_u32(w.fp, n);
+  for (r = ctx->rule_compiler->first_rule; r; r = r->next) {
+    put_i32(w.fp, r->id);
+    put_str(w.fp, r->name);
+    put_u32(w.fp, rule_signature(r));
+    put_i32(w.fp, r->dynamic_env_sz);
+  }
+  for (r = ctx->retired_rules; r; r = r->next) {
+    put_i32(w.fp, checkpoint_rule_id(ctx, r));
+    put_str(w.fp, r->name);
+    put_u32(w.fp, rule_signature(r));
+    put_i32(w.fp, r->dynamic_env_sz);
+  }
+
+  /* events */
+  n = 0;
+  for (ae = ctx->active_event_head; ae; ae = ae->next)
+    n++;
+  put_u32(w.fp, n);
+  n = 0;
+  for (ae = ctx->active_event_head; ae; ae = ae->next) {
+    ptrmap_add(&w.events, ae, ++n);
+    i = 0;
+    for (e = ae->event; e; e = e->next)
+      i++;
+    put_u32(w.fp, i);
+    for (e = ae->event; e; e = e->next) {
+      put_i32(w.fp, e->field_id);
+      put_value(&w, e->value, NULL);
+    }
+  }
+
+  /* shared sketches */
+  put_u32(w.fp, strhash_elmts(ctx->sketches));
+  ohash_walk(&ctx->sketches->tbl, write_sketch, &w);
+
+  /* rule instances */
+  n = 0;
+  states_nb = 0;
+  for (ri = ctx->first_rule_instance; ri; ri = ri->next) {
+    n++;
+    states_nb++;
+    for (si = ri->state_list; si; si = si->retrig_next)
+      states_nb++;
+  }
+  put_u32(w.fp, n);
+  put_u32(w.fp, states_nb);
+  for (ri = ctx->first_rule_instance; ri; ri = ri->next)
+    write_rule_instance(&w, ri);
+
+  /* threads: between two events, they all are in these two queues */
+  write_thread_queue(&w, ctx->new_qh);
+  write_thread_queue(&w, ctx->retrig_qh);
+
+  put_u32(w.fp, CHECKPOINT_MAGIC);
+
+  err = ferror(w.fp);
+  if (fclose(w.fp))
+    err = 1;
+
+  ohash_destroy(&w.vals);
+  ohash_destroy(&w.events);
+  ohash_destroy(&w.states);
+
+  if (err) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "checkpoint: error while writing '%s'\n", tmp);
+    unlink(tmp);
+    return (-1);
+  }
+  if (rename(tmp, path)) {
+    DebugLog(DF_CORE, DS_ERROR, "checkpoint: can't rename '%s': %s\n",
+             tmp, strerror(errno));
+    unlink(tmp);
+    return (-1);
+  }
+
+  gettimeofday(&end, NULL);
+  Timer_Sub(&end, &end, &start);
+  DebugLog(DF_CORE, DS_NOTICE,
+           "checkpoint: wrote %u rule instances, %u state instances, "
+           "%u values to '%s' in %li.%06li s\n",
+           ctx->rule_instances, w.states_nb, w.vals_nb, path,
+           (long) end.tv_sec, (long) end.tv_usec);
+
+  return (RETURN_SUCCESS);
+}
+
+
+/*
+** Reader
+*/
+
+#define GET(r, x) \
+  do { \
+    if (fread(&(x), sizeof (x), 1, (r)->fp) != 1) \
+      (r)->err = 1; \
+  } while (0)
+
+static uint32_t
+get_u32(ckpt_reader_t *r)
+{
+  uint32_t v;
+
+  v = 0;
+  GET(r, v);
+
+  return (v);
+}
+
+static int32_t
+get_i32(ckpt_reader_t *r)
+{
+  int32_t v;
+
+  v = 0;
+  GET(r, v);
+
+  return (v);
+}
+
+static char *
+get_str(ckpt_reader_t *r)
+{
+  uint32_t len;
+  char *s;
+
+  len = get_u32(r);
+  if (r->err || len > CKPT_MAX_STR) {
+    r->err = 1;
+    return (NULL);
+  }
+  s = Xmalloc(len + 1);
+  if (len && fread(s, len, 1, r->fp) != 1) {
+    r->err = 1;
+    Xfree(s);
+    return (NULL);
+  }
+  s[len] = '\0';
+
+  return (s);
+}
+
+static int
+same_value(ovm_var_t *v1, ovm_var_t *v2)
+{
+  issdl_type_t *t;
+  size_t len;
+
+  if (TYPE(v1) != TYPE(v2))
+    return (FALSE);
+  if (TYPE(v1) == T_NULL)
+    return (ERRNO(v1) == ERRNO(v2));
+
+  t = &issdlgettypes()[TYPE(v1)];
+  if (t->get_data == NULL || t->get_data_len == NULL)
+    return (FALSE);
+  len = t->get_data_len(v1);
+  if (len != t->get_data_len(v2))
+    return (FALSE);
+
+  return (memcmp(t->get_data(v1), t->get_data(v2), len) == 0);
+}
+
+static ovm_var_t *
+get_value(ckpt_reader_t *r, int keep, rule_t *rule)
+{
+  ovm_var_t *var;
+  uint32_t code;
+  uint32_t id;
+  uint32_t s;
+
+  code = get_u32(r);
+  if (r->err || code == CKPT_VAL_NULL)
+    return (NULL);
+  if (code == CKPT_VAL_NOT_NEEDED)
+    return (F_NOT_NEEDED);
+
+  if (code != CKPT_VAL_NEW && !(code & CKPT_VAL_STATIC)) {
+    if (code > r->vals_nb) {
+      r->err = 1;
+      return (NULL);
+    }
+    id = code - 1;
+  }
+  else {
+    var = issdl_restore(r->fp);
+    if (var == NULL) {
+      r->err = 1;
+      return (NULL);
+    }
+    if (r->vals_nb == r->vals_sz) {
+      r->vals_sz = r->vals_sz ? 2 * r->vals_sz : 4096;
+      r->vals = Xrealloc(r->vals, r->vals_sz * sizeof (ovm_var_t *));
+      r->vals_flags = Xrealloc(r->vals_flags, r->vals_sz);
+    }
+    id = r->vals_nb++;
+    r->vals_flags[id] = 0;
+
+    /* A rule constant: use the constant of the current rule if it
+     * is still the same, else keep the restored copy. */
+    s = code & CKPT_VAL_STATIC_IDX;
+    if (code != CKPT_VAL_NEW && rule
+        && s < (uint32_t) rule->static_env_sz
+        && same_value(var, rule->static_env[s])) {
+      issdl_free(var);
+      var = rule->static_env[s];
+      r->vals_flags[id] = CKPT_VALUE_STATIC;
+    }
+    r->vals[id] = var;
+  }
+
+  if (keep)
+    r->vals_flags[id] |= CKPT_VALUE_USED;
+
+  return (r->vals[id]);
+}
+
+
+static int
+read_header(ckpt_reader_t *r)
+{
+  time_t date;
+  char asc_time[32];
+
+  if (get_u32(r) != CHECKPOINT_MAGIC) {
+    DebugLog(DF_CORE, DS_ERROR, "checkpoint: bad magic number\n");
+    return (-1);
+  }
+  if (get_u32(r) != CHECKPOINT_VERSION
+      || get_u32(r) != sizeof (long)
+      || get_u32(r) != sizeof (time_t)) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "checkpoint: incompatible file (version or architecture)\n");
+    return (-1);
+  }
+  date = 0;
+  GET(r, date);
+  if (r->err)
+    return (-1);
+
+  strftime(asc_time, sizeof (asc_time), "%Y-%m-%d %H:%M:%S",
+           localtime(&date));
+  DebugLog(DF_CORE, DS_NOTICE, "checkpoint: restoring state of %s\n",
+           asc_time);
+
+  return (0);
+}
+
+
+static void
+read_fields(ckpt_reader_t *r)
+{
+  field_record_t *f;
+  uint32_t i;
+  char *name;
+
+  r->fields_nb = get_u32(r);
+  if (r->err)
+    return ;
+  r->field_map = Xmalloc(r->fields_nb * sizeof (int32_t) + 1);
+  for (i = 0; i < r->fields_nb; i++) {
+    name = get_str(r);
+    if (name == NULL)
+      return ;
+    f = strhash_get(r->ctx->rule_compiler->fields_hash, name);
+    r->field_map[i] = f ? f->id : -1;
+    if (f == NULL)
+      DebugLog(DF_CORE, DS_WARN,
+               "checkpoint: field '%s' no longer exists\n", name);
+    Xfree(name);
+  }
+}
+
+
+static void
+read_rules(ckpt_reader_t *r)
+{
+  rule_t *rule;
+  uint32_t sig;
+  uint32_t i;
+  int32_t id;
+  int32_t env_sz;
+  char *name;
+
+  r->rules_nb = get_u32(r);
+  if (r->err)
+    return ;
+  r->rules = Xzmalloc(r->rules_nb * sizeof (rule_t *) + 1);
+  r->rules_env_sz = Xzmalloc(r->rules_nb * sizeof (int32_t) + 1);
+  for (i = 0; i < r->rules_nb; i++) {
+    id = get_i32(r);
+    name = get_str(r);
+    sig = get_u32(r);
+    env_sz = get_i32(r);
+    if (name == NULL || id < 0 || (uint32_t) id >= r->rules_nb) {
+      r->err = 1;
+      Xfree(name);
+      return ;
+    }
+    r->rules_env_sz[id] = env_sz;
+    rule = strhash_get(r->ctx->rule_compiler->rulenames_hash, name);
+    if (rule == NULL)
+      DebugLog(DF_CORE, DS_WARN,
+               "checkpoint: rule '%s' no longer exists, "
+               "dropping its instances\n", name);
+    else if (rule_signature(rule) != sig) {
+      DebugLog(DF_CORE, DS_WARN,
+               "checkpoint: rule '%s' has changed, "
+               "dropping its instances\n", name);
+      rule = NULL;
+    }
+    r->rules[id] = rule;
+    Xfree(name);
+  }
+}
+
+
+static void
+read_events(ckpt_reader_t *r)
+{
+  orchids_t *ctx;
+  active_event_t *ae;
+  event_t *e;
+  event_t **tail;
+  ovm_var_t *val;
+  uint32_t i;
+  uint32_t nf;
+  int32_t fid;
+
+  ctx = r->ctx;
+  r->events_nb = get_u32(r);
+  if (r->err)
+    return ;
+  r->events = Xmalloc(r->events_nb * sizeof (active_event_t *) + 1);
+  for (i = 0; i < r->events_nb && !r->err; i++) {
+    ae = Xzmalloc(sizeof (active_event_t));
+    tail = &ae->event;
+    for (nf = get_u32(r); nf > 0 && !r->err; nf--) {
+      fid = get_i32(r);
+      if (fid < 0 || (uint32_t) fid >= r->fields_nb
+          || r->field_map[fid] < 0) {
+        get_value(r, FALSE, NULL);
+        continue ;
+      }
+      val = get_value(r, TRUE, NULL);
+      if (val == NULL || val == F_NOT_NEEDED)
+        continue ;
+      e = Xmalloc(sizeof (event_t));
+      e->field_id = r->field_map[fid];
+      e->value = val;
+      e->next = NULL;
+      e->arena = NULL;
+      *tail = e;
+      tail = &e->next;
+    }
+    r->events[i] = ae;
+
+    /* Link and account events now, free_rule_instance() expects it */
+    ae->mem_size = memgov_event_size(ae->event);
+    memgov_retain_event(ctx, ae);
+    if (ctx->active_event_head == NULL) {
+      ctx->active_event_head = ae;
+      ctx->active_event_tail = ae;
+    } else {
+      ae->prev = ctx->active_event_tail;
+      ctx->active_event_tail->next = ae;
+      ctx->active_event_tail = ae;
+    }
+    ctx->active_events++;
+  }
+}
+
+
+/**
+ ** Register the shared sketches again.  A name which is already
+ ** registered keeps its current sketch.
+ **/
+static void
+read_sketches(ckpt_reader_t *r)
+{
+  ovm_var_t *var;
+  uint32_t n;
+  char *name;
+
+  for (n = get_u32(r); n > 0 && !r->err; n--) {
+    name = get_str(r);
+    if (name == NULL)
+      return ;
+    /* Shared sketches are never freed */
+    var = get_value(r, TRUE, NULL);
+    if (var == NULL || var == F_NOT_NEEDED
+        || strhash_get(r->ctx->sketches, name) != NULL) {
+      Xfree(name);
+      continue ;
+    }
+    strhash_add(r->ctx->sketches, var, name);
+  }
+}
+
+
+static void
+read_rule_instance(ckpt_reader_t *r, uint32_t *state_id)
+{
+  orchids_t *ctx;
+  rule_instance_t *ri;
+  rule_instance_t dropped;
+  state_instance_t *si;
+  state_instance_t *parent;
+  sync_lock_list_t *lock;
+  sync_lock_list_t **lock_tail;
+  rule_t *rule;
+  uint32_t base;
+  uint32_t n;
+  uint32_t i;
+  uint32_t ev;
+  uint32_t idx;
+  int32_t rule_id;
+  int32_t sid;
+  int32_t pidx;
+  int env_sz;
+  int k;
+
+  ctx = r->ctx;
+  rule_id = get_i32(r);
+  if (r->err || rule_id < 0 || (uint32_t) rule_id >= r->rules_nb) {
+    r->err = 1;
+    return ;
+  }
+  rule = r->rules[rule_id];
+  env_sz = r->rules_env_sz[rule_id];
+
+  if (rule)
+    ri = Xzmalloc(sizeof (rule_instance_t));
+  else {
+    memset(&dropped, 0, sizeof (dropped));
+    ri = &dropped;
+  }
+  ri->rule = rule;
+  ri->flags = get_u32(r);
+  GET(r, ri->creation_date);
+  GET(r, ri->new_creation_date);
+  GET(r, ri->new_last_act);
+  ri->max_depth = get_i32(r);
+  ri->state_instances = get_i32(r);
+
+  n = get_u32(r);
+  base = *state_id;
+  if (r->err || n == 0 || n > r->states_nb - base) {
+    r->err = 1;
+    if (rule)
+      Xfree(ri);
+    return ;
+  }
+
+  for (i = 0; i < n; i++) {
+    sid = get_i32(r);
+    pidx = get_i32(r);
+    ev = get_u32(r);
+    if (r->err || (i == 0 && pidx != -1)
+        || (i > 0 && (pidx < 0 || (uint32_t) pidx >= i))
+        || ev > r->events_nb
+        || (rule && (sid < 0 || sid >= rule->state_nb))) {
+      r->err = 1;
+      break ;
+    }
+
+    if (rule == NULL) {
+      /* dropped instance: only skip its data */
+      get_i32(r);
+      get_u32(r);
+      get_i32(r);
+      for (k = 0; k < 2 * env_sz; k++)
+        get_value(r, FALSE, NULL);
+      r->states[(*state_id)++] = NULL;
+      continue ;
+    }
+
+    si = Xzmalloc(sizeof (state_instance_t));
+    si->state = &rule->state[sid];
+    si->rule_instance = ri;
+    si->event_level = get_i32(r);
+    si->flags = get_u32(r);
+    si->depth = get_i32(r);
+    if (env_sz > 0) {
+      si->current_env = Xmalloc(env_sz * sizeof (ovm_var_t *));
+      si->inherit_env = Xmalloc(env_sz * sizeof (ovm_var_t *));
+      for (k = 0; k < env_sz; k++) {
+        si->current_env[k] = get_value(r, TRUE, rule);
+        if (si->current_env[k] && si->current_env[k] != F_NOT_NEEDED
+            && CAN_FREE_VAR(si->current_env[k]))
+          MEMGOV_CHARGE(ctx, ri, memgov_var_size(si->current_env[k]));
+      }
+      for (k = 0; k < env_sz; k++)
+        si->inherit_env[k] = get_value(r, TRUE, rule);
+    }
+    if (i == 0)
+      MEMGOV_CHARGE(ctx, ri, sizeof (rule_instance_t));
+    MEMGOV_CHARGE(ctx, ri,
+                  sizeof (state_instance_t)
+                  + 2 * env_sz * sizeof (ovm_var_t *));
+
+    if (i == 0) {
+      ri->first_state = si;
+    }
+    else {
+      parent = r->states[base + pidx];
+      si->parent = parent;
+      si->next_sibling = parent->first_child;
+      parent->first_child = si;
+      si->retrig_next = ri->state_list;
+      ri->state_list = si;
+    }
+    if (ev) {
+      si->event = r->events[ev - 1];
+      si->event->refs++;
+      memgov_ref_event(ctx, ri, si->event);
+    }
+    r->states[(*state_id)++] = si;
+    ctx->state_instances++;
+  }
+
+  if (r->err) {
+    /* Put the already restored part in the engine, so that it gets
+     * freed with the other instances. */
+    if (rule == NULL)
+      return ;
+    if (ri->first_state == NULL) {
+      MEMGOV_RELEASE(ctx, ri, ri->mem_used);
+      Xfree(ri);
+      return ;
+    }
+    ri->creation_date = 0;
+  }
+
+  n = r->err ? 0 : get_u32(r);
+  lock_tail = &ri->sync_lock_list;
+  for ( ; n > 0 && !r->err; n--) {
+    idx = get_u32(r);
+    if (idx >= *state_id - base) {
+      r->err = 1;
+      break ;
+    }
+    if (rule == NULL || rule->sync_lock == NULL)
+      continue ;
+    si = r->states[base + idx];
+    objhash_add(rule->sync_lock, si, si);
+    lock = Xmalloc(sizeof (sync_lock_list_t));
+    lock->state = si;
+    lock->next = NULL;
+    *lock_tail = lock;
+    lock_tail = &lock->next;
+  }
+
+  if (rule == NULL)
+    return ;
+
+  if (ri->creation_date) {
+    rule->instances++;
+    ctx->rule_instances++;
+  }
+
+  /* The engine prepends new instances: keep the saved order. */
+  if (ctx->last_rule_instance)
+    ctx->last_rule_instance->next = ri;
+  else
+    ctx->first_rule_instance = ri;
+  ctx->last_rule_instance = ri;
+}
+
+
+static void
+read_thread_queue(ckpt_reader_t *r, wait_thread_t **qh, wait_thread_t **qt)
+{
+  orchids_t *ctx;
+  wait_thread_t *t;
+  state_instance_t *si;
+  uint32_t n;
+  uint32_t sid;
+  int32_t tid;
+  uint32_t flags;
+  uint32_t pass;
+  time_t timeout;
+
+  ctx = r->ctx;
+  for (n = get_u32(r); n > 0 && !r->err; n--) {
+    sid = get_u32(r);
+    tid = get_i32(r);
+    flags = get_u32(r);
+    pass = get_u32(r);
+    timeout = 0;
+    GET(r, timeout);
+    if (r->err || sid == 0 || sid > r->states_nb) {
+      r->err = 1;
+      break ;
+    }
+
+    si = r->states[sid - 1];
+    if (si == NULL || tid < 0 || tid >= si->state->trans_nb) {
+      /* thread of a dropped rule: keep the queue commit point */
+      if ((flags & THREAD_BUMP) && *qt)
+        (*qt)->flags |= THREAD_BUMP;
+      continue ;
+    }
+
+    t = Xzmalloc(sizeof (wait_thread_t));
+    t->trans = &si->state->trans[tid];
+    t->state_instance = si;
+    t->flags = flags;
+    t->pass = pass;
+    t->timeout = timeout;
+    if ( !THREAD_IS_ONLYONCE(t) ) {
+      t->next_in_state_instance = si->thread_list;
+      si->thread_list = t;
+    }
+    si->rule_instance->threads++;
+    ctx->threads++;
+
+    if (*qt) {
+      (*qt)->next = t;
+      *qt = t;
+    } else {
+      *qh = t;
+      *qt = t;
+    }
+  }
+}
+
+
+/**
+ ** Remove the events no restored state instance refers to.
+ **/
+static void
+release_unreferenced_events(ckpt_reader_t *r)
+{
+  orchids_t *ctx;
+  active_event_t *ae;
+  active_event_t *next;
+
+  ctx = r->ctx;
+  for (ae = ctx->active_event_head; ae; ae = next) {
+    next = ae->next;
+    if (ae->refs > 0)
+      continue ;
+    if (ae->prev)
+      ae->prev->next = ae->next;
+    else
+      ctx->active_event_head = ae->next;
+    if (ae->next)
+      ae->next->prev = ae->prev;
+    else
+      ctx->active_event_tail = ae->prev;
+    ctx->active_events--;
+    memgov_release_event(ctx, ae);
+    free_active_event(ae);
+  }
+}
+
+
+int
+checkpoint_restore(orchids_t *ctx, const char *path)
+{
+  ckpt_reader_t r;
+  rule_instance_t *ri;
+  struct timeval start;
+  struct timeval end;
+  uint32_t ri_nb;
+  uint32_t state_id;
+  uint32_t i;
+  int evict;
+
+  gettimeofday(&start, NULL);
+
+  memset(&r, 0, sizeof (r));
+  r.ctx = ctx;
+  r.fp = Xfopen(path, "r");
+  if (r.fp == NULL) {
+    DebugLog(DF_CORE, DS_NOTICE, "checkpoint: can't open '%s': %s\n",
+             path, strerror(errno));
+    return (-1);
+  }
+  setvbuf(r.fp, NULL, _IOFBF, CHECKPOINT_IOBUF_SZ);
+
+  if (read_header(&r)) {
+    Xfclose(r.fp);
+    return (-1);
+  }
+  read_fields(&r);
+  read_rules(&r);
+  read_events(&r);
+  read_sketches(&r);
+
+  ri_nb = get_u32(&r);
+  r.states_nb = get_u32(&r);
+  if (!r.err)
+    r.states = Xmalloc(r.states_nb * sizeof (state_instance_t *) + 1);
+  state_id = 0;
+  for (i = 0; i < ri_nb && !r.err; i++)
+    read_rule_instance(&r, &state_id);
+  r.states_nb = state_id;
+
+  if (!r.err)
+    read_thread_queue(&r, &ctx->new_qh, &ctx->new_qt);
+  if (!r.err)
+    read_thread_queue(&r, &ctx->retrig_qh, &ctx->retrig_qt);
+  if (!r.err && get_u32(&r) != CHECKPOINT_MAGIC)
+    r.err = 1;
+  Xfclose(r.fp);
+
+  /* On error, throw everything away.  Instances left without threads
+   * would never be reaped: free them too. */
+  evict = FALSE;
+  for (ri = ctx->first_rule_instance; ri; ri = ri->next)
+    if (r.err || ri->threads == 0) {
+      ri->flags |= RULE_EVICTED;
+      evict = TRUE;
+    }
+  if (evict)
+    evict_rule_instances(ctx);
+  release_unreferenced_events(&r);
+
+  /* Free the restored values nothing refers to */
+  for (i = 0; i < r.vals_nb; i++)
+    if (r.vals_flags[i] == 0)
+      issdl_free(r.vals[i]);
+
+  if (r.vals) {
+    Xfree(r.vals);
+    Xfree(r.vals_flags);
+  }
+  if (r.states)
+    Xfree(r.states);
+  if (r.events)
+    Xfree(r.events);
+  if (r.rules) {
+    Xfree(r.rules);
+    Xfree(r.rules_env_sz);
+  }
+  if (r.field_map)
+    Xfree(r.field_map);
+
+  if (r.err) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "checkpoint: '%s' is corrupted or truncated, ignored\n", path);
+    return (-1);
+  }
+
+  gettimeofday(&end, NULL);
+  Timer_Sub(&end, &end, &start);
+  DebugLog(DF_CORE, DS_NOTICE,
+           "checkpoint: restored %u rule instances, %u state instances, "
+           "%u threads, %u events in %li.%06li s\n",
+           ctx->rule_instances, ctx->state_instances, ctx->threads,
+           ctx->active_events, (long) end.tv_sec, (long) end.tv_usec);
+
+  return (RETURN_SUCCESS);
+}
+
+
+/*
+** Warm restart
+*/
+
+static void
+checkpoint_sigterm(int signo)
+{
+  checkpoint_sigterm_g = 1;
+}
+
+
+/**
+ ** Periodic checkpoints are written by a child process, on a
+ ** copy-on-write image of the engine: the main loop is only blocked
+ ** for the fork().  Children are reaped by the SIGCHLD handler.
+ **/
+static void
+checkpoint_in_background(orchids_t *ctx)
+{
+  pid_t pid;
+
+  if (checkpoint_child_g > 0 && kill(checkpoint_child_g, 0) == 0) {
+    DebugLog(DF_CORE, DS_WARN,
+             "checkpoint: previous checkpoint still running, skipped\n");
+    return ;
+  }
+
+  pid = fork();
+  if (pid == 0) {
+    _exit(checkpoint_save(ctx, ctx->checkpoint_file) == RETURN_SUCCESS
+          ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  if (pid < 0) {
+    DebugLog(DF_CORE, DS_WARN, "checkpoint: fork(): %s\n", strerror(errno));
+    checkpoint_save(ctx, ctx->checkpoint_file);
+    return ;
+  }
+  checkpoint_child_g = pid;
+}
+
+
+static int
+rtaction_checkpoint(orchids_t *ctx, rtaction_t *e)
+{
+  if (checkpoint_sigterm_g) {
+    DebugLog(DF_CORE, DS_NOTICE,
+             "SIGTERM received: writing checkpoint and exiting\n");
+    while (ctx->queued_events > 0)
+      drain_input_queues(ctx, DEFAULT_QUEUE_DRAIN_BUDGET);
+    checkpoint_save(ctx, ctx->checkpoint_file);
+    exit(EXIT_SUCCESS);
+  }
+
+  if (ctx->checkpoint_period > 0
+      && ctx->cur_loop_time.tv_sec >= checkpoint_next_g) {
+    checkpoint_in_background(ctx);
+    checkpoint_next_g = ctx->cur_loop_time.tv_sec + ctx->checkpoint_period;
+  }
+
+  /* The signal handler can't run the checkpoint itself (the engine
+   * may be in the middle of an event), so poll its flag every second. */
+  e->date = ctx->cur_loop_time;
+  e->date.tv_sec += 1;
+  register_rtaction(ctx, e);
+
+  return (0);
+}
+
+
+void
+checkpoint_setup(orchids_t *ctx)
+{
+  if (ctx->checkpoint_file == NULL || ctx->off_line_mode != MODE_ONLINE)
+    return ;
+
+  if (access(ctx->checkpoint_file, R_OK) == 0)
+    checkpoint_restore(ctx, ctx->checkpoint_file);
+
+  checkpoint_next_g = ctx->cur_loop_time.tv_sec + ctx->checkpoint_period;
+  Xsignal(SIGTERM, checkpoint_sigterm);
+  register_rtcallback(ctx, rtaction_checkpoint, NULL, 1);
+}
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -0,0 +1,105 @@
+/**
+ ** @file checkpoint.h
+ ** Public definitions for checkpoint.c
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "orchids.h"
+
+/** Checkpoint file magic number ("OCKP"). */
+#define CHECKPOINT_MAGIC   0x4f434b50
+/** Checkpoint file format version. */
+#define CHECKPOINT_VERSION 2
+
+/** Stdio buffer size used when writing or reading a checkpoint. */
+#define CHECKPOINT_IOBUF_SZ (1 << 20)
+
+
+/**
+ ** Write the analysis engine state (rule instances, state instances
+ ** and their environments, waiting threads and referenced events)
+ ** into a checkpoint file.  The file is first written under a
+ ** temporary name, then renamed, so that a crash while writing
+ ** never destroys the previous checkpoint.
+ ** Must be called between two events (e.g. from a real-time action).
+ ** @param ctx   Orchids application context.
+ ** @param path  Checkpoint file name.
+ ** @return RETURN_SUCCESS, or a negative value on error.
+ **/
+int
+checkpoint_save(orchids_t *ctx, const char *path);
+
+
+/**
+ ** Restore the analysis engine state from a checkpoint file.  Rules
+ ** are matched by name and by a structural signature: instances of
+ ** rules that no longer exist, or that changed, are dropped.
+ ** Must be called after rule compilation, before the first event.
+ ** @param ctx   Orchids application context.
+ ** @param path  Checkpoint file name.
+ ** @return RETURN_SUCCESS, or a negative value on error (in which
+ **   case the engine is left empty).
+ **/
+int
+checkpoint_restore(orchids_t *ctx, const char *path);
+
+
+/**
+ ** Warm restart: restore the checkpoint file named by the
+ ** CheckpointFile directive if it exists, register the periodic
+ ** checkpoint real-time action and the SIGTERM handler.
+ ** Called just before entering the main loop.
+ ** @param ctx  Orchids application context.
+ **/
+void
+checkpoint_setup(orchids_t *ctx);
+
+
+#endif /* CHECKPOINT_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
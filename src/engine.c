@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <sys/time.h>
 #include <string.h>
 
 #include "orchids.h"
@@ -33,6 +34,8 @@
 
 #include "engine.h"
 #include "engine_priv.h"
+#include "mem_governor.h"
+#include "latency.h"
 
 /* WARNING -- Field list in event_t, and field IDs in int array must
    be sorted in decreasing order */
@@ -271,6 +274,9 @@ create_rule_initial_threads(orchids_t *ctx,
     new_rule->first_state = init;
     new_rule->state_instances = 1;
     init->rule_instance = new_rule; /* move in create_init_inst() ? */
+    MEMGOV_CHARGE(ctx, new_rule,
+                  sizeof (rule_instance_t) + sizeof (state_instance_t)
+                  + 2 * r->dynamic_env_sz * sizeof (ovm_var_t *));
     /* link rule */
 /*     ctx->state_instances++; */
 
@@ -333,22 +339,35 @@ unlink_thread_in_state_instance_list(wait_thread_t *thread)
   }
 }
 
-static int
-backtrack_is_not_needed(orchids_t *ctx, wait_thread_t *thread)
+void
+cut_state_instance(state_instance_t *state)
 {
-#if 1
-  /* if destination state is fully blocking AND doesn't bind field value
-   * to a free variable, this is THE shortest run.
-   * Next threads will be redundant. */
-  if (thread->trans->dest->trans_nb > 0 &&
-      !(thread->trans->dest->flags & BYTECODE_HAVE_PUSHFIELD))
-    return (TRUE);
-  /* XXX: Destination MUST NOT be a cut-point.
-     Destination cuts should be resolved at compilation-time
-     instead of runtime ? */
-#endif
+  state_instance_t *si;
+  wait_thread_t *t;
+
+  /* Depth-first walk of the subtree, using the parent links */
+  si = state;
+  for (;;) {
+    si->flags |= SF_PRUNED;
 
-  return (FALSE);
+    /* Cut current state instance threads */
+    for (t = si->thread_list; t; t = t->next_in_state_instance) {
+      if ( !(t->flags & THREAD_ONLYONCE) ) {
+        DebugLog(DF_ENG, DS_TRACE, "Marking thread %p as KILLED (cut)\n", t);
+        t->flags |= THREAD_KILLED;
+      }
+    }
+
+    if (si->first_child) {
+      si = si->first_child;
+      continue ;
+    }
+    while (si != state && si->next_sibling == NULL)
+      si = si->parent;
+    if (si == state)
+      break ;
+    si = si->next_sibling;
+  }
 }
 
 
@@ -364,8 +383,11 @@ inject_event(orchids_t *ctx, event_t *event)
   int ret = 0;
   int passed_threads = 0;
   time_t cur_time;
+  timeval_t inject_start;
+  timeval_t inject_end;
 
   cur_time = time(NULL);
+  gettimeofday(&inject_start, NULL);
 
   DebugLog(DF_ENG, DS_INFO, "inject_event() (one-evt)\n");
 
@@ -374,7 +396,7 @@ inject_event(orchids_t *ctx, event_t *event)
   ctx->events++;
 
   /* prepare an active event record */
-  active_event = Xzmalloc(sizeof (active_event_t));
+  active_event = new_active_event(event);
   active_event->event = event;
   ctx->active_event_cur = active_event;
 
@@ -500,6 +522,7 @@ inject_event(orchids_t *ctx, event_t *event)
       new_state->parent = t->state_instance;
       new_state->event = active_event;
       active_event->refs++;
+      memgov_ref_event(ctx, new_state->rule_instance, active_event);
 
       /* Update state instance list of the current rule instance */
       new_state->retrig_next = t->state_instance->rule_instance->state_list;
@@ -513,7 +536,7 @@ inject_event(orchids_t *ctx, event_t *event)
 	ret += sret;
 
       /* Static analysis flags test here (RETRIGGER) */
-      if ( backtrack_is_not_needed(ctx, t) ) {
+      if (t->trans->flags & TRANS_NO_BACKTRACK) {
         DebugLog(DF_ENG, DS_DEBUG, "Backtrack not needed\n");
         KILL_THREAD(ctx, t);
       }
@@ -620,6 +643,10 @@ inject_event(orchids_t *ctx, event_t *event)
 
   execute_post_inject_hooks(ctx, active_event->event);
 
+  /* Correlation time, for event latency statistics */
+  gettimeofday(&inject_end, NULL);
+  ctx->inject_usec += LATENCY_USEC(&inject_end, &inject_start);
+
   for (e = event; e; e = e->next)
     ctx->global_fields[ e->field_id ].val = NULL;
 
@@ -629,8 +656,7 @@ inject_event(orchids_t *ctx, event_t *event)
     DebugLog(DF_ENG, DS_DEBUG,
              "free unreferenced event (%p/%p)\n",
              active_event, active_event->event);
-    free_event(active_event->event);
-    Xfree(active_event);
+    free_active_event(active_event);
   }
   else {
     ctx->last_evt_act = ctx->cur_loop_time;
@@ -646,8 +672,11 @@ inject_event(orchids_t *ctx, event_t *event)
       ctx->active_event_tail = active_event;
     }
     ctx->active_events++;
+    memgov_retain_event(ctx, active_event);
   }
 
+  memgov_check(ctx);
+
   DebugLog(DF_ENG, DS_TRACE,
            "simulate_state_and_create_threads() = %i\n", ret);
 
@@ -672,6 +701,7 @@ create_state_instance(orchids_t *ctx,
   new_state->state = state;
   new_state->rule_instance = parent->rule_instance;
   new_state->depth = parent->depth + 1;
+  env_sz = 0;
 
   /* Build inherited environment */
   if (state->rule->dynamic_env_sz > 0) {
@@ -681,6 +711,8 @@ create_state_instance(orchids_t *ctx,
     new_state->inherit_env = Xmalloc(env_sz);
     new_state->current_env = Xzmalloc(env_sz);
   }
+  MEMGOV_CHARGE(ctx, new_state->rule_instance,
+                sizeof (state_instance_t) + 2 * env_sz);
   /* IDEA of optimization :
   ** if there is no action byte-code in this state, inherit_env can be
   ** a reference to parent environments (this add a problem for
@@ -802,8 +834,6 @@ free_rule_instance(orchids_t *ctx, rule_instance_t *rule_instance)
       if (si->event->refs <= 0 && si->event != ctx->active_event_cur) {
         ctx->last_evt_act = ctx->cur_loop_time;
         DebugLog(DF_ENG, DS_DEBUG, "event %p ref=0\n", si->event);
-        free_event(si->event->event);
-        si->event->event = NULL;
         ctx->active_events--;
         /* unlink */
         if (!si->event->prev) { /* If we are in the first event reference */
@@ -834,7 +864,8 @@ free_rule_instance(orchids_t *ctx, rule_instance_t *rule_instance)
           /* ctx->active_event_tail = si->event->prev; */
         }
 
-        Xfree(si->event);
+        memgov_release_event(ctx, si->event);
+        free_active_event(si->event);
       }
     }
     Xfree(si);
@@ -847,10 +878,80 @@ free_rule_instance(orchids_t *ctx, rule_instance_t *rule_instance)
     ctx->rule_instances--;
   }
 
+  memgov_release_rule_instance(ctx, rule_instance);
   Xfree(rule_instance);
 }
 
 
+static void
+evict_threads_in_queue(orchids_t *ctx, wait_thread_t **qh, wait_thread_t **qt)
+{
+  wait_thread_t *t;
+  wait_thread_t *next;
+  wait_thread_t *prev;
+
+  prev = NULL;
+  for (t = *qh; t; t = next) {
+    next = t->next;
+    if ( !(t->state_instance->rule_instance->flags & RULE_EVICTED) ) {
+      prev = t;
+      continue ;
+    }
+    DebugLog(DF_ENG, DS_DEBUG, "Rip evicted thread (%p)\n", t);
+    if (prev)
+      prev->next = next;
+    else
+      *qh = next;
+    if (t == *qt)
+      *qt = prev;
+    /* Keep the queue commit point */
+    if ((t->flags & THREAD_BUMP) && prev)
+      prev->flags |= THREAD_BUMP;
+    t->state_instance->rule_instance->threads--;
+    ctx->threads--;
+    Xfree(t);
+  }
+}
+
+
+void
+evict_rule_instances(orchids_t *ctx)
+{
+  rule_instance_t *r;
+  rule_instance_t *next_rule;
+  rule_instance_t *prev_rule;
+
+  /* Between two events, waiting threads are either in the new queue
+   * or in the retrig queue.  The current queue is stale. */
+  evict_threads_in_queue(ctx, &ctx->new_qh, &ctx->new_qt);
+  evict_threads_in_queue(ctx, &ctx->retrig_qh, &ctx->retrig_qt);
+  ctx->cur_retrig_qh = NULL;
+  ctx->cur_retrig_qt = NULL;
+  ctx->current_tail = NULL;
+  /* The last injected event is now an ordinary active event:
+   * free_rule_instance() may release it. */
+  ctx->active_event_cur = NULL;
+
+  prev_rule = NULL;
+  for (r = ctx->first_rule_instance; r; r = next_rule) {
+    next_rule = r->next;
+    if ( !(r->flags & RULE_EVICTED) ) {
+      prev_rule = r;
+      continue ;
+    }
+    DebugLog(DF_ENG, DS_TRACE, "ripping evicted rule %p\n", r);
+    if (prev_rule)
+      prev_rule->next = next_rule;
+    else
+      ctx->first_rule_instance = next_rule;
+    r->flags |= THREAD_KILLED;
+    free_rule_instance(ctx, r);
+  }
+
+  ctx->last_ruleinst_act = ctx->cur_loop_time;
+}
+
+
 void
 fprintf_rule_instances(FILE *fp, const orchids_t *ctx)
 {
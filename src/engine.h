@@ -33,6 +33,28 @@ void
 inject_event(orchids_t *ctx, event_t *event);
 
 
+/**
+ ** Free all rule instances marked as evicted (#RULE_EVICTED) by the
+ ** memory governor, with their waiting threads.
+ ** This must only be called between two event injections.
+ **
+ ** @param ctx    Orchids application context.
+ **/
+void
+evict_rule_instances(orchids_t *ctx);
+
+
+/**
+ ** Cut a state instance: mark it and all its descendants as pruned,
+ ** and kill their waiting threads.  This is an iterative walk, which
+ ** doesn't touch the siblings of the state instance.
+ **
+ ** @param state  The root of the subtree to cut.
+ **/
+void
+cut_state_instance(state_instance_t *state);
+
+
 /**
  ** Display all active rule instances on a stream.
  ** Displayed informations are :
@@ -128,47 +128,6 @@ create_rule_initial_threads(orchids_t *ctx,
 static void
 unlink_thread_in_state_instance_list(wait_thread_t *thread);
 
-/**
- * This function tells if this thread will need to be re-checked in
- * the future, with the present knowledge (this is a green cut).  In
- * case we are (for some reasons) sure that we have a shortest-run,
- * then this thread will not need to be rechecked in the future.  We
- * can add any (lightweight if possible) analysis.  This function
- * should be a trade-off between the time we spend to perform the
- * analysis, and the time we waste be searching in useless threads.
- *
- *   The current analysis is (somewhat) simple: if the destination
- * state is (1) fully-blocking (i.e. with no epsilon-transition), and
- * (2) the destination state action code does not bind a field value
- * to a variable, and (3) the destination state is not a cut point, then
- * the thread is the shortest run.
- *
- *   The condition (1) ensure that the execution can't continue in
- * other states (so we can only analyze the destination state.  An
- * alternative could be to recursively analyze states that are
- * reachable from the destination state of the current thread). By
- * ensuring that the execution will not go further, we are sure that
- * any field of the current event will not be bound to a variable.
- * 
- *   The condition (2) ensure that if no field is bound to a variable,
- * no future test involving a variable with a value derived from this
- * event and other event will be done.
- *
- *  The condition (3) ensure the if the destination is not a cut
- * point, this thread wont need to be tested in the future.  This is
- * because a cut is somewhat like a cancellation (or a commitment,
- * depending how we use it) of the search in the path tree.  When a
- * cut is done (killing all child-threads of a state instance), we
- * will need a new instance, with new events.
- *
- * @param ctx     The Orchids application context.
- * @param thread  The thread to be analyzed.
- * @return A boolean telling if a backtracking will be needed
- *           in the future or not.
- **/
-static int
-backtrack_is_not_needed(orchids_t *ctx, wait_thread_t *thread);
-
 #endif /* ENGINE_PRIV_H */
 
 /*
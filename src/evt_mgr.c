@@ -26,6 +26,8 @@
 #include <string.h>
 
 #include "orchids.h"
+#include "orchids_defaults.h"
+#include "orchids_api.h"
 
 #include "evt_mgr.h"
 #include "evt_mgr_priv.h"
@@ -123,6 +125,7 @@ event_dispatcher_main_loop(orchids_t *ctx)
   realtime_input_t *rti;
   rtaction_t *e;
   realtime_input_t *next;
+  int draining;
 
   if ((ctx->poll_handler_list == NULL) && (ctx->realtime_handler_list == NULL))
     {
@@ -151,6 +154,7 @@ event_dispatcher_main_loop(orchids_t *ctx)
   for (;;) {
     gettimeofday(&cur_time, NULL);
     ctx->cur_loop_time = cur_time;
+    ctx->input_time = cur_time;
 
     /* Consume past event, if any */
     while ( e && timercmp( &e->date, &cur_time, <= )) {
@@ -167,6 +171,13 @@ event_dispatcher_main_loop(orchids_t *ctx)
       wait_time_ptr = NULL;
     }
 
+    /* Don't block while events are waiting in the input queues */
+    draining = (ctx->queued_events > 0);
+    if (draining) {
+      timerclear(&wait_time);
+      wait_time_ptr = &wait_time;
+    }
+
     Monitor_Activity();
     memcpy(&rfds, &ctx->fds, sizeof(fd_set));
 
@@ -179,6 +190,7 @@ event_dispatcher_main_loop(orchids_t *ctx)
 
     if (retval) {
       DebugLog(DF_CORE, DS_INFO, "New real-time input data.... (%i)\n", retval);
+      gettimeofday(&ctx->input_time, NULL);
       for (rti = ctx->realtime_handler_list; rti && retval; ) {
         next = rti->next;
         if (FD_ISSET(rti->fd, &rfds)) {
@@ -194,7 +206,7 @@ event_dispatcher_main_loop(orchids_t *ctx)
         rti = next;
       }
     }
-    else {
+    else if (!draining) {
       DebugLog(DF_CORE, DS_DEBUG, "Timeout... Calling real-time callback...\n");
       gettimeofday(&cur_time, NULL);
       ctx->cur_loop_time = cur_time; // added, JGL Jun 03, 2012
@@ -211,6 +223,9 @@ event_dispatcher_main_loop(orchids_t *ctx)
        * when action execution is longer than the delay
        * to the next action. */
     }
+
+    if (ctx->queued_events > 0)
+      drain_input_queues(ctx, DEFAULT_QUEUE_DRAIN_BUDGET);
   }
 }
 
@@ -0,0 +1,650 @@
+/**
+ ** @file ipset.c
+ ** IPv4 address sets for the ISSDL language.
+ **
+ ** Threat intelligence lists hold hundreds of thousands of addresses
+ ** and networks, which can't reasonably be matched with chains of
+ ** comparisons in rules.  An IP set (T_IPSET) is loaded from a file
+ ** with one entry per line:
+ **   192.0.2.1            an address
+ **   198.51.100.0/24      a network
+ **   203.0.113.10-203.0.113.20  a range
+ ** ('#' starts a comment), and stored as sorted disjoint ranges, so
+ ** that a lookup is a binary search (at most 32 steps whatever the
+ ** size of the list).
+ **
+ ** Sets are named, global to all rules, and declared either by the
+ ** IPSet directive or by the first call to ipset_load() in a rule:
+ **   $bl = ipset_load("blocklist", "/etc/orchids/blocklist.txt");
+ **   expect (ipset_contains($bl, .ip.src)) goto alert;
+ ** A reload (ipset_reload(), periodic reloads of the IPSet directive)
+ ** reads the file by steps in real-time actions, so that the engine
+ ** keeps processing events, and the set keeps its previous contents
+ ** until the new ones are completely read.
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "orchids.h"
+#include "safelib.h"
+#include "strhash.h"
+#include "evt_mgr.h"
+#include "lang.h"
+
+#include "ipset.h"
+
+
+/**
+ ** Parse an address, a network or a range.
+ ** @return 0 on success, 1 on an empty line, -1 on a malformed line.
+ **/
+static int
+ipset_parse_line(char *s, uint32_t *lo, uint32_t *hi)
+{
+  struct in_addr a;
+  char *end;
+  char *sep;
+  char kind;
+  long len;
+  uint32_t mask;
+
+  if ((end = strchr(s, '#')) != NULL)
+    *end = '\0';
+  while (isspace((unsigned char)*s))
+    s++;
+  end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1]))
+    *--end = '\0';
+  if (*s == '\0')
+    return (1);
+
+  kind = '\0';
+  if ((sep = strpbrk(s, "/-")) != NULL) {
+    kind = *sep;
+    *sep = '\0';
+  }
+  if (inet_pton(AF_INET, s, &a) != 1)
+    return (-1);
+  *lo = ntohl(a.s_addr);
+  *hi = *lo;
+
+  if (sep == NULL)
+    return (0);
+
+  if (kind == '/') {
+    /* network */
+    len = strtol(sep + 1, &end, 10);
+    if (end == sep + 1 || *end != '\0' || len < 0 || len > 32)
+      return (-1);
+    mask = len ? 0xFFFFFFFFU << (32 - len) : 0;
+    *lo &= mask;
+    *hi = *lo | ~mask;
+    return (0);
+  }
+
+  /* range */
+  if (inet_pton(AF_INET, sep + 1, &a) != 1)
+    return (-1);
+  *hi = ntohl(a.s_addr);
+  if (*hi < *lo)
+    return (-1);
+
+  return (0);
+}
+
+
+static ipset_load_t *
+ipset_load_open(const char *path)
+{
+  ipset_load_t *ld;
+  FILE *fp;
+
+  if ((fp = fopen(path, "r")) == NULL) {
+    DebugLog(DF_CORE, DS_ERROR, "ipset: can't open %s: %s\n",
+             path, strerror(errno));
+    return (NULL);
+  }
+
+  ld = Xzmalloc(sizeof (ipset_load_t));
+  ld->fp = fp;
+
+  return (ld);
+}
+
+
+/**
+ ** Read some lines of a set file.
+ ** @return 1 if the whole file was read, 0 otherwise.
+ **/
+static int
+ipset_load_step(ipset_load_t *ld, int lines)
+{
+  char buf[128];
+  size_t len;
+  uint32_t lo;
+  uint32_t hi;
+  int c;
+
+  for ( ; lines > 0; lines--) {
+    if (fgets(buf, sizeof (buf), ld->fp) == NULL)
+      return (1);
+    ld->line++;
+
+    len = strlen(buf);
+    if (len == sizeof (buf) - 1 && buf[len - 1] != '\n') {
+      /* too long to be an address: skip the rest of the line */
+      while ((c = fgetc(ld->fp)) != EOF && c != '\n')
+        ;
+      ld->bad_lines++;
+      continue ;
+    }
+
+    switch (ipset_parse_line(buf, &lo, &hi)) {
+    case 0:
+      if (ld->nb == ld->sz) {
+        ld->sz = ld->sz ? 2 * ld->sz : 1024;
+        ld->ranges = Xrealloc(ld->ranges, ld->sz * sizeof (uint64_t));
+      }
+      ld->ranges[ld->nb++] = ((uint64_t)lo << 32) | hi;
+      break ;
+    case -1:
+      if (ld->bad_lines++ == 0)
+        DebugLog(DF_CORE, DS_WARN, "ipset: malformed line %lu\n", ld->line);
+      break ;
+    }
+  }
+
+  return (0);
+}
+
+
+static int
+range_cmp(const void *a, const void *b)
+{
+  uint64_t ra = *(const uint64_t *)a;
+  uint64_t rb = *(const uint64_t *)b;
+
+  return ((ra > rb) - (ra < rb));
+}
+
+
+/**
+ ** Replace the contents of a set by the ranges read, sorted and
+ ** merged.
+ **/
+static void
+ipset_load_commit(ipset_t *set, ipset_load_t *ld)
+{
+  uint32_t *lo;
+  uint32_t *hi;
+  uint32_t l;
+  uint32_t h;
+  uint64_t addrs;
+  size_t n;
+  size_t i;
+
+  qsort(ld->ranges, ld->nb, sizeof (uint64_t), range_cmp);
+
+  lo = Xmalloc((ld->nb ? ld->nb : 1) * sizeof (uint32_t));
+  hi = Xmalloc((ld->nb ? ld->nb : 1) * sizeof (uint32_t));
+  n = 0;
+  addrs = 0;
+  for (i = 0; i < ld->nb; i++) {
+    l = ld->ranges[i] >> 32;
+    h = ld->ranges[i] & 0xFFFFFFFFU;
+    /* overlapping or adjacent to the previous range */
+    if (n > 0 && (hi[n - 1] == 0xFFFFFFFFU || l <= hi[n - 1] + 1)) {
+      if (h > hi[n - 1]) {
+        addrs += h - hi[n - 1];
+        hi[n - 1] = h;
+      }
+      continue ;
+    }
+    lo[n] = l;
+    hi[n] = h;
+    addrs += (uint64_t)h - l + 1;
+    n++;
+  }
+
+  if (set->lo)
+    Xfree(set->lo);
+  if (set->hi)
+    Xfree(set->hi);
+  set->lo = lo;
+  set->hi = hi;
+  set->nb = n;
+  set->addrs = addrs;
+  set->loads++;
+  set->bad_lines = ld->bad_lines;
+
+  DebugLog(DF_CORE, DS_NOTICE,
+           "ipset %s: %lu lines, %zu ranges, %llu addresses, %lu bad lines\n",
+           set->name, ld->line, n, (unsigned long long)addrs, ld->bad_lines);
+
+  fclose(ld->fp);
+  if (ld->ranges)
+    Xfree(ld->ranges);
+  Xfree(ld);
+}
+
+
+static time_t
+ipset_file_mtime(const char *path)
+{
+  struct stat st;
+
+  if (stat(path, &st) != 0)
+    return (0);
+
+  return (st.st_mtime);
+}
+
+
+static int
+rtaction_ipset_load(orchids_t *ctx, rtaction_t *e)
+{
+  ipset_t *set = e->data;
+
+  if (ipset_load_step(set->loading, IPSET_LOAD_CHUNK) == 0) {
+    e->date = ctx->cur_loop_time;
+    e->date.tv_usec += IPSET_LOAD_DELAY;
+    if (e->date.tv_usec >= 1000000) {
+      e->date.tv_sec += e->date.tv_usec / 1000000;
+      e->date.tv_usec %= 1000000;
+    }
+    register_rtaction(ctx, e);
+    return (0);
+  }
+
+  ipset_load_commit(set, set->loading);
+  set->loading = NULL;
+  Xfree(e);
+
+  return (0);
+}
+
+
+int
+ipset_reload(orchids_t *ctx, ipset_t *set)
+{
+  if (set->loading != NULL) {
+    DebugLog(DF_CORE, DS_INFO, "ipset %s: reload already in progress\n",
+             set->name);
+    return (-1);
+  }
+
+  set->mtime = ipset_file_mtime(set->path);
+  if ((set->loading = ipset_load_open(set->path)) == NULL)
+    return (-1);
+
+  DebugLog(DF_CORE, DS_INFO, "ipset %s: reloading %s\n", set->name, set->path);
+  register_rtcallback(ctx, rtaction_ipset_load, set, 0);
+
+  return (0);
+}
+
+
+static int
+rtaction_ipset_check(orchids_t *ctx, rtaction_t *e)
+{
+  ipset_t *set = e->data;
+  time_t mtime;
+
+  if (set->period == 0) {
+    Xfree(e);
+    return (0);
+  }
+
+  mtime = ipset_file_mtime(set->path);
+  if (mtime != 0 && mtime != set->mtime)
+    ipset_reload(ctx, set);
+
+  e->date = ctx->cur_loop_time;
+  e->date.tv_sec += set->period;
+  register_rtaction(ctx, e);
+
+  return (0);
+}
+
+
+ipset_t *
+ipset_declare(orchids_t *ctx, const char *name, const char *path,
+              time_t period)
+{
+  ipset_t *set;
+  ipset_load_t *ld;
+  time_t old_period;
+
+  if ((ld = ipset_load_open(path)) == NULL)
+    return (NULL);
+
+  set = strhash_get(ctx->ipsets, (char *)name);
+  if (set == NULL) {
+    set = Xzmalloc(sizeof (ipset_t));
+    set->name = Xstrdup((char *)name);
+    set->var = Xzmalloc(sizeof (ovm_ipset_t));
+    set->var->type = T_IPSET;
+    IPSET(set->var) = set;
+    strhash_add(ctx->ipsets, set, set->name);
+  }
+  else if (set->loading != NULL) {
+    /* keep the reload in progress */
+    fclose(ld->fp);
+    Xfree(ld);
+    return (set);
+  }
+
+  if (set->path)
+    Xfree(set->path);
+  set->path = Xstrdup((char *)path);
+  old_period = set->period;
+  set->period = period;
+
+  /* Initial load: the engine isn't processing events yet, or a rule
+   * asks for a set that must be available at once. */
+  set->mtime = ipset_file_mtime(path);
+  while (ipset_load_step(ld, IPSET_LOAD_CHUNK) == 0)
+    ;
+  ipset_load_commit(set, ld);
+
+  if (period > 0 && old_period == 0)
+    register_rtcallback(ctx, rtaction_ipset_check, set, period);
+
+  return (set);
+}
+
+
+int
+ipset_contains(ipset_t *set, uint32_t addr)
+{
+  size_t l;
+  size_t h;
+  size_t m;
+
+  /* last range starting at or before addr */
+  l = 0;
+  h = set->nb;
+  while (l < h) {
+    m = l + (h - l) / 2;
+    if (set->lo[m] <= addr)
+      l = m + 1;
+    else
+      h = m;
+  }
+
+  return (l > 0 && addr <= set->hi[l - 1]);
+}
+
+
+void *
+ipset_get_data(ovm_var_t *var)
+{
+  return (&IPSET(var));
+}
+
+
+size_t
+ipset_get_data_len(ovm_var_t *var)
+{
+  return (sizeof (ipset_t *));
+}
+
+
+static int
+fprintf_ipset(void *elmt, void *data)
+{
+  ipset_t *set = elmt;
+  FILE *fp = data;
+
+  fprintf(fp, "%24.24s | %8zu | %10llu | %5lu | %6lu | %s%s\n",
+          set->name, set->nb, (unsigned long long)set->addrs,
+          set->loads, set->bad_lines, set->path,
+          set->loading ? " (reloading)" : "");
+
+  return (0);
+}
+
+
+void
+fprintf_ipsets(FILE *fp, orchids_t *ctx)
+{
+  fprintf(fp,
+          "-------------------------+----------+------------+-------+--------+------\n");
+  fprintf(fp,
+          "                    name |   ranges |  addresses | loads |    bad | file\n");
+  fprintf(fp,
+          "-------------------------+----------+------------+-------+--------+------\n");
+  strhash_walk(ctx->ipsets, fprintf_ipset, fp);
+  fprintf(fp,
+          "-------------------------+----------+------------+-------+--------+------\n");
+}
+
+
+/*
+** ISSDL functions
+*/
+
+/**
+ ** Find the set designated by an ISSDL value: a set, or a set name.
+ **/
+static ipset_t *
+get_ipset(orchids_t *ctx, ovm_var_t *var)
+{
+  char name[256];
+  size_t len;
+
+  if (IS_NULL(var))
+    return (NULL);
+
+  switch (TYPE(var)) {
+  case T_IPSET:
+    return (IPSET(var));
+  case T_STR:
+  case T_VSTR:
+    len = issdl_get_data_len(var);
+    if (len >= sizeof (name))
+      return (NULL);
+    memcpy(name, issdl_get_data(var), len);
+    name[len] = '\0';
+    return (strhash_get(ctx->ipsets, name));
+  }
+
+  return (NULL);
+}
+
+
+/**
+ ** Get the address of an ISSDL value (ipv4, or dotted-quad string), in
+ ** host byte order.
+ **/
+static int
+get_ipv4(ovm_var_t *var, uint32_t *addr)
+{
+  struct in_addr a;
+  char buf[INET_ADDRSTRLEN];
+  size_t len;
+
+  if (IS_NULL(var))
+    return (-1);
+
+  switch (TYPE(var)) {
+  case T_IPV4:
+    *addr = ntohl(IPV4(var).s_addr);
+    return (0);
+  case T_STR:
+  case T_VSTR:
+    len = issdl_get_data_len(var);
+    if (len >= sizeof (buf))
+      return (-1);
+    memcpy(buf, issdl_get_data(var), len);
+    buf[len] = '\0';
+    if (inet_pton(AF_INET, buf, &a) != 1)
+      return (-1);
+    *addr = ntohl(a.s_addr);
+    return (0);
+  }
+
+  return (-1);
+}
+
+
+/**
+ ** Copy a string value to a new C string.
+ **/
+static char *
+get_cstring(ovm_var_t *var)
+{
+  char *s;
+  size_t len;
+
+  len = issdl_get_data_len(var);
+  s = Xmalloc(len + 1);
+  memcpy(s, issdl_get_data(var), len);
+  s[len] = '\0';
+
+  return (s);
+}
+
+
+static void
+issdl_ipset_load(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *name, *path;
+  ipset_t *set;
+  char *n;
+  char *p;
+
+  name = stack_pop(ctx->ovm_stack);
+  path = stack_pop(ctx->ovm_stack);
+
+  set = get_ipset(ctx, name);
+  if (set == NULL && !IS_NULL(name) && !IS_NULL(path)
+      && (TYPE(path) == T_STR || TYPE(path) == T_VSTR)
+      && (TYPE(name) == T_STR || TYPE(name) == T_VSTR)) {
+    n = get_cstring(name);
+    p = get_cstring(path);
+    set = ipset_declare(ctx, n, p, 0);
+    Xfree(n);
+    Xfree(p);
+  }
+
+  if (set)
+    stack_push(ctx->ovm_stack, set->var);
+  else {
+    DebugLog(DF_ENG, DS_ERROR, "ipset_load(name, path): can't load set\n");
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  }
+
+  FREE_IF_NEEDED(name);
+  FREE_IF_NEEDED(path);
+}
+
+
+static void
+issdl_ipset_contains(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *s, *addr;
+  ipset_t *set;
+  uint32_t a;
+
+  s = stack_pop(ctx->ovm_stack);
+  addr = stack_pop(ctx->ovm_stack);
+
+  if ((set = get_ipset(ctx, s)) == NULL || get_ipv4(addr, &a) != 0)
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else if (ipset_contains(set, a))
+    ISSDL_RETURN_TRUE(ctx, state);
+  else
+    ISSDL_RETURN_FALSE(ctx, state);
+
+  FREE_IF_NEEDED(s);
+  FREE_IF_NEEDED(addr);
+}
+
+
+static void
+issdl_ipset_reload(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *s;
+  ipset_t *set;
+
+  s = stack_pop(ctx->ovm_stack);
+
+  if ((set = get_ipset(ctx, s)) == NULL)
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else if (ipset_reload(ctx, set) == 0)
+    ISSDL_RETURN_TRUE(ctx, state);
+  else
+    ISSDL_RETURN_FALSE(ctx, state);
+
+  FREE_IF_NEEDED(s);
+}
+
+
+void
+register_ipset_functions(orchids_t *ctx)
+{
+  register_lang_function(ctx, issdl_ipset_load, "ipset_load", 2,
+                         "get a named IP set, loading it from a file");
+  register_lang_function(ctx, issdl_ipset_contains, "ipset_contains", 2,
+                         "test if an address belongs to an IP set");
+  register_lang_function(ctx, issdl_ipset_reload, "ipset_reload", 1,
+                         "reload an IP set from its file, in background");
+}
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
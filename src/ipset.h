@@ -0,0 +1,228 @@
+/**
+ ** @file ipset.h
+ ** Public definitions for ipset.c
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef IPSET_H
+#define IPSET_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "orchids.h"
+#include "lang.h"
+
+/** Number of lines read from a set file at each reload step. */
+#define IPSET_LOAD_CHUNK 16384
+/** Delay between two reload steps, in microseconds. */
+#define IPSET_LOAD_DELAY 10000
+
+
+typedef struct ipset_load_s ipset_load_t;
+
+/**
+ ** @struct ipset_load_s
+ **   A set file being read.  The ranges are accumulated here, and
+ **   replace the ranges of the set once the whole file is read.
+ **/
+/**   @var ipset_load_s::fp
+ **     The set file.
+ **/
+/**   @var ipset_load_s::nb
+ **     Number of ranges read.
+ **/
+/**   @var ipset_load_s::sz
+ **     Allocated size of the range array.
+ **/
+/**   @var ipset_load_s::ranges
+ **     Ranges read: lowest address in the 32 high bits, highest address
+ **     in the 32 low bits (host byte order), so that sorting the ranges
+ **     sorts them by lowest address.
+ **/
+/**   @var ipset_load_s::line
+ **     Number of lines read.
+ **/
+/**   @var ipset_load_s::bad_lines
+ **     Number of malformed lines (ignored).
+ **/
+struct ipset_load_s
+{
+  FILE          *fp;
+  size_t         nb;
+  size_t         sz;
+  uint64_t      *ranges;
+  unsigned long  line;
+  unsigned long  bad_lines;
+};
+
+
+/**
+ ** @struct ipset_s
+ **   A named set of IPv4 addresses and networks, stored as sorted,
+ **   disjoint and non adjacent address ranges.
+ **/
+/**   @var ipset_s::name
+ **     Set name (global to all rules).
+ **/
+/**   @var ipset_s::path
+ **     File the set is loaded from.
+ **/
+/**   @var ipset_s::nb
+ **     Number of ranges.
+ **/
+/**   @var ipset_s::lo
+ **     Lowest address of each range (host byte order), sorted.
+ **/
+/**   @var ipset_s::hi
+ **     Highest address of each range (host byte order).
+ **/
+/**   @var ipset_s::addrs
+ **     Number of addresses in the set.
+ **/
+/**   @var ipset_s::var
+ **     The ISSDL value referencing the set (shared, never freed).
+ **/
+/**   @var ipset_s::loading
+ **     Reload in progress, or NULL.
+ **/
+/**   @var ipset_s::mtime
+ **     Modification time of the file when it was last loaded.
+ **/
+/**   @var ipset_s::period
+ **     Period of the automatic reloads, in seconds (0: none).  The
+ **     file is only reloaded if it was modified.
+ **/
+/**   @var ipset_s::loads
+ **     Number of completed loads.
+ **/
+/**   @var ipset_s::bad_lines
+ **     Number of malformed lines in the last load.
+ **/
+struct ipset_s
+{
+  char          *name;
+  char          *path;
+  size_t         nb;
+  uint32_t      *lo;
+  uint32_t      *hi;
+  uint64_t       addrs;
+  ovm_var_t     *var;
+  ipset_load_t  *loading;
+  time_t         mtime;
+  time_t         period;
+  unsigned long  loads;
+  unsigned long  bad_lines;
+};
+
+
+/**
+ ** Declare a named set and load its file.  If the set already exists,
+ ** only its file and reload period are updated.
+ ** @param ctx    A pointer to the Orchids application context.
+ ** @param name   The set name.
+ ** @param path   The set file.
+ ** @param period Period of the automatic reloads, in seconds (0: none).
+ ** @return The set, or NULL if the file could not be read.
+ **/
+ipset_t *
+ipset_declare(orchids_t *ctx, const char *name, const char *path,
+              time_t period);
+
+
+/**
+ ** Test if an address belongs to a set, by binary search over the
+ ** ranges.
+ ** @param set  The set.
+ ** @param addr The address, in host byte order.
+ ** @return TRUE if the address belongs to the set.
+ **/
+int
+ipset_contains(ipset_t *set, uint32_t addr);
+
+
+/**
+ ** Start reloading a set.  The file is read by steps of
+ ** IPSET_LOAD_CHUNK lines, in real-time actions, and the set keeps
+ ** its current contents until the file is completely read.
+ ** @param ctx A pointer to the Orchids application context.
+ ** @param set The set.
+ ** @return 0 on success, -1 if the file cannot be opened or a reload
+ **   is already in progress.
+ **/
+int
+ipset_reload(orchids_t *ctx, ipset_t *set);
+
+
+void *
+ipset_get_data(ovm_var_t *var);
+
+
+size_t
+ipset_get_data_len(ovm_var_t *var);
+
+
+/**
+ ** Display the list of the sets.
+ ** @param fp  Output stream.
+ ** @param ctx A pointer to the Orchids application context.
+ **/
+void
+fprintf_ipsets(FILE *fp, orchids_t *ctx);
+
+
+/**
+ ** Register the ISSDL functions of the IP sets: ipset_load(),
+ ** ipset_contains() and ipset_reload().
+ ** @param ctx A pointer to the Orchids application context.
+ **/
+void
+register_ipset_functions(orchids_t *ctx);
+
+
+#endif /* IPSET_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -37,41 +37,52 @@
 #include "safelib.h"
 #include "dlist.h"
 #include "timer.h"
+#include "engine.h"
 #include "graph_output.h"
 #include "orchids_api.h"
+#include "report_queue.h"
 
 #include "ovm.h"
 #include "lang.h"
 #include "lang_priv.h"
+#include "sketch.h"
+#include "ipset.h"
 
 /**
  ** Table of data type natively recognized in the Orchids language.
  **/
 static struct issdl_type_s issdl_types_g[] = {
-  { "null",    0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "Null type for error/exception managmnent" },
-  { "func",    0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "Function reference" },
-  { "int",     0, int_get_data, int_get_data_len, int_cmp, int_add, int_sub, int_mul, int_div, int_mod, int_clone, NULL, "Integer numbers (32-bits signed int)" },
-  { "bstr",    0, bytestr_get_data, bytestr_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, bstr_clone, NULL, "Binary string, allocated, (unsigned char *)" },
-  { "vbstr",   0, vbstr_get_data, vbstr_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, vbstr_clone, NULL, "Virtual binary string, not allocated, only pointer/offset reference" },
-  { "str",     0, string_get_data, string_get_data_len, str_cmp, str_add, NULL, NULL, NULL, NULL, string_clone, NULL, "Character string, allocated, (char *)" },
-  { "vstr",    0, vstring_get_data, vstring_get_data_len, vstr_cmp, vstr_add, NULL, NULL, NULL, NULL, vstr_clone, NULL, "Virtual string, not allocated, only pointer/offset reference" },
-  { "array",   0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "Array" },
-  { "hash",    0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "Hash table" },
-  { "ctime",   0, ctime_get_data, ctime_get_data_len, ctime_cmp, ctime_add, ctime_sub, ctime_mul, ctime_div, ctime_mod, ctime_clone, NULL, "C Time, seconds since Epoch (Jan. 1, 1970, 00:00 GMT), (time_t)" },
-  { "ipv4",    0, ipv4_get_data, ipv4_get_data_len, ipv4_cmp, NULL, NULL, NULL, NULL, NULL, ipv4_clone, NULL, "IPv4 address (struct in_addr)" },
-  { "timeval", 0, timeval_get_data, timeval_get_data_len, timeval_cmp, timeval_add, timeval_sub, timeval_mul, timeval_div, timeval_mod, timeval_clone, NULL, "Seconds and microseconds since Epoch, (struct timeval)" },
-  { "counter", 0, counter_get_data, counter_get_data_len, counter_cmp, counter_add, NULL, counter_mul, NULL, NULL, counter_clone, NULL, "Counter (a monotonic integer)" },
-  { "regex",   0, regex_get_data, regex_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, NULL, regex_destruct, "Posix Extended Regular Expression, without substring addressing" },
-  { "sregex",  0, splitregex_get_data, splitregex_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, NULL, splitregex_destruct, "Posix Extended Regular Expression, with substring addressing" },
-  { "ptr32",   0, address_get_data, address_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "32-bit memory pointer" },
-  { "uint",    0, uint_get_data, uint_get_data_len, uint_cmp, uint_add, uint_sub, uint_mul, uint_div, uint_mod, uint_clone, NULL, "Non negative integer (32-bits unsigned int)" },
-  { "snmpoid", 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "SNMP Object Identifier" },
-  { "float",   0, float_get_data, float_get_data_len, float_cmp, float_add, float_sub, float_mul, float_div, NULL, float_clone, NULL, "IEEE 32-bit floating point number (float)" },
-  { "double",  0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "IEEE 64-bit floating point number (double)" },
-  { "extern",  0, extern_get_data, extern_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, NULL, extern_destruct, "External data (provided by a plugin)" },
-  { NULL, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "" }
+  { "null",    0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, null_save, null_restore, "Null type for error/exception managmnent" },
+  { "func",    0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "Function reference" },
+  { "int",     0, int_get_data, int_get_data_len, int_cmp, int_add, int_sub, int_mul, int_div, int_mod, int_clone, NULL, scalar_save, int_restore, "Integer numbers (32-bits signed int)" },
+  { "bstr",    0, bytestr_get_data, bytestr_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, bstr_clone, NULL, bstr_save, bstr_restore, "Binary string, allocated, (unsigned char *)" },
+  { "vbstr",   0, vbstr_get_data, vbstr_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, vbstr_clone, NULL, bstr_save, bstr_restore, "Virtual binary string, not allocated, only pointer/offset reference" },
+  { "str",     0, string_get_data, string_get_data_len, str_cmp, str_add, NULL, NULL, NULL, NULL, string_clone, NULL, str_save, str_restore, "Character string, allocated, (char *)" },
+  { "vstr",    0, vstring_get_data, vstring_get_data_len, vstr_cmp, vstr_add, NULL, NULL, NULL, NULL, vstr_clone, NULL, str_save, str_restore, "Virtual string, not allocated, only pointer/offset reference" },
+  { "array",   0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "Array" },
+  { "hash",    0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "Hash table" },
+  { "ctime",   0, ctime_get_data, ctime_get_data_len, ctime_cmp, ctime_add, ctime_sub, ctime_mul, ctime_div, ctime_mod, ctime_clone, NULL, scalar_save, ctime_restore, "C Time, seconds since Epoch (Jan. 1, 1970, 00:00 GMT), (time_t)" },
+  { "ipv4",    0, ipv4_get_data, ipv4_get_data_len, ipv4_cmp, NULL, NULL, NULL, NULL, NULL, ipv4_clone, NULL, scalar_save, ipv4_restore, "IPv4 address (struct in_addr)" },
+  { "timeval", 0, timeval_get_data, timeval_get_data_len, timeval_cmp, timeval_add, timeval_sub, timeval_mul, timeval_div, timeval_mod, timeval_clone, NULL, scalar_save, timeval_restore, "Seconds and microseconds since Epoch, (struct timeval)" },
+  { "counter", 0, counter_get_data, counter_get_data_len, counter_cmp, counter_add, NULL, counter_mul, NULL, NULL, counter_clone, NULL, scalar_save, counter_restore, "Counter (a monotonic integer)" },
+  { "regex",   0, regex_get_data, regex_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, NULL, regex_destruct, regex_save, regex_restore, "Posix Extended Regular Expression, without substring addressing" },
+  { "sregex",  0, splitregex_get_data, splitregex_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, NULL, splitregex_destruct, splitregex_save, splitregex_restore, "Posix Extended Regular Expression, with substring addressing" },
+  { "ptr32",   0, address_get_data, address_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "32-bit memory pointer" },
+  { "uint",    0, uint_get_data, uint_get_data_len, uint_cmp, uint_add, uint_sub, uint_mul, uint_div, uint_mod, uint_clone, NULL, scalar_save, uint_restore, "Non negative integer (32-bits unsigned int)" },
+  { "snmpoid", 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, snmpoid_save, snmpoid_restore, "SNMP Object Identifier" },
+  { "float",   0, float_get_data, float_get_data_len, float_cmp, float_add, float_sub, float_mul, float_div, NULL, float_clone, NULL, scalar_save, float_restore, "IEEE 32-bit floating point number (float)" },
+  { "double",  0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "IEEE 64-bit floating point number (double)" },
+  { "extern",  0, extern_get_data, extern_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, NULL, extern_destruct, NULL, NULL, "External data (provided by a plugin)" },
+  { "hll",     0, sketch_get_data, sketch_get_data_len, NULL, sketch_merge, NULL, NULL, NULL, NULL, sketch_clone, NULL, sketch_save, sketch_restore, "HyperLogLog sketch (distinct count estimation)" },
+  { "cms",     0, sketch_get_data, sketch_get_data_len, NULL, sketch_merge, NULL, NULL, NULL, NULL, sketch_clone, NULL, sketch_save, sketch_restore, "Count-Min sketch (frequency estimation)" },
+  { "topk",    0, sketch_get_data, sketch_get_data_len, NULL, sketch_merge, NULL, NULL, NULL, NULL, sketch_clone, NULL, sketch_save, sketch_restore, "Top-k sketch (most frequent values)" },
+  { "ipset",   0, ipset_get_data, ipset_get_data_len, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "Set of IPv4 addresses and networks" },
+  { NULL, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "" }
 };
 
+/** Number of entries of issdl_types_g[] (without the terminator). */
+#define ISSDL_TYPES_NB (sizeof (issdl_types_g) / sizeof (issdl_types_g[0]) - 1)
+
 static int resolve_ipv4_g = 0;
 
 char *
@@ -95,7 +106,8 @@ issdl_free(ovm_var_t	*var)
   if (issdl_types_g[TYPE(var)].destruct)
     issdl_types_g[TYPE(var)].destruct(var);
 
-  Xfree(var);
+  if (!(FLAGS(var) & TYPE_ARENA))
+    Xfree(var);
 }
 
 /*
@@ -1537,6 +1549,349 @@ ovm_snmpoid_new(size_t len)
   return ( OVM_VAR(o) );
 }
 
+/*
+** Binary save/restore of values, for engine checkpoints.
+** Data is written in native byte order: checkpoints are only meant
+** to be read back by the same Orchids binary, on the same host.
+*/
+
+static int
+write_len(FILE *fp, size_t len)
+{
+  unsigned long l;
+
+  l = len;
+  return (fwrite(&l, sizeof (l), 1, fp) == 1 ? 0 : -1);
+}
+
+static int
+read_len(FILE *fp, size_t *len)
+{
+  unsigned long l;
+
+  if (fread(&l, sizeof (l), 1, fp) != 1)
+    return (-1);
+  *len = l;
+
+  return (0);
+}
+
+static int
+null_save(FILE *fp, ovm_var_t *var)
+{
+  return (fwrite(&ERRNO(var), sizeof (ERRNO(var)), 1, fp) == 1 ? 0 : -1);
+}
+
+static ovm_var_t *
+null_restore(FILE *fp)
+{
+  ovm_var_t *var;
+
+  var = ovm_null_new();
+  if (fread(&ERRNO(var), sizeof (ERRNO(var)), 1, fp) != 1) {
+    Xfree(var);
+    return (NULL);
+  }
+
+  return (var);
+}
+
+/* fixed size types: the raw data is the value itself */
+static int
+scalar_save(FILE *fp, ovm_var_t *var)
+{
+  issdl_type_t *t;
+
+  t = &issdl_types_g[TYPE(var)];
+
+  return (fwrite(t->get_data(var), t->get_data_len(var), 1, fp) == 1 ? 0 : -1);
+}
+
+static ovm_var_t *
+scalar_restore(FILE *fp, ovm_var_t *var)
+{
+  issdl_type_t *t;
+
+  t = &issdl_types_g[TYPE(var)];
+  if (fread(t->get_data(var), t->get_data_len(var), 1, fp) != 1) {
+    Xfree(var);
+    return (NULL);
+  }
+
+  return (var);
+}
+
+static ovm_var_t *
+int_restore(FILE *fp)
+{
+  return (scalar_restore(fp, ovm_int_new()));
+}
+
+static ovm_var_t *
+uint_restore(FILE *fp)
+{
+  return (scalar_restore(fp, ovm_uint_new()));
+}
+
+static ovm_var_t *
+counter_restore(FILE *fp)
+{
+  return (scalar_restore(fp, ovm_counter_new()));
+}
+
+static ovm_var_t *
+ctime_restore(FILE *fp)
+{
+  return (scalar_restore(fp, ovm_ctime_new()));
+}
+
+static ovm_var_t *
+ipv4_restore(FILE *fp)
+{
+  return (scalar_restore(fp, ovm_ipv4_new()));
+}
+
+static ovm_var_t *
+timeval_restore(FILE *fp)
+{
+  return (scalar_restore(fp, ovm_timeval_new()));
+}
+
+static ovm_var_t *
+float_restore(FILE *fp)
+{
+  return (scalar_restore(fp, ovm_float_new()));
+}
+
+/* bstr and vbstr: a virtual string is restored as a real one */
+static int
+bstr_save(FILE *fp, ovm_var_t *var)
+{
+  size_t len;
+
+  len = issdl_types_g[TYPE(var)].get_data_len(var);
+  if (write_len(fp, len))
+    return (-1);
+  if (len && fwrite(issdl_types_g[TYPE(var)].get_data(var), len, 1, fp) != 1)
+    return (-1);
+
+  return (0);
+}
+
+static ovm_var_t *
+bstr_restore(FILE *fp)
+{
+  ovm_var_t *var;
+  size_t len;
+
+  if (read_len(fp, &len))
+    return (NULL);
+  var = ovm_bstr_new(len);
+  if (len && fread(BSTR(var), len, 1, fp) != 1) {
+    Xfree(var);
+    return (NULL);
+  }
+
+  return (var);
+}
+
+static int
+str_save(FILE *fp, ovm_var_t *var)
+{
+  return (bstr_save(fp, var));
+}
+
+static ovm_var_t *
+str_restore(FILE *fp)
+{
+  ovm_var_t *var;
+  size_t len;
+
+  if (read_len(fp, &len))
+    return (NULL);
+  var = ovm_str_new(len);
+  if (len && fread(STR(var), len, 1, fp) != 1) {
+    Xfree(var);
+    return (NULL);
+  }
+
+  return (var);
+}
+
+/* regular expressions are saved as their source, and recompiled */
+static int
+save_regex_string(FILE *fp, char *str)
+{
+  size_t len;
+
+  len = (str == NULL) ? 0 : strlen(str);
+  if (write_len(fp, len))
+    return (-1);
+  if (len && fwrite(str, len, 1, fp) != 1)
+    return (-1);
+
+  return (0);
+}
+
+static char *
+restore_regex_string(FILE *fp)
+{
+  char *str;
+  size_t len;
+
+  if (read_len(fp, &len))
+    return (NULL);
+  str = Xmalloc(len + 1);
+  if (len && fread(str, len, 1, fp) != 1) {
+    Xfree(str);
+    return (NULL);
+  }
+  str[len] = '\0';
+
+  return (str);
+}
+
+static int
+regex_save(FILE *fp, ovm_var_t *var)
+{
+  return (save_regex_string(fp, REGEXSTR(var)));
+}
+
+static ovm_var_t *
+regex_restore(FILE *fp)
+{
+  ovm_var_t *var;
+  char *str;
+
+  str = restore_regex_string(fp);
+  if (str == NULL)
+    return (NULL);
+  var = ovm_regex_new();
+  if (regcomp(&(REGEX(var)), str, REG_EXTENDED | REG_NOSUB)) {
+    DebugLog(DF_OVM, DS_ERROR,
+             "regex_restore(): can't recompile \"%s\"\n", str);
+    Xfree(str);
+    Xfree(var);
+    return (NULL);
+  }
+  REGEXSTR(var) = str;
+
+  return (var);
+}
+
+static int
+splitregex_save(FILE *fp, ovm_var_t *var)
+{
+  if (save_regex_string(fp, SREGEXSTR(var)))
+    return (-1);
+
+  return (fwrite(&SREGEXNUM(var), sizeof (SREGEXNUM(var)), 1, fp) == 1 ? 0 : -1);
+}
+
+static ovm_var_t *
+splitregex_restore(FILE *fp)
+{
+  ovm_var_t *var;
+  char *str;
+
+  str = restore_regex_string(fp);
+  if (str == NULL)
+    return (NULL);
+  var = ovm_sregex_new();
+  if (fread(&SREGEXNUM(var), sizeof (SREGEXNUM(var)), 1, fp) != 1) {
+    Xfree(str);
+    Xfree(var);
+    return (NULL);
+  }
+  if (regcomp(&(SREGEX(var)), str, REG_EXTENDED)) {
+    DebugLog(DF_OVM, DS_ERROR,
+             "splitregex_restore(): can't recompile \"%s\"\n", str);
+    Xfree(str);
+    Xfree(var);
+    return (NULL);
+  }
+  SREGEXSTR(var) = str;
+
+  return (var);
+}
+
+static int
+snmpoid_save(FILE *fp, ovm_var_t *var)
+{
+  if (write_len(fp, SNMPOIDLEN(var)))
+    return (-1);
+  if (SNMPOIDLEN(var) &&
+      fwrite(SNMPOID(var), sizeof (oid_t), SNMPOIDLEN(var), fp) != SNMPOIDLEN(var))
+    return (-1);
+
+  return (0);
+}
+
+static ovm_var_t *
+snmpoid_restore(FILE *fp)
+{
+  ovm_var_t *var;
+  size_t len;
+
+  if (read_len(fp, &len))
+    return (NULL);
+  var = ovm_snmpoid_new(len);
+  if (len && fread(SNMPOID(var), sizeof (oid_t), len, fp) != len) {
+    Xfree(var);
+    return (NULL);
+  }
+
+  return (var);
+}
+
+int
+issdl_save(FILE *fp, ovm_var_t *var)
+{
+  uint32_t hdr[2];
+
+  if (var == NULL || TYPE(var) >= ISSDL_TYPES_NB
+      || issdl_types_g[TYPE(var)].save == NULL) {
+    ovm_null_t n;
+
+    /* not serializable: saved as an undefined value */
+    hdr[0] = T_NULL;
+    hdr[1] = (var == NULL) ? 0 : FLAGS(var);
+    if (fwrite(hdr, sizeof (hdr), 1, fp) != 1)
+      return (-1);
+    n.err_no = ERRNO_UNDEFINED;
+    return (null_save(fp, OVM_VAR(&n)));
+  }
+
+  hdr[0] = TYPE(var);
+  hdr[1] = FLAGS(var);
+  if (fwrite(hdr, sizeof (hdr), 1, fp) != 1)
+    return (-1);
+
+  return (issdl_types_g[TYPE(var)].save(fp, var));
+}
+
+ovm_var_t *
+issdl_restore(FILE *fp)
+{
+  uint32_t hdr[2];
+  ovm_var_t *var;
+
+  if (fread(hdr, sizeof (hdr), 1, fp) != 1)
+    return (NULL);
+  if (hdr[0] >= ISSDL_TYPES_NB || issdl_types_g[hdr[0]].restore == NULL) {
+    DebugLog(DF_OVM, DS_ERROR,
+             "issdl_restore(): bad value type %u\n", hdr[0]);
+    return (NULL);
+  }
+  var = issdl_types_g[hdr[0]].restore(fp);
+  /* Restored values are allocated on their own, even if the saved
+   * one lived in an event arena */
+  if (var)
+    FLAGS(var) = hdr[1] & ~TYPE_ARENA;
+
+  return (var);
+}
+
 /* raw data support */
 
 void *
@@ -2161,6 +2516,17 @@ fprintf_issdl_val(FILE *fp, ovm_var_t *val)
       fprintf(fp, "float: %f\n", FLOAT(val));
       break;
 
+    case T_HLL:
+    case T_CMS:
+    case T_TOPK:
+      fprintf_sketch(fp, val);
+      break;
+
+    case T_IPSET:
+      fprintf(fp, "ipset: %s (%zu ranges)\n",
+              IPSET(val)->name, IPSET(val)->nb);
+      break;
+
     case T_SNMPOID:
       fprintf(fp, "snmpoid[%zd]: ", SNMPOIDLEN(val));
       for (i=0; i < SNMPOIDLEN(val); i++) {
@@ -2380,57 +2746,30 @@ issdl_kill_threads(orchids_t *ctx, state_instance_t *state)
   PUSH_RETURN_TRUE(ctx, state)
 }
 
-static void
-do_recursive_cut(state_instance_t *state)
-{
-  wait_thread_t *t;
-
-  state->flags |= SF_PRUNED;
-
-  /* Cut current state instance threads */
-  for (t = state->thread_list; t; t = t->next_in_state_instance) {
-    if ( !(t->flags & THREAD_ONLYONCE) ) {
-      DebugLog(DF_ENG, DS_TRACE, "Marking thread %p as KILLED (cut)\n", t);
-      t->flags |= THREAD_KILLED;
-    }
-  }
-
-  /* Then call recursively */
-  if (state->first_child)
-    do_recursive_cut(state->first_child);
-
-  if (state->next_sibling)
-    do_recursive_cut(state->next_sibling);
-}
-
 static void
 issdl_cut(orchids_t *ctx, state_instance_t *state)
 {
-  ovm_var_t *str;
+  ovm_var_t *dest;
   state_instance_t *si;
 
-  /* First poor implementation of cuts:
-   * The cut should be included in the language, and should also be resolved
-   * at compilation-time to apply syntactic restrictions and avoid problems
-   * (ONE CUT per state MAX! And ensure at the compilation time that the
-   * destination exists and is reachable) */
-
-  str = stack_pop(ctx->ovm_stack);
+  /* The rule compiler replaces the state name by the state identifier,
+   * and checks that the destination leads to the current state. */
+  dest = stack_pop(ctx->ovm_stack);
 
-  if (TYPE(str) != T_STR) {
+  if (IS_NULL(dest) || TYPE(dest) != T_INT) {
     DebugLog(DF_ENG, DS_ERROR, "parameter type error\n");
     return ;
   }
 
   /* Find the destination of the cut */
   for (si = state;
-       si->parent && strcmp(STR(str), si->state->name);
+       si->parent && si->state->id != INT(dest);
        si = si->parent)
     ;
 
   DebugLog(DF_ENG, DS_INFO, "found cut dest @ %s:%p\n", si->state->name, si);
 
-  do_recursive_cut(si);
+  cut_state_instance(si);
 
   PUSH_RETURN_TRUE(ctx, state)
 }
@@ -2464,8 +2803,6 @@ ovm_strdup(ovm_var_t *str)
 static void
 issdl_report(orchids_t *ctx, state_instance_t *state)
 {
-  reportmod_t* r;
-
   DebugLog(DF_ENG, DS_INFO, "Generating report\n");
 
   if (state->rule_instance == NULL)
@@ -2474,9 +2811,7 @@ issdl_report(orchids_t *ctx, state_instance_t *state)
     return;
   }
 
-  SLIST_FOREACH(r, &ctx->reportmod_list, list) {
-    r->cb(ctx, r->mod, r->data, state);
-  }
+  report_state(ctx, state);
   ctx->reports++;
   PUSH_RETURN_TRUE(ctx, state)
 }
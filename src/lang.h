@@ -56,6 +56,14 @@
 
 #define T_EXTERNAL	 20
 
+/* Probabilistic sketches (see sketch.c) */
+#define T_HLL        21
+#define T_CMS        22
+#define T_TOPK       23
+
+/* IPv4 address sets (see ipset.c) */
+#define T_IPSET      24
+
 /* ToDo -- coming soon */
 #define T_NTPTIMESTAMP 0
 #define T_TCPPORT 0
@@ -79,6 +87,8 @@
 ** must be kept. */
 #define TYPE_CANFREE     (1 << 2)
 #define TYPE_NOTBOUND    (1 << 3)
+/* Value allocated in an event arena: freed with its event, never alone. */
+#define TYPE_ARENA       (1 << 4)
 
 #define CAN_FREE_VAR(x) ((x)->flags & TYPE_CANFREE)
 #define IS_NOT_BOUND(x) \
@@ -131,6 +141,10 @@
 #define    SNMPOID(var)  (((ovm_snmpoid_t *)(var))->objoid)
 #define      FLOAT(var)    (((ovm_float_t *)(var))->val)
 #define     DOUBLE(var)   (((ovm_double_t *)(var))->val)
+#define        HLL(var)      ((ovm_hll_t *)(var))
+#define        CMS(var)      ((ovm_cms_t *)(var))
+#define       TOPK(var)     ((ovm_topk_t *)(var))
+#define      IPSET(var)    (((ovm_ipset_t *)(var))->set)
 #define     EXTPTR(var)    (((ovm_extern_t *)(var))->ptr)
 #define    EXTDESC(var)    (((ovm_extern_t *)(var))->desc)
 #define    EXTFREE(var)    (((ovm_extern_t *)(var))->free)
@@ -206,6 +220,8 @@ typedef ovm_var_t *(*var_div_t)(ovm_var_t *var1, ovm_var_t *var2);
 typedef ovm_var_t *(*var_mod_t)(ovm_var_t *var1, ovm_var_t *var2);
 typedef ovm_var_t *(*var_clone_t)(ovm_var_t *var);
 typedef void	   (*var_destruct_t)(ovm_var_t *var);
+typedef int        (*var_save_t)(FILE *fp, ovm_var_t *var);
+typedef ovm_var_t *(*var_restore_t)(FILE *fp);
 
 /**
  ** @struct issdl_type_s
@@ -247,6 +263,13 @@ typedef void	   (*var_destruct_t)(ovm_var_t *var);
 /**   @var issdl_type_s::destruct
  **     Destructor function handler.
  **/
+/**   @var issdl_type_s::save
+ **     Write the value data in binary form (for engine checkpoints).
+ **     Returns 0 on success.
+ **/
+/**   @var issdl_type_s::restore
+ **     Read a value written by save.  Returns NULL on error.
+ **/
 /**   @var issdl_type_s::desc
  **     A shot text description of the type.
  **/
@@ -265,6 +288,8 @@ struct issdl_type_s
   var_mod_t            mod;
   var_clone_t          clone;
   var_destruct_t       destruct;
+  var_save_t           save;
+  var_restore_t        restore;
   /* XXX add extension here */
   char                *desc;
 };
@@ -720,6 +745,168 @@ struct ovm_extern_s
   void (*free)(void *ptr);
 };
 
+/**
+ ** @struct ovm_hll_s
+ **   ISSDL HyperLogLog sketch: estimates the number of distinct
+ **   values added, in 2^precision bytes.
+ **/
+/**   @var ovm_hll_s::type
+ **     Data type identifier: T_HLL.
+ **/
+/**   @var ovm_hll_s::flags
+ **     Data access flags.
+ **/
+/**   @var ovm_hll_s::precision
+ **     Number of index bits (4 to 16).
+ **/
+/**   @var ovm_hll_s::hist
+ **     Number of registers holding each value, so that estimates
+ **     don't scan the registers.
+ **/
+/**   @var ovm_hll_s::regs
+ **     Registers: maximum rank seen for each index.
+ **/
+typedef struct ovm_hll_s ovm_hll_t;
+struct ovm_hll_s
+{
+  uint32_t  type;
+  uint32_t  flags;
+  uint32_t  precision;
+  uint32_t  hist[66];
+  uint8_t   regs[];
+};
+
+/**
+ ** @struct ovm_cms_s
+ **   ISSDL Count-Min sketch: estimates the frequency of values, in
+ **   width x depth counters.
+ **/
+/**   @var ovm_cms_s::type
+ **     Data type identifier: T_CMS.
+ **/
+/**   @var ovm_cms_s::flags
+ **     Data access flags.
+ **/
+/**   @var ovm_cms_s::width
+ **     Number of counters per row.
+ **/
+/**   @var ovm_cms_s::depth
+ **     Number of rows (hash functions).
+ **/
+/**   @var ovm_cms_s::total
+ **     Sum of the added amounts.
+ **/
+/**   @var ovm_cms_s::counters
+ **     depth rows of width counters.
+ **/
+typedef struct ovm_cms_s ovm_cms_t;
+struct ovm_cms_s
+{
+  uint32_t  type;
+  uint32_t  flags;
+  uint32_t  width;
+  uint32_t  depth;
+  uint64_t  total;
+  uint32_t  counters[];
+};
+
+/**
+ ** @struct topk_entry_s
+ **   A monitored value of a top-k sketch.
+ **/
+/**   @var topk_entry_s::hash
+ **     Hash of the value.
+ **/
+/**   @var topk_entry_s::count
+ **     Estimated count (an upper bound).
+ **/
+/**   @var topk_entry_s::error
+ **     Maximum overestimation of count.
+ **/
+/**   @var topk_entry_s::vtype
+ **     ISSDL type of the value.
+ **/
+/**   @var topk_entry_s::len
+ **     Length of the value (truncated to TOPK_VALUE_SZ bytes in val).
+ **/
+/**   @var topk_entry_s::val
+ **     The value bytes.
+ **/
+#define TOPK_VALUE_SZ 48
+typedef struct topk_entry_s topk_entry_t;
+struct topk_entry_s
+{
+  uint64_t      hash;
+  uint64_t      count;
+  uint64_t      error;
+  uint32_t      vtype;
+  uint32_t      len;
+  unsigned char val[TOPK_VALUE_SZ];
+};
+
+/**
+ ** @struct ovm_topk_s
+ **   ISSDL top-k sketch (Space-Saving): monitors the k most frequent
+ **   values in a min-heap of k entries, indexed by an open-addressing
+ **   table of 2^index_bits slots.
+ **/
+/**   @var ovm_topk_s::type
+ **     Data type identifier: T_TOPK.
+ **/
+/**   @var ovm_topk_s::flags
+ **     Data access flags.
+ **/
+/**   @var ovm_topk_s::k
+ **     Number of monitored values.
+ **/
+/**   @var ovm_topk_s::n
+ **     Number of entries in use.
+ **/
+/**   @var ovm_topk_s::index_bits
+ **     Log2 of the number of index slots.
+ **/
+/**   @var ovm_topk_s::total
+ **     Number of added values.
+ **/
+/**   @var ovm_topk_s::heap
+ **     Min-heap of entries, by count; followed by the index slots
+ **     (heap position + 1, or 0 if free).
+ **/
+typedef struct ovm_topk_s ovm_topk_t;
+struct ovm_topk_s
+{
+  uint32_t      type;
+  uint32_t      flags;
+  uint32_t      k;
+  uint32_t      n;
+  uint32_t      index_bits;
+  uint64_t      total;
+  topk_entry_t  heap[];
+};
+
+/**
+ ** @struct ovm_ipset_s
+ **   ISSDL IPv4 address set: a reference to a named set of addresses
+ **   and networks, loaded from a file (see ipset.c).
+ **/
+/**   @var ovm_ipset_s::type
+ **     Data type identifier: T_IPSET.
+ **/
+/**   @var ovm_ipset_s::flags
+ **     Data access flags.
+ **/
+/**   @var ovm_ipset_s::set
+ **     The referenced set.
+ **/
+typedef struct ipset_s ipset_t;
+typedef struct ovm_ipset_s ovm_ipset_t;
+struct ovm_ipset_s
+{
+  uint32_t  type;
+  uint32_t  flags;
+  ipset_t  *set;
+};
+
 
 
 /*----------------------------------------------------------------------------*
@@ -748,6 +935,28 @@ void
 issdl_free(ovm_var_t	*var);
 
 
+/**
+ ** Write a variable in binary form on a stream (type, flags and data),
+ ** using the save handler of its type.  Types which can't be saved
+ ** (references to external data, functions...) are written as null.
+ ** Virtual strings are saved as real strings.
+ ** @param fp   The output stream.
+ ** @param var  The variable to save.
+ ** @return 0 on success, -1 on write error.
+ **/
+int
+issdl_save(FILE *fp, ovm_var_t *var);
+
+
+/**
+ ** Read back a variable written by issdl_save().
+ ** @param fp  The input stream.
+ ** @return A newly allocated variable, or NULL on read error.
+ **/
+ovm_var_t *
+issdl_restore(FILE *fp);
+
+
 /**
  ** Comparison function of the Orchids language.  This functions is used in
  ** the implementation of comparison opcode (equal, less than, greater
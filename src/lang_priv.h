@@ -281,6 +281,66 @@ extern_get_data_len(ovm_var_t *address);
 void
 extern_destruct(ovm_var_t *var);
 
+static int
+null_save(FILE *fp, ovm_var_t *var);
+
+static ovm_var_t *
+null_restore(FILE *fp);
+
+static int
+scalar_save(FILE *fp, ovm_var_t *var);
+
+static ovm_var_t *
+int_restore(FILE *fp);
+
+static ovm_var_t *
+uint_restore(FILE *fp);
+
+static ovm_var_t *
+counter_restore(FILE *fp);
+
+static ovm_var_t *
+ctime_restore(FILE *fp);
+
+static ovm_var_t *
+ipv4_restore(FILE *fp);
+
+static ovm_var_t *
+timeval_restore(FILE *fp);
+
+static ovm_var_t *
+float_restore(FILE *fp);
+
+static int
+bstr_save(FILE *fp, ovm_var_t *var);
+
+static ovm_var_t *
+bstr_restore(FILE *fp);
+
+static int
+str_save(FILE *fp, ovm_var_t *var);
+
+static ovm_var_t *
+str_restore(FILE *fp);
+
+static int
+regex_save(FILE *fp, ovm_var_t *var);
+
+static ovm_var_t *
+regex_restore(FILE *fp);
+
+static int
+splitregex_save(FILE *fp, ovm_var_t *var);
+
+static ovm_var_t *
+splitregex_restore(FILE *fp);
+
+static int
+snmpoid_save(FILE *fp, ovm_var_t *var);
+
+static ovm_var_t *
+snmpoid_restore(FILE *fp);
+
 #endif /* LANG_PRIV_H */
 
 /*
@@ -0,0 +1,217 @@
+/**
+ ** @file latency.c
+ ** End-to-end event latency.
+ **
+ ** Each event read by an input module is stamped with the time its
+ ** data arrived (the time select() returned, or the beginning of the
+ ** main loop for polled inputs), and this stamp follows it through
+ ** the input queue.  When dispatch ends, i.e. after the post-injection
+ ** hooks of the analysis engine have run, the latency is split into
+ ** queueing, dissection and correlation time, and recorded into
+ ** histograms of the sending module.
+ **
+ ** Histograms have logarithmic buckets, with LATENCY_SUB sub-buckets
+ ** per power of two (as HDR histograms): recording is a few integer
+ ** operations, and quantiles are within 1/LATENCY_SUB of the truth.
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "orchids.h"
+
+#include "latency.h"
+
+
+int
+latency_bucket(unsigned long us)
+{
+  int e;
+
+  if (us < 2 * LATENCY_SUB)
+    return ((int)us);
+
+  if (us > 0xffffffffUL)
+    us = 0xffffffffUL;
+
+  /* e = floor(log2(us)) - LATENCY_SUB_BITS */
+  e = (int)(8 * sizeof (unsigned long)) - 1 - __builtin_clzl(us)
+    - LATENCY_SUB_BITS;
+
+  return ((e + 1) * LATENCY_SUB + (int)(us >> e) - LATENCY_SUB);
+}
+
+
+uint64_t
+latency_bucket_low(int b)
+{
+  int e;
+
+  if (b < 2 * LATENCY_SUB)
+    return ((uint64_t)b);
+
+  e = b / LATENCY_SUB - 1;
+
+  return ((uint64_t)(b % LATENCY_SUB + LATENCY_SUB) << e);
+}
+
+
+unsigned long
+latency_count_upto(const latency_hist_t *h, uint64_t us)
+{
+  unsigned long n;
+  int b;
+
+  n = 0;
+  for (b = 0; b < LATENCY_BUCKETS && latency_bucket_low(b) <= us; b++)
+    n += h->buckets[b];
+
+  return (n);
+}
+
+
+unsigned long
+latency_quantile(const latency_hist_t *h, double q)
+{
+  unsigned long rank;
+  unsigned long n;
+  uint64_t high;
+  int b;
+
+  if (h->count == 0)
+    return (0);
+
+  rank = (unsigned long)(q * h->count);
+  if (rank >= h->count)
+    rank = h->count - 1;
+
+  n = 0;
+  for (b = 0; b < LATENCY_BUCKETS; b++) {
+    n += h->buckets[b];
+    if (n > rank)
+      break ;
+  }
+
+  if (b >= LATENCY_BUCKETS - 1)
+    return (h->max_us);
+  high = latency_bucket_low(b + 1) - 1;
+
+  return (high < h->max_us ? (unsigned long)high : h->max_us);
+}
+
+
+static void
+latency_add(latency_hist_t *h, unsigned long us)
+{
+  h->count++;
+  h->sum_us += us;
+  if (us > h->max_us)
+    h->max_us = us;
+  h->buckets[latency_bucket(us)]++;
+}
+
+
+void
+latency_record(orchids_t *ctx, mod_entry_t *sender,
+               const timeval_t *arrival, const timeval_t *start,
+               const timeval_t *end, unsigned long corr_us)
+{
+  mod_latency_t *lat;
+  unsigned long dispatch_us;
+
+  if (sender->latency == NULL)
+    sender->latency = Xzmalloc(sizeof (mod_latency_t));
+  lat = sender->latency;
+
+  dispatch_us = LATENCY_USEC(end, start);
+  if (corr_us > dispatch_us)
+    corr_us = dispatch_us;
+
+  latency_add(&lat->phase[LATENCY_QUEUE], LATENCY_USEC(start, arrival));
+  latency_add(&lat->phase[LATENCY_DISSECT], dispatch_us - corr_us);
+  latency_add(&lat->phase[LATENCY_CORRELATE], corr_us);
+  latency_add(&lat->phase[LATENCY_TOTAL], LATENCY_USEC(end, arrival));
+}
+
+
+void
+fprintf_latency_stats(FILE *fp, const orchids_t *ctx)
+{
+  int i;
+  const mod_latency_t *lat;
+
+  fprintf(fp, "event latency (microseconds, p50/p99):\n");
+  fprintf(fp,
+          "--------------------+------------+---------------+---------------+---------------+---------------+----------\n");
+  fprintf(fp,
+          "             module |     events |         queue |       dissect |     correlate |         total | max\n");
+  fprintf(fp,
+          "--------------------+------------+---------------+---------------+---------------+---------------+----------\n");
+  for (i = 0; i < ctx->loaded_modules; i++) {
+    lat = ctx->mods[i].latency;
+    if (lat == NULL)
+      continue ;
+    fprintf(fp, "%19.19s | %10lu | %6lu/%-6lu | %6lu/%-6lu | %6lu/%-6lu | %6lu/%-6lu | %lu\n",
+            ctx->mods[i].mod->name,
+            lat->phase[LATENCY_TOTAL].count,
+            latency_quantile(&lat->phase[LATENCY_QUEUE], 0.5),
+            latency_quantile(&lat->phase[LATENCY_QUEUE], 0.99),
+            latency_quantile(&lat->phase[LATENCY_DISSECT], 0.5),
+            latency_quantile(&lat->phase[LATENCY_DISSECT], 0.99),
+            latency_quantile(&lat->phase[LATENCY_CORRELATE], 0.5),
+            latency_quantile(&lat->phase[LATENCY_CORRELATE], 0.99),
+            latency_quantile(&lat->phase[LATENCY_TOTAL], 0.5),
+            latency_quantile(&lat->phase[LATENCY_TOTAL], 0.99),
+            lat->phase[LATENCY_TOTAL].max_us);
+  }
+  fprintf(fp,
+          "--------------------+------------+---------------+---------------+---------------+---------------+----------\n");
+}
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
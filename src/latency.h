@@ -0,0 +1,202 @@
+/**
+ ** @file latency.h
+ ** Public definitions for latency.c
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "orchids.h"
+
+/** Sub-buckets per power of two, as a number of bits (relative
+ ** error 1/8). */
+#define LATENCY_SUB_BITS 3
+/** Number of sub-buckets per power of two. */
+#define LATENCY_SUB      (1 << LATENCY_SUB_BITS)
+/** Number of buckets: exact below 2*LATENCY_SUB us, then
+ ** LATENCY_SUB per power of two up to 2^32 us (about 71 minutes). */
+#define LATENCY_BUCKETS  ((32 - LATENCY_SUB_BITS + 1) * LATENCY_SUB)
+
+/** Time from arrival to the start of dispatch (queueing). */
+#define LATENCY_QUEUE     0
+/** Time spent in dissectors, excluding injection. */
+#define LATENCY_DISSECT   1
+/** Time spent in inject_event() (correlation). */
+#define LATENCY_CORRELATE 2
+/** Time from arrival to the end of correlation. */
+#define LATENCY_TOTAL     3
+/** Number of measured phases. */
+#define LATENCY_PHASES    4
+
+/** Microseconds elapsed from timeval b to timeval a (0 if negative). */
+#define LATENCY_USEC(a, b)                                            \
+  ((a)->tv_sec < (b)->tv_sec                                          \
+   || ((a)->tv_sec == (b)->tv_sec && (a)->tv_usec < (b)->tv_usec)     \
+   ? 0UL                                                              \
+   : (unsigned long)((a)->tv_sec - (b)->tv_sec) * 1000000UL           \
+     + (a)->tv_usec - (b)->tv_usec)
+
+
+/**
+ ** @struct latency_hist_s
+ **   Latency histogram, with logarithmic buckets (HDR-style): the
+ **   relative error on quantiles is at most 1/LATENCY_SUB.
+ **/
+/**   @var latency_hist_s::count
+ **     Number of recorded values.
+ **/
+/**   @var latency_hist_s::sum_us
+ **     Sum of recorded values, in microseconds.
+ **/
+/**   @var latency_hist_s::max_us
+ **     Largest recorded value, in microseconds.
+ **/
+/**   @var latency_hist_s::buckets
+ **     Value counts, see latency_bucket().
+ **/
+typedef struct latency_hist_s latency_hist_t;
+struct latency_hist_s
+{
+  unsigned long count;
+  uint64_t      sum_us;
+  unsigned long max_us;
+  unsigned long buckets[LATENCY_BUCKETS];
+};
+
+
+/**
+ ** @struct mod_latency_s
+ **   Latency histograms of the events posted by an input module.
+ **/
+/**   @var mod_latency_s::phase
+ **     One histogram per phase (LATENCY_QUEUE...LATENCY_TOTAL).
+ **/
+struct mod_latency_s
+{
+  latency_hist_t phase[LATENCY_PHASES];
+};
+
+
+/**
+ ** Bucket of a latency value.
+ **
+ ** @param us Latency, in microseconds.
+ ** @return Bucket index, in [0, LATENCY_BUCKETS).
+ **/
+int
+latency_bucket(unsigned long us);
+
+
+/**
+ ** Lower bound of a bucket.
+ **
+ ** @param b Bucket index.
+ ** @return Smallest value falling into bucket b, in microseconds.
+ **/
+uint64_t
+latency_bucket_low(int b);
+
+
+/**
+ ** Number of recorded values up to a bucket boundary, included, as
+ ** Prometheus "le" buckets count them.  The bucket starting at the
+ ** boundary is counted whole: below 2*LATENCY_SUB us this is exact,
+ ** above it values up to us * (1 + 1/LATENCY_SUB), excluded, count
+ ** too.
+ **
+ ** @param h  Histogram.
+ ** @param us A bucket boundary (a power of two, or less than
+ **   2*LATENCY_SUB), in microseconds.
+ ** @return Number of values lower than or equal to us.
+ **/
+unsigned long
+latency_count_upto(const latency_hist_t *h, uint64_t us);
+
+
+/**
+ ** Estimate a quantile of a histogram.
+ **
+ ** @param h Histogram.
+ ** @param q Quantile, between 0 and 1.
+ ** @return Upper bound of the bucket holding the quantile, capped by
+ **   the largest recorded value, in microseconds.
+ **/
+unsigned long
+latency_quantile(const latency_hist_t *h, double q);
+
+
+/**
+ ** Record the latency of an event dispatched for an input module.
+ **
+ ** @param ctx     Orchids application context.
+ ** @param sender  Input module which posted the event.
+ ** @param arrival Time at which the event data was read.
+ ** @param start   Time at which the event was dispatched.
+ ** @param end     Time at which dispatch ended.
+ ** @param corr_us Time spent in inject_event() during dispatch, in
+ **   microseconds.
+ **/
+void
+latency_record(orchids_t *ctx, mod_entry_t *sender,
+               const timeval_t *arrival, const timeval_t *start,
+               const timeval_t *end, unsigned long corr_us);
+
+
+/**
+ ** Print per-module latency quantiles.
+ **
+ ** @param fp  Output stream.
+ ** @param ctx Orchids application context.
+ **/
+void
+fprintf_latency_stats(FILE *fp, const orchids_t *ctx);
+
+
+#endif /* LATENCY_H */
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
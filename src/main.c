@@ -38,6 +38,9 @@
 #include "evt_mgr.h"
 #include "orchids_api.h"
 #include "rule_compiler.h"
+#include "checkpoint.h"
+#include "report_queue.h"
+#include "rule_reload.h"
 
 #include "main_priv.h"
 
@@ -126,6 +129,10 @@ main(int argc, char *argv[])
 
   proceed_post_config(ctx);
   compile_rules(ctx);
+  /* warm restart, before modules can inject their first events */
+  checkpoint_setup(ctx);
+  rule_reload_setup(ctx);
+  report_queue_setup(ctx);
   proceed_post_compil(ctx);
 
   /* change run id here */
@@ -0,0 +1,525 @@
+/**
+ ** @file mem_governor.c
+ ** Memory governor: memory accounting of the analysis engine,
+ ** rule instance eviction and load shedding.
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "orchids.h"
+#include "lang.h"
+#include "engine.h"
+#include "orchids_api.h"
+
+#include "mem_governor.h"
+
+
+size_t
+memgov_var_size(ovm_var_t *var)
+{
+  issdl_type_t *t;
+
+  if (var == NULL || var == F_NOT_NEEDED)
+    return (0);
+
+  switch (TYPE(var)) {
+  case T_VBSTR:
+  case T_VSTR:
+    return (sizeof (ovm_var_t) + sizeof (void *) + sizeof (size_t));
+  default:
+    break ;
+  }
+
+  t = issdlgettypes();
+  if (t[TYPE(var)].get_data_len)
+    return (sizeof (ovm_var_t) + t[TYPE(var)].get_data_len(var));
+
+  return (sizeof (ovm_var_t));
+}
+
+
+size_t
+memgov_event_size(event_t *event)
+{
+  event_arena_t *arena;
+  size_t sz;
+
+  /* Nodes and values held by an arena are accounted by its chunks */
+  arena = NULL;
+  sz = 0;
+  for ( ; event; event = event->next) {
+    if (event->arena == NULL)
+      sz += sizeof (event_t);
+    else if (arena == NULL)
+      arena = event->arena;
+    if (!(FLAGS(event->value) & TYPE_ARENA))
+      sz += memgov_var_size(event->value);
+  }
+
+  if (arena == NULL)
+    return (sz + sizeof (active_event_t));
+
+  for ( ; arena; arena = arena->next)
+    sz += arena->size;
+
+  return (sz);
+}
+
+
+void
+memgov_ref_event(orchids_t *ctx, rule_instance_t *ri, active_event_t *event)
+{
+  if (event->mem_size == 0)
+    event->mem_size = memgov_event_size(event->event);
+
+  ri->mem_events += event->mem_size;
+  ri->rule->mem_used += event->mem_size;
+}
+
+
+void
+memgov_retain_event(orchids_t *ctx, active_event_t *event)
+{
+  ctx->memgov.event_used += event->mem_size;
+}
+
+
+void
+memgov_release_event(orchids_t *ctx, active_event_t *event)
+{
+  ctx->memgov.event_used -= event->mem_size;
+}
+
+
+void
+memgov_release_rule_instance(orchids_t *ctx, rule_instance_t *ri)
+{
+  ri->rule->mem_used -= ri->mem_used + ri->mem_events;
+  ctx->memgov.inst_used -= ri->mem_used;
+  ri->mem_used = 0;
+  ri->mem_events = 0;
+}
+
+
+static size_t
+rule_instance_footprint(const rule_instance_t *ri)
+{
+  return (ri->mem_used + ri->mem_events);
+}
+
+
+static int
+cmp_oldest(const void *a, const void *b)
+{
+  const rule_instance_t *r1 = *(rule_instance_t * const *) a;
+  const rule_instance_t *r2 = *(rule_instance_t * const *) b;
+
+  if (timercmp(&r1->new_creation_date, &r2->new_creation_date, <))
+    return (-1);
+  if (timercmp(&r1->new_creation_date, &r2->new_creation_date, >))
+    return (1);
+  return (0);
+}
+
+
+static int
+cmp_lru(const void *a, const void *b)
+{
+  const rule_instance_t *r1 = *(rule_instance_t * const *) a;
+  const rule_instance_t *r2 = *(rule_instance_t * const *) b;
+
+  if (timercmp(&r1->new_last_act, &r2->new_last_act, <))
+    return (-1);
+  if (timercmp(&r1->new_last_act, &r2->new_last_act, >))
+    return (1);
+  return (cmp_oldest(a, b));
+}
+
+
+static int
+cmp_priority(const void *a, const void *b)
+{
+  const rule_instance_t *r1 = *(rule_instance_t * const *) a;
+  const rule_instance_t *r2 = *(rule_instance_t * const *) b;
+
+  if (r1->rule->priority != r2->rule->priority)
+    return (r1->rule->priority < r2->rule->priority ? -1 : 1);
+  /* Inside a priority level, shed the biggest instances first. */
+  if (rule_instance_footprint(r1) != rule_instance_footprint(r2))
+    return (rule_instance_footprint(r1) > rule_instance_footprint(r2)
+            ? -1 : 1);
+  return (cmp_lru(a, b));
+}
+
+
+static const char *
+policy_name(int policy)
+{
+  switch (policy) {
+  case MEMGOV_EVICT_LRU:
+    return ("least-recently-active");
+  case MEMGOV_EVICT_PRIORITY:
+    return ("lowest-priority");
+  default:
+    return ("oldest");
+  }
+}
+
+
+static void
+mark_evicted(orchids_t *ctx, rule_instance_t *ri, const char *reason)
+{
+  DebugLog(DF_ENG, DS_NOTICE,
+           "memory governor: evicting instance %p of rule '%s' "
+           "(%zu bytes, %i states, created %li, last act. %li) [%s]\n",
+           (void *) ri, ri->rule->name, rule_instance_footprint(ri),
+           ri->state_instances, ri->new_creation_date.tv_sec,
+           ri->new_last_act.tv_sec, reason);
+
+  ri->flags |= RULE_EVICTED;
+  ri->rule->evicted++;
+  ctx->memgov.evicted_instances++;
+}
+
+
+/**
+ ** Collect all live (in use, not yet killed or evicted) rule instances,
+ ** optionally restricted to one rule, sorted by eviction order.
+ **/
+static rule_instance_t **
+collect_candidates(orchids_t *ctx, rule_t *rule, size_t *nb)
+{
+  rule_instance_t *ri;
+  rule_instance_t **tbl;
+  size_t n;
+
+  n = 0;
+  for (ri = ctx->first_rule_instance; ri; ri = ri->next)
+    if (rule == NULL || ri->rule == rule)
+      n++;
+
+  *nb = 0;
+  if (n == 0)
+    return (NULL);
+
+  tbl = Xmalloc(n * sizeof (rule_instance_t *));
+  n = 0;
+  for (ri = ctx->first_rule_instance; ri; ri = ri->next) {
+    if (rule != NULL && ri->rule != rule)
+      continue ;
+    if ( !(ri->flags & RULE_INUSE)
+         || (ri->flags & (THREAD_KILLED | RULE_EVICTED)) )
+      continue ;
+    tbl[n++] = ri;
+  }
+
+  switch (ctx->memgov.policy) {
+  case MEMGOV_EVICT_LRU:
+    qsort(tbl, n, sizeof (rule_instance_t *), cmp_lru);
+    break ;
+  case MEMGOV_EVICT_PRIORITY:
+    qsort(tbl, n, sizeof (rule_instance_t *), cmp_priority);
+    break ;
+  default:
+    qsort(tbl, n, sizeof (rule_instance_t *), cmp_oldest);
+    break ;
+  }
+
+  *nb = n;
+  return (tbl);
+}
+
+
+/**
+ ** Mark rule instances as evicted, in policy order, until the usage
+ ** drops under the target.
+ ** @return The estimated amount of memory released.
+ **/
+static size_t
+evict_down_to(orchids_t *ctx, rule_t *rule, size_t used, size_t target,
+              const char *reason)
+{
+  rule_instance_t **tbl;
+  size_t nb;
+  size_t i;
+  size_t shed;
+
+  tbl = collect_candidates(ctx, rule, &nb);
+  shed = 0;
+  for (i = 0; i < nb && shed < used && used - shed > target; i++) {
+    shed += rule_instance_footprint(tbl[i]);
+    mark_evicted(ctx, tbl[i], reason);
+  }
+  if (tbl != NULL)
+    Xfree(tbl);
+
+  return (shed);
+}
+
+
+static size_t
+low_water(size_t limit)
+{
+  return (limit - (limit >> MEMGOV_HYSTERESIS));
+}
+
+
+void
+memgov_check(orchids_t *ctx)
+{
+  mem_governor_t *gov;
+  rule_t *r;
+  size_t used;
+  size_t limit;
+  size_t shed;
+  uint32_t evicted;
+
+  gov = &ctx->memgov;
+  used = MEMGOV_USED(ctx);
+  if (used > gov->peak)
+    gov->peak = used;
+
+  evicted = gov->evicted_instances;
+  shed = 0;
+
+  /* Per-rule budgets */
+  for (r = gov->rule_budgets ? ctx->rule_compiler->first_rule : NULL;
+       r;
+       r = r->next)
+    if (r->mem_limit && r->mem_used > r->mem_limit)
+      shed += evict_down_to(ctx, r, r->mem_used, low_water(r->mem_limit),
+                            "rule budget");
+
+  /* Global budget */
+  limit = gov->soft_limit ? gov->soft_limit : gov->hard_limit;
+  if (limit && shed < used && used - shed > limit)
+    shed += evict_down_to(ctx, NULL, used - shed, low_water(limit),
+                          policy_name(gov->policy));
+
+  if (gov->evicted_instances == evicted)
+    return ;
+
+  evict_rule_instances(ctx);
+  gov->evicted_bytes += used - MEMGOV_USED(ctx);
+
+  DebugLog(DF_ENG, DS_WARN,
+           "memory governor: evicted %u rule instance(s), "
+           "memory usage %zu -> %zu bytes (soft %zu, hard %zu)\n",
+           gov->evicted_instances - evicted, used, MEMGOV_USED(ctx),
+           gov->soft_limit, gov->hard_limit);
+}
+
+
+int
+memgov_shed_event(orchids_t *ctx, mod_entry_t *sender, event_t *event)
+{
+  mem_governor_t *gov;
+
+  gov = &ctx->memgov;
+  if (gov->hard_limit == 0)
+    return (FALSE);
+
+  if (MEMGOV_USED(ctx) > gov->hard_limit)
+    memgov_check(ctx);
+
+  if (MEMGOV_USED(ctx) <= gov->hard_limit) {
+    if (gov->shedding) {
+      DebugLog(DF_CORE, DS_NOTICE,
+               "memory governor: back under hard limit, "
+               "stop shedding events (%u shed so far)\n",
+               gov->shed_events);
+      gov->shedding = FALSE;
+    }
+    return (FALSE);
+  }
+
+  if (!gov->shedding) {
+    DebugLog(DF_CORE, DS_WARN,
+             "memory governor: hard limit exceeded (%zu > %zu bytes), "
+             "shedding events\n",
+             MEMGOV_USED(ctx), gov->hard_limit);
+    gov->shedding = TRUE;
+  }
+  DebugLog(DF_CORE, DS_DEBUG,
+           "memory governor: shedding event from module '%s'\n",
+           sender->mod->name);
+  gov->shed_events++;
+  free_event(event);
+
+  return (TRUE);
+}
+
+
+memgov_rule_cfg_t *
+memgov_get_rule_cfg(orchids_t *ctx, char *name)
+{
+  memgov_rule_cfg_t *cfg;
+
+  if (ctx->memgov.rule_cfg == NULL)
+    ctx->memgov.rule_cfg = new_strhash(61);
+
+  cfg = strhash_get(ctx->memgov.rule_cfg, name);
+  if (cfg != NULL)
+    return (cfg);
+
+  cfg = Xzmalloc(sizeof (memgov_rule_cfg_t));
+  cfg->name = strdup(name);
+  strhash_add(ctx->memgov.rule_cfg, cfg, cfg->name);
+
+  return (cfg);
+}
+
+
+void
+memgov_bind_rules(orchids_t *ctx)
+{
+  rule_t *r;
+  memgov_rule_cfg_t *cfg;
+
+  if (ctx->memgov.soft_limit && ctx->memgov.hard_limit
+      && ctx->memgov.soft_limit > ctx->memgov.hard_limit) {
+    DebugLog(DF_CORE, DS_WARN,
+             "memory governor: soft limit (%zu) above hard limit (%zu), "
+             "using the hard limit\n",
+             ctx->memgov.soft_limit, ctx->memgov.hard_limit);
+    ctx->memgov.soft_limit = ctx->memgov.hard_limit;
+  }
+
+  if (ctx->memgov.rule_cfg == NULL)
+    return ;
+
+  for (r = ctx->rule_compiler->first_rule; r; r = r->next) {
+    cfg = strhash_get(ctx->memgov.rule_cfg, r->name);
+    if (cfg == NULL)
+      continue ;
+    DebugLog(DF_CORE, DS_INFO,
+             "memory governor: rule '%s' priority %i budget %zu\n",
+             r->name, cfg->priority, cfg->mem_limit);
+    r->priority = cfg->priority;
+    r->mem_limit = cfg->mem_limit;
+    if (r->mem_limit)
+      ctx->memgov.rule_budgets = TRUE;
+  }
+}
+
+
+int
+memgov_parse_size(const char *str, size_t *size)
+{
+  char *end;
+  unsigned long long v;
+
+  errno = 0;
+  v = strtoull(str, &end, 10);
+  if (errno || end == str)
+    return (-1);
+
+  switch (*end) {
+  case 'k': case 'K':
+    v <<= 10;
+    end++;
+    break ;
+  case 'm': case 'M':
+    v <<= 20;
+    end++;
+    break ;
+  case 'g': case 'G':
+    v <<= 30;
+    end++;
+    break ;
+  }
+  if (*end != '\0' && *end != ' ' && *end != '\t')
+    return (-1);
+
+  *size = (size_t) v;
+
+  return (RETURN_SUCCESS);
+}
+
+
+void
+fprintf_memgov_stats(FILE *fp, const orchids_t *ctx)
+{
+  const mem_governor_t *gov;
+  rule_t *r;
+
+  gov = &ctx->memgov;
+
+  fprintf(fp,
+          "-------------------------[ "
+          "memory governor"
+          " ]-------------------------\n");
+  fprintf(fp, "         soft limit : %zu\n", gov->soft_limit);
+  fprintf(fp, "         hard limit : %zu\n", gov->hard_limit);
+  fprintf(fp, "    eviction policy : %s\n", policy_name(gov->policy));
+  fprintf(fp, "  instances+env mem : %zu\n", gov->inst_used);
+  fprintf(fp, "  retained evts mem : %zu\n", gov->event_used);
+  fprintf(fp, "       peak mem use : %zu\n", gov->peak);
+  fprintf(fp, "  evicted instances : %u\n", gov->evicted_instances);
+  fprintf(fp, "      evicted bytes : %zu\n", gov->evicted_bytes);
+  fprintf(fp, "        shed events : %u%s\n",
+          gov->shed_events, gov->shedding ? " (shedding)" : "");
+  fprintf(fp,
+          "--------------------------+------+------------+------------+--------\n");
+  fprintf(fp,
+          "                rule name | prio |   mem used |     budget | evicted\n");
+  fprintf(fp,
+          "--------------------------+------+------------+------------+--------\n");
+  for (r = ctx->rule_compiler->first_rule; r; r = r->next)
+    fprintf(fp, "%25.25s | %4i | %10zu | %10zu | %7u\n",
+            r->name, r->priority, r->mem_used, r->mem_limit, r->evicted);
+  fprintf(fp,
+          "--------------------------+------+------------+------------+--------\n");
+}
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
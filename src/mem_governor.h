@@ -0,0 +1,230 @@
+/**
+ ** @file mem_governor.h
+ ** Public definitions for mem_governor.c
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef MEM_GOVERNOR_H
+#define MEM_GOVERNOR_H
+
+#include "orchids.h"
+
+/**
+ ** Fraction of a budget under which eviction stops, expressed as a
+ ** right shift: eviction goes down to (limit - limit >> MEMGOV_HYSTERESIS).
+ ** This avoids evicting one rule instance per injected event when the
+ ** engine works close to its budget.
+ **/
+#define MEMGOV_HYSTERESIS 3
+
+/** Current memory usage accounted by the governor. */
+#define MEMGOV_USED(ctx) \
+  ((ctx)->memgov.inst_used + (ctx)->memgov.event_used)
+
+/** Charge sz bytes of state instance/environment memory to a rule instance. */
+#define MEMGOV_CHARGE(ctx, ri, sz)              \
+  do {                                          \
+    (ri)->mem_used += (sz);                     \
+    (ri)->rule->mem_used += (sz);               \
+    (ctx)->memgov.inst_used += (sz);            \
+  } while (0)
+
+/** Release sz bytes previously charged with MEMGOV_CHARGE(). */
+#define MEMGOV_RELEASE(ctx, ri, sz)             \
+  do {                                          \
+    (ri)->mem_used -= (sz);                     \
+    (ri)->rule->mem_used -= (sz);               \
+    (ctx)->memgov.inst_used -= (sz);            \
+  } while (0)
+
+
+/**
+ ** Per-rule settings read from the configuration file.
+ **/
+typedef struct memgov_rule_cfg_s memgov_rule_cfg_t;
+struct memgov_rule_cfg_s
+{
+  char    *name;
+  int32_t  priority;
+  size_t   mem_limit;
+};
+
+
+/**
+ ** Estimate the memory footprint of an ISSDL value.
+ ** Virtual strings only count their header, since they point into the
+ ** data of another value.
+ **
+ ** @param var  The value.
+ ** @return The estimated size in bytes.
+ **/
+size_t
+memgov_var_size(ovm_var_t *var);
+
+
+/**
+ ** Estimate the memory footprint of an event (field list and values).
+ **
+ ** @param event  The event.
+ ** @return The estimated size in bytes.
+ **/
+size_t
+memgov_event_size(event_t *event);
+
+
+/**
+ ** Account a state instance reference to an active event.  The event
+ ** size is computed on the first reference and charged to the rule
+ ** instance (rule_instance_s::mem_events) and to its rule.
+ **
+ ** @param ctx    Orchids application context.
+ ** @param ri     The rule instance retaining the event.
+ ** @param event  The active event record.
+ **/
+void
+memgov_ref_event(orchids_t *ctx, rule_instance_t *ri, active_event_t *event);
+
+
+/**
+ ** Account an event that becomes retained (linked into the active
+ ** event list).
+ **
+ ** @param ctx    Orchids application context.
+ ** @param event  The active event record.
+ **/
+void
+memgov_retain_event(orchids_t *ctx, active_event_t *event);
+
+
+/**
+ ** Release the memory of a retained event that is being freed.
+ **
+ ** @param ctx    Orchids application context.
+ ** @param event  The active event record.
+ **/
+void
+memgov_release_event(orchids_t *ctx, active_event_t *event);
+
+
+/**
+ ** Release all memory accounted to a rule instance that is being freed.
+ **
+ ** @param ctx  Orchids application context.
+ ** @param ri   The rule instance.
+ **/
+void
+memgov_release_rule_instance(orchids_t *ctx, rule_instance_t *ri);
+
+
+/**
+ ** Check memory usage against the global and per-rule budgets, and
+ ** evict rule instances according to the eviction policy if they are
+ ** exceeded.  This must be called between two event injections.
+ **
+ ** @param ctx  Orchids application context.
+ **/
+void
+memgov_check(orchids_t *ctx);
+
+
+/**
+ ** Load shedding: drop an incoming event if the memory usage is still
+ ** over the hard limit after eviction.
+ **
+ ** @param ctx     Orchids application context.
+ ** @param sender  The module which posted the event.
+ ** @param event   The event.  It is freed if it is shed.
+ ** @return TRUE if the event was shed, FALSE otherwise.
+ **/
+int
+memgov_shed_event(orchids_t *ctx, mod_entry_t *sender, event_t *event);
+
+
+/**
+ ** Record per-rule settings (from the RulePriority and RuleMemoryLimit
+ ** configuration directives).
+ **
+ ** @param ctx  Orchids application context.
+ ** @param name The rule name.
+ ** @return The (possibly newly created) settings record for this rule.
+ **/
+memgov_rule_cfg_t *
+memgov_get_rule_cfg(orchids_t *ctx, char *name);
+
+
+/**
+ ** Bind per-rule settings to the compiled rules.
+ ** Called after rule compilation.
+ **
+ ** @param ctx  Orchids application context.
+ **/
+void
+memgov_bind_rules(orchids_t *ctx);
+
+
+/**
+ ** Parse a memory size, with an optional k, M or G suffix.
+ **
+ ** @param str   The string to parse.
+ ** @param size  The result.
+ ** @return RETURN_SUCCESS or a negative value if the string is invalid.
+ **/
+int
+memgov_parse_size(const char *str, size_t *size);
+
+
+/**
+ ** Display memory governor statistics and per-rule memory usage.
+ **
+ ** @param fp   The output stream.
+ ** @param ctx  Orchids application context.
+ **/
+void
+fprintf_memgov_stats(FILE *fp, const orchids_t *ctx);
+
+
+#endif /* MEM_GOVERNOR_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -0,0 +1,287 @@
+/**
+ ** @file audisp_replay.c
+ ** Replay recorded audispd binary streams, for testing the audisp
+ ** input of mod_auditd (AddAudispInput directive).
+ **
+ ** A stream is recorded by running an audispd plugin that copies its
+ ** standard input to a file, with format = binary, e.g.
+ **   path = /bin/sh
+ **   args = -c "cat >> /var/tmp/audisp.rec"
+ **
+ ** Usage: audisp_replay [-s socket] [-r records/s] [-n loops] file...
+ **
+ ** The records are written to the standard output (to be piped to an
+ ** "AddAudispInput -" or written to a fifo), or, with -s, to the
+ ** client connecting to a unix stream socket created at the given
+ ** path, as the af_unix audispd plugin does.  Without -r, the records
+ ** are written as fast as possible, in large batches.
+ **
+ ** @version 0.1
+ ** @ingroup modules
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Same layout as struct audit_dispatcher_header in libaudit.h */
+struct audisp_header {
+  uint32_t ver;
+  uint32_t hlen;
+  uint32_t type;
+  uint32_t size;
+};
+
+#define REPLAY_BUFFER_SIZE 65536
+#define REPLAY_MAX_RECORD  (sizeof (struct audisp_header) + 8970)
+
+
+static void
+usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-s socket] [-r records/s] [-n loops] file...\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+
+static int
+write_all(int fd, const char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue ;
+    if (n <= 0)
+      return (-1);
+    buf += n;
+    len -= n;
+  }
+
+  return (0);
+}
+
+
+static int
+listen_socket(const char *path)
+{
+  struct sockaddr_un sunx;
+  int sd;
+  int fd;
+
+  sd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sd < 0) {
+    perror("socket");
+    exit(EXIT_FAILURE);
+  }
+  unlink(path);
+  memset(&sunx, 0, sizeof (sunx));
+  sunx.sun_family = AF_UNIX;
+  strncpy(sunx.sun_path, path, sizeof (sunx.sun_path) - 1);
+  if (bind(sd, (struct sockaddr *)&sunx, SUN_LEN(&sunx)) < 0
+      || listen(sd, 1) < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stderr, "waiting for a client on %s\n", path);
+  fd = accept(sd, NULL, NULL);
+  if (fd < 0) {
+    perror("accept");
+    exit(EXIT_FAILURE);
+  }
+  close(sd);
+  unlink(path);
+
+  return (fd);
+}
+
+
+/**
+ ** Replay one recorded stream.  Records are checked and written in
+ ** batches of whole records; with a rate, one record at a time.
+ ** @return The number of records written, or -1 on error.
+ **/
+static long
+replay_file(const char *path, int out, long rate)
+{
+  struct audisp_header hdr;
+  struct timespec pause;
+  char *buf;
+  size_t len;
+  size_t off;
+  size_t rec;
+  ssize_t n;
+  long records;
+  FILE *fp;
+
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return (-1);
+  }
+
+  if (rate > 0) {
+    pause.tv_sec = 0;
+    pause.tv_nsec = 1000000000L / rate;
+    if (rate == 1) {
+      pause.tv_sec = 1;
+      pause.tv_nsec = 0;
+    }
+  }
+
+  buf = malloc(REPLAY_BUFFER_SIZE);
+  records = 0;
+  len = 0;
+  while ((n = fread(buf + len, 1, REPLAY_BUFFER_SIZE - len, fp)) > 0) {
+    len += n;
+    for (off = 0; len - off >= sizeof (hdr); off += rec) {
+      memcpy(&hdr, buf + off, sizeof (hdr));
+      rec = (size_t)hdr.hlen + hdr.size;
+      if (hdr.hlen < sizeof (hdr) || hdr.hlen > REPLAY_MAX_RECORD
+          || rec > REPLAY_MAX_RECORD) {
+        fprintf(stderr, "%s: bad record header at record %li\n",
+                path, records);
+        free(buf);
+        fclose(fp);
+        return (-1);
+      }
+      if (len - off < rec)
+        break ;
+      records++;
+      if (rate > 0) {
+        if (write_all(out, buf + off, rec) < 0)
+          goto write_error;
+        nanosleep(&pause, NULL);
+      }
+    }
+    if (rate <= 0 && off > 0 && write_all(out, buf, off) < 0)
+      goto write_error;
+    len -= off;
+    memmove(buf, buf + off, len);
+  }
+  if (len > 0)
+    fprintf(stderr, "%s: %lu trailing bytes ignored\n",
+            path, (unsigned long)len);
+
+  free(buf);
+  fclose(fp);
+  return (records);
+
+ write_error:
+  perror("write");
+  free(buf);
+  fclose(fp);
+  return (-1);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  char *sock;
+  long rate;
+  long loops;
+  long records;
+  long total;
+  int out;
+  int opt;
+  int i;
+
+  sock = NULL;
+  rate = 0;
+  loops = 1;
+  while ((opt = getopt(argc, argv, "s:r:n:")) != -1) {
+    switch (opt) {
+    case 's':
+      sock = optarg;
+      break ;
+    case 'r':
+      rate = atol(optarg);
+      break ;
+    case 'n':
+      loops = atol(optarg);
+      break ;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind >= argc)
+    usage(argv[0]);
+
+  signal(SIGPIPE, SIG_IGN);
+  out = sock ? listen_socket(sock) : STDOUT_FILENO;
+
+  total = 0;
+  for ( ; loops > 0; loops--) {
+    for (i = optind; i < argc; i++) {
+      records = replay_file(argv[i], out, rate);
+      if (records < 0)
+        exit(EXIT_FAILURE);
+      total += records;
+    }
+  }
+  fprintf(stderr, "%li records replayed\n", total);
+
+  if (sock)
+    close(out);
+
+  return (0);
+}
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -76,6 +76,13 @@ static htmloutput_list_t **htmloutput_list_tail_g = NULL;
 static char *report_prefix_g;
 static char *report_ext_g;
 
+/* Engine activity at the last regeneration */
+static timeval_t regen_rule_act_g;
+static timeval_t regen_ruleinst_act_g;
+static timeval_t regen_evt_act_g;
+static uint32_t regen_reports_g;
+static time_t regen_date_g = 0;
+
 
 void
 html_output_add_menu_entry(orchids_t *ctx,
@@ -116,15 +123,33 @@ rtaction_html_cache_cleanup(orchids_t *ctx, rtaction_t *e)
 }
 
 
+/**
+ ** Return TRUE if rules, rule instances, active events or reports
+ ** changed since the last regeneration.
+ **/
+static int
+html_output_dirty(orchids_t *ctx)
+{
+  return (timercmp(&ctx->last_rule_act, &regen_rule_act_g, !=)
+          || timercmp(&ctx->last_ruleinst_act, &regen_ruleinst_act_g, !=)
+          || timercmp(&ctx->last_evt_act, &regen_evt_act_g, !=)
+          || ctx->reports != regen_reports_g);
+}
+
+
 int
 rtaction_html_regeneration(orchids_t *ctx, rtaction_t *e)
 {
-  DebugLog(DF_MOD, DS_TRACE,
-           "HTML periodic regeneration...\n");
+  html_output_cfg_t *cfg = e->data;
 
-  html_output(ctx, e->data);
+  if (html_output_dirty(ctx)
+      || ctx->cur_loop_time.tv_sec - regen_date_g >= HTMLSTATE_FORCE_PERIOD) {
+    DebugLog(DF_MOD, DS_TRACE,
+             "HTML periodic regeneration...\n");
+    html_output(ctx, cfg);
+  }
 
-  e->date.tv_sec += 20; /* XXX: use a customizable parameter */
+  e->date.tv_sec += cfg->page_generation_delay;
 
   register_rtaction(ctx, e);
 
@@ -167,6 +192,12 @@ html_output(orchids_t *ctx, html_output_cfg_t *cfg)
    * So, the child process can access to its parent rusage. */
   getrusage(RUSAGE_SELF, &ctx->ru);
 
+  regen_rule_act_g = ctx->last_rule_act;
+  regen_ruleinst_act_g = ctx->last_ruleinst_act;
+  regen_evt_act_g = ctx->last_evt_act;
+  regen_reports_g = ctx->reports;
+  regen_date_g = ctx->cur_loop_time.tv_sec;
+
 #ifdef ORCHIDS_DEBUG
 
   do_html_output(ctx, cfg);
@@ -541,6 +572,49 @@ generate_html_orchids_datatypes(orchids_t *ctx, html_output_cfg_t  *cfg)
 }
 
 
+static void
+fprintf_html_input_queues(FILE *fp, orchids_t *ctx)
+{
+  int i;
+  int p;
+  input_queue_t *q;
+  static const char *policy_str[] = { "drop-newest", "drop-oldest", "sample" };
+
+  fprintf(fp, "<center>\n");
+  fprintf(fp, "<table border=\"0\" cellpadding=\"3\" width=\"600\">\n");
+  fprintf(fp,
+          "  <tr class=\"h\"> <th colspan=\"6\"> Input modules </th> </tr>\n");
+  fprintf(fp,
+          "  <tr class=\"hh\"> <th> Module </th> <th> Posts </th> "
+          "<th> Accepted </th> <th> Dropped </th> <th> Queued </th> "
+          "<th> Policy </th> </tr>\n\n");
+
+  for (i = 0; i < ctx->loaded_modules; i++) {
+    p = i % 2;
+    q = ctx->mods[i].queue;
+    if (q == NULL) {
+      fprintf(fp,
+              "  <tr> <td class=\"e%i\"> %s </td> <td class=\"v%i\"> %lu </td> "
+              "<td class=\"v%i\" colspan=\"4\"> no queue </td> </tr>\n",
+              p, ctx->mods[i].mod->name, p, ctx->mods[i].posts, p);
+      continue ;
+    }
+    fprintf(fp,
+            "  <tr> <td class=\"e%i\"> %s </td> <td class=\"v%i\"> %lu </td> "
+            "<td class=\"v%i\"> %lu </td> <td class=\"v%i\"> %lu </td> "
+            "<td class=\"v%i\"> %zu/%zu (max %zu) </td> "
+            "<td class=\"v%i\"> %s </td> </tr>\n",
+            p, ctx->mods[i].mod->name, p, ctx->mods[i].posts,
+            p, q->accepted, p, q->dropped,
+            p, q->count, q->size, q->high_water,
+            p, policy_str[q->policy]);
+  }
+
+  fprintf(fp, "</table>\n");
+  fprintf(fp, "</center>\n");
+}
+
+
 static void
 generate_html_orchids_stats(orchids_t *ctx, html_output_cfg_t  *cfg)
 {
@@ -749,6 +823,8 @@ generate_html_orchids_stats(orchids_t *ctx, html_output_cfg_t  *cfg)
   fprintf(fp, "</table>\n");
   fprintf(fp, "</center>\n");
 
+  fprintf_html_input_queues(fp, ctx);
+
   fprintf_html_trailer(fp);
   Xfclose(fp);
 
@@ -1140,8 +1216,59 @@ generate_html_rules(orchids_t *ctx, html_output_cfg_t  *cfg)
 }
 
 
+/**
+ ** Read the date of the last complete regeneration: the pages of
+ ** rule instances inactive since then are up to date.
+ **/
 static void
-generate_html_rule_instances(orchids_t *ctx, html_output_cfg_t  *cfg)
+read_regen_stamp(html_output_cfg_t *cfg, struct timeval *since)
+{
+  char path[PATH_MAX];
+  FILE *fp;
+  long sec;
+  long usec;
+
+  since->tv_sec = 0;
+  since->tv_usec = 0;
+  if (snprintf(path, sizeof (path), "%s/rule-insts/" HTMLSTATE_REGEN_STAMP,
+               cfg->html_output_dir) >= (int) sizeof (path))
+    return ;
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return ;
+  if (fscanf(fp, "%li.%li", &sec, &usec) == 2) {
+    since->tv_sec = sec;
+    since->tv_usec = usec;
+  }
+  fclose(fp);
+}
+
+
+static void
+write_regen_stamp(html_output_cfg_t *cfg, const struct timeval *date)
+{
+  char path[PATH_MAX];
+  FILE *fp;
+
+  if (snprintf(path, sizeof (path), "%s/rule-insts/" HTMLSTATE_REGEN_STAMP,
+               cfg->html_output_dir) >= (int) sizeof (path))
+    return ;
+  fp = fopen(path, "w");
+  if (fp == NULL)
+    return ;
+  fprintf(fp, "%li.%06li\n", (long) date->tv_sec, (long) date->tv_usec);
+  fclose(fp);
+}
+
+
+/**
+ ** Generate the pages of the rule instances active since the last
+ ** complete regeneration, within the time budget.
+ ** @return TRUE if all pages were generated.
+ **/
+static int
+generate_html_rule_instances(orchids_t *ctx, html_output_cfg_t  *cfg,
+                             const struct timeval *since)
 {
   FILE *fp;
   int i;
@@ -1152,13 +1279,27 @@ generate_html_rule_instances(orchids_t *ctx, html_output_cfg_t  *cfg)
   char basefile[PATH_MAX];
   char cmdline[2048];
   unsigned long ntpch, ntpcl, ntpah, ntpal;
+  struct timeval start;
+  struct timeval now;
 
   if (ctx->first_rule_instance == NULL) {
-    return ;
+    return (TRUE);
   }
 
+  gettimeofday(&start, NULL);
+  Xrealpath(cfg->html_output_dir, absolute_dir);
   for (r = ctx->first_rule_instance, i = 0; r; r = r->next, i++) {
-    Xrealpath(cfg->html_output_dir, absolute_dir);
+    if (timercmp(&r->new_last_act, since, <))
+      continue ;
+    if (cfg->time_budget > 0) {
+      gettimeofday(&now, NULL);
+      if (now.tv_sec - start.tv_sec >= cfg->time_budget) {
+        DebugLog(DF_MOD, DS_NOTICE,
+                 "HTML time budget exceeded, rule instance pages "
+                 "left for the next regeneration\n");
+        return (FALSE);
+      }
+    }
     Timer_to_NTP(&r->new_creation_date, ntpch, ntpcl);
     Timer_to_NTP(&r->new_last_act, ntpah, ntpal);
     snprintf(basefile, sizeof (basefile),
@@ -1241,6 +1382,8 @@ generate_html_rule_instances(orchids_t *ctx, html_output_cfg_t  *cfg)
     Xfclose(fp);
     }
   }
+
+  return (TRUE);
 }
 
 
@@ -2006,6 +2149,7 @@ do_html_output(orchids_t *ctx, html_output_cfg_t  *cfg)
 {
   int fd;
   int ret;
+  struct timeval since;
 
   /* Acquire lock or return */
   fd = Xopen(DEFAULT_OUTPUTHTML_LOCKFILE, O_RDWR|O_CREAT, S_IRUSR|S_IWUSR);
@@ -2028,7 +2172,9 @@ do_html_output(orchids_t *ctx, html_output_cfg_t  *cfg)
   generate_html_orchids_datatypes(ctx, cfg);
   generate_html_rules(ctx, cfg);
   generate_html_rule_list(ctx, cfg);
-  generate_html_rule_instances(ctx, cfg);
+  read_regen_stamp(cfg, &since);
+  if (generate_html_rule_instances(ctx, cfg, &since))
+    write_regen_stamp(cfg, &ctx->cur_loop_time);
   generate_html_rule_instance_list(ctx,cfg);
   generate_html_thread_queue(ctx, cfg);
   generate_html_events(ctx, cfg);
@@ -2057,6 +2203,18 @@ convert_filename(char *file)
 }
 
 
+static void
+unlink_regen_stamp(const char *base_dir)
+{
+  char path[PATH_MAX];
+
+  if (snprintf(path, sizeof (path), "%s/rule-insts/" HTMLSTATE_REGEN_STAMP,
+               base_dir) >= (int) sizeof (path))
+    return ;
+  unlink(path);
+}
+
+
 void
 html_output_cache_cleanup(html_output_cfg_t  *cfg)
 {
@@ -2077,6 +2235,8 @@ html_output_cache_cleanup(html_output_cfg_t  *cfg)
 
   snprintf(dir, sizeof (dir), "%s/rule-insts/", base_dir);
   cache_gc(dir, "orchids-ruleinst-",     50000, 100 * 1024 * 1024, 48 * 3600);
+  /* pages of inactive instances may be gone: check them all */
+  unlink_regen_stamp(base_dir);
 
   cache_gc(base_dir, "orchids-thread-queue-", 4, 100 * 1024, 48 * 3600);
   cache_gc(base_dir, "orchids-events-", 4, 10 * 1024 * 1024, 48 * 3600);
@@ -2104,6 +2264,7 @@ html_output_cache_flush(html_output_cfg_t  *cfg)
 
   snprintf(dir, sizeof (dir), "%s/rule-insts/", base_dir);
   cache_gc(dir, "orchids-ruleinst-", 0, 0, 0);
+  unlink_regen_stamp(base_dir);
 
   cache_gc(base_dir, "orchids-thread-queue-", 0, 0, 0);
   cache_gc(base_dir, "orchids-events-", 0, 0, 0);
@@ -51,6 +51,18 @@
 
 #define HTMLSTATE_STATE_LIMIT 50
 
+/* Default period of the regeneration, in seconds.  When the engine
+ * didn't change, the pages are only regenerated every
+ * HTMLSTATE_FORCE_PERIOD seconds (for the statistics). */
+#define HTMLSTATE_REGEN_PERIOD 20
+#define HTMLSTATE_FORCE_PERIOD 300
+
+/* Default time budget of a regeneration, in seconds */
+#define HTMLSTATE_TIME_BUDGET 10
+
+/* Date of the last complete regeneration, in rule-insts/ */
+#define HTMLSTATE_REGEN_STAMP "orchids-regen-stamp"
+
 typedef struct html_output_cfg_s html_output_cfg_t;
 
 typedef int (*mod_htmloutput_t)(orchids_t *ctx,
@@ -82,6 +94,7 @@ struct html_output_cfg_s
   int rule_instence_state_limit;
   int thread_limit;
   int event_limit;
+  int time_budget; /* seconds, 0 for none */
 
   char* html_output_dir;
 
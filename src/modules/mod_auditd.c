@@ -23,23 +23,24 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <math.h>
 
-#ifdef OBSOLETE
 #include <libaudit.h>
 #include <sys/socket.h>
 #include <sys/un.h>
-#endif
-
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stddef.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
 
 #include "orchids.h"
+#include "evt_mgr.h"
 
 #include "orchids_api.h"
+#include "timestamp.h"
 
 #include "mod_auditd.h"
 
@@ -95,6 +96,7 @@ static struct action actions[] = {
   { "ogid=", F_AUDITD_OGID, ACTION_INT },
   { "rdev=",  F_AUDITD_RDEV, ACTION_DEV },
   { "cwd=", F_AUDITD_CWD, ACTION_STRING },
+  { "proctitle=", F_AUDITD_PROCTITLE, ACTION_STRING },
   { NULL, 0 }
 };
 
@@ -114,9 +116,41 @@ struct action_tree {
 struct action_orchids_ctx {
   orchids_t *ctx;
   mod_entry_t *mod;
-  event_t *event;
+  event_arena_t *arena; /* arena of the record event */
+  ovm_var_t **attr; /* fields of the record, AUDITD_FIELDS entries */
+  int path; /* item number, in PATH records */
+  int aggregate; /* records are aggregated (AggregateRecords) */
 };
-#define FILL_EVENT(octx, attr,n,len) add_fields_to_event_stride(octx->ctx, octx->mod, &octx->event, (attr), n, n+len)
+
+/* Store the values of fields n to n+len-1.  When records are
+   aggregated, fields of PATH records go to the slots of their item
+   number.  Values of fields already set (or of items beyond
+   AUDITD_MAX_PATHS) are dropped. */
+static void
+fill_attr (struct action_orchids_ctx *octx, ovm_var_t **attr, int n, int len)
+{
+  int i, id;
+
+  for (i=0; i<len; i++, n++)
+    {
+      id = n;
+      if (octx->aggregate && n>=F_AUDITD_ITEM && n<=F_AUDITD_RDEV)
+	{
+	  if (n==F_AUDITD_ITEM)
+	    octx->path = INT(attr[i]);
+	  if (octx->path<0 || octx->path>=AUDITD_MAX_PATHS)
+	    id = -1;
+	  else if (octx->path>0)
+	    id = F_AUDITD_PATHS + (octx->path-1)*AUDITD_PATH_FIELDS
+	      + n - F_AUDITD_ITEM;
+	}
+      if (id<0 || octx->attr[id]!=NULL)
+	FREE_VAR(attr[i]);
+      else
+	octx->attr[id] = attr[i];
+    }
+}
+#define FILL_EVENT(octx, attr,n,len) fill_attr(octx, (attr), n, len)
 
 struct action_ctx {
   struct action_tree *tree;
@@ -229,16 +263,12 @@ char *action_atoi_signed (char *s, int *ip)
 char *time_convert(char *str, struct timeval *tv)
 {
   char c, *s;
-  double secs, floor_part;
 
-  secs = strtod(str,&s);
+  s = (char *) ts_parse_epoch(str, tv);
   c = *s;
   if (c==':' || c==')')
     {
       *s++ = '\0';
-      floor_part = floor(secs);
-      tv->tv_sec = floor_part;
-      tv->tv_usec = 1000000.0 * (secs - floor_part);
       return s;
     }
   else return s-1;
@@ -263,11 +293,11 @@ char *action_doer_audit (struct action_ctx *actx, char *s,
       t = action_atoi_unsigned (t+1, &serial);
       if (*t==')') t++;
     }
-  attr[0] = ovm_timeval_new();
+  attr[0] = ovm_timeval_new_arena(octx->arena);
   TIMEVAL(attr[0]) = time;
-  attr[0]->flags = TYPE_MONO;
+  attr[0]->flags |= TYPE_MONO;
 
-  attr[1] = ovm_int_new();
+  attr[1] = ovm_int_new_arena(octx->arena);
   INT(attr[1]) = serial;
   attr[1]->flags |= TYPE_MONO;
 
@@ -283,7 +313,7 @@ char *action_doer_int (struct action_ctx *actx, char *s,
   char *t;
 
   t = action_atoi_signed (s, &i);
-  v = ovm_int_new();
+  v = ovm_int_new_arena(octx->arena);
   INT(v) = i;
   FILL_EVENT(octx, &v, n, 1);
   return t;
@@ -297,7 +327,7 @@ char *action_doer_unsigned_int (struct action_ctx *actx, char *s,
   char *t;
 
   t = action_atoi_unsigned (s, &i);
-  v = ovm_int_new();
+  v = ovm_int_new_arena(octx->arena);
   INT(v) = i;
   FILL_EVENT(octx, &v, n, 1);
   return t;
@@ -311,7 +341,7 @@ char *action_doer_hex (struct action_ctx *actx, char *s,
   char *t;
 
   t = action_atoi_hex (s, &i);
-  v = ovm_int_new();
+  v = ovm_int_new_arena(octx->arena);
   INT(v) = i;
   FILL_EVENT(octx, &v, n, 1);
   return t;
@@ -340,7 +370,7 @@ char *action_doer_dev (struct action_ctx *actx, char *s,
     }
   i = (major << 6) | minor;
   t = action_atoi_unsigned (s, &i);
-  v = ovm_int_new();
+  v = ovm_int_new_arena(octx->arena);
   INT(v) = i;
   FILL_EVENT(octx, &v, n, 1);
   return t;
@@ -354,7 +384,7 @@ char *action_doer_id (struct action_ctx *actx, char *s,
   char c, *t;
   ovm_var_t *v;
 
-  v = ovm_vstr_new();
+  v = ovm_vstr_new_arena(octx->arena);
   VSTR(v) = s;
   for (t=s; c = *t, c!=0 && !isspace (c); t++);
   VSTRLEN(v) = t-s;
@@ -374,7 +404,7 @@ char *action_doer_string (struct action_ctx *actx, char *s,
   if (*s != '"')
     return action_doer_id (actx, s, octx, n);
   to = s++;
-  v = ovm_vstr_new();
+  v = ovm_vstr_new_arena(octx->arena);
   VSTR(v) = to;
   while (1)
     {
@@ -503,27 +533,525 @@ void action_parse_event (struct action_ctx *actx, char *data,
 
 
 
+/* Post the aggregated event of an audit serial and free its slot. */
+static void
+flush_group(orchids_t *ctx, mod_entry_t *mod, auditd_cfg_t *cfg,
+	    auditd_group_t *g)
+{
+  event_t *event;
+  ovm_var_t *attr[AUDITD_FIELDS];
+
+  DebugLog(DF_MOD, DS_TRACE, "auditd: posting serial %i (%i records)\n",
+	   g->serial, g->records);
+
+  event = g->event;
+  memcpy(attr, g->attr, sizeof (attr));
+  attr[F_AUDITD_RECORDS] = ovm_int_new_arena(event_arena(ctx, event));
+  INT(attr[F_AUDITD_RECORDS]) = g->records;
+  g->serial = 0;
+  g->event = NULL;
+  memset(g->attr, 0, sizeof (g->attr));
+
+  cfg->events++;
+  add_fields_to_event(ctx, mod, &event, attr, AUDITD_FIELDS);
+  post_event(ctx, mod, event);
+}
+
+/* Post the aggregated events of all the serials, at the end of the
+   input. */
+static void
+flush_all_groups(orchids_t *ctx, mod_entry_t *mod, auditd_cfg_t *cfg)
+{
+  int i;
+
+  if (cfg->groups==NULL)
+    return;
+  for (i=0; i<cfg->reorder_sz; i++)
+    if (cfg->groups[i].serial!=0)
+      flush_group(ctx, mod, cfg, &cfg->groups[i]);
+}
+
+/* Post the audit events still being aggregated, e.g. before
+   mod_textfile exits after reading all of its files.  Called by
+   call_mod_func(). */
+int
+mod_auditd_flush(orchids_t *ctx, mod_entry_t *mod, void *params)
+{
+  flush_all_groups(ctx, mod, mod->config);
+
+  return (0);
+}
+
+/* Same, at exit, for the other ways an offline run ends.  In the main
+   process only: forked children exit too. */
+static orchids_t *auditd_ctx_g = NULL;
+static mod_entry_t *auditd_mod_g = NULL;
+static pid_t auditd_pid_g;
+
+static void
+auditd_atexit(void)
+{
+  if (auditd_ctx_g==NULL || getpid()!=auditd_pid_g)
+    return;
+  flush_all_groups(auditd_ctx_g, auditd_mod_g, auditd_mod_g->config);
+}
+
+/* Add a record to the aggregated event of its serial.  The record
+   event is kept (its fields point into its text) and appended to the
+   aggregated event. */
+static void
+aggregate_record(orchids_t *ctx, mod_entry_t *mod, auditd_cfg_t *cfg,
+		 event_t *event, ovm_var_t **attr)
+{
+  auditd_group_t *g, *o, *oldest;
+  struct timeval time;
+  int serial, eoe, i;
+
+  serial = INT(attr[F_AUDITD_SERIAL]);
+  eoe = attr[F_AUDITD_TYPE]!=NULL && VSTRLEN(attr[F_AUDITD_TYPE])==3
+    && !strncmp(VSTR(attr[F_AUDITD_TYPE]), "EOE", 3);
+  if (attr[F_AUDITD_TIME]!=NULL)
+    time = TIMEVAL(attr[F_AUDITD_TIME]);
+  else
+    time = ctx->cur_loop_time;
+
+  g = NULL;
+  for (i=0; i<cfg->reorder_sz; i++)
+    if (cfg->groups[i].serial==serial)
+      {
+	g = &cfg->groups[i];
+	break;
+      }
+
+  /* Audit events whose last record is long past never got their EOE */
+  for (i=0; i<cfg->reorder_sz; i++)
+    {
+      o = &cfg->groups[i];
+      if (o->serial!=0 && o!=g && o->time.tv_sec+cfg->timeout<time.tv_sec)
+	flush_group(ctx, mod, cfg, o);
+    }
+
+  if (g==NULL && eoe)
+    {
+      /* End of an audit event already posted: nothing to add */
+      free_fields(attr, AUDITD_FIELDS);
+      free_event(event);
+      return;
+    }
+
+  if (g==NULL)
+    {
+      oldest = NULL;
+      for (i=0; i<cfg->reorder_sz; i++)
+	{
+	  o = &cfg->groups[i];
+	  if (o->serial==0)
+	    {
+	      g = o;
+	      break;
+	    }
+	  if (oldest==NULL || o->seq<oldest->seq)
+	    oldest = o;
+	}
+      if (g==NULL)
+	{
+	  DebugLog(DF_MOD, DS_DEBUG, "auditd: reorder buffer full\n");
+	  flush_group(ctx, mod, cfg, oldest);
+	  g = oldest;
+	}
+      g->serial = serial;
+      g->seq = cfg->seq++;
+      g->arrival = ctx->cur_loop_time.tv_sec;
+      g->time = time;
+      g->records = 0;
+    }
+
+  for (i=0; i<AUDITD_FIELDS; i++)
+    {
+      if (attr[i]==NULL)
+	continue;
+      if (g->attr[i]==NULL)
+	g->attr[i] = attr[i];
+      else
+	FREE_VAR(attr[i]);
+    }
+  /* Records received later go first, so the engine sees the
+     textfile fields of the first record */
+  g->event = concat_events(event, g->event);
+  g->records++;
+
+  if (eoe)
+    flush_group(ctx, mod, cfg, g);
+}
+
+static int
+rtaction_auditd_flush(orchids_t *ctx, rtaction_t *e)
+{
+  mod_entry_t *mod = e->data;
+  auditd_cfg_t *cfg = mod->config;
+  auditd_group_t *g;
+  int i;
+
+  for (i=0; i<cfg->reorder_sz; i++)
+    {
+      g = &cfg->groups[i];
+      if (g->serial!=0 && g->arrival+cfg->timeout<=ctx->cur_loop_time.tv_sec)
+	flush_group(ctx, mod, cfg, g);
+    }
+
+  e->date = ctx->cur_loop_time;
+  e->date.tv_sec += 1;
+  register_rtaction(ctx, e);
+
+  return (0);
+}
+
+/* Post the fields of a record, or add them to the aggregated event
+   of its serial. */
+static void
+post_record(orchids_t *ctx, mod_entry_t *mod, auditd_cfg_t *cfg,
+	    event_t *event, ovm_var_t **attr)
+{
+  cfg->records++;
+  if (cfg->aggregate && attr[F_AUDITD_SERIAL]!=NULL
+      && INT(attr[F_AUDITD_SERIAL])!=0)
+    {
+      aggregate_record(ctx, mod, cfg, event, attr);
+      return;
+    }
+
+  /* then, post the Orchids event */
+  cfg->events++;
+  add_fields_to_event(ctx, mod, &event, attr, AUDITD_FIELDS);
+  post_event(ctx, mod, event);
+}
+
 static int
 dissect_auditd(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
 {
   char *txt_line;
-  int txt_len;
   auditd_cfg_t *cfg = mod->config; // (auditd_cfg_t *)data;
-  struct action_orchids_ctx octx = { ctx, mod, event };
+  ovm_var_t *attr[AUDITD_FIELDS];
+  struct action_orchids_ctx octx;
 
   DebugLog(DF_MOD, DS_TRACE, "auditd_callback()\n");
-  // memset(attr, 0, sizeof(attr));
+  memset(attr, 0, sizeof(attr));
 
   txt_line = STR(event->value);
   //printf("mod_auditd: %s\n", txt_line);
-  txt_len = STRLEN(event->value);
 
+  octx.ctx = ctx;
+  octx.mod = mod;
+  octx.arena = event_arena(ctx, event);
+  octx.attr = attr;
+  octx.path = 0;
+  octx.aggregate = cfg->aggregate;
   action_parse_event (cfg->actx, txt_line, &octx);
 
 //!!! missing dev, rdev
 
-  /* then, post the Orchids event */
-  post_event(ctx, mod, octx.event);
+  post_record(ctx, mod, cfg, event, attr);
+
+  return (0);
+}
+
+/********************************************************************************************/
+
+/* Names of the record types (from linux/audit.h), sorted by number */
+static struct audisp_type {
+  unsigned int type;
+  char *name;
+} audisp_types[] = {
+  { 1006, "LOGIN" },
+  { 1100, "USER_AUTH" },
+  { 1101, "USER_ACCT" },
+  { 1102, "USER_MGMT" },
+  { 1103, "CRED_ACQ" },
+  { 1104, "CRED_DISP" },
+  { 1105, "USER_START" },
+  { 1106, "USER_END" },
+  { 1107, "USER_AVC" },
+  { 1108, "USER_CHAUTHTOK" },
+  { 1109, "USER_ERR" },
+  { 1110, "CRED_REFR" },
+  { 1111, "USYS_CONFIG" },
+  { 1112, "USER_LOGIN" },
+  { 1113, "USER_LOGOUT" },
+  { 1114, "ADD_USER" },
+  { 1115, "DEL_USER" },
+  { 1116, "ADD_GROUP" },
+  { 1117, "DEL_GROUP" },
+  { 1118, "DAC_CHECK" },
+  { 1119, "CHGRP_ID" },
+  { 1120, "TEST" },
+  { 1121, "TRUSTED_APP" },
+  { 1122, "USER_SELINUX_ERR" },
+  { 1123, "USER_CMD" },
+  { 1124, "USER_TTY" },
+  { 1125, "CHUSER_ID" },
+  { 1126, "GRP_AUTH" },
+  { 1130, "SERVICE_START" },
+  { 1131, "SERVICE_STOP" },
+  { 1200, "DAEMON_START" },
+  { 1201, "DAEMON_END" },
+  { 1202, "DAEMON_ABORT" },
+  { 1203, "DAEMON_CONFIG" },
+  { 1204, "DAEMON_RECONFIG" },
+  { 1205, "DAEMON_ROTATE" },
+  { 1206, "DAEMON_RESUME" },
+  { 1207, "DAEMON_ACCEPT" },
+  { 1208, "DAEMON_CLOSE" },
+  { 1300, "SYSCALL" },
+  { 1302, "PATH" },
+  { 1303, "IPC" },
+  { 1304, "SOCKETCALL" },
+  { 1305, "CONFIG_CHANGE" },
+  { 1306, "SOCKADDR" },
+  { 1307, "CWD" },
+  { 1309, "EXECVE" },
+  { 1311, "IPC_SET_PERM" },
+  { 1312, "MQ_OPEN" },
+  { 1313, "MQ_SENDRECV" },
+  { 1314, "MQ_NOTIFY" },
+  { 1315, "MQ_GETSETATTR" },
+  { 1316, "KERNEL_OTHER" },
+  { 1317, "FD_PAIR" },
+  { 1318, "OBJ_PID" },
+  { 1319, "TTY" },
+  { 1320, "EOE" },
+  { 1321, "BPRM_FCAPS" },
+  { 1322, "CAPSET" },
+  { 1323, "MMAP" },
+  { 1324, "NETFILTER_PKT" },
+  { 1325, "NETFILTER_CFG" },
+  { 1326, "SECCOMP" },
+  { 1327, "PROCTITLE" },
+  { 1328, "FEATURE_CHANGE" },
+  { 1329, "REPLACE" },
+  { 1330, "KERN_MODULE" },
+  { 1331, "FANOTIFY" },
+  { 1400, "AVC" },
+  { 1401, "SELINUX_ERR" },
+  { 1402, "AVC_PATH" },
+  { 1403, "MAC_POLICY_LOAD" },
+  { 1404, "MAC_STATUS" },
+  { 1405, "MAC_CONFIG_CHANGE" },
+  { 1700, "ANOM_PROMISCUOUS" },
+  { 1701, "ANOM_ABEND" },
+  { 1702, "ANOM_LINK" },
+  { 1800, "INTEGRITY_DATA" },
+  { 1801, "INTEGRITY_METADATA" },
+  { 1802, "INTEGRITY_STATUS" },
+  { 1803, "INTEGRITY_HASH" },
+  { 1804, "INTEGRITY_PCR" },
+  { 1805, "INTEGRITY_RULE" },
+};
+
+/* The auditd.type value of a record type: its name, or UNKNOWN[type]
+   as auditd writes it. */
+static ovm_var_t *
+audisp_type_name(event_arena_t *arena, unsigned int type)
+{
+  ovm_var_t *v;
+  int lo, hi, mid;
+  char *s;
+
+  v = ovm_vstr_new_arena(arena);
+  v->flags |= TYPE_MONO;
+  lo = 0;
+  hi = sizeof (audisp_types) / sizeof (audisp_types[0]);
+  while (lo<hi)
+    {
+      mid = (lo+hi)/2;
+      if (audisp_types[mid].type==type)
+	{
+	  VSTR(v) = audisp_types[mid].name;
+	  VSTRLEN(v) = strlen(VSTR(v));
+	  return v;
+	}
+      if (audisp_types[mid].type<type)
+	lo = mid+1;
+      else
+	hi = mid;
+    }
+  s = event_arena_alloc(arena, 24);
+  VSTRLEN(v) = snprintf(s, 24, "UNKNOWN[%u]", type);
+  VSTR(v) = s;
+  return v;
+}
+
+/* Dissect one record of the audispd binary plugin protocol.  The type
+   comes from the header; the time and serial are decoded at their
+   fixed position, so that only the key=value body goes through the
+   keyword trie.  The record text is copied to the arena of the new
+   event: the parser cuts it into the string fields. */
+static void
+audisp_record(orchids_t *ctx, mod_entry_t *mod, auditd_cfg_t *cfg,
+	      unsigned int type, char *data, size_t len)
+{
+  ovm_var_t *attr[AUDITD_FIELDS];
+  struct action_orchids_ctx octx;
+  event_t *event;
+  char *body, *s;
+
+  memset(attr, 0, sizeof(attr));
+  while (len>0 && (data[len-1]=='\n' || data[len-1]=='\0'))
+    len--;
+
+  octx.ctx = ctx;
+  octx.mod = mod;
+  octx.arena = event_arena(ctx, NULL);
+  octx.attr = attr;
+  octx.path = 0;
+  octx.aggregate = cfg->aggregate;
+
+  attr[F_AUDITD_RECORD] = ovm_str_new_arena(octx.arena, len);
+  memcpy(STR(attr[F_AUDITD_RECORD]), data, len);
+  body = event_arena_alloc(octx.arena, len+1);
+  memcpy(body, data, len);
+  body[len] = '\0';
+
+  attr[F_AUDITD_TYPE] = audisp_type_name(octx.arena, type);
+
+  s = body;
+  if (len>6 && !memcmp(s, "audit(", 6))
+    {
+      s = action_doer_audit(cfg->actx, s+6, &octx, F_AUDITD_TIME);
+      if (*s==':')
+	s++;
+    }
+  action_parse_event (cfg->actx, s, &octx);
+
+  /* The record event holds the arena, hence the values of the record */
+  event = NULL;
+  add_fields_to_event_stride(ctx, mod, &event, &attr[F_AUDITD_RECORD],
+			     F_AUDITD_RECORD, F_AUDITD_RECORD+1);
+  attr[F_AUDITD_RECORD] = NULL;
+  post_record(ctx, mod, cfg, event, attr);
+}
+
+/* Connect to the unix socket of the af_unix audispd plugin, or open
+   a fifo or a recorded stream.  "-" is the standard input, e.g. when
+   Orchids is itself run as an audispd plugin. */
+static int
+audisp_open(audisp_input_t *in)
+{
+  struct sockaddr_un sunx;
+  struct stat st;
+  int fd;
+
+  if (!strcmp(in->path, "-"))
+    return 0;
+
+  if (stat(in->path, &st)==0 && S_ISSOCK(st.st_mode))
+    {
+      in->reopen = 1;
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fd<0)
+	return -1;
+      memset(&sunx, 0, sizeof(sunx));
+      sunx.sun_family = AF_UNIX;
+      strncpy(sunx.sun_path, in->path, sizeof(sunx.sun_path)-1);
+      if (connect(fd, (struct sockaddr *)&sunx, SUN_LEN(&sunx))<0)
+	{
+	  close(fd);
+	  return -1;
+	}
+      return fd;
+    }
+
+  if (stat(in->path, &st)==0 && S_ISFIFO(st.st_mode))
+    in->reopen = 1;
+  return open(in->path, O_RDONLY | O_NONBLOCK);
+}
+
+static int
+audisp_callback(orchids_t *ctx, mod_entry_t *mod, int fd, void *data);
+
+static int
+rtaction_audisp_reconnect(orchids_t *ctx, rtaction_t *e)
+{
+  audisp_input_t *in = e->data;
+
+  in->fd = audisp_open(in);
+  if (in->fd<0)
+    {
+      e->date = ctx->cur_loop_time;
+      e->date.tv_sec += AUDISP_RECONNECT;
+      register_rtaction(ctx, e);
+      return (0);
+    }
+  DebugLog(DF_MOD, DS_NOTICE, "auditd: reopened %s\n", in->path);
+  in->len = 0;
+  add_input_descriptor(ctx, in->mod, audisp_callback, in->fd, in);
+  Xfree(e);
+  return (0);
+}
+
+static void
+audisp_close(orchids_t *ctx, audisp_input_t *in)
+{
+  DebugLog(DF_MOD, DS_NOTICE, "auditd: end of %s\n", in->path);
+  del_input_descriptor(ctx, in->fd);
+  close(in->fd);
+  in->fd = -1;
+  if (in->reopen)
+    register_rtcallback(ctx, rtaction_audisp_reconnect, in,
+			AUDISP_RECONNECT);
+  else /* no more records will complete the audit events */
+    flush_all_groups(ctx, in->mod, in->mod->config);
+}
+
+/* Read as many records as fit in the buffer, and dissect the complete
+   ones.  A truncated record is kept for the next read. */
+static int
+audisp_callback(orchids_t *ctx, mod_entry_t *mod, int fd, void *data)
+{
+  audisp_input_t *in = data;
+  auditd_cfg_t *cfg = mod->config;
+  struct audit_dispatcher_header hdr;
+  ssize_t n;
+  size_t off;
+
+  DebugLog(DF_MOD, DS_TRACE, "audisp_callback()\n");
+
+  n = read(fd, in->buf + in->len, AUDISP_BUFFER_SIZE - in->len);
+  if (n<0 && (errno==EINTR || errno==EAGAIN))
+    return (0);
+  if (n<=0)
+    {
+      audisp_close(ctx, in);
+      return (0);
+    }
+  in->len += n;
+
+  for (off = 0; in->len - off >= sizeof (hdr);
+       off += (size_t)hdr.hlen + hdr.size)
+    {
+      memcpy(&hdr, in->buf + off, sizeof (hdr));
+      if (hdr.ver>AUDISP_MAX_VERSION || hdr.hlen<sizeof (hdr)
+	  || hdr.hlen>sizeof (hdr) + AUDISP_HEADER_SLACK
+	  || hdr.size>MAX_AUDIT_MESSAGE_LENGTH
+	  || (size_t)hdr.hlen + hdr.size>AUDISP_BUFFER_SIZE)
+	{
+	  /* Not the audisp binary protocol, or lost synchronization:
+	     nothing tells where the next record starts */
+	  DebugLog(DF_MOD, DS_ERROR,
+		   "auditd: bad audisp header in %s (ver=%u hlen=%u size=%u), "
+		   "dropping %lu bytes\n", in->path, hdr.ver, hdr.hlen,
+		   hdr.size, (unsigned long)(in->len - off));
+	  in->len = 0;
+	  return (0);
+	}
+      if (in->len - off < (size_t)hdr.hlen + hdr.size)
+	break;
+      audisp_record(ctx, mod, cfg, hdr.type,
+		    in->buf + off + hdr.hlen, hdr.size);
+    }
+
+  in->len -= off;
+  if (in->len>0 && off>0)
+    memmove(in->buf, in->buf + off, in->len);
 
   return (0);
 }
@@ -566,7 +1094,7 @@ static field_t auditd_fields[] = {
   {"auditd.subj",     T_VSTR,     "lspp subject's context string"       },
   {"auditd.key",      T_VSTR,     "tty interface"                       },
   {"auditd.item",     T_INT,      "file path: item"                     },
-  {"auditd.name",     T_INT,      "file path: name"                     },
+  {"auditd.name",     T_VSTR,     "file path: name"                     },
   {"auditd.inode",    T_INT,      "file path: inode"                    },
   {"auditd.mode",     T_INT,      "file path: mode"                     },
   {"auditd.dev",      T_INT,      "file path: device (major and minor)" },
@@ -574,10 +1102,112 @@ static field_t auditd_fields[] = {
   {"auditd.ogid",     T_INT,      "file path: originator gid"           },
   {"auditd.rdev",     T_INT,      "file path: real device (major, minor)" },
   {"auditd.cwd",      T_VSTR,     "file cwd: the current working directory" },
+  {"auditd.proctitle", T_VSTR,    "process title (hex encoded)"         },
+  {"auditd.records",  T_INT,      "number of aggregated records"        },
+  {"auditd.record",   T_STR,      "record text (audisp input)"          },
+  {"auditd.item1",      T_INT,      "path 1: item" },
+  {"auditd.name1",      T_VSTR,     "path 1: name" },
+  {"auditd.inode1",     T_INT,      "path 1: inode" },
+  {"auditd.mode1",      T_INT,      "path 1: mode" },
+  {"auditd.dev1",       T_INT,      "path 1: device (major and minor)" },
+  {"auditd.ouid1",      T_INT,      "path 1: originator uid" },
+  {"auditd.ogid1",      T_INT,      "path 1: originator gid" },
+  {"auditd.rdev1",      T_INT,      "path 1: real device (major, minor)" },
+  {"auditd.item2",      T_INT,      "path 2: item" },
+  {"auditd.name2",      T_VSTR,     "path 2: name" },
+  {"auditd.inode2",     T_INT,      "path 2: inode" },
+  {"auditd.mode2",      T_INT,      "path 2: mode" },
+  {"auditd.dev2",       T_INT,      "path 2: device (major and minor)" },
+  {"auditd.ouid2",      T_INT,      "path 2: originator uid" },
+  {"auditd.ogid2",      T_INT,      "path 2: originator gid" },
+  {"auditd.rdev2",      T_INT,      "path 2: real device (major, minor)" },
+  {"auditd.item3",      T_INT,      "path 3: item" },
+  {"auditd.name3",      T_VSTR,     "path 3: name" },
+  {"auditd.inode3",     T_INT,      "path 3: inode" },
+  {"auditd.mode3",      T_INT,      "path 3: mode" },
+  {"auditd.dev3",       T_INT,      "path 3: device (major and minor)" },
+  {"auditd.ouid3",      T_INT,      "path 3: originator uid" },
+  {"auditd.ogid3",      T_INT,      "path 3: originator gid" },
+  {"auditd.rdev3",      T_INT,      "path 3: real device (major, minor)" },
 };
 
 
 
+static void
+set_aggregate(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  DebugLog(DF_MOD, DS_INFO, "setting AggregateRecords to %s\n", dir->args);
+
+  ((auditd_cfg_t *)mod->config)->aggregate = atoi(dir->args) != 0;
+}
+
+static void
+set_reorder_buffer(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting ReorderBuffer to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 1)
+    value = 1;
+  ((auditd_cfg_t *)mod->config)->reorder_sz = value;
+}
+
+static void
+set_aggregate_timeout(orchids_t *ctx, mod_entry_t *mod,
+		      config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting AggregateTimeout to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 0)
+    value = 0;
+  ((auditd_cfg_t *)mod->config)->timeout = value;
+}
+
+static void
+add_audisp_input(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  audisp_input_t *in;
+
+  DebugLog(DF_MOD, DS_INFO, "Add audisp input [%s]\n", dir->args);
+
+  in = Xzmalloc(sizeof (audisp_input_t));
+  in->mod = mod;
+  in->path = dir->args;
+  in->buf = Xmalloc(AUDISP_BUFFER_SIZE);
+  in->fd = audisp_open(in);
+  if (in->fd<0)
+    {
+      if (!in->reopen)
+	{
+	  DebugLog(DF_MOD, DS_ERROR, "auditd: can't open %s: %s\n",
+		   in->path, strerror(errno));
+	  Xfree(in->buf);
+	  Xfree(in);
+	  return;
+	}
+      DebugLog(DF_MOD, DS_WARN, "auditd: can't connect to %s: %s\n",
+	       in->path, strerror(errno));
+      register_rtcallback(ctx, rtaction_audisp_reconnect, in,
+			  AUDISP_RECONNECT);
+      return;
+    }
+  add_input_descriptor(ctx, mod, audisp_callback, in->fd, in);
+}
+
+static mod_cfg_cmd_t auditd_dir[] =
+{
+  { "AggregateRecords", set_aggregate, "Post one event per audit serial" },
+  { "ReorderBuffer", set_reorder_buffer, "Max audit events being aggregated" },
+  { "AggregateTimeout", set_aggregate_timeout, "Post partial audit events after this many seconds" },
+  { "AddAudispInput", add_audisp_input, "Read the audispd binary protocol from a unix socket, a fifo, a file or - (stdin)" },
+  { NULL, NULL }
+};
+
 static void *
 auditd_preconfig(orchids_t *ctx, mod_entry_t *mod)
 {
@@ -591,9 +1221,33 @@ auditd_preconfig(orchids_t *ctx, mod_entry_t *mod)
   cfg->actx = Xmalloc(sizeof(struct action_ctx));
   memset(cfg->actx, 0, sizeof(struct action_ctx));
   action_init (cfg->actx);	
+  cfg->aggregate = 0;
+  cfg->reorder_sz = DEFAULT_AUDITD_REORDER;
+  cfg->timeout = DEFAULT_AUDITD_TIMEOUT;
+  cfg->seq = 0;
+  cfg->groups = NULL;
+  cfg->records = 0;
+  cfg->events = 0;
   return cfg;
 }
 
+static void
+auditd_postconfig(orchids_t *ctx, mod_entry_t *mod)
+{
+  auditd_cfg_t *cfg = mod->config;
+
+  if (!cfg->aggregate)
+    return;
+
+  cfg->groups = Xzmalloc(cfg->reorder_sz * sizeof (auditd_group_t));
+  register_rtcallback(ctx, rtaction_auditd_flush, mod, 1);
+
+  auditd_ctx_g = ctx;
+  auditd_mod_g = mod;
+  auditd_pid_g = getpid();
+  atexit(auditd_atexit);
+}
+
 
 input_module_t mod_auditd = {
   MOD_MAGIC,                /* Magic number */
@@ -601,9 +1255,9 @@ input_module_t mod_auditd = {
   "auditd",                 /* module name */
   "CeCILL2",                /* module license */
   NULL,
-  NULL,
+  auditd_dir,               /* config directives */
   auditd_preconfig,         /* called just after module registration */
-  NULL,
+  auditd_postconfig,        /* called after all modules are configured */
   NULL
 };
 
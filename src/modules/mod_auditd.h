@@ -80,11 +80,114 @@
 #define F_AUDITD_OGID      36
 #define F_AUDITD_RDEV      37
 #define F_AUDITD_CWD       38
+#define F_AUDITD_PROCTITLE 39
+#define F_AUDITD_RECORDS   40
+#define F_AUDITD_RECORD    41
+// Fields of the PATH records with item=1 to AUDITD_MAX_PATHS-1, in the
+// order of F_AUDITD_ITEM to F_AUDITD_RDEV
+#define F_AUDITD_PATHS     42
+
+#define AUDITD_PATH_FIELDS (F_AUDITD_RDEV - F_AUDITD_ITEM + 1)
+#define AUDITD_MAX_PATHS   4
+
+#define AUDITD_FIELDS (F_AUDITD_PATHS + (AUDITD_MAX_PATHS-1)*AUDITD_PATH_FIELDS)
+
+#define DEFAULT_AUDITD_REORDER 32
+#define DEFAULT_AUDITD_TIMEOUT 2
+
+// Read buffer of an audisp input: many records per read(), and room
+// for at least one record of maximal size
+#define AUDISP_BUFFER_SIZE  65536
+// Highest audisp protocol version understood; version 1 only differs
+// from version 0 by the meaning of the record types
+#define AUDISP_MAX_VERSION  1
+// Bytes a header of a later protocol version may add to
+// struct audit_dispatcher_header
+#define AUDISP_HEADER_SLACK 64
+// Seconds between two attempts to reopen an audisp socket or fifo
+#define AUDISP_RECONNECT    5
 
-#define AUDITD_FIELDS 39
+/**
+ ** @struct audisp_input_s
+ **   An input of records in the audispd binary plugin protocol: the
+ **   stream is a sequence of struct audit_dispatcher_header, each one
+ **   followed by the text of a record.
+ **/
+/**   @var audisp_input_s::mod
+ **     The auditd module entry.
+ **/
+/**   @var audisp_input_s::path
+ **     Unix socket, fifo or file name, or "-" for the standard input.
+ **/
+/**   @var audisp_input_s::fd
+ **     The file descriptor, -1 if disconnected.
+ **/
+/**   @var audisp_input_s::reopen
+ **     Non-zero if path is a unix socket or a fifo, reopened when
+ **     closed.
+ **/
+/**   @var audisp_input_s::len
+ **     Number of bytes in buf not dissected yet.
+ **/
+/**   @var audisp_input_s::buf
+ **     Read buffer, AUDISP_BUFFER_SIZE bytes.
+ **/
+typedef struct audisp_input_s audisp_input_t;
+struct audisp_input_s {
+  mod_entry_t *mod;
+  char *path;
+  int fd;
+  int reopen;
+  size_t len;
+  char *buf;
+};
+
+/**
+ ** @struct auditd_group_s
+ **   Records of one audit event (same serial) being aggregated.
+ **/
+/**   @var auditd_group_s::serial
+ **     Audit serial number, 0 if the slot is free.
+ **/
+/**   @var auditd_group_s::seq
+ **     Creation order of the group, to flush the oldest one first.
+ **/
+/**   @var auditd_group_s::arrival
+ **     Time the first record was received.
+ **/
+/**   @var auditd_group_s::time
+ **     Audit time of the first record.
+ **/
+/**   @var auditd_group_s::records
+ **     Number of records aggregated.
+ **/
+/**   @var auditd_group_s::event
+ **     The record events, the last received first.
+ **/
+/**   @var auditd_group_s::attr
+ **     Fields of the aggregated event, the first record setting a
+ **     field winning.
+ **/
+typedef struct auditd_group_s auditd_group_t;
+struct auditd_group_s {
+  int serial;
+  unsigned long seq;
+  time_t arrival;
+  struct timeval time;
+  int records;
+  event_t *event;
+  ovm_var_t *attr[AUDITD_FIELDS];
+};
 
 typedef struct auditd_cfg_s {
   struct action_ctx *actx; // internal context data used by auditd_callback()
+  int aggregate; // aggregate the records of an audit event in one event
+  int reorder_sz; // max number of audit events being aggregated
+  int timeout; // seconds after which a partial audit event is posted
+  unsigned long seq;
+  auditd_group_t *groups;
+  unsigned long records;
+  unsigned long events;
 } auditd_cfg_t;
 
 /***********************************************/
@@ -97,10 +200,11 @@ auditd_callback(orchids_t *ctx, mod_entry_t *mod, int sd, void *data);
 static void *
 auditd_preconfig(orchids_t *ctx, mod_entry_t *mod);
 
-#ifdef OBSOLETE
 static void
 auditd_postconfig(orchids_t *ctx, mod_entry_t *mod);
-#endif
+
+int
+mod_auditd_flush(orchids_t *ctx, mod_entry_t *mod, void *params);
 
 
 #endif /* MOD_AUDITD_H */
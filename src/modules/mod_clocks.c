@@ -332,7 +332,7 @@ clocks_htmloutput(orchids_t *ctx, mod_entry_t *mod, FILE *menufp, html_output_cf
   fprintf(fp, "<tr class=\"hh\"><th>Clock name</th><th>Precision</th><th>Synchronization</th></tr>\n");
 
   ctx_array = strhash_to_array(modcfg->clocks);
-  ctx_array_sz = modcfg->clocks->elmts;
+  ctx_array_sz = strhash_elmts(modcfg->clocks);
   qsort(ctx_array, ctx_array_sz, sizeof (myclock_t *), qsort_clockcmp);
 
   for (i = 0; i < ctx_array_sz; i++) {
@@ -45,6 +45,8 @@ htmlstate_preconfig(orchids_t *ctx, mod_entry_t *mod)
 
   mod_cfg->report_prefix = "report-";
   mod_cfg->report_ext = ".html";
+  mod_cfg->page_generation_delay = HTMLSTATE_REGEN_PERIOD;
+  mod_cfg->time_budget = HTMLSTATE_TIME_BUDGET;
 
   html_output_preconfig(ctx);
 
@@ -83,6 +85,44 @@ add_cache_params(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
   // XXX FIXME
 }
 
+static void
+set_page_generation_delay(orchids_t *ctx, mod_entry_t *mod,
+                          config_directive_t *dir)
+{
+  html_output_cfg_t *cfg;
+  int delay;
+
+  cfg = (html_output_cfg_t *)mod->config;
+  delay = atoi(dir->args);
+  if (delay <= 0) {
+    DebugLog(DF_MOD, DS_ERROR, "PageGenerationDelay must be positive\n");
+    return ;
+  }
+  cfg->page_generation_delay = delay;
+}
+
+static void
+set_time_budget(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  html_output_cfg_t *cfg;
+
+  cfg = (html_output_cfg_t *)mod->config;
+  cfg->time_budget = atoi(dir->args);
+  if (cfg->time_budget < 0)
+    cfg->time_budget = 0;
+}
+
+/**
+ ** Regenerate the pages at once (remoteadm 'htmloutput' command).
+ **/
+int
+mod_htmlstate_do_update(orchids_t *ctx, mod_entry_t *mod, void *params)
+{
+  html_output(ctx, mod->config);
+
+  return (0);
+}
+
 static void
 set_HTML_output_dir(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
 {
@@ -100,6 +140,8 @@ static mod_cfg_cmd_t htmlstate_dir[] =
   { "EnableCache", enable_cache, "Enable file cache" },
   { "<cache", add_cache_params, "Add cache parameters" },
   { "HTMLOutputDir", set_HTML_output_dir, "set HTML output directory" },
+  { "PageGenerationDelay", set_page_generation_delay, "set the period of the page regeneration (in seconds)" },
+  { "HTMLTimeBudget", set_time_budget, "set the time budget of a regeneration (in seconds, 0 for none)" },
   { NULL, NULL }
 };
 
@@ -32,6 +32,7 @@
 #include "mod_mgr.h"
 #include "mod_idmef.h"
 #include "mod_xml.h"
+#include "timestamp.h"
 
 input_module_t mod_idmef;
 
@@ -39,54 +40,22 @@ field_t idmef_fields[MAX_IDMEF_FIELDS] = {
   { "idmef.ptr",		    T_EXTERNAL,"idmef xml doc"   }
 };
 
+static ts_cache_t idmef_ts_g = TS_CACHE_INITIALIZER;
+
 static ovm_var_t*
 parse_idmef_datetime(char	*datetime)
 {
-  struct tm tm;
-  char	*datetime_ = datetime;
-  int	h;
-  int	m;
+  struct timeval tv;
   ovm_var_t	*res;
 
-  memset(&tm, 0, sizeof(tm));
-  tm.tm_isdst = -1;
-
-  datetime = strptime(datetime, "%Y-%m-%dT%H:%M:%S", &tm);
-
-  if (!datetime)
+  if (ts_parse_iso8601(&idmef_ts_g, datetime, strlen(datetime), &tv) == NULL)
   {
-    DebugLog(DF_MOD, DS_ERROR, "Malformated idmef datetime (%s)\n", datetime_);
+    DebugLog(DF_MOD, DS_ERROR, "Malformated idmef datetime (%s)\n", datetime);
     return NULL;
   }
 
-  if ((*datetime == '.') ||
-      (*datetime == ','))
-  {
-    // skip fraction seconds
-    datetime++;
-    while ( isdigit(*datetime) )
-      datetime++;
-  }
-
-  if ((*datetime == '+') ||
-      (*datetime == '-'))
-  {
-    if (sscanf(datetime + 1, "%2u:%2u", &h, &m) != 2)
-      DebugLog(DF_MOD, DS_ERROR, "Malformated idmef datetime (%s)\n", datetime_);
-    if (*datetime == '+')
-    {
-      tm.tm_min -= m;
-      tm.tm_hour -= h;
-    }
-    else
-    {
-      tm.tm_min += m;
-      tm.tm_hour += h;
-    }
-  }
-
   res = ovm_ctime_new();
-  CTIME(res) = mktime(&tm);
+  CTIME(res) = tv.tv_sec;
   return res;
 }
 
@@ -0,0 +1,466 @@
+/**
+ ** @file mod_ipdecode.c
+ ** Decoding of the Ethernet/VLAN, IPv4/IPv6 and TCP/UDP/ICMP headers
+ ** of the frames captured by mod_pcap.
+ **
+ ** The headers are decoded in one pass, without copying: addresses
+ ** and the payload point into the frame (see pcap_retain_hook() in
+ ** mod_pcap.c).  The fields of this module are only activated when
+ ** a rule uses them, and no value is built for inactive fields.
+ **
+ ** @version 0.1
+ ** @ingroup modules
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "orchids.h"
+
+#include "orchids_api.h"
+
+#include "mod_ipdecode.h"
+
+input_module_t mod_ipdecode;
+
+#define GET16(p) ((unsigned int)(p)[0] << 8 | (p)[1])
+#define GET32(p) ((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 \
+                  | (uint32_t)(p)[2] << 8 | (p)[3])
+
+
+static void
+decode_l4(const u_char *p, const u_char *end, ipdecode_t *h)
+{
+  size_t len = end - p;
+  size_t hlen;
+
+  switch (h->proto) {
+  case IPPROTO_TCP:
+    if (len < 20)
+      return ;
+    hlen = (p[12] >> 4) * 4;
+    if (hlen < 20 || hlen > len)
+      return ;
+    h->sport = GET16(p);
+    h->dport = GET16(p + 2);
+    h->seq = GET32(p + 4);
+    h->ack = GET32(p + 8);
+    h->tcpflags = (p[12] & 1) << 8 | p[13];
+    h->win = GET16(p + 14);
+    break ;
+
+  case IPPROTO_UDP:
+    if (len < 8)
+      return ;
+    hlen = 8;
+    h->sport = GET16(p);
+    h->dport = GET16(p + 2);
+    break ;
+
+  case IPPROTO_ICMP:
+  case IPPROTO_ICMPV6:
+    if (len < 8)
+      return ;
+    hlen = 8;
+    h->icmptype = p[0];
+    h->icmpcode = p[1];
+    break ;
+
+  default:
+    return ;
+  }
+
+  h->l4 = 1;
+  h->payload = p + hlen;
+  h->paylen = len - hlen;
+}
+
+
+static void
+decode_ipv4(const u_char *p, const u_char *end, ipdecode_t *h)
+{
+  size_t hlen;
+  unsigned int frag;
+
+  if (end - p < 20 || (p[0] >> 4) != 4)
+    return ;
+  hlen = (p[0] & 0x0f) * 4;
+  if (hlen < 20 || hlen > (size_t)(end - p))
+    return ;
+
+  h->version = 4;
+  h->iplen = GET16(p + 2);
+  h->ipid = GET16(p + 4);
+  frag = GET16(p + 6);
+  h->fragoff = (frag & 0x1fff) * 8;
+  h->morefrags = (frag & 0x2000) != 0;
+  h->ttl = p[8];
+  h->proto = p[9];
+  h->src = p + 12;
+  h->dst = p + 16;
+
+  /* trailer (Ethernet padding) or truncated capture */
+  if (h->iplen >= hlen && h->iplen < end - p)
+    end = p + h->iplen;
+  h->payload = p + hlen;
+  h->paylen = end - h->payload;
+
+  /* only the first fragment has the L4 header */
+  if (h->fragoff == 0)
+    decode_l4(p + hlen, end, h);
+}
+
+
+static void
+decode_ipv6(const u_char *p, const u_char *end, ipdecode_t *h)
+{
+  const u_char *q;
+  size_t len;
+  int nxt;
+  int i;
+
+  if (end - p < 40 || (p[0] >> 4) != 6)
+    return ;
+
+  h->version = 6;
+  h->iplen = 40 + GET16(p + 4);
+  h->ttl = p[7];
+  h->src = p + 8;
+  h->dst = p + 24;
+  if (h->iplen < end - p)
+    end = p + h->iplen;
+
+  nxt = p[6];
+  q = p + 40;
+  for (i = 0; i < IPDECODE_MAX_EXTHDRS; i++) {
+    if (nxt == 0 || nxt == 43 || nxt == 60) { /* hop-by-hop, routing, dst */
+      if (end - q < 8)
+        break ;
+      len = (q[1] + 1) * 8;
+    } else if (nxt == 44) { /* fragment */
+      if (end - q < 8)
+        break ;
+      h->ipid = GET32(q + 4);
+      h->fragoff = GET16(q + 2) & 0xfff8;
+      h->morefrags = q[3] & 1;
+      len = 8;
+    } else if (nxt == 51) { /* authentication header */
+      if (end - q < 8)
+        break ;
+      len = (q[1] + 2) * 4;
+    } else
+      break ;
+    if (len > (size_t)(end - q))
+      break ;
+    nxt = q[0];
+    q += len;
+  }
+
+  h->proto = nxt;
+  h->payload = q;
+  h->paylen = end - q;
+  if (h->fragoff == 0)
+    decode_l4(q, end, h);
+}
+
+
+/**
+ ** Decode the headers of a frame.
+ ** @param pkt      The frame.
+ ** @param caplen   Captured length.
+ ** @param datalink The link type of the frame.
+ ** @param h        The decoded headers.
+ ** @return 0, or -1 if the link type is not supported.
+ **/
+int
+ipdecode_frame(const u_char *pkt, size_t caplen, int datalink,
+               ipdecode_t *h)
+{
+  const u_char *p = pkt;
+  const u_char *end = pkt + caplen;
+  uint32_t family;
+
+  memset(h, 0, sizeof (*h));
+  h->vlan = -1;
+
+  switch (datalink) {
+  case IPDECODE_DLT_EN10MB:
+    if (caplen < 14)
+      return (0);
+    h->ethertype = GET16(p + 12);
+    p += 14;
+    while ((h->ethertype == ETHERTYPE_VLAN || h->ethertype == ETHERTYPE_QINQ
+            || h->ethertype == ETHERTYPE_QINQ1) && end - p >= 4) {
+      if (h->vlan < 0)
+        h->vlan = GET16(p) & 0x0fff;
+      h->ethertype = GET16(p + 2);
+      p += 4;
+    }
+    break ;
+
+  case IPDECODE_DLT_LINUX_SLL:
+    if (caplen < 16)
+      return (0);
+    h->ethertype = GET16(p + 14);
+    p += 16;
+    break ;
+
+  case IPDECODE_DLT_NULL:
+    if (caplen < 4)
+      return (0);
+    memcpy(&family, p, sizeof (family));
+    p += 4;
+    if (family == 2)
+      h->ethertype = ETHERTYPE_IPV4;
+    else if (family == 10 || family == 24 || family == 28 || family == 30)
+      h->ethertype = ETHERTYPE_IPV6;
+    break ;
+
+  case IPDECODE_DLT_RAW:
+  case IPDECODE_DLT_RAW_BSD:
+  case IPDECODE_LINKTYPE_RAW:
+    if (caplen < 1)
+      return (0);
+    h->ethertype = (p[0] >> 4) == 6 ? ETHERTYPE_IPV6 : ETHERTYPE_IPV4;
+    break ;
+
+  default:
+    return (-1);
+  }
+
+  if (h->ethertype == ETHERTYPE_IPV4)
+    decode_ipv4(p, end, h);
+  else if (h->ethertype == ETHERTYPE_IPV6)
+    decode_ipv6(p, end, h);
+
+  return (0);
+}
+
+
+#define ACTIVE(f) (ctx->global_fields[mod->first_field_pos + (f)].active)
+
+#define SET_INT(f, v) \
+  if (ACTIVE(f)) { \
+    attr[f] = ovm_int_new_arena(arena); \
+    INT(attr[f]) = (v); \
+  }
+
+#define SET_UINT(f, v) \
+  if (ACTIVE(f)) { \
+    attr[f] = ovm_uint_new_arena(arena); \
+    UINT(attr[f]) = (v); \
+  }
+
+#define SET_VBSTR(f, p, len) \
+  if (ACTIVE(f)) { \
+    attr[f] = ovm_vbstr_new_arena(arena); \
+    VBSTR(attr[f]) = (unsigned char *)(p); \
+    VBSTRLEN(attr[f]) = (len); \
+  }
+
+
+static int
+ipdecode_dissect(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
+{
+  ovm_var_t *attr[IPDECODE_FIELDS];
+  event_arena_t *arena;
+  ipdecode_t h;
+  u_char *pkt;
+  size_t caplen;
+
+  DebugLog(DF_MOD, DS_TRACE, "ipdecode_dissect()\n");
+
+  if (event->value == NULL)
+    return (-1);
+  if (TYPE(event->value) == T_VBSTR) {
+    pkt = VBSTR(event->value);
+    caplen = VBSTRLEN(event->value);
+  } else if (TYPE(event->value) == T_BSTR) {
+    pkt = BSTR(event->value);
+    caplen = BSTRLEN(event->value);
+  } else
+    return (-1);
+
+  if (ipdecode_frame(pkt, caplen, *(long *)data, &h))
+    return (-1);
+
+  memset(attr, 0, sizeof (attr));
+  arena = event_arena(ctx, event);
+
+  SET_INT(F_ETHERTYPE, h.ethertype);
+  if (h.vlan >= 0)
+    SET_INT(F_VLAN, h.vlan);
+
+  if (h.version != 0) {
+    SET_INT(F_IPVERSION, h.version);
+    if (h.version == 4) {
+      if (ACTIVE(F_SRC)) {
+        attr[F_SRC] = ovm_ipv4_new_arena(arena);
+        memcpy(&IPV4(attr[F_SRC]), h.src, 4);
+      }
+      if (ACTIVE(F_DST)) {
+        attr[F_DST] = ovm_ipv4_new_arena(arena);
+        memcpy(&IPV4(attr[F_DST]), h.dst, 4);
+      }
+    } else {
+      SET_VBSTR(F_SRC6, h.src, 16);
+      SET_VBSTR(F_DST6, h.dst, 16);
+    }
+    SET_INT(F_PROTO, h.proto);
+    SET_INT(F_TTL, h.ttl);
+    SET_INT(F_IPLEN, h.iplen);
+    SET_INT(F_IPID, h.ipid);
+    SET_INT(F_FRAGOFF, h.fragoff);
+    SET_INT(F_MOREFRAGS, h.morefrags);
+    SET_VBSTR(F_PAYLOAD, h.payload, h.paylen);
+    SET_INT(F_PAYLEN, h.paylen);
+  }
+
+  if (h.l4) {
+    if (h.proto == IPPROTO_TCP || h.proto == IPPROTO_UDP) {
+      SET_INT(F_SPORT, h.sport);
+      SET_INT(F_DPORT, h.dport);
+    }
+    if (h.proto == IPPROTO_TCP) {
+      SET_INT(F_TCPFLAGS, h.tcpflags);
+      SET_UINT(F_SEQ, h.seq);
+      SET_UINT(F_ACK, h.ack);
+      SET_INT(F_WIN, h.win);
+    } else if (h.proto == IPPROTO_ICMP || h.proto == IPPROTO_ICMPV6) {
+      SET_INT(F_ICMPTYPE, h.icmptype);
+      SET_INT(F_ICMPCODE, h.icmpcode);
+    }
+  }
+
+  add_fields_to_event(ctx, mod, &event, attr, IPDECODE_FIELDS);
+
+  post_event(ctx, mod, event);
+
+  return (0);
+}
+
+
+static field_t ipdecode_fields[] = {
+  { "ipdecode.ethertype", T_INT,   "Ethernet type of the network layer"  },
+  { "ipdecode.vlan",      T_INT,   "VLAN identifier (outer tag)"         },
+  { "ipdecode.version",   T_INT,   "IP version (4 or 6)"                 },
+  { "ipdecode.src",       T_IPV4,  "IPv4 source address"                 },
+  { "ipdecode.dst",       T_IPV4,  "IPv4 destination address"            },
+  { "ipdecode.src6",      T_VBSTR, "IPv6 source address (16 bytes)"      },
+  { "ipdecode.dst6",      T_VBSTR, "IPv6 destination address (16 bytes)" },
+  { "ipdecode.proto",     T_INT,   "Transport protocol"                  },
+  { "ipdecode.ttl",       T_INT,   "Time to live (hop limit)"            },
+  { "ipdecode.iplen",     T_INT,   "IP packet length"                    },
+  { "ipdecode.ipid",      T_INT,   "IP identification"                   },
+  { "ipdecode.fragoff",   T_INT,   "Fragment offset in bytes"            },
+  { "ipdecode.morefrags", T_INT,   "More fragments flag"                 },
+  { "ipdecode.sport",     T_INT,   "TCP/UDP source port"                 },
+  { "ipdecode.dport",     T_INT,   "TCP/UDP destination port"            },
+  { "ipdecode.tcpflags",  T_INT,   "TCP flags (FIN=1 SYN=2 RST=4 PSH=8 ACK=16 URG=32)" },
+  { "ipdecode.seq",       T_UINT,  "TCP sequence number"                 },
+  { "ipdecode.ack",       T_UINT,  "TCP acknowledgment number"           },
+  { "ipdecode.win",       T_INT,   "TCP window"                          },
+  { "ipdecode.icmptype",  T_INT,   "ICMP type"                           },
+  { "ipdecode.icmpcode",  T_INT,   "ICMP code"                           },
+  { "ipdecode.payload",   T_VBSTR, "Transport payload (or IP payload)"   },
+  { "ipdecode.paylen",    T_INT,   "Payload length"                      }
+};
+
+
+static long ipdecode_datalinks_g[] = {
+  IPDECODE_DLT_NULL,
+  IPDECODE_DLT_EN10MB,
+  IPDECODE_DLT_RAW,
+  IPDECODE_DLT_RAW_BSD,
+  IPDECODE_LINKTYPE_RAW,
+  IPDECODE_DLT_LINUX_SLL
+};
+
+
+static void *
+ipdecode_preconfig(orchids_t *ctx, mod_entry_t *mod)
+{
+  int i;
+
+  DebugLog(DF_MOD, DS_DEBUG, "load() ipdecode@%p\n", (void *) &mod_ipdecode);
+
+  register_fields(ctx, mod, ipdecode_fields, IPDECODE_FIELDS);
+
+  /* Fields are activated by the rules (or modules) using them */
+  for (i = 0; i < IPDECODE_FIELDS; i++)
+    ctx->global_fields[mod->first_field_pos + i].active = FALSE;
+
+  /* pcap.datalink is the key of conditional pcap dissectors */
+  for (i = 0; i < sizeof (ipdecode_datalinks_g) / sizeof (long); i++)
+    register_conditional_dissector(ctx, mod, "pcap",
+                                   (void *)&ipdecode_datalinks_g[i],
+                                   sizeof (long),
+                                   ipdecode_dissect,
+                                   (void *)&ipdecode_datalinks_g[i]);
+
+  return (NULL);
+}
+
+
+input_module_t mod_ipdecode = {
+  MOD_MAGIC,
+  ORCHIDS_VERSION,
+  "ipdecode",
+  "CeCILL2",
+  NULL,
+  NULL,
+  ipdecode_preconfig,
+  NULL,
+  NULL
+};
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
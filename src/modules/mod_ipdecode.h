@@ -0,0 +1,141 @@
+/**
+ ** @file mod_ipdecode.h
+ ** Definitions for mod_ipdecode.c
+ **
+ ** @version 0.1
+ ** @ingroup modules
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef MOD_IPDECODE_H
+#define MOD_IPDECODE_H
+
+#include "orchids.h"
+
+#define IPDECODE_FIELDS   23
+#define F_ETHERTYPE        0
+#define F_VLAN             1
+#define F_IPVERSION        2
+#define F_SRC              3
+#define F_DST              4
+#define F_SRC6             5
+#define F_DST6             6
+#define F_PROTO            7
+#define F_TTL              8
+#define F_IPLEN            9
+#define F_IPID            10
+#define F_FRAGOFF         11
+#define F_MOREFRAGS       12
+#define F_SPORT           13
+#define F_DPORT           14
+#define F_TCPFLAGS        15
+#define F_SEQ             16
+#define F_ACK             17
+#define F_WIN             18
+#define F_ICMPTYPE        19
+#define F_ICMPCODE        20
+#define F_PAYLOAD         21
+#define F_PAYLEN          22
+
+/* Link types (pcap.datalink), from pcap/bpf.h */
+#define IPDECODE_DLT_NULL       0
+#define IPDECODE_DLT_EN10MB     1
+#define IPDECODE_DLT_RAW       12
+#define IPDECODE_DLT_RAW_BSD   14
+#define IPDECODE_LINKTYPE_RAW 101
+#define IPDECODE_DLT_LINUX_SLL 113
+
+#define ETHERTYPE_IPV4   0x0800
+#define ETHERTYPE_IPV6   0x86dd
+#define ETHERTYPE_VLAN   0x8100
+#define ETHERTYPE_QINQ   0x88a8
+#define ETHERTYPE_QINQ1  0x9100
+
+/* Max number of IPv6 extension headers skipped */
+#define IPDECODE_MAX_EXTHDRS 8
+
+/**
+ ** @struct ipdecode_s
+ **   Headers of a frame, decoded in one pass.  Addresses and the
+ **   payload point into the frame.
+ **/
+typedef struct ipdecode_s ipdecode_t;
+struct ipdecode_s {
+  int            ethertype;
+  int            vlan;      /* outer VLAN id, -1 if none */
+  int            version;   /* 4 or 6, 0 if not IP */
+  const u_char  *src;
+  const u_char  *dst;
+  int            proto;     /* upper layer protocol, after IPv6 extensions */
+  int            ttl;
+  int            iplen;
+  int            ipid;
+  int            fragoff;
+  int            morefrags;
+  int            l4;        /* TCP, UDP or ICMP header decoded */
+  int            sport;
+  int            dport;
+  int            tcpflags;
+  uint32_t       seq;
+  uint32_t       ack;
+  int            win;
+  int            icmptype;
+  int            icmpcode;
+  const u_char  *payload;
+  size_t         paylen;
+};
+
+
+int
+ipdecode_frame(const u_char *pkt, size_t caplen, int datalink,
+               ipdecode_t *h);
+
+static int
+ipdecode_dissect(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data);
+
+static void *
+ipdecode_preconfig(orchids_t *ctx, mod_entry_t *mod);
+
+
+#endif /* MOD_IPDECODE_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -25,6 +25,8 @@
 //#include <avl.h>
 
 
+#include "engine.h"
+
 #include "mod_mark.h"
 
 input_module_t mod_mark;
@@ -56,29 +58,6 @@ issdl_mark_update(orchids_t *ctx, state_instance_t *state)
 }
 
 
-static void
-do_recursive_cut(state_instance_t *state)
-{
-  wait_thread_t *t;
-
-  state->flags |= SF_PRUNED;
-
-  /* Cut current state instance threads */
-  for (t = state->thread_list; t; t = t->next_in_state_instance) {
-    if ( !(t->flags & THREAD_ONLYONCE) ) {
-      DebugLog(DF_ENG, DS_TRACE, "Marking thread %p as KILLED (cut)\n", t);
-      t->flags |= THREAD_KILLED;
-    }
-  }
-
-  /* Then call recursively */
-  if (state->first_child)
-    do_recursive_cut(state->first_child);
-
-  if (state->next_sibling)
-    do_recursive_cut(state->next_sibling);
-}
-
 static void
 issdl_mark_cut(orchids_t *ctx, state_instance_t *state)
 {
@@ -91,7 +70,7 @@ issdl_mark_cut(orchids_t *ctx, state_instance_t *state)
     return;
   }
 
-  do_recursive_cut(EXTPTR(mark));
+  cut_state_instance(EXTPTR(mark));
 
   ISSDL_RETURN_TRUE(ctx, state);
 }
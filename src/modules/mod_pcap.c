@@ -18,6 +18,7 @@
 #include <string.h>
 
 #include <sys/types.h>
+#include <sys/time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -27,11 +28,20 @@
 #include "orchids.h"
 
 #include "orchids_api.h"
+#include "mod_mgr.h"
 
 #include "mod_pcap.h"
 
 input_module_t mod_pcap;
 
+/*
+** The frame is not copied: pcap.packet is a vbstr over the libpcap
+** buffer, which is only valid until the callback returns.  If an
+** event of the frame is retained by a rule instance,
+** pcap_retain_hook() moves the frame to the event arena.  Queued
+** events (of this module or of a sub-dissector) are not injected
+** before the callback returns, so their frame is copied at once.
+*/
 static void
 libpcap_callback(u_char *data,
                  const pcap_pkthdr_t *pkthdr,
@@ -39,9 +49,11 @@ libpcap_callback(u_char *data,
 {
   ovm_var_t *attr[PCAP_FIELDS];
   event_t *event;
+  event_arena_t *arena;
   orchids_t *ctx;
   mod_entry_t *mod;
   mod_pcap_if_t *pcapif;
+  pcap_cfg_t *cfg;
 
   DebugLog(DF_MOD, DS_TRACE, "pcap_callback()\n");
 
@@ -53,29 +65,130 @@ libpcap_callback(u_char *data,
   ctx = ((pcap_cb_data_t *)data)->ctx;
   mod = ((pcap_cb_data_t *)data)->mod;
   pcapif = ((pcap_cb_data_t *)data)->pcapif;
+  cfg = mod->config;
+  arena = event_arena(ctx, NULL);
 
-  attr[F_TIME] = ovm_timeval_new();
+  attr[F_TIME] = ovm_timeval_new_arena(arena);
   TIMEVAL(attr[F_TIME]) = pkthdr->ts;
 
-  attr[F_LEN] = ovm_int_new();
+  attr[F_LEN] = ovm_int_new_arena(arena);
   INT(attr[F_LEN]) = pkthdr->len;
 
-  attr[F_CAPLEN] = ovm_int_new();
+  attr[F_CAPLEN] = ovm_int_new_arena(arena);
   INT(attr[F_CAPLEN]) = pkthdr->caplen;
 
-  attr[F_INTERFACE] = ovm_vstr_new();
+  attr[F_INTERFACE] = ovm_vstr_new_arena(arena);
   VSTR(attr[F_INTERFACE]) = pcapif->name;
   VSTRLEN(attr[F_INTERFACE]) = strlen(pcapif->name);
 
-  attr[F_DATALINK] = ovm_int_new();
+  attr[F_DATALINK] = ovm_int_new_arena(arena);
   INT(attr[F_DATALINK]) = pcapif->datalink;
 
-  attr[F_PACKET] = ovm_bstr_new(pkthdr->len);
-  memcpy(BSTR(attr[F_PACKET]), pkt, pkthdr->len);
+  attr[F_PACKET] = ovm_vbstr_new_arena(arena);
+  VBSTRLEN(attr[F_PACKET]) = pkthdr->caplen;
+  if (cfg->queued && ctx->off_line_mode == MODE_ONLINE) {
+    VBSTR(attr[F_PACKET]) = event_arena_alloc(arena, pkthdr->caplen);
+    memcpy(VBSTR(attr[F_PACKET]), pkt, pkthdr->caplen);
+  } else
+    VBSTR(attr[F_PACKET]) = (unsigned char *)pkt;
 
   add_fields_to_event(ctx, mod, &event, attr, PCAP_FIELDS);
 
+  /* All the events injected from now on until post_event() returns
+   * may hold views of the frame */
+  cfg->cur_pkt = pkt;
+  cfg->cur_caplen = pkthdr->caplen;
+  cfg->copy_arena = NULL;
+  cfg->copy = NULL;
   post_event(ctx, mod, event);
+  cfg->cur_pkt = NULL;
+  cfg->copy_arena = NULL;
+  cfg->copy = NULL;
+}
+
+
+/*
+** Post-injection hook: if an event holding views of the frame being
+** posted is retained, copy the frame to the event arena and move the
+** values pointing into it (pcap.packet, and the views of
+** sub-dissectors).  Rule environments hold these very values, so they
+** follow.  Events of the same arena (e.g. the frame event, then the
+** same event passed through by mod_tcpflow) share one copy.
+*/
+static int
+pcap_retain_hook(orchids_t *ctx, mod_entry_t *mod, void *data, event_t *event)
+{
+  pcap_cfg_t *cfg = mod->config;
+  const u_char *pkt = cfg->cur_pkt;
+  event_arena_t *arena;
+  unsigned char *p;
+  ovm_var_t *v;
+  event_t *e;
+
+  if (pkt == NULL || ctx->active_event_cur == NULL
+      || ctx->active_event_cur->refs == 0)
+    return (0);
+
+  for (e = event; e; e = e->next) {
+    v = e->value;
+    if (v == NULL)
+      continue ;
+    if (TYPE(v) == T_VBSTR)
+      p = VBSTR(v);
+    else if (TYPE(v) == T_VSTR)
+      p = (unsigned char *)VSTR(v);
+    else
+      continue ;
+    if (p < pkt || p > pkt + cfg->cur_caplen)
+      continue ;
+
+    /* a view of the frame: copy it once per arena */
+    arena = e->arena ? e->arena : event_arena(ctx, event);
+    if (arena != cfg->copy_arena) {
+      cfg->copy = event_arena_alloc(arena, cfg->cur_caplen);
+      memcpy(cfg->copy, pkt, cfg->cur_caplen);
+      cfg->copy_arena = arena;
+    }
+    if (TYPE(v) == T_VBSTR)
+      VBSTR(v) = cfg->copy + (p - pkt);
+    else
+      VSTR(v) = (char *)cfg->copy + (p - pkt);
+  }
+
+  return (0);
+}
+
+
+/*
+** Does a module, or one of its sub-dissectors, queue its events?
+*/
+static int
+dissector_queues(mod_entry_t *mod, int depth);
+
+static int
+sub_dissector_queues(void *elmt, void *data)
+{
+  conditional_dissector_record_t *d = elmt;
+
+  return (dissector_queues(d->mod, *(int *)data));
+}
+
+
+static int
+dissector_queues(mod_entry_t *mod, int depth)
+{
+  if (mod->queue)
+    return (1);
+  /* guard against dissector loops */
+  if (--depth == 0)
+    return (0);
+  if (mod->dissect_mod && dissector_queues(mod->dissect_mod, depth))
+    return (1);
+  if (mod->sub_dissectors
+      && hash_walk(mod->sub_dissectors, sub_dissector_queues, &depth))
+    return (1);
+
+  return (0);
 }
 
 
@@ -112,18 +225,91 @@ static field_t pcap_fields[] = {
   { "pcap.caplen", T_INT, "Length of data captured" },
   { "pcap.interface", T_VSTR, "Interface name where the packet was captured"},
   { "pcap.datalink", T_INT, "Datalink type" },
-  { "pcap.packet", T_BSTR, "The raw bytes of the captured frame"}
+  { "pcap.packet", T_VBSTR, "The raw bytes of the captured frame"}
 };
 
 
 static void *
 pcap_preconfig(orchids_t *ctx, mod_entry_t *mod)
 {
+  pcap_cfg_t *cfg;
+
   DebugLog(DF_MOD, DS_DEBUG, "load() pcap@%p\n", (void *) &mod_pcap);
 
   register_fields(ctx, mod, pcap_fields, PCAP_FIELDS);
 
-  return (NULL);
+  cfg = Xzmalloc(sizeof (pcap_cfg_t));
+  register_post_inject_hook(ctx, mod, pcap_retain_hook, NULL);
+
+  return (cfg);
+}
+
+
+/*
+** Savefiles are read at full speed, once the rules are compiled.
+*/
+static void
+read_savefile(orchids_t *ctx, mod_entry_t *mod, mod_pcap_if_t *sf)
+{
+  char errbuf[PCAP_ERRBUF_SIZE];
+  pcap_cb_data_t pcapdata;
+  struct timeval start;
+  struct timeval end;
+  unsigned long packets;
+  long ms;
+  int ret;
+
+  sf->pcap = pcap_open_offline(sf->name, errbuf);
+  if (sf->pcap == NULL) {
+    DebugLog(DF_MOD, DS_ERROR, "pcap_open_offline error: %s\n", errbuf);
+    return ;
+  }
+  sf->datalink = pcap_datalink(sf->pcap);
+
+  pcapdata.ctx = ctx;
+  pcapdata.mod = mod;
+  pcapdata.pcapif = sf;
+
+  packets = 0;
+  gettimeofday(&start, NULL);
+  while ((ret = pcap_dispatch(sf->pcap, -1, libpcap_callback,
+                              (void *) &pcapdata)) > 0)
+    packets += ret;
+  if (ret == -1)
+    DebugLog(DF_MOD, DS_ERROR, "pcap_dispatch error on %s: %s\n",
+             sf->name, pcap_geterr(sf->pcap));
+  gettimeofday(&end, NULL);
+
+  ms = (end.tv_sec - start.tv_sec) * 1000
+    + (end.tv_usec - start.tv_usec) / 1000;
+  DebugLog(DF_MOD, DS_NOTICE,
+           "savefile %s: %lu packets in %li ms (%lu packets/s)\n",
+           sf->name, packets, ms,
+           ms > 0 ? (unsigned long)(packets * 1000.0 / ms) : packets);
+
+  pcap_close(sf->pcap);
+  sf->pcap = NULL;
+}
+
+
+static void
+pcap_postcompil(orchids_t *ctx, mod_entry_t *mod)
+{
+  pcap_cfg_t *cfg = mod->config;
+  mod_pcap_if_t *sf;
+
+  /* Dissectors and queues are configured by now */
+  cfg->queued = dissector_queues(mod, ctx->loaded_modules + 1);
+
+  for (sf = cfg->savefiles; sf; sf = sf->next)
+    read_savefile(ctx, mod, sf);
+
+  /* End of the savefiles: close the flows (if mod_tcpflow is loaded) */
+  if (cfg->savefiles)
+    call_mod_func(ctx, "tcpflow", "flush", NULL);
+
+  if (cfg->savefiles && cfg->exit_after_savefiles)
+    exit(EXIT_SUCCESS);
 }
 
 
@@ -172,11 +358,41 @@ add_device(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
   add_input_descriptor(ctx, mod, modpcap_callback, newif->fd, newif);
 }
 
+static void
+add_savefile(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  pcap_cfg_t *cfg = mod->config;
+  mod_pcap_if_t *sf;
+  mod_pcap_if_t **last;
+
+  DebugLog(DF_MOD, DS_INFO, "Add savefile %s\n", dir->args);
+
+  sf = Xzmalloc(sizeof (mod_pcap_if_t));
+  sf->name = dir->args;
+  sf->fd = -1;
+
+  /* keep the order of the configuration */
+  for (last = &cfg->savefiles; *last; last = &(*last)->next)
+    ;
+  *last = sf;
+}
+
+static void
+set_exit_after_savefiles(orchids_t *ctx, mod_entry_t *mod,
+                         config_directive_t *dir)
+{
+  DebugLog(DF_MOD, DS_INFO, "setting ExitAfterSavefiles to %s\n", dir->args);
+
+  ((pcap_cfg_t *)mod->config)->exit_after_savefiles = atoi(dir->args) != 0;
+}
+
 static mod_cfg_cmd_t pcap_dir[] = 
 {
 /*   { "Promiscuous", set_promisc, "Set promiscuous parameter" }, */
 /*   { "CaptureLength", set_caplen, "Set the capture length" }, */
   { "AddDevice", add_device, "Add a device to listen to" },
+  { "AddSavefile", add_savefile, "Add a pcap savefile to read at full speed" },
+  { "ExitAfterSavefiles", set_exit_after_savefiles, "Exit after reading all savefiles" },
   { NULL, NULL, NULL }
 };
 
@@ -189,7 +405,7 @@ input_module_t mod_pcap = {
   pcap_dir,
   pcap_preconfig,
   NULL,
-  NULL
+  pcap_postcompil
 };
 
 /* End-of-file */
@@ -39,6 +39,7 @@ struct pcap_cb_data_s
 
 struct mod_pcap_if_s
 {
+  mod_pcap_if_t *next;
   char   *name;
   int     promisc;
   int     snaplen;
@@ -47,6 +48,21 @@ struct mod_pcap_if_s
   int     datalink;
 };
 
+typedef struct pcap_cfg_s pcap_cfg_t;
+struct pcap_cfg_s
+{
+  mod_pcap_if_t  *savefiles;
+  int             exit_after_savefiles;
+  /* frame being posted: pcap.packet points into the libpcap buffer */
+  const u_char   *cur_pkt;
+  size_t          cur_caplen;
+  /* copy of the frame, and the event arena holding it */
+  event_arena_t  *copy_arena;
+  unsigned char  *copy;
+  /* events of this module or of a sub-dissector may be queued */
+  int             queued;
+};
+
 static void
 libpcap_callback(u_char *data,
                  const pcap_pkthdr_t *pkthdr,
@@ -55,12 +71,25 @@ libpcap_callback(u_char *data,
 static int
 modpcap_callback(orchids_t *ctx, mod_entry_t *mod, int fd, void *data);
 
+static int
+pcap_retain_hook(orchids_t *ctx, mod_entry_t *mod, void *data, event_t *event);
+
 static void *
 pcap_preconfig(orchids_t *ctx, mod_entry_t *mod);
 
+static void
+pcap_postcompil(orchids_t *ctx, mod_entry_t *mod);
+
 static void
 add_device(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
 
+static void
+add_savefile(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+static void
+set_exit_after_savefiles(orchids_t *ctx, mod_entry_t *mod,
+                         config_directive_t *dir);
+
 
 #endif /* MOD_PCAP_H */
 
@@ -43,7 +43,6 @@ period_htmloutput(orchids_t *ctx, mod_entry_t *mod, FILE *menufp, html_output_cf
 {
   FILE *fp;
   int i;
-  strhash_elmt_t *helmt;
   size_t ctx_array_sz;
   char **ctx_array;
 
@@ -56,16 +55,9 @@ period_htmloutput(orchids_t *ctx, mod_entry_t *mod, FILE *menufp, html_output_cf
 
   fprintf(fp, "<center><h1>Orchids frequencies / phases tables</h1></center>\n");
 
-  ctx_array = NULL;
-  ctx_array_sz = 0;
-  for (i = 0; i < ctx->temporal->size; i++) {
-    for (helmt = ctx->temporal->htable[i]; helmt; helmt = helmt->next) {
-      ctx_array_sz++;
-      ctx_array = Xrealloc(ctx_array, ctx_array_sz * sizeof (char *));
-      ctx_array[ ctx_array_sz - 1 ] = helmt->key;
-/*       period_output_gnuplot(); */
-    }
-  }
+  /* temporal contexts are stored with their key as data */
+  ctx_array = strhash_to_array(ctx->temporal);
+  ctx_array_sz = strhash_elmts(ctx->temporal);
   qsort(ctx_array, ctx_array_sz, sizeof (char *), qsort_strcmp);
 
   fprintf(fp, "%zd context%s<br/><br/><br/>\n",
@@ -109,7 +101,7 @@ issdl_temporal(orchids_t *ctx, state_instance_t *state)
     DebugLog(DF_ENG, DS_INFO, "New container %s\n", key);
     /* create container ctx */
     /* add to hash */
-    strhash_add(ctx->temporal, (void *)1, key);
+    strhash_add(ctx->temporal, key, key);
   }
   else {
     Xfree(key);
@@ -33,9 +33,14 @@
 
 #include "engine.h"
 #include "graph_output.h"
+#include "ipset.h"
+#include "latency.h"
+#include "mem_governor.h"
 #include "mod_mgr.h"
 #include "orchids_api.h"
 #include "rule_compiler.h"
+#include "rule_reload.h"
+#include "window_aggr.h"
 
 #include "mod_remoteadm.h"
 
@@ -108,14 +113,20 @@ remoteadm_cmd_t radm_cmd_g[] = {
   { "showdirs", radm_cmd_showdirs, "show known configuration directives" },
   { "showfields", radm_cmd_showfields, "show registered fields" },
   { "stats", radm_cmd_stats, "show orchids statistics" },
+  { "memstats", radm_cmd_memstats, "show memory governor statistics" },
+  { "latency", radm_cmd_latency, "show event latency per input module" },
   { "lsrules", radm_cmd_lsrules, "list rules" },
   { "lsinsts", radm_cmd_lsinstances, "list rule instances" },
   { "lsthreads", radm_cmd_lsthreads, "list retrig queue" },
   { "lsevents", radm_cmd_lsevents, "list active events list" },
   { "lsfuncts", radm_cmd_lsfunctions, "list language functions" },
+  { "lswindows", radm_cmd_lswindows, "list window aggregators" },
+  { "lsipsets", radm_cmd_lsipsets, "list IP sets" },
+  { "ipsetreload", radm_cmd_ipsetreload, "reload an IP set from its file" },
   { "dumpinst", radm_cmd_dumpinst, "dump a rule instance in AT&T GraphViz dot format" },
   { "dumprule", radm_cmd_dumprule, "dump rule in AT&T GraphViz dot format" },
   { "htmloutput", radm_cmd_htmloutput, "Request an html output generation" },
+  { "reload", radm_cmd_reload, "recompile modified rule files" },
   { "about", radm_cmd_about, "some greetings ;-)" },
   { "exit", radm_cmd_exit, "close admin console" },
   { "quit", radm_cmd_exit, "same as 'exit'" },
@@ -187,6 +198,20 @@ radm_cmd_htmloutput(FILE *fp, orchids_t *ctx, char *args)
 }
 
 
+static void
+radm_cmd_reload(FILE *fp, orchids_t *ctx, char *args)
+{
+  int ret;
+
+  ret = reload_rules(ctx);
+  if (ret < 0)
+    fprintf(fp, "reload failed, current rules kept (see log).\n");
+  else
+    fprintf(fp, "%i rule files recompiled, %i rules loaded.\n",
+            ret, ctx->rule_compiler->rules);
+}
+
+
 static void
 radm_cmd_exit(FILE *fp, orchids_t *ctx, char *args)
 {
@@ -225,6 +250,61 @@ static void
 radm_cmd_stats(FILE *fp, orchids_t *ctx, char *args)
 {
   fprintf_orchids_stats(fp, ctx);
+  call_mod_func(ctx, "textfile", "stats", fp);
+  show_prompt(fp);
+}
+
+
+static void
+radm_cmd_memstats(FILE *fp, orchids_t *ctx, char *args)
+{
+  fprintf_memgov_stats(fp, ctx);
+  show_prompt(fp);
+}
+
+
+static void
+radm_cmd_latency(FILE *fp, orchids_t *ctx, char *args)
+{
+  fprintf_latency_stats(fp, ctx);
+  show_prompt(fp);
+}
+
+
+static void
+radm_cmd_lswindows(FILE *fp, orchids_t *ctx, char *args)
+{
+  fprintf_windows(fp, ctx);
+  show_prompt(fp);
+}
+
+
+static void
+radm_cmd_lsipsets(FILE *fp, orchids_t *ctx, char *args)
+{
+  fprintf_ipsets(fp, ctx);
+  show_prompt(fp);
+}
+
+
+static void
+radm_cmd_ipsetreload(FILE *fp, orchids_t *ctx, char *args)
+{
+  ipset_t *set;
+
+  if (args == NULL) {
+    fprintf(fp, "ipsetreload: missing set name.\n");
+    show_prompt(fp);
+    return ;
+  }
+
+  set = strhash_get(ctx->ipsets, args);
+  if (set == NULL)
+    fprintf(fp, "ipsetreload: unknown set '%s'.\n", args);
+  else if (ipset_reload(ctx, set) != 0)
+    fprintf(fp, "ipsetreload: can't reload '%s'.\n", set->name);
+  else
+    fprintf(fp, "reloading '%s' from %s.\n", set->name, set->path);
   show_prompt(fp);
 }
 
@@ -111,6 +111,11 @@ static void radm_cmd_cfgtree(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_showdirs(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_showfields(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_stats(FILE *fp, orchids_t *ctx, char *args);
+static void radm_cmd_memstats(FILE *fp, orchids_t *ctx, char *args);
+static void radm_cmd_latency(FILE *fp, orchids_t *ctx, char *args);
+static void radm_cmd_lswindows(FILE *fp, orchids_t *ctx, char *args);
+static void radm_cmd_lsipsets(FILE *fp, orchids_t *ctx, char *args);
+static void radm_cmd_ipsetreload(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_lsrules(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_lsinstances(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_lsthreads(FILE *fp, orchids_t *ctx, char *args);
@@ -119,6 +124,7 @@ static void radm_cmd_lsfunctions(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_dumprule(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_dumpinst(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_htmloutput(FILE *fp, orchids_t *ctx, char *args);
+static void radm_cmd_reload(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_exit(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_about(FILE *fp, orchids_t *ctx, char *args);
 static void radm_cmd_shutdown(FILE *fp, orchids_t *ctx, char *args);
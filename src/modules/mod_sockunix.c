@@ -84,45 +84,61 @@ create_sockunix_socket(const char *path)
 }
 
 
+/*
+** Read a burst of datagrams at once: the time of reception is taken
+** once per burst, and the values of each event go to its arena.
+*/
 static int
 sockunix_callback(orchids_t *ctx, mod_entry_t *mod, int fd, void *data)
 {
+  sockunix_cfg_t *cfg = mod->config;
+  sockunix_socket_t *sock = data;
   ovm_var_t *attr[SOCKUNIX_FIELDS];
-  char buf[8194];
-  socklen_t sz;
-  struct sockaddr_un from;
-  socklen_t len;
+  event_arena_t *arena;
+  struct timeval now;
+  uint32_t drops;
+  dgram_t *dg;
   event_t *event;
+  size_t len;
+  int n;
+  int i;
 
   DebugLog(DF_MOD, DS_TRACE, "sockunix_callback()\n");
 
-  memset(attr, 0, sizeof(attr));
+  drops = sock->drops;
+  n = dgram_recv(cfg->ring, fd, &sock->drops);
+  if (n < 0) {
+    DebugLog(DF_MOD, DS_ERROR, "recvmmsg(): %s\n", strerror(errno));
+    return (0);
+  }
+  mod->lost += sock->drops - drops;
 
-  sz = Xrecvfrom(fd,buf,8192,0, NULL, NULL);
-  buf[sz] = '\0';
+  len = strlen(sock->path);
+  gettimeofday(&now, NULL);
+  for (i = 0; i < n; i++) {
+    dg = &cfg->ring->dgram[i];
+    memset(attr, 0, sizeof(attr));
+    arena = event_arena(ctx, NULL);
 
-  attr[F_TIME] = ovm_timeval_new();
-  attr[F_TIME]->flags |= TYPE_MONO;
-  gettimeofday( &(TIMEVAL(attr[F_TIME])) , NULL);
+    attr[F_TIME] = ovm_timeval_new_arena(arena);
+    attr[F_TIME]->flags |= TYPE_MONO;
+    TIMEVAL(attr[F_TIME]) = now;
 
-  attr[F_EVENT] = ovm_int_new();
-  attr[F_EVENT]->flags |= TYPE_MONO;
-  INT(attr[F_EVENT]) = (long) mod->posts;
+    attr[F_EVENT] = ovm_int_new_arena(arena);
+    attr[F_EVENT]->flags |= TYPE_MONO;
+    INT(attr[F_EVENT]) = (long) mod->posts;
 
-  len = sizeof (struct sockaddr_un);
-  memset(&from, 0, sizeof (struct sockaddr_un));
-  getsockname(fd, (struct sockaddr *)&from, &len);
-  len = strlen(from.sun_path);
-  attr[F_SOCKET] = ovm_str_new(len);
-  memcpy(STR(attr[F_SOCKET]), from.sun_path, len);
+    attr[F_SOCKET] = ovm_str_new_arena(arena, len);
+    memcpy(STR(attr[F_SOCKET]), sock->path, len);
 
-  attr[F_MSG] = ovm_bstr_new(sz);
-  memcpy(BSTR(attr[F_MSG]), buf, sz);
+    attr[F_MSG] = ovm_bstr_new_arena(arena, dg->len);
+    memcpy(BSTR(attr[F_MSG]), dg->buf, dg->len);
 
-  event = NULL;
-  add_fields_to_event(ctx, mod, &event, attr, SOCKUNIX_FIELDS);
+    event = NULL;
+    add_fields_to_event(ctx, mod, &event, attr, SOCKUNIX_FIELDS);
 
-  post_event(ctx, mod, event);
+    post_event(ctx, mod, event);
+  }
 
   return (0);
 }
@@ -137,28 +153,81 @@ static field_t sockunix_fields[] = {
 static void *
 sockunix_preconfig(orchids_t *ctx, mod_entry_t *mod)
 {
+  sockunix_cfg_t *cfg;
+
   DebugLog(DF_MOD, DS_DEBUG, "load() sockunix@%p\n", (void *) &mod_sockunix);
 
   register_fields(ctx, mod, sockunix_fields, SOCKUNIX_FIELDS);
 
-  return (NULL);
+  cfg = Xzmalloc(sizeof (sockunix_cfg_t));
+  cfg->batch = DGRAM_DEFAULT_BATCH;
+  cfg->rcvbuf = 0;
+
+  return (cfg);
+}
+
+static void
+sockunix_postconfig(orchids_t *ctx, mod_entry_t *mod)
+{
+  sockunix_cfg_t *cfg = mod->config;
+  sockunix_socket_t *sock;
+
+  if (cfg->socks == NULL)
+    return ;
+
+  cfg->ring = dgram_ring_new(cfg->batch);
+  for (sock = cfg->socks; sock; sock = sock->next)
+    dgram_socket_setup(sock->fd, cfg->rcvbuf);
 }
 
 static void
 add_unix_socket(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
 {
-  int sd;
+  sockunix_cfg_t *cfg = mod->config;
+  sockunix_socket_t *sock;
 
   DebugLog(DF_MOD, DS_INFO, "Add unix socket port [%s]\n", dir->args);
 
-  sd = create_sockunix_socket(dir->args);
-  add_input_descriptor(ctx, mod, sockunix_callback, sd, (void *)dir->args);
+  sock = Xzmalloc(sizeof (sockunix_socket_t));
+  sock->path = dir->args;
+  sock->fd = create_sockunix_socket(dir->args);
+  sock->next = cfg->socks;
+  cfg->socks = sock;
+  add_input_descriptor(ctx, mod, sockunix_callback, sock->fd, sock);
+}
+
+static void
+set_recv_batch(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting RecvBatch to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 1)
+    value = 1;
+  ((sockunix_cfg_t *)mod->config)->batch = value;
+}
+
+static void
+set_recv_buffer(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting RecvBuffer to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 0)
+    value = 0;
+  ((sockunix_cfg_t *)mod->config)->rcvbuf = value;
 }
 
 static mod_cfg_cmd_t sockunix_dir[] =
 {
   { "AddUnixSocket", add_unix_socket, "Add a unix socket" },
   { "INPUT", add_unix_socket, "Add a unix socket" },
+  { "RecvBatch", set_recv_batch, "Max datagrams read per wakeup" },
+  { "RecvBuffer", set_recv_buffer, "Socket receive buffer size (bytes)" },
   { NULL, NULL, NULL }
 };
 
@@ -170,7 +239,7 @@ input_module_t mod_sockunix = {
   NULL,
   sockunix_dir,
   sockunix_preconfig,
-  NULL,
+  sockunix_postconfig,
   NULL
 };
 
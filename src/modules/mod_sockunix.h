@@ -18,12 +18,45 @@
 #ifndef MOD_SOCKUNIX_H
 #define MOD_SOCKUNIX_H
 
+#include "dgram.h"
+
 #define SOCKUNIX_FIELDS 4
 #define F_EVENT    0
 #define F_TIME     1
 #define F_SOCKET   2
 #define F_MSG      3
 
+/**
+ ** @struct sockunix_socket_s
+ **   A listening unix datagram socket.
+ **/
+/**   @var sockunix_socket_s::next
+ **     Next socket.
+ **/
+/**   @var sockunix_socket_s::path
+ **     Socket path.
+ **/
+/**   @var sockunix_socket_s::fd
+ **     The socket.
+ **/
+/**   @var sockunix_socket_s::drops
+ **     Last value of the kernel drop counter of the socket.
+ **/
+typedef struct sockunix_socket_s sockunix_socket_t;
+struct sockunix_socket_s {
+  sockunix_socket_t *next;
+  char *path;
+  int fd;
+  uint32_t drops;
+};
+
+typedef struct sockunix_cfg_s {
+  int batch; // max datagrams read per wakeup
+  int rcvbuf; // socket receive buffer size, 0 for the default
+  sockunix_socket_t *socks;
+  dgram_ring_t *ring;
+} sockunix_cfg_t;
+
 
 static int
 create_sockunix_socket(const char *path);
@@ -37,6 +70,10 @@ static void *
 sockunix_preconfig(orchids_t *ctx, mod_entry_t *mod);
 
 
+static void
+sockunix_postconfig(orchids_t *ctx, mod_entry_t *mod);
+
+
 static void
 add_unix_socket(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
 
@@ -1,7 +1,10 @@
 /**
  ** @file mod_stats.c
  ** Provide statistics of the whole analysis engine.
- ** Used to test/debug/orchids internals at runtime.
+ ** Serve them to Prometheus (text exposition format) on a TCP port:
+ ** GET /metrics.  All the metrics are counters and gauges already
+ ** maintained by the engine, so a scrape doesn't walk the rule or
+ ** state instances (only the list of rules, for per-rule gauges).
  **
  ** @author Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
  **
@@ -20,20 +23,461 @@
 #endif
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "orchids.h"
 
+#include "evt_mgr.h"
+#include "latency.h"
+#include "mem_governor.h"
+#include "orchids_api.h"
+
+#include "mod_stats.h"
+
 input_module_t mod_stats;
 
-#define DEFAULT_STATS_PORT 10000
+static const double stats_lag_buckets_g[] = STATS_LAG_BUCKETS;
+
 
-typedef struct statscfg_s statscfg_t;
-struct statscfg_s
+static void
+stats_printf(statscfg_t *cfg, const char *fmt, ...)
 {
-  int listen_port;
+  va_list ap;
+  int n;
+
+  for (;;) {
+    va_start(ap, fmt);
+    n = vsnprintf(cfg->buf + cfg->buf_len, cfg->buf_sz - cfg->buf_len,
+                  fmt, ap);
+    va_end(ap);
+    if (n < 0)
+      return ;
+    if (cfg->buf_len + n < cfg->buf_sz) {
+      cfg->buf_len += n;
+      return ;
+    }
+    cfg->buf_sz = 2 * cfg->buf_sz + n;
+    cfg->buf = Xrealloc(cfg->buf, cfg->buf_sz);
+  }
+}
+
+
+static void
+stats_metric(statscfg_t *cfg, const char *name, const char *type,
+             const char *help)
+{
+  stats_printf(cfg, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+
+static void
+stats_latency(orchids_t *ctx, statscfg_t *cfg)
+{
+  static const char *phase_g[] = { "queue", "dissect", "correlate", "total" };
+  const latency_hist_t *h;
+  uint64_t le;
+  int i;
+  int p;
+
+  stats_metric(cfg, "orchids_event_latency_seconds", "histogram",
+               "Latency of the events posted by each module, by phase.");
+  for (i = 0; i < ctx->loaded_modules; i++) {
+    if (ctx->mods[i].latency == NULL)
+      continue ;
+    for (p = 0; p < LATENCY_PHASES; p++) {
+      h = &ctx->mods[i].latency->phase[p];
+      /* Powers of 4 are bucket boundaries of the latency histograms */
+      for (le = 4; le <= STATS_LATENCY_MAX_US; le *= 4)
+        stats_printf(cfg, "orchids_event_latency_seconds_bucket"
+                     "{module=\"%s\",phase=\"%s\",le=\"%g\"} %lu\n",
+                     ctx->mods[i].mod->name, phase_g[p], le / 1e6,
+                     latency_count_upto(h, le));
+      stats_printf(cfg, "orchids_event_latency_seconds_bucket"
+                   "{module=\"%s\",phase=\"%s\",le=\"+Inf\"} %lu\n",
+                   ctx->mods[i].mod->name, phase_g[p], h->count);
+      stats_printf(cfg, "orchids_event_latency_seconds_sum"
+                   "{module=\"%s\",phase=\"%s\"} %.6f\n",
+                   ctx->mods[i].mod->name, phase_g[p], h->sum_us / 1e6);
+      stats_printf(cfg, "orchids_event_latency_seconds_count"
+                   "{module=\"%s\",phase=\"%s\"} %lu\n",
+                   ctx->mods[i].mod->name, phase_g[p], h->count);
+    }
+  }
+}
+
+
+static void
+stats_build(orchids_t *ctx, statscfg_t *cfg)
+{
+  struct rusage ru;
+  rule_t *r;
+  int i;
+
+  cfg->buf_len = 0;
+  getrusage(RUSAGE_SELF, &ru);
+
+  stats_metric(cfg, "orchids_start_time_seconds", "gauge",
+               "Start time of the process since the Epoch.");
+  stats_printf(cfg, "orchids_start_time_seconds %li.%06li\n",
+               (long) ctx->start_time.tv_sec, (long) ctx->start_time.tv_usec);
+  stats_metric(cfg, "orchids_cpu_seconds_total", "counter",
+               "User and system CPU time.");
+  stats_printf(cfg, "orchids_cpu_seconds_total %.3f\n",
+               ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+               + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6);
+
+  stats_metric(cfg, "orchids_events_total", "counter",
+               "Events injected in the analysis engine.");
+  stats_printf(cfg, "orchids_events_total %u\n", ctx->events);
+  stats_metric(cfg, "orchids_module_events_total", "counter",
+               "Events posted by each module.");
+  for (i = 0; i < ctx->loaded_modules; i++)
+    stats_printf(cfg, "orchids_module_events_total{module=\"%s\"} %lu\n",
+                 ctx->mods[i].mod->name, ctx->mods[i].posts);
+  stats_metric(cfg, "orchids_module_lost_events_total", "counter",
+               "Events lost by each module.");
+  for (i = 0; i < ctx->loaded_modules; i++)
+    stats_printf(cfg, "orchids_module_lost_events_total{module=\"%s\"} %lu\n",
+                 ctx->mods[i].mod->name, ctx->mods[i].lost);
+  stats_metric(cfg, "orchids_queued_events", "gauge",
+               "Events waiting in the ingestion queues.");
+  stats_printf(cfg, "orchids_queued_events %zu\n", ctx->queued_events);
+
+  stats_metric(cfg, "orchids_active_events", "gauge",
+               "Events referenced by state instances.");
+  stats_printf(cfg, "orchids_active_events %u\n", ctx->active_events);
+  stats_metric(cfg, "orchids_rule_instances", "gauge",
+               "Rule instances.");
+  stats_printf(cfg, "orchids_rule_instances %u\n", ctx->rule_instances);
+  stats_metric(cfg, "orchids_state_instances", "gauge",
+               "State instances.");
+  stats_printf(cfg, "orchids_state_instances %u\n", ctx->state_instances);
+  stats_metric(cfg, "orchids_threads", "gauge",
+               "Threads waiting for an event.");
+  stats_printf(cfg, "orchids_threads %u\n", ctx->threads);
+
+  stats_metric(cfg, "orchids_rule_instances_by_rule", "gauge",
+               "Rule instances of each rule.");
+  for (r = ctx->rule_compiler->first_rule; r; r = r->next)
+    stats_printf(cfg, "orchids_rule_instances_by_rule{rule=\"%s\"} %i\n",
+                 r->name, r->instances);
+  stats_metric(cfg, "orchids_rule_memory_bytes", "gauge",
+               "Memory used by the instances of each rule.");
+  for (r = ctx->rule_compiler->first_rule; r; r = r->next)
+    stats_printf(cfg, "orchids_rule_memory_bytes{rule=\"%s\"} %zu\n",
+                 r->name, r->mem_used);
+
+  stats_metric(cfg, "orchids_memory_bytes", "gauge",
+               "Memory used by the analysis engine.");
+  stats_printf(cfg, "orchids_memory_bytes %zu\n", MEMGOV_USED(ctx));
+  stats_metric(cfg, "orchids_memory_peak_bytes", "gauge",
+               "Highest memory use of the analysis engine.");
+  stats_printf(cfg, "orchids_memory_peak_bytes %zu\n", ctx->memgov.peak);
+  stats_metric(cfg, "orchids_evicted_instances_total", "counter",
+               "Rule instances evicted by the memory governor.");
+  stats_printf(cfg, "orchids_evicted_instances_total %u\n",
+               ctx->memgov.evicted_instances);
+  stats_metric(cfg, "orchids_shed_events_total", "counter",
+               "Events shed by the memory governor.");
+  stats_printf(cfg, "orchids_shed_events_total %u\n", ctx->memgov.shed_events);
+
+  stats_metric(cfg, "orchids_reports_total", "counter", "Reports.");
+  stats_printf(cfg, "orchids_reports_total %u\n", ctx->reports);
+  stats_metric(cfg, "orchids_queued_reports", "gauge",
+               "Reports waiting for the report writer.");
+  stats_printf(cfg, "orchids_queued_reports %zu\n", ctx->report_queue.len);
+  stats_metric(cfg, "orchids_dropped_reports_total", "counter",
+               "Reports dropped because the report queue was full.");
+  stats_printf(cfg, "orchids_dropped_reports_total %u\n",
+               ctx->report_queue.dropped);
+
+  stats_metric(cfg, "orchids_loop_lag_seconds", "histogram",
+               "Delay of the real-time actions of the main loop.");
+  for (i = 0; i < STATS_LAG_BUCKETS_NB; i++)
+    stats_printf(cfg, "orchids_loop_lag_seconds_bucket{le=\"%g\"} %lu\n",
+                 stats_lag_buckets_g[i], cfg->lag_buckets[i]);
+  stats_printf(cfg, "orchids_loop_lag_seconds_bucket{le=\"+Inf\"} %lu\n",
+               cfg->lag_count);
+  stats_printf(cfg, "orchids_loop_lag_seconds_sum %.6f\n", cfg->lag_sum);
+  stats_printf(cfg, "orchids_loop_lag_seconds_count %lu\n", cfg->lag_count);
+  stats_metric(cfg, "orchids_loop_lag_max_seconds", "gauge",
+               "Highest delay of the real-time actions.");
+  stats_printf(cfg, "orchids_loop_lag_max_seconds %.6f\n", cfg->lag_max);
+
+  stats_latency(ctx, cfg);
+
+  stats_metric(cfg, "orchids_scrapes_total", "counter",
+               "Requests to the metrics endpoint.");
+  stats_printf(cfg, "orchids_scrapes_total %lu\n", cfg->scrapes);
+}
+
+
+static void
+stats_client_close(orchids_t *ctx, stats_client_t *cli)
+{
+  if (cli->out == NULL)
+    del_input_descriptor(ctx, cli->fd);
+  close(cli->fd);
+  cli->fd = -1;
+}
+
+
+/**
+ ** Send what the socket buffer takes of the rest of the response,
+ ** without blocking the main loop.
+ ** @return 1 when the whole response is sent or the client is gone,
+ **   0 otherwise.
+ **/
+static int
+stats_client_send(stats_client_t *cli)
+{
+  ssize_t n;
+
+  while (cli->out_off < cli->out_len) {
+    n = send(cli->fd, cli->out + cli->out_off, cli->out_len - cli->out_off,
+             MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue ;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return (0);
+    if (n <= 0)
+      return (1);
+    cli->out_off += n;
+  }
+
+  return (1);
+}
+
+
+static void
+stats_reply(stats_client_t *cli, const char *status,
+            const char *body, size_t len)
+{
+  char hdr[256];
+  int n;
+
+  n = snprintf(hdr, sizeof (hdr),
+               "HTTP/1.0 %s\r\n"
+               "Content-Type: text/plain; version=0.0.4\r\n"
+               "Content-Length: %zu\r\n"
+               "Connection: close\r\n\r\n", status, len);
+  cli->out = Xmalloc(n + len);
+  memcpy(cli->out, hdr, n);
+  if (len > 0)
+    memcpy(cli->out + n, body, len);
+  cli->out_len = n + len;
+  cli->out_off = 0;
+}
+
+
+static int
+stats_client_callback(orchids_t *ctx, mod_entry_t *mod, int fd, void *data)
+{
+  statscfg_t *cfg = mod->config;
+  stats_client_t *cli = data;
+  char *req;
+  ssize_t sz;
+
+  sz = recv(fd, cli->req + cli->req_len,
+            sizeof (cli->req) - 1 - cli->req_len, MSG_DONTWAIT);
+  if (sz < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+    return (0);
+  if (sz <= 0) {
+    stats_client_close(ctx, cli);
+    return (0);
+  }
+  cli->req_len += sz;
+  cli->req[cli->req_len] = '\0';
+
+  /* Wait for the end of the request line */
+  if (strchr(cli->req, '\n') == NULL) {
+    if (cli->req_len < sizeof (cli->req) - 1)
+      return (0);
+    stats_reply(cli, "414 Request-URI Too Long", NULL, 0);
+  }
+  else {
+    req = cli->req;
+    if (!strncmp(req, "GET /metrics", 12) && strchr(" ?\r\n", req[12])) {
+      cfg->scrapes++;
+      stats_build(ctx, cfg);
+      stats_reply(cli, "200 OK", cfg->buf, cfg->buf_len);
+    }
+    else
+      stats_reply(cli, "404 Not Found", NULL, 0);
+  }
+
+  /* Don't read the rest of the request */
+  del_input_descriptor(ctx, fd);
+  if (stats_client_send(cli))
+    stats_client_close(ctx, cli);
+
+  return (0);
+}
+
+
+/**
+ ** Real-time action of a connection: send the rest of the response,
+ ** close the connection once it is sent, or at the deadline, and free
+ ** the connection once closed.
+ **/
+static int
+rtaction_stats_client(orchids_t *ctx, rtaction_t *e)
+{
+  stats_client_t *cli = e->data;
+
+  if (cli->fd >= 0 && cli->out && stats_client_send(cli))
+    stats_client_close(ctx, cli);
+  if (cli->fd >= 0 && !timercmp(&ctx->cur_loop_time, &cli->deadline, <)) {
+    DebugLog(DF_MOD, DS_DEBUG, "metrics client timed out\n");
+    stats_client_close(ctx, cli);
+  }
+  if (cli->fd < 0) {
+    if (cli->out)
+      Xfree(cli->out);
+    Xfree(cli);
+    Xfree(e);
+    return (0);
+  }
+
+  e->date = ctx->cur_loop_time;
+  e->date.tv_usec += STATS_SEND_DELAY;
+  if (e->date.tv_usec >= 1000000) {
+    e->date.tv_sec += e->date.tv_usec / 1000000;
+    e->date.tv_usec %= 1000000;
+  }
+  register_rtaction(ctx, e);
+
+  return (0);
+}
+
+
+static int
+stats_listen_callback(orchids_t *ctx, mod_entry_t *mod, int fd, void *data)
+{
+  struct sockaddr_in cliadd;
+  socklen_t clilen;
+  stats_client_t *cli;
+  int cli_fd;
+
+  clilen = sizeof (cliadd);
+  cli_fd = accept(fd, (struct sockaddr *) &cliadd, &clilen);
+  if (cli_fd < 0) {
+    DebugLog(DF_MOD, DS_WARN, "accept(): %s\n", strerror(errno));
+    return (0);
+  }
+
+  DebugLog(DF_MOD, DS_DEBUG,
+           "metrics request from %s\n", inet_ntoa(cliadd.sin_addr));
+
+  cli = Xzmalloc(sizeof (stats_client_t));
+  cli->fd = cli_fd;
+  gettimeofday(&cli->deadline, NULL);
+  cli->deadline.tv_sec += STATS_CLIENT_TIMEOUT;
+  add_input_descriptor(ctx, mod, stats_client_callback, cli_fd, cli);
+  register_rtcallback(ctx, rtaction_stats_client, cli, 0);
+
+  return (0);
+}
+
+
+static int
+create_tcplisten_socket(int port)
+{
+  int fd, on = 1;
+  struct sockaddr_in sin;
+
+  fd = Xsocket(AF_INET, SOCK_STREAM, 0);
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(port);
+
+  Xsetsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  Xbind(fd, (struct sockaddr *) &sin, sizeof(sin));
+
+  Xlisten(fd, 5);
+
+  return (fd);
+}
+
+
+/**
+ ** Measure the loop lag: how late this action runs, with respect to
+ ** the date it was scheduled at.
+ **/
+static int
+rtaction_stats_lag(orchids_t *ctx, rtaction_t *e)
+{
+  statscfg_t *cfg = e->data;
+  struct timeval now;
+  struct timeval diff;
+  double lag;
+  int i;
+
+  gettimeofday(&now, NULL);
+  Timer_Sub(&diff, &now, &e->date);
+  lag = Timer_Float(&diff);
+  if (lag < 0)
+    lag = 0;
+
+  cfg->lag = lag;
+  if (lag > cfg->lag_max)
+    cfg->lag_max = lag;
+  cfg->lag_sum += lag;
+  cfg->lag_count++;
+  for (i = 0; i < STATS_LAG_BUCKETS_NB; i++)
+    if (lag <= stats_lag_buckets_g[i])
+      cfg->lag_buckets[i]++;
+
+  e->date = now;
+  e->date.tv_sec += 1;
+  register_rtaction(ctx, e);
+
+  return (0);
+}
+
+
+static void *
+stats_preconfig(orchids_t *ctx, mod_entry_t *mod)
+{
+  statscfg_t *mod_cfg;
+
+  DebugLog(DF_MOD, DS_INFO,
+           "loading stats module @ %p\n", (void *) &mod_stats);
+
+  mod_cfg = Xzmalloc(sizeof (statscfg_t));
+  mod_cfg->listen_port = DEFAULT_STATS_PORT;
+  mod_cfg->buf_sz = 16384;
+  mod_cfg->buf = Xmalloc(mod_cfg->buf_sz);
+
+  return (mod_cfg);
+}
+
+
+static void
+stats_postconfig(orchids_t *ctx, mod_entry_t *mod)
+{
+  statscfg_t *cfg = mod->config;
+  int fd;
+
+  fd = create_tcplisten_socket(cfg->listen_port);
+  add_input_descriptor(ctx, mod, stats_listen_callback, fd, NULL);
+
+  register_rtcallback(ctx, rtaction_stats_lag, cfg, 1);
+}
 
-  /* some statistics ... */
-};
 
 static void
 set_listen_port(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
@@ -44,23 +488,23 @@ set_listen_port(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
   DebugLog(DF_MOD, DS_INFO, "setting tcp listen port on %i\n", port);
 
   if (port > 0)
-    ((radmcfg_t *)mod->config)->listen_port = port;
+    ((statscfg_t *)mod->config)->listen_port = port;
 }
 
 static mod_cfg_cmd_t stats_dir[] = {
-  { "ListenPort", set_listen_port, "Set listen port for remonte admin" },
+  { "ListenPort", set_listen_port, "Set listen port for the metrics endpoint" },
   { NULL, NULL }
 };
 
-input_module_t mod_remoteadm = {
+input_module_t mod_stats = {
   MOD_MAGIC,
   ORCHIDS_VERSION,
   "stats",
   "CeCILL2",
   NULL,
   stats_dir,
-  NULL,
-  NULL,
+  stats_preconfig,
+  stats_postconfig,
   NULL
 };
 
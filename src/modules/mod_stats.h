@@ -0,0 +1,113 @@
+/**
+ ** @file mod_stats.h
+ ** Definitions for mod_stats.c
+ **
+ ** @version 0.1
+ ** @ingroup modules
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef MOD_STATS_H
+#define MOD_STATS_H
+
+#include "orchids.h"
+
+#define DEFAULT_STATS_PORT 10000
+
+/* Size of the buffer for the HTTP request line */
+#define STATS_REQUEST_SZ 1024
+
+/* Seconds a client has to send its request and read the response */
+#define STATS_CLIENT_TIMEOUT 10
+
+/* Delay between two attempts to send the rest of a response, in
+ * microseconds */
+#define STATS_SEND_DELAY 20000
+
+/* Upper bounds of the loop lag histogram buckets, in seconds */
+#define STATS_LAG_BUCKETS \
+  { 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0, 5.0 }
+#define STATS_LAG_BUCKETS_NB 8
+
+/* Largest upper bound of the event latency histogram buckets, in
+ * microseconds (bounds are powers of 4, from 4us to about 4s) */
+#define STATS_LATENCY_MAX_US 4194304
+
+/* A connection to the metrics endpoint.  The request line is read
+ * without blocking, then the response is sent by steps, as the client
+ * reads it.  A real-time action owns the connection: it sends the
+ * rest of the response and closes the connection at the deadline. */
+typedef struct stats_client_s stats_client_t;
+struct stats_client_s
+{
+  int             fd;       /* -1 once closed */
+  struct timeval  deadline;
+  char            req[STATS_REQUEST_SZ];
+  size_t          req_len;
+  char           *out;      /* response, NULL until the request is read */
+  size_t          out_len;
+  size_t          out_off;
+};
+
+typedef struct statscfg_s statscfg_t;
+struct statscfg_s
+{
+  int listen_port;
+
+  /* loop lag, measured by a 1 s real-time action */
+  double        lag;
+  double        lag_max;
+  double        lag_sum;
+  unsigned long lag_count;
+  unsigned long lag_buckets[STATS_LAG_BUCKETS_NB];
+
+  unsigned long scrapes;
+
+  /* response buffer, reused between scrapes */
+  char   *buf;
+  size_t  buf_len;
+  size_t  buf_sz;
+};
+
+#endif /* MOD_STATS_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
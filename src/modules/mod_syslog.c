@@ -28,11 +28,14 @@
 #include "orchids.h"
 
 #include "orchids_api.h"
+#include "timestamp.h"
 
 #include "mod_syslog.h"
 
 input_module_t mod_syslog;
 
+static ts_cache_t syslog_ts_g = TS_CACHE_INITIALIZER;
+
 /*
 ** priority = facility * 8 + severity
 ** (extracted from rfc3164)
@@ -89,7 +92,9 @@ static int
 dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
 {
   ovm_var_t *attr[SYSLOG_FIELDS];
-  struct tm *t;
+  event_arena_t *arena;
+  struct timeval tv;
+  time_t t;
   char *txt_line;
   int txt_len;
   size_t token_size;
@@ -98,6 +103,7 @@ dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
   DebugLog(DF_MOD, DS_DEBUG, "syslog_dissector()\n");
 
   memset(attr, 0, sizeof(attr));
+  arena = event_arena(ctx, event);
 
   txt_line = STR(event->value);
   txt_len = STRLEN(event->value);
@@ -109,10 +115,10 @@ dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
       DebugLog(DF_MOD, DS_WARN, "PRI error.\n");
       return (1);
     }
-    attr[F_FACILITY] = ovm_vstr_new();
+    attr[F_FACILITY] = ovm_vstr_new_arena(arena);
     VSTR(attr[F_FACILITY]) = syslog_facility_g[syslog_priority >> 3];
     VSTRLEN(attr[F_FACILITY])= strlen(syslog_facility_g[syslog_priority >> 3]);
-    attr[F_SEVERITY] = ovm_vstr_new();
+    attr[F_SEVERITY] = ovm_vstr_new_arena(arena);
     VSTR(attr[F_SEVERITY]) = syslog_severity_g[syslog_priority & 0x07];
     VSTRLEN(attr[F_SEVERITY]) = strlen(syslog_severity_g[syslog_priority & 0x07]);
 
@@ -120,22 +126,37 @@ dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
     txt_len -= token_size + 2;
   }
 
-  if ((txt_len > 15) &&
+  if ((txt_len > TS_SYSLOG_LEN) &&
       (txt_line[3] == ' ') && (txt_line[6] == ' ') &&
       (txt_line[9] == ':') && (txt_line[12] == ':') &&
       (txt_line[15] == ' ')) {
-    t = syslog_getdate(txt_line);
-    if (t == NULL) {
+    if (ts_parse_syslog(&syslog_ts_g, txt_line,
+                        ctx->cur_loop_time.tv_sec, &t)) {
+      DebugLog(DF_MOD, DS_WARN, "time format error.\n");
+      free_fields(attr, SYSLOG_FIELDS);
+      return (1);
+    }
+    attr[F_TIME] = ovm_ctime_new_arena(arena);
+    attr[F_TIME]->flags |= TYPE_MONO;
+    CTIME(attr[F_TIME]) = t;
+
+    txt_line += TS_SYSLOG_LEN + 1;
+    txt_len -= TS_SYSLOG_LEN + 1;
+  } else if ((txt_len > TS_ISO8601_LEN) &&
+             (txt_line[4] == '-') && (txt_line[7] == '-')) {
+    /* RFC 3339 date, as written by rsyslog (high precision format) */
+    token_size = my_strspn(txt_line, " ", txt_len);
+    if (ts_parse_iso8601(&syslog_ts_g, txt_line, token_size, &tv) == NULL) {
       DebugLog(DF_MOD, DS_WARN, "time format error.\n");
       free_fields(attr, SYSLOG_FIELDS);
       return (1);
     }
-    attr[F_TIME] = ovm_ctime_new();
+    attr[F_TIME] = ovm_ctime_new_arena(arena);
     attr[F_TIME]->flags |= TYPE_MONO;
-    CTIME(attr[F_TIME]) = mktime(t);
+    CTIME(attr[F_TIME]) = tv.tv_sec;
 
-    txt_line += 16;
-    txt_len -= 16;
+    txt_line += token_size + 1;
+    txt_len -= token_size + 1;
   } else {
     DebugLog(DF_MOD, DS_INFO, "no date present.\n");
   }
@@ -154,7 +175,7 @@ dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
 #endif
     DebugLog(DF_MOD, DS_DEBUG, "read host.\n");
 
-    attr[F_HOST] = ovm_vstr_new();
+    attr[F_HOST] = ovm_vstr_new_arena(arena);
     VSTRLEN(attr[F_HOST]) = token_size;
     VSTR(attr[F_HOST]) = txt_line;
 
@@ -174,17 +195,17 @@ dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
   /* Handle syslog message repetition */
   if (!strncmp("last message repeated ", txt_line, 22)) {
     token_size = my_strspn(txt_line, "\r\n", txt_len);
-    attr[F_MSG] = ovm_vstr_new();
+    attr[F_MSG] = ovm_vstr_new_arena(arena);
     VSTR(attr[F_MSG]) = txt_line;
     VSTRLEN(attr[F_MSG]) = token_size;
     txt_line += 22;
     txt_len -= 22;
-    attr[F_REPEAT] = ovm_int_new();
+    attr[F_REPEAT] = ovm_int_new_arena(arena);
     token_size = get_next_int(txt_line, &(INT(attr[F_REPEAT])), txt_len);
     token_size++;
     txt_line += token_size;
     txt_len -= token_size;
-    attr[F_PROG] = ovm_str_new(6);
+    attr[F_PROG] = ovm_str_new_arena(arena, 6);
     strcpy(STR(attr[F_PROG]), "syslog");
     add_fields_to_event(ctx, mod, &event, attr, SYSLOG_FIELDS);
     post_event(ctx, mod, event);
@@ -194,7 +215,7 @@ dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
 
   token_size = my_strspn(txt_line, "[:", txt_len);
 
-  attr[F_PROG] = ovm_vstr_new();
+  attr[F_PROG] = ovm_vstr_new_arena(arena);
 
 #ifndef NO_GCONFD_HACK
   if (!strncmp("gconfd", txt_line, 6)) {
@@ -222,7 +243,7 @@ dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
 
   /* look ahead */
   if (*txt_line == '[') { /* fill pid */
-    attr[F_PID] = ovm_int_new();
+    attr[F_PID] = ovm_int_new_arena(arena);
     token_size = get_next_int(txt_line + 1, &(INT(attr[F_PID])), txt_len);
     if (strncmp(txt_line + token_size + 1, "]: ", 3)) {
       DebugLog(DF_MOD, DS_WARN, "syntax error.\n");
@@ -242,7 +263,7 @@ dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
   }
 
   /* remaining string is the syslog message */
-  attr[F_MSG] = ovm_vstr_new();
+  attr[F_MSG] = ovm_vstr_new_arena(arena);
   token_size = my_strspn(txt_line, "\r\n", txt_len);
   VSTRLEN(attr[F_MSG]) = token_size;
   VSTR(attr[F_MSG]) = txt_line;
@@ -296,97 +317,6 @@ input_module_t mod_syslog = {
   NULL
 };
 
-
-/*
-** date conversion
-*/
-
-struct tm *
-syslog_getdate(const char *date)
-{
-  static struct tm t;
-  int day;
-
-  /* XXX hard coded year */
-  t.tm_year = 107;
-
-  switch (date[0]) {
-    case 'A': /* Aug, Avr */
-      switch (date[1]) {
-        case 'u':
-          t.tm_mon = MOD_SYSLOG_AUG;
-          break;
-        case 'v':
-          t.tm_mon = MOD_SYSLOG_AVR;
-          break;
-      }
-      break;
-
-    case 'D': /* Dec */
-      t.tm_mon = MOD_SYSLOG_DEC;
-      break;
-
-    case 'F': /* Feb */
-      t.tm_mon = MOD_SYSLOG_FEB;
-      break;
-
-    case 'J': /* Jan, Jul, Jun */
-      if (date[1] == 'a') {
-        t.tm_mon = MOD_SYSLOG_JAN;
-      }
-      else if (date[1] == 'u' && date[2] == 'l') {
-        t.tm_mon = MOD_SYSLOG_JUL;
-      }
-      else if (date[1] == 'u' && date[2] == 'n') {
-        t.tm_mon = MOD_SYSLOG_JUN;
-      }
-      break;
-
-    case 'M': /* Mar, May */
-      switch (date[2]) {
-      case 'r':
-        t.tm_mon = MOD_SYSLOG_MAR;
-        break;
-      case 'y':
-        t.tm_mon = MOD_SYSLOG_MAY;
-        break;
-      }
-      break;
-
-    case 'N': /* Nov */
-      t.tm_mon = MOD_SYSLOG_NOV;
-      break;
-
-    case 'O': /* Oct */
-      t.tm_mon = MOD_SYSLOG_OCT;
-      break;
-
-    case 'S': /* Sep */
-      t.tm_mon = MOD_SYSLOG_SEP;
-      break;
-
-    default:
-      return (NULL);
-      break;
-    }
-
-  if (date[4] != ' ') {
-    day = (date[4] - '0') * 10;
-  }
-  else {
-    day = 0;
-  }
-  day += date[5] - '0';
-  t.tm_mday = day;
-
-  t.tm_hour = (date[7] - '0') * 10 + (date[8] - '0');
-  t.tm_min = (date[10] - '0') * 10 + (date[11] - '0');
-  t.tm_sec = (date[13] - '0') * 10 + (date[14] - '0');
-
-  return (&t);
-}
-
-
 /*
 ** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
 ** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
@@ -29,25 +29,6 @@
 #define F_PROG 6
 #define F_MSG 7
 
-/* for date convertion */
-#define MOD_SYSLOG_JAN  0
-#define MOD_SYSLOG_FEB  1
-#define MOD_SYSLOG_MAR  2
-#define MOD_SYSLOG_AVR  3
-#define MOD_SYSLOG_MAY  4
-#define MOD_SYSLOG_JUN  5
-#define MOD_SYSLOG_JUL  6
-#define MOD_SYSLOG_AUG  7
-#define MOD_SYSLOG_SEP  8
-#define MOD_SYSLOG_OCT  9
-#define MOD_SYSLOG_NOV 10
-#define MOD_SYSLOG_DEC 11
-
-
-struct tm *
-syslog_getdate(const char *date);
-
-
 static int
 dissect_syslog(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data);
 
@@ -0,0 +1,766 @@
+/**
+ ** @file mod_tcpflow.c
+ ** TCP flow table and stream reassembly, on top of mod_ipdecode.
+ **
+ ** TCP packets are not injected one by one.  Instead, each connection
+ ** produces a 'start' event, 'data' events carrying its reassembled
+ ** payload in chunks (one chunk is also posted when the direction of
+ ** the data changes, so that requests and responses are not mixed),
+ ** and an 'end' event with the per-direction counters, after the
+ ** FIN exchange, a RST, an idle timeout or when the table is full.
+ **
+ ** Idle flows are expired on the time of the packets, so that the
+ ** same events are produced from pcap savefiles, and by a real-time
+ ** callback when no packet comes.  mod_pcap calls
+ ** mod_tcpflow_flush() once its savefiles are read.
+ **
+ ** @version 0.1
+ ** @ingroup modules
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "orchids.h"
+
+#include "orchids_api.h"
+#include "evt_mgr.h"
+#include "engine.h"
+#include "mod_mgr.h"
+
+#include "mod_tcpflow.h"
+
+input_module_t mod_tcpflow;
+
+
+/**
+ ** Field names of mod_ipdecode and mod_pcap, in the IN_* order.
+ **/
+static char *tcpflow_in_fields_g[TCPFLOW_IN_FIELDS] = {
+  "ipdecode.version",
+  "ipdecode.src",
+  "ipdecode.dst",
+  "ipdecode.src6",
+  "ipdecode.dst6",
+  "ipdecode.proto",
+  "ipdecode.sport",
+  "ipdecode.dport",
+  "ipdecode.tcpflags",
+  "ipdecode.seq",
+  "ipdecode.payload",
+  "pcap.time"
+};
+
+
+static void
+free_half(tcpflow_half_t *h)
+{
+  tcpflow_seg_t *s;
+  tcpflow_seg_t *next;
+
+  for (s = h->ooo; s; s = next) {
+    next = s->next;
+    Xfree(s);
+  }
+  if (h->buf)
+    Xfree(h->buf);
+}
+
+
+static ovm_var_t *
+vstr_arena(event_arena_t *arena, char *s)
+{
+  ovm_var_t *var;
+
+  var = ovm_vstr_new_arena(arena);
+  VSTR(var) = s;
+  VSTRLEN(var) = strlen(s);
+
+  return (var);
+}
+
+
+static ovm_var_t *
+int_arena(event_arena_t *arena, long i)
+{
+  ovm_var_t *var;
+
+  var = ovm_int_new_arena(arena);
+  INT(var) = i;
+
+  return (var);
+}
+
+
+/**
+ ** Post a flow event, with the fields common to all flow events.
+ ** The other fields are already in attr.
+ **/
+static void
+post_flow_event(orchids_t *ctx, mod_entry_t *mod, tcpflow_t *f,
+                char *type, event_arena_t *arena, ovm_var_t **attr)
+{
+  tcpflow_key_t *k = &f->key;
+  int c = f->client;
+  event_t *event;
+
+  attr[F_TYPE] = vstr_arena(arena, type);
+  attr[F_ID] = ovm_uint_new_arena(arena);
+  UINT(attr[F_ID]) = f->id;
+  attr[F_TIME] = ovm_timeval_new_arena(arena);
+  TIMEVAL(attr[F_TIME]) = f->last;
+  if (k->version == 4) {
+    attr[F_SRC] = ovm_ipv4_new_arena(arena);
+    memcpy(&IPV4(attr[F_SRC]), k->addr[c], 4);
+    attr[F_DST] = ovm_ipv4_new_arena(arena);
+    memcpy(&IPV4(attr[F_DST]), k->addr[1 - c], 4);
+  } else {
+    attr[F_SRC6] = ovm_bstr_new_arena(arena, 16);
+    memcpy(BSTR(attr[F_SRC6]), k->addr[c], 16);
+    attr[F_DST6] = ovm_bstr_new_arena(arena, 16);
+    memcpy(BSTR(attr[F_DST6]), k->addr[1 - c], 16);
+  }
+  attr[F_SPORT] = int_arena(arena, k->port[c]);
+  attr[F_DPORT] = int_arena(arena, k->port[1 - c]);
+
+  event = NULL;
+  add_fields_to_event(ctx, mod, &event, attr, TCPFLOW_FIELDS);
+  post_event(ctx, mod, event);
+}
+
+
+static void
+post_flow_start(orchids_t *ctx, mod_entry_t *mod, tcpflow_t *f)
+{
+  ovm_var_t *attr[TCPFLOW_FIELDS];
+  event_arena_t *arena;
+
+  memset(attr, 0, sizeof (attr));
+  arena = event_arena(ctx, NULL);
+  attr[F_HANDSHAKE] = int_arena(arena, f->handshake);
+  post_flow_event(ctx, mod, f, "start", arena, attr);
+}
+
+
+/**
+ ** Post the in-order bytes buffered in one direction.
+ **/
+static void
+post_flow_data(orchids_t *ctx, mod_entry_t *mod, tcpflow_t *f, int dir)
+{
+  tcpflow_half_t *h = &f->half[dir];
+  ovm_var_t *attr[TCPFLOW_FIELDS];
+  event_arena_t *arena;
+
+  if (h->len == 0)
+    return ;
+
+  memset(attr, 0, sizeof (attr));
+  arena = event_arena(ctx, NULL);
+  attr[F_DIR] = int_arena(arena, dir);
+  attr[F_DATA] = ovm_bstr_new_arena(arena, h->len);
+  memcpy(BSTR(attr[F_DATA]), h->buf, h->len);
+  h->len = 0;
+  post_flow_event(ctx, mod, f, "data", arena, attr);
+}
+
+
+/**
+ ** Post the end of a flow and remove it from the flow table.
+ **/
+static void
+end_flow(orchids_t *ctx, mod_entry_t *mod, tcpflow_t *f, char *reason)
+{
+  tcpflow_cfg_t *cfg = mod->config;
+  ovm_var_t *attr[TCPFLOW_FIELDS];
+  event_arena_t *arena;
+
+  post_flow_data(ctx, mod, f, 0);
+  post_flow_data(ctx, mod, f, 1);
+
+  memset(attr, 0, sizeof (attr));
+  arena = event_arena(ctx, NULL);
+  attr[F_HANDSHAKE] = int_arena(arena, f->handshake);
+  attr[F_START] = ovm_timeval_new_arena(arena);
+  TIMEVAL(attr[F_START]) = f->start;
+  attr[F_PKTS_CS] = int_arena(arena, f->half[0].pkts);
+  attr[F_PKTS_SC] = int_arena(arena, f->half[1].pkts);
+  attr[F_BYTES_CS] = int_arena(arena, f->half[0].bytes);
+  attr[F_BYTES_SC] = int_arena(arena, f->half[1].bytes);
+  attr[F_GAPS] = int_arena(arena, f->half[0].gaps + f->half[1].gaps);
+  attr[F_REASON] = vstr_arena(arena, reason);
+  post_flow_event(ctx, mod, f, "end", arena, attr);
+
+  hash_del(cfg->flows, &f->key, sizeof (tcpflow_key_t));
+  DTAILQ_REMOVE(&cfg->lru, f, lru);
+  cfg->nflows--;
+  free_half(&f->half[0]);
+  free_half(&f->half[1]);
+  Xfree(f);
+}
+
+
+/**
+ ** Expire the flows idle since before a given date.
+ **/
+static void
+expire_flows(orchids_t *ctx, mod_entry_t *mod, const timeval_t *now)
+{
+  tcpflow_cfg_t *cfg = mod->config;
+  tcpflow_t *f;
+
+  while ((f = DTAILQ_FIRST(&cfg->lru)) != NULL
+         && f->last.tv_sec + cfg->idle_timeout < now->tv_sec)
+    end_flow(ctx, mod, f, "timeout");
+}
+
+
+/**
+ ** Append in-order bytes to a direction, posting full chunks.
+ **/
+static void
+append_data(orchids_t *ctx, mod_entry_t *mod, tcpflow_t *f, int dir,
+            const u_char *data, size_t len)
+{
+  tcpflow_cfg_t *cfg = mod->config;
+  tcpflow_half_t *h = &f->half[dir];
+  size_t n;
+
+  /* Data in one direction ends the chunk of the other one */
+  if (f->half[1 - dir].len)
+    post_flow_data(ctx, mod, f, 1 - dir);
+
+  if (h->buf == NULL)
+    h->buf = Xmalloc(cfg->chunk_size);
+
+  h->next_seq += len;
+  h->bytes += len;
+  while (len > 0) {
+    n = cfg->chunk_size - h->len;
+    if (n > len)
+      n = len;
+    memcpy(h->buf + h->len, data, n);
+    h->len += n;
+    data += n;
+    len -= n;
+    if (h->len == cfg->chunk_size)
+      post_flow_data(ctx, mod, f, dir);
+  }
+}
+
+
+/**
+ ** Append the out-of-order segments which are now in sequence.
+ **/
+static void
+drain_ooo(orchids_t *ctx, mod_entry_t *mod, tcpflow_t *f, int dir)
+{
+  tcpflow_half_t *h = &f->half[dir];
+  tcpflow_seg_t *s;
+  size_t skip;
+
+  while ((s = h->ooo) != NULL && SEQ_LEQ(s->seq, h->next_seq)) {
+    h->ooo = s->next;
+    h->ooo_bytes -= s->len;
+    skip = h->next_seq - s->seq;
+    if (skip < s->len)
+      append_data(ctx, mod, f, dir, s->data + skip, s->len - skip);
+    Xfree(s);
+  }
+}
+
+
+static void
+queue_ooo(tcpflow_half_t *h, uint32_t seq, const u_char *data, size_t len)
+{
+  tcpflow_seg_t **prev;
+  tcpflow_seg_t *s;
+
+  for (prev = &h->ooo; *prev && SEQ_LEQ((*prev)->seq, seq);
+       prev = &(*prev)->next)
+    if ((*prev)->seq == seq && (*prev)->len >= len)
+      return ; /* retransmission */
+
+  s = Xmalloc(offsetof(tcpflow_seg_t, data) + len);
+  s->seq = seq;
+  s->len = len;
+  memcpy(s->data, data, len);
+  s->next = *prev;
+  *prev = s;
+  h->ooo_bytes += len;
+}
+
+
+/**
+ ** Reassemble a TCP segment sent in one direction.
+ **/
+static void
+reassemble(orchids_t *ctx, mod_entry_t *mod, tcpflow_t *f, int dir,
+           uint32_t seq, const u_char *data, size_t len)
+{
+  tcpflow_cfg_t *cfg = mod->config;
+  tcpflow_half_t *h = &f->half[dir];
+  uint32_t resume;
+  size_t skip;
+
+  if (len == 0)
+    return ;
+
+  /* Retransmitted bytes */
+  if (SEQ_LT(seq, h->next_seq)) {
+    skip = h->next_seq - seq;
+    if (skip >= len)
+      return ;
+    seq += skip;
+    data += skip;
+    len -= skip;
+  }
+
+  if (seq != h->next_seq) {
+    if (h->ooo_bytes + len <= cfg->max_ooo) {
+      queue_ooo(h, seq, data, len);
+      return ;
+    }
+    /* Too much data is missing: give up the hole, up to the first
+     * queued segment if it comes before this one */
+    resume = seq;
+    if (h->ooo && SEQ_LT(h->ooo->seq, resume))
+      resume = h->ooo->seq;
+    DebugLog(DF_MOD, DS_DEBUG, "flow %lu: skipping %u bytes\n",
+             f->id, resume - h->next_seq);
+    h->gaps += resume - h->next_seq;
+    h->next_seq = resume;
+    drain_ooo(ctx, mod, f, dir);
+    reassemble(ctx, mod, f, dir, seq, data, len);
+    return ;
+  }
+
+  append_data(ctx, mod, f, dir, data, len);
+  drain_ooo(ctx, mod, f, dir);
+}
+
+
+static tcpflow_t *
+new_flow(orchids_t *ctx, mod_entry_t *mod, tcpflow_key_t *key,
+         int client, int handshake, const timeval_t *time)
+{
+  tcpflow_cfg_t *cfg = mod->config;
+  tcpflow_t *f;
+
+  if (cfg->nflows >= cfg->max_flows) {
+    cfg->evicted++;
+    end_flow(ctx, mod, DTAILQ_FIRST(&cfg->lru), "evicted");
+  }
+
+  f = Xzmalloc(sizeof (tcpflow_t));
+  f->key = *key;
+  f->client = client;
+  f->id = cfg->next_id++;
+  f->handshake = handshake;
+  f->start = *time;
+  f->last = *time;
+  hash_add(cfg->flows, f, &f->key, sizeof (tcpflow_key_t));
+  DTAILQ_INSERT_TAIL(&cfg->lru, f, lru);
+  cfg->nflows++;
+
+  post_flow_start(ctx, mod, f);
+
+  return (f);
+}
+
+
+static ovm_var_t *
+get_in_field(tcpflow_cfg_t *cfg, event_t *event, int in)
+{
+  for ( ; event; event = event->next)
+    if (event->field_id == cfg->in[in])
+      return (event->value);
+
+  return (NULL);
+}
+
+
+static int
+tcpflow_dissect(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data)
+{
+  tcpflow_cfg_t *cfg = mod->config;
+  ovm_var_t *var[TCPFLOW_IN_FIELDS];
+  tcpflow_key_t key;
+  u_char addr[16];
+  tcpflow_t *f;
+  timeval_t time;
+  int side;
+  int dir;
+  int flags;
+  uint32_t seq;
+  int i;
+
+  DebugLog(DF_MOD, DS_TRACE, "tcpflow_dissect()\n");
+
+  for (i = 0; i < TCPFLOW_IN_FIELDS; i++)
+    var[i] = get_in_field(cfg, event, i);
+
+  if (var[IN_PROTO] == NULL || INT(var[IN_PROTO]) != IPPROTO_TCP
+      || var[IN_TCPFLAGS] == NULL || var[IN_SEQ] == NULL
+      || (var[IN_SRC] == NULL && var[IN_SRC6] == NULL)) {
+    /* Not TCP, or a non-first fragment */
+    inject_event(ctx, event);
+    return (0);
+  }
+
+  if (var[IN_TIME])
+    time = TIMEVAL(var[IN_TIME]);
+  else
+    time = ctx->cur_loop_time;
+  expire_flows(ctx, mod, &time);
+
+  /* Build the key, lowest endpoint first */
+  memset(&key, 0, sizeof (key));
+  key.version = INT(var[IN_VERSION]);
+  if (key.version == 4) {
+    memcpy(key.addr[0], &IPV4(var[IN_SRC]), 4);
+    memcpy(key.addr[1], &IPV4(var[IN_DST]), 4);
+  } else {
+    memcpy(key.addr[0], VBSTR(var[IN_SRC6]), 16);
+    memcpy(key.addr[1], VBSTR(var[IN_DST6]), 16);
+  }
+  key.port[0] = INT(var[IN_SPORT]);
+  key.port[1] = INT(var[IN_DPORT]);
+  side = 0;
+  i = memcmp(key.addr[0], key.addr[1], 16);
+  if (i > 0 || (i == 0 && key.port[0] > key.port[1])) {
+    memcpy(addr, key.addr[0], 16);
+    memcpy(key.addr[0], key.addr[1], 16);
+    memcpy(key.addr[1], addr, 16);
+    key.port[0] = key.port[1];
+    key.port[1] = INT(var[IN_SPORT]);
+    side = 1;
+  }
+
+  flags = INT(var[IN_TCPFLAGS]);
+  seq = UINT(var[IN_SEQ]);
+
+  f = hash_get(cfg->flows, &key, sizeof (key));
+
+  /* A new SYN on a known connection: the ports were reused */
+  if (f && (flags & (TH_SYN | TH_ACK)) == TH_SYN
+      && f->half[0].seq_known && seq + 1 != f->half[0].next_seq) {
+    end_flow(ctx, mod, f, "reused");
+    f = NULL;
+  }
+
+  if (f == NULL) {
+    if (flags & TH_RST)
+      goto done;
+    /* The client sends the SYN; without one, assume it's the sender */
+    if ((flags & (TH_SYN | TH_ACK)) == (TH_SYN | TH_ACK))
+      f = new_flow(ctx, mod, &key, 1 - side, 1, &time);
+    else
+      f = new_flow(ctx, mod, &key, side, (flags & TH_SYN) != 0, &time);
+  }
+
+  f->last = time;
+  DTAILQ_REMOVE(&cfg->lru, f, lru);
+  DTAILQ_INSERT_TAIL(&cfg->lru, f, lru);
+
+  dir = (side == f->client) ? 0 : 1;
+  f->half[dir].pkts++;
+
+  if (flags & TH_RST) {
+    end_flow(ctx, mod, f, "rst");
+    goto done;
+  }
+
+  if (flags & TH_SYN) {
+    f->half[dir].next_seq = seq + 1;
+    f->half[dir].seq_known = 1;
+    seq++;
+  } else if (!f->half[dir].seq_known) {
+    f->half[dir].next_seq = seq;
+    f->half[dir].seq_known = 1;
+  }
+
+  if (var[IN_PAYLOAD])
+    reassemble(ctx, mod, f, dir, seq,
+               VBSTR(var[IN_PAYLOAD]), VBSTRLEN(var[IN_PAYLOAD]));
+
+  if (flags & TH_FIN) {
+    f->half[dir].fin = 1;
+    if (f->half[1 - dir].fin) {
+      end_flow(ctx, mod, f, "fin");
+      goto done;
+    }
+  }
+
+ done:
+  if (cfg->pass_packets)
+    inject_event(ctx, event);
+  else
+    free_event(event);
+
+  return (0);
+}
+
+
+static int
+rtaction_tcpflow_expire(orchids_t *ctx, rtaction_t *e)
+{
+  mod_entry_t *mod = e->data;
+
+  expire_flows(ctx, mod, &ctx->cur_loop_time);
+
+  e->date = ctx->cur_loop_time;
+  e->date.tv_sec += 1;
+  register_rtaction(ctx, e);
+
+  return (0);
+}
+
+
+/**
+ ** Post the end of all the flows, e.g. at the end of pcap savefiles.
+ ** Called by call_mod_func().
+ **/
+int
+mod_tcpflow_flush(orchids_t *ctx, mod_entry_t *mod, void *params)
+{
+  tcpflow_cfg_t *cfg = mod->config;
+  tcpflow_t *f;
+
+  while ((f = DTAILQ_FIRST(&cfg->lru)) != NULL)
+    end_flow(ctx, mod, f, "flush");
+
+  return (0);
+}
+
+
+static field_t tcpflow_fields[] = {
+  { "tcpflow.type",      T_VSTR,    "Flow event type: start, data or end" },
+  { "tcpflow.id",        T_UINT,    "Flow identifier"                     },
+  { "tcpflow.time",      T_TIMEVAL, "Time of the last packet of the flow" },
+  { "tcpflow.src",       T_IPV4,    "Client IPv4 address"                 },
+  { "tcpflow.dst",       T_IPV4,    "Server IPv4 address"                 },
+  { "tcpflow.src6",      T_BSTR,    "Client IPv6 address (16 bytes)"      },
+  { "tcpflow.dst6",      T_BSTR,    "Server IPv6 address (16 bytes)"      },
+  { "tcpflow.sport",     T_INT,     "Client port"                         },
+  { "tcpflow.dport",     T_INT,     "Server port"                         },
+  { "tcpflow.handshake", T_INT,     "Flow seen from its SYN"              },
+  { "tcpflow.dir",       T_INT,     "Data direction (0: to the server)"   },
+  { "tcpflow.data",      T_BSTR,    "Reassembled payload chunk"           },
+  { "tcpflow.start",     T_TIMEVAL, "Time of the first packet"            },
+  { "tcpflow.pkts_cs",   T_INT,     "Packets from the client"             },
+  { "tcpflow.pkts_sc",   T_INT,     "Packets from the server"             },
+  { "tcpflow.bytes_cs",  T_INT,     "Payload bytes from the client"       },
+  { "tcpflow.bytes_sc",  T_INT,     "Payload bytes from the server"       },
+  { "tcpflow.gaps",      T_INT,     "Payload bytes never captured"        },
+  { "tcpflow.reason",    T_VSTR,    "End reason: fin, rst, timeout, reused, evicted, flush" }
+};
+
+
+static void *
+tcpflow_preconfig(orchids_t *ctx, mod_entry_t *mod)
+{
+  tcpflow_cfg_t *cfg;
+  mod_entry_t *m;
+  char modname[64];
+  size_t len;
+  int32_t f;
+  int i;
+
+  DebugLog(DF_MOD, DS_DEBUG, "load() tcpflow@%p\n", (void *) &mod_tcpflow);
+
+  register_fields(ctx, mod, tcpflow_fields, TCPFLOW_FIELDS);
+
+  cfg = Xzmalloc(sizeof (tcpflow_cfg_t));
+  DTAILQ_INIT(&cfg->lru);
+  cfg->max_flows = DEFAULT_MAX_FLOWS;
+  cfg->chunk_size = DEFAULT_CHUNK_SIZE;
+  cfg->max_ooo = DEFAULT_MAX_OOO;
+  cfg->idle_timeout = DEFAULT_IDLE_TIMEOUT;
+
+  /* Find (and activate) the packet fields we need */
+  for (i = 0; i < TCPFLOW_IN_FIELDS; i++) {
+    len = strchr(tcpflow_in_fields_g[i], '.') - tcpflow_in_fields_g[i];
+    memcpy(modname, tcpflow_in_fields_g[i], len);
+    modname[len] = '\0';
+    m = find_module_entry(ctx, modname);
+    if (m == NULL) {
+      DebugLog(DF_MOD, DS_FATAL,
+               "tcpflow: module %s must be loaded before tcpflow\n",
+               modname);
+      exit(EXIT_FAILURE);
+    }
+    cfg->in[i] = -1;
+    for (f = 0; f < m->num_fields; f++) {
+      if (!strcmp(ctx->global_fields[m->first_field_pos + f].name,
+                  tcpflow_in_fields_g[i])) {
+        cfg->in[i] = m->first_field_pos + f;
+        ctx->global_fields[cfg->in[i]].active = TRUE;
+        break ;
+      }
+    }
+  }
+
+  register_dissector(ctx, mod, "ipdecode", tcpflow_dissect, NULL);
+
+  return (cfg);
+}
+
+
+static void
+tcpflow_postconfig(orchids_t *ctx, mod_entry_t *mod)
+{
+  tcpflow_cfg_t *cfg = mod->config;
+
+  cfg->flows = new_hash(cfg->max_flows / 4 + 16);
+
+  register_rtcallback(ctx, rtaction_tcpflow_expire, mod, 1);
+}
+
+
+static void
+set_idle_timeout(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting IdleTimeout to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 1)
+    value = 1;
+  ((tcpflow_cfg_t *)mod->config)->idle_timeout = value;
+}
+
+
+static void
+set_max_flows(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting MaxFlows to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 1)
+    value = 1;
+  ((tcpflow_cfg_t *)mod->config)->max_flows = value;
+}
+
+
+static void
+set_chunk_size(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting ChunkSize to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 64)
+    value = 64;
+  ((tcpflow_cfg_t *)mod->config)->chunk_size = value;
+}
+
+
+static void
+set_max_out_of_order(orchids_t *ctx, mod_entry_t *mod,
+                     config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting MaxOutOfOrder to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 0)
+    value = 0;
+  ((tcpflow_cfg_t *)mod->config)->max_ooo = value;
+}
+
+
+static void
+set_pass_packets(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  DebugLog(DF_MOD, DS_INFO, "setting PassPackets to %s\n", dir->args);
+
+  ((tcpflow_cfg_t *)mod->config)->pass_packets = atoi(dir->args) != 0;
+}
+
+
+static mod_cfg_cmd_t tcpflow_dir[] = {
+  { "IdleTimeout", set_idle_timeout, "Seconds before an idle flow ends" },
+  { "MaxFlows", set_max_flows, "Max number of flows in the table" },
+  { "ChunkSize", set_chunk_size, "Max size of a data event (bytes)" },
+  { "MaxOutOfOrder", set_max_out_of_order, "Max out-of-order bytes kept per direction" },
+  { "PassPackets", set_pass_packets, "Also inject the TCP packet events" },
+  { NULL, NULL }
+};
+
+
+static char *tcpflow_deps[] = {
+  "pcap",
+  "ipdecode",
+  NULL
+};
+
+
+input_module_t mod_tcpflow = {
+  MOD_MAGIC,
+  ORCHIDS_VERSION,
+  "tcpflow",
+  "CeCILL2",
+  tcpflow_deps,
+  tcpflow_dir,
+  tcpflow_preconfig,
+  tcpflow_postconfig,
+  NULL
+};
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
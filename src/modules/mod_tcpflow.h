@@ -0,0 +1,198 @@
+/**
+ ** @file mod_tcpflow.h
+ ** Definitions for mod_tcpflow.c
+ **
+ ** @version 0.1
+ ** @ingroup modules
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef MOD_TCPFLOW_H
+#define MOD_TCPFLOW_H
+
+#include "orchids.h"
+
+#include "dtailq.h"
+
+#define TCPFLOW_FIELDS    19
+#define F_TYPE             0
+#define F_ID               1
+#define F_TIME             2
+#define F_SRC              3
+#define F_DST              4
+#define F_SRC6             5
+#define F_DST6             6
+#define F_SPORT            7
+#define F_DPORT            8
+#define F_HANDSHAKE        9
+#define F_DIR             10
+#define F_DATA            11
+#define F_START           12
+#define F_PKTS_CS         13
+#define F_PKTS_SC         14
+#define F_BYTES_CS        15
+#define F_BYTES_SC        16
+#define F_GAPS            17
+#define F_REASON          18
+
+/* Fields of mod_ipdecode and mod_pcap used by the flow table */
+#define TCPFLOW_IN_FIELDS 12
+#define IN_VERSION         0
+#define IN_SRC             1
+#define IN_DST             2
+#define IN_SRC6            3
+#define IN_DST6            4
+#define IN_PROTO           5
+#define IN_SPORT           6
+#define IN_DPORT           7
+#define IN_TCPFLAGS        8
+#define IN_SEQ             9
+#define IN_PAYLOAD        10
+#define IN_TIME           11
+
+#define TH_FIN  0x01
+#define TH_SYN  0x02
+#define TH_RST  0x04
+#define TH_ACK  0x10
+
+#define SEQ_LT(a, b)  ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+
+#define DEFAULT_IDLE_TIMEOUT   300
+#define DEFAULT_MAX_FLOWS    65536
+#define DEFAULT_CHUNK_SIZE    4096
+#define DEFAULT_MAX_OOO      65536
+
+/**
+ ** @struct tcpflow_key_s
+ **   Flow key: both endpoints, lowest first, so that both directions
+ **   of a connection hash to the same flow.
+ **/
+typedef struct tcpflow_key_s tcpflow_key_t;
+struct tcpflow_key_s {
+  u_char   addr[2][16];
+  uint16_t port[2];
+  uint16_t version;
+};
+
+/**
+ ** @struct tcpflow_seg_s
+ **   Out-of-order segment, waiting for the data before it.
+ **/
+typedef struct tcpflow_seg_s tcpflow_seg_t;
+struct tcpflow_seg_s {
+  tcpflow_seg_t *next;
+  uint32_t       seq;
+  size_t         len;
+  u_char         data[1];
+};
+
+/**
+ ** @struct tcpflow_half_s
+ **   One direction of a flow.
+ **/
+typedef struct tcpflow_half_s tcpflow_half_t;
+struct tcpflow_half_s {
+  int            seq_known;
+  uint32_t       next_seq;  /* next in-order sequence number */
+  int            fin;
+  unsigned long  pkts;
+  unsigned long  bytes;     /* in-order payload bytes */
+  unsigned long  gaps;      /* bytes never seen */
+  u_char        *buf;       /* in-order bytes not yet posted */
+  size_t         len;
+  tcpflow_seg_t *ooo;       /* sorted by sequence number */
+  size_t         ooo_bytes;
+};
+
+/**
+ ** @struct tcpflow_s
+ **   A TCP connection.  half[0] goes from the client to the server.
+ **/
+typedef struct tcpflow_s tcpflow_t;
+struct tcpflow_s {
+  tcpflow_key_t  key;
+  int            client;    /* endpoint of key which is the client */
+  unsigned long  id;
+  int            handshake; /* seen from the SYN */
+  timeval_t      start;
+  timeval_t      last;
+  tcpflow_half_t half[2];
+  DTAILQ_ENTRY(tcpflow_t) lru;
+};
+
+/**
+ ** @struct tcpflow_cfg_s
+ **   Flow table, ordered by last activity for idle timeouts.
+ **/
+typedef struct tcpflow_cfg_s tcpflow_cfg_t;
+struct tcpflow_cfg_s {
+  hash_t        *flows;
+  DTAILQ_HEAD(tcpflow_lru, tcpflow_t) lru;
+  size_t         nflows;
+  size_t         max_flows;
+  size_t         chunk_size;
+  size_t         max_ooo;
+  time_t         idle_timeout;
+  int            pass_packets;
+  unsigned long  next_id;
+  unsigned long  evicted;
+  int32_t        in[TCPFLOW_IN_FIELDS];
+};
+
+
+int
+mod_tcpflow_flush(orchids_t *ctx, mod_entry_t *mod, void *params);
+
+static int
+tcpflow_dissect(orchids_t *ctx, mod_entry_t *mod, event_t *event, void *data);
+
+static void *
+tcpflow_preconfig(orchids_t *ctx, mod_entry_t *mod);
+
+static void
+tcpflow_postconfig(orchids_t *ctx, mod_entry_t *mod);
+
+
+#endif /* MOD_TCPFLOW_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -21,7 +21,9 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -30,10 +32,23 @@
 #include <limits.h>
 #include <errno.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+/* zlib's crc32() clashes with ours (orchids.h) */
+#define crc32 zlib_crc32
+#include <zlib.h>
+#undef crc32
+#endif
+
 #include "orchids.h"
 
 #include "evt_mgr.h"
 #include "orchids_api.h"
+#include "mod_mgr.h"
+#include "timestamp.h"
 
 #include "mod_textfile.h"
 
@@ -42,25 +57,29 @@ input_module_t mod_textfile;
 
 
 static void
-textfile_buildevent(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf, char *buf)
+textfile_buildevent(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf,
+                    const char *buf, size_t len)
 {
   ovm_var_t *attr[TF_FIELDS];
   event_t *event;
+  event_arena_t *arena;
 
-  DebugLog(DF_MOD, DS_TRACE, "Dissecting: %s", buf);
+  DebugLog(DF_MOD, DS_TRACE, "Dissecting: %.*s", (int)len, buf);
 
   memset(attr, 0, sizeof(attr));
+  arena = event_arena(ctx, NULL);
 
-  attr[F_LINE_NUM] = ovm_int_new();
+  attr[F_LINE_NUM] = ovm_int_new_arena(arena);
   attr[F_LINE_NUM]->flags |= TYPE_MONO;
   INT(attr[F_LINE_NUM]) = tf->line;
 
-  attr[F_FILE] = ovm_vstr_new();
+  attr[F_FILE] = ovm_vstr_new_arena(arena);
   VSTR(attr[F_FILE]) = tf->filename;
   VSTRLEN(attr[F_FILE]) = tf->filename_len;
 
-  attr[F_LINE] = ovm_str_new(strlen(buf));
-  memcpy (STR(attr[F_LINE]), buf,STRLEN(attr[F_LINE]));
+  attr[F_LINE] = ovm_str_new_arena(arena, len);
+  memcpy (STR(attr[F_LINE]), buf, len);
+  STR(attr[F_LINE])[len] = '\0';
 
   event = NULL;
   add_fields_to_event(ctx, mod, &event, attr, TF_FIELDS);
@@ -125,7 +144,7 @@ process_new_lines(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf)
 	       "read line %i crc(0x%08X) %s",
 	       tf->line, *(unsigned int *)&tf->hash, buff);
 
-      textfile_buildevent(ctx, mod, tf, buff);
+      textfile_buildevent(ctx, mod, tf, buff, strlen(buff));
       if (buff == d_buff)
 	Xfree(buff);
     }
@@ -136,6 +155,18 @@ process_new_lines(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf)
   return eof;
 }
 
+/**
+ ** All the data is processed (ExitAfterProcessAll): post the audit
+ ** events still being aggregated by mod_auditd, if it is loaded, and
+ ** exit.
+ **/
+static void
+textfile_exit(orchids_t *ctx)
+{
+  call_mod_func(ctx, "auditd", "flush", NULL);
+  exit(EXIT_SUCCESS);
+}
+
 static int
 textfile_callback(orchids_t *ctx, mod_entry_t *mod, void *dummy)
 {
@@ -148,6 +179,8 @@ textfile_callback(orchids_t *ctx, mod_entry_t *mod, void *dummy)
 
   cfg = (textfile_config_t *)mod->config;
   for (tf = cfg->file_list; tf; tf = tf->next) {
+    if (tf->gz_pid)
+      continue ; /* read at once in textfile_postcompil() */
     if (tf->eof)
     {
       /* Checks if mtime has changed for each file... */
@@ -178,11 +211,827 @@ textfile_callback(orchids_t *ctx, mod_entry_t *mod, void *dummy)
   }
 
   if (cfg->exit_process_all_data && eof)
-    exit(EXIT_SUCCESS);
+    textfile_exit(ctx);
 
   return (eof);
 }
 
+/*
+** Buffered line reader, shared by the inotify backend and the
+** time-ordered merge: tf->buf holds the bytes read from the file,
+** from which lines are split in place.
+*/
+
+static void
+gz_finished(textfile_t *tf);
+
+
+/**
+ ** Get the next complete line of a file in tf->cur.
+ ** @param flush Also return a last line without newline at the end
+ **   of the file.
+ ** @return 1, or 0 if there is no more line to read for now.
+ **/
+static int
+read_line(textfile_t *tf, int flush)
+{
+  char *p;
+  ssize_t sz;
+  int fd;
+
+  fd = fileno(tf->fd);
+  for (;;) {
+    p = memchr(tf->buf + tf->read_off, '\n', tf->write_off - tf->read_off);
+    if (p != NULL) {
+      tf->cur = tf->buf + tf->read_off;
+      tf->cur_len = p + 1 - tf->cur;
+      tf->read_off += tf->cur_len;
+      if (tf->flags & TEXTFILE_LINE_TOO_LONG) {
+        tf->flags &= ~TEXTFILE_LINE_TOO_LONG; /* end of a dropped line */
+        tf->line++;
+        continue ;
+      }
+      if (tf->cur_len > MAX_LINE_SZ) {
+        DebugLog(DF_MOD, DS_WARN,
+                 "Line too long (%zu bytes), dropping event (max line size : %i)",
+                 tf->cur_len, MAX_LINE_SZ);
+        tf->line++;
+        continue ;
+      }
+      return (1);
+    }
+
+    /* Move the unfinished line to the beginning of the buffer */
+    if (tf->read_off > 0) {
+      memmove(tf->buf, tf->buf + tf->read_off, tf->write_off - tf->read_off);
+      tf->write_off -= tf->read_off;
+      tf->read_off = 0;
+    }
+    if (tf->write_off > MAX_LINE_SZ) {
+      DebugLog(DF_MOD, DS_WARN,
+               "Line too long (%zu bytes), dropping event (max line size : %i)",
+               tf->write_off, MAX_LINE_SZ);
+      tf->flags |= TEXTFILE_LINE_TOO_LONG;
+      tf->write_off = 0;
+    }
+
+    sz = read(fd, tf->buf + tf->write_off, TEXTFILE_READ_SZ - tf->write_off);
+    if (sz < 0 && errno == EINTR)
+      continue ;
+    if (sz <= 0) {
+      if (sz == 0 && tf->gz_pid > 0)
+        gz_finished(tf);
+      if ((flush || tf->gz_pid) && tf->write_off > 0
+          && !(tf->flags & TEXTFILE_LINE_TOO_LONG)) {
+        tf->cur = tf->buf;
+        tf->cur_len = tf->write_off;
+        tf->read_off = tf->write_off;
+        return (1);
+      }
+      return (0);
+    }
+    tf->offset += sz;
+    tf->write_off += sz;
+#ifdef POSIX_FADV_WILLNEED
+    /* Let the kernel read the next block while we process this one */
+    posix_fadvise(fd, tf->offset, TEXTFILE_READ_SZ, POSIX_FADV_WILLNEED);
+#endif
+  }
+}
+
+
+static void
+post_line(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf)
+{
+  tf->line++;
+  *(unsigned int *)&tf->hash =
+    crc32(*(unsigned int *)&tf->hash, tf->cur, tf->cur_len);
+  textfile_buildevent(ctx, mod, tf, tf->cur, tf->cur_len);
+}
+
+
+/*
+** gzip-compressed files are decompressed by a child process, which
+** writes to a pipe: the file is then read like any other, while the
+** decompression goes on in parallel with the analysis.  The SIGCHLD
+** handler reaps the child, so it reports its exit status through a
+** second pipe.
+*/
+
+static int
+is_gzip_file(const char *path)
+{
+  unsigned char magic[2];
+  FILE *fp;
+  size_t n;
+
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return (0);
+  n = fread(magic, 1, 2, fp);
+  fclose(fp);
+
+  return (n == 2 && magic[0] == 0x1f && magic[1] == 0x8b);
+}
+
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+
+static void
+gunzip_exit(int status_fd, char status)
+{
+  while (write(status_fd, &status, 1) < 0 && errno == EINTR)
+    ;
+  _exit(status);
+}
+
+
+static void
+gunzip_child(const char *path, int in, int out, int status_fd)
+{
+  gzFile gz;
+  const char *msg;
+  char *buf;
+  char *p;
+  ssize_t w;
+  int n;
+  int err;
+
+  gz = gzdopen(in, "rb");
+  if (gz == NULL)
+    gunzip_exit(status_fd, EXIT_FAILURE);
+  gzbuffer(gz, TEXTFILE_GZ_BUF_SZ);
+  buf = Xmalloc(TEXTFILE_GZ_BUF_SZ);
+
+  while ((n = gzread(gz, buf, TEXTFILE_GZ_BUF_SZ)) > 0) {
+    for (p = buf; n > 0; p += w, n -= w) {
+      w = write(out, p, n);
+      if (w < 0 && errno == EINTR)
+        w = 0;
+      else if (w < 0)
+        gunzip_exit(status_fd, EXIT_FAILURE); /* the reader is gone */
+    }
+  }
+  msg = gzerror(gz, &err); /* also catches truncated files */
+  if (n < 0 || err != Z_OK) {
+    DebugLog(DF_MOD, DS_ERROR, "File [%s]: %s\n", path, msg);
+    gunzip_exit(status_fd, EXIT_FAILURE);
+  }
+
+  gunzip_exit(status_fd, EXIT_SUCCESS);
+}
+
+
+/**
+ ** Open a gzip-compressed file, through a decompressing child.
+ **/
+static FILE *
+open_gzip_file(textfile_t *tf, const char *path)
+{
+  int fds[2];
+  int status[2];
+  int in;
+
+  in = Xopen(path, O_RDONLY, 0);
+  if (pipe(fds) || pipe(status)) {
+    DebugLog(DF_MOD, DS_FATAL, "pipe(): %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  fflush(NULL);
+  tf->gz_pid = fork();
+  if (tf->gz_pid == 0) {
+    close(fds[0]);
+    close(status[0]);
+    gunzip_child(path, in, fds[1], status[1]);
+  }
+  if (tf->gz_pid < 0) {
+    DebugLog(DF_MOD, DS_FATAL, "fork(): %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  close(in);
+  close(fds[1]);
+  close(status[1]);
+  tf->gz_status = status[0];
+#ifdef F_SETPIPE_SZ
+  fcntl(fds[0], F_SETPIPE_SZ, TEXTFILE_PIPE_SZ);
+#endif
+  gettimeofday(&tf->gz_start, NULL);
+
+  return (fdopen(fds[0], "r"));
+}
+
+#endif /* HAVE_ZLIB_H && HAVE_LIBZ */
+
+
+static double
+gz_seconds(const textfile_t *tf)
+{
+  struct timeval end;
+  struct timeval diff;
+  double secs;
+
+  if (tf->gz_pid > 0)
+    gettimeofday(&end, NULL);
+  else
+    end = tf->gz_end;
+  Timer_Sub(&diff, &end, &tf->gz_start);
+  secs = Timer_Float(&diff);
+
+  return (secs > 0 ? secs : 1e-6);
+}
+
+
+/**
+ ** End of a compressed file: get the exit status of the child (none
+ ** if it was killed) and log the throughput.
+ **/
+static void
+gz_finished(textfile_t *tf)
+{
+  char status;
+  ssize_t n;
+  double secs;
+
+  gettimeofday(&tf->gz_end, NULL);
+  while ((n = read(tf->gz_status, &status, 1)) < 0 && errno == EINTR)
+    ;
+  if (n != 1 || status != EXIT_SUCCESS)
+    DebugLog(DF_MOD, DS_ERROR, "File [%s]: decompression failed\n",
+             tf->filename);
+  close(tf->gz_status);
+  tf->gz_status = -1;
+  tf->gz_pid = -1;
+
+  secs = gz_seconds(tf);
+  DebugLog(DF_MOD, DS_NOTICE,
+           "File [%s]: %.1f MB decompressed in %.3f s (%.1f MB/s), "
+           "%u lines (%.0f lines/s)\n",
+           tf->filename, tf->offset / 1e6, secs, tf->offset / 1e6 / secs,
+           tf->line, tf->line / secs);
+}
+
+
+/**
+ ** Print the statistics of the input files.
+ ** Called by call_mod_func(), with the output FILE * as parameter.
+ **/
+int
+mod_textfile_stats(orchids_t *ctx, mod_entry_t *mod, void *params)
+{
+  textfile_config_t *cfg = mod->config;
+  FILE *fp = params;
+  textfile_t *tf;
+  double secs;
+
+  fprintf(fp, "-------[ textfile inputs ]-------\n");
+  fprintf(fp, "     lines |  MB read |   MB/s |    lines/s | file\n");
+  for (tf = cfg->file_list; tf; tf = tf->next) {
+    if (tf->gz_pid == 0) {
+      fprintf(fp, "%10u | %8.1f |        |            | %s\n",
+              tf->line, tf->offset / 1e6, tf->filename);
+      continue ;
+    }
+    secs = gz_seconds(tf);
+    fprintf(fp, "%10u | %8.1f | %6.1f | %10.0f | %s (gzip, %.1f MB)\n",
+            tf->line, tf->offset / 1e6, tf->offset / 1e6 / secs,
+            tf->line / secs, tf->filename, tf->file_stat.st_size / 1e6);
+  }
+
+  return (0);
+}
+
+
+/**
+ ** Read a whole compressed file.
+ **/
+static void
+drain_archive(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf)
+{
+  while (read_line(tf, 1))
+    post_line(ctx, mod, tf);
+}
+
+
+/*
+** Time-ordered merge (MergeByTime): the files are read together,
+** and their lines are posted in the order of their timestamps
+** through a min-heap of the files, keyed by the timestamp of their
+** current line.  A line without timestamp keeps the timestamp of
+** the previous line of its file.
+*/
+
+static const ts_cache_t ts_cache_init_g = TS_CACHE_INITIALIZER;
+
+static const char *ts_format_names_g[TEXTFILE_TS_FORMATS] = {
+  "auto", "iso8601", "syslog", "clf", "epoch"
+};
+
+
+static int
+get_digits(const char **pp, const char *end, int n, int *val)
+{
+  const char *p = *pp;
+  int v = 0;
+
+  if (end - p < n)
+    return (-1);
+  for ( ; n > 0; n--, p++) {
+    if (*p < '0' || *p > '9')
+      return (-1);
+    v = v * 10 + (*p - '0');
+  }
+  *val = v;
+  *pp = p;
+
+  return (0);
+}
+
+
+static int
+expect(const char **pp, const char *end, char c)
+{
+  if (*pp >= end || **pp != c)
+    return (-1);
+  (*pp)++;
+
+  return (0);
+}
+
+
+/**
+ ** Parse HH:MM:SS and an optional fraction of second.
+ **/
+static int
+get_time(const char **pp, const char *end, long *secs, long *usecs)
+{
+  int h, m, s;
+  int n;
+
+  if (get_digits(pp, end, 2, &h) || expect(pp, end, ':')
+      || get_digits(pp, end, 2, &m) || expect(pp, end, ':')
+      || get_digits(pp, end, 2, &s))
+    return (-1);
+  *secs = h * 3600 + m * 60 + s;
+  *usecs = 0;
+  if (*pp < end && (**pp == '.' || **pp == ',')) {
+    (*pp)++;
+    for (n = 0; *pp < end && **pp >= '0' && **pp <= '9'; (*pp)++, n++)
+      if (n < 6)
+        *usecs = *usecs * 10 + (**pp - '0');
+    for ( ; n < 6; n++)
+      *usecs *= 10;
+  }
+
+  return (0);
+}
+
+
+/**
+ ** Parse a timezone offset: Z, +HH:MM, +HHMM or +HH.
+ **/
+static long
+get_tzoff(const char **pp, const char *end)
+{
+  int sign;
+  int h;
+  int m = 0;
+
+  if (*pp < end && **pp == 'Z') {
+    (*pp)++;
+    return (0);
+  }
+  if (*pp >= end || (**pp != '+' && **pp != '-'))
+    return (0);
+  sign = (**pp == '-') ? -1 : 1;
+  (*pp)++;
+  if (get_digits(pp, end, 2, &h))
+    return (0);
+  if (*pp < end && **pp == ':')
+    (*pp)++;
+  get_digits(pp, end, 2, &m);
+
+  return (sign * (h * 3600 + m * 60));
+}
+
+
+static int
+ts_iso8601(textfile_t *tf, const char *p, const char *end, struct timeval *tv)
+{
+  if (ts_parse_iso8601(&tf->ts_cache, p, end - p, tv) == NULL)
+    return (-1);
+
+  return (0);
+}
+
+
+static int
+ts_syslog(textfile_t *tf, const char *p, const char *end, struct timeval *tv)
+{
+  struct tm tm;
+  int mo, d;
+  long secs, usecs;
+
+  if (end - p < 3 || (mo = ts_month(p)) < 0)
+    return (-1);
+  p += 3;
+  if (expect(&p, end, ' '))
+    return (-1);
+  if (p < end && *p == ' ')
+    p++;
+  if (get_digits(&p, end, 2, &d) && get_digits(&p, end, 1, &d))
+    return (-1);
+  if (expect(&p, end, ' ') || get_time(&p, end, &secs, &usecs))
+    return (-1);
+
+  /* No year: take the one of the file, or the year before for the
+   * lines written before new year's day.  Syslog dates are in local
+   * time, unlike the other formats. */
+  localtime_r(&tf->file_stat.st_mtime, &tm);
+  if (mo > tm.tm_mon + 1)
+    tm.tm_year--;
+  tv->tv_sec = ts_localtime(&tf->ts_cache,
+                            ts_mkgmtime(tm.tm_year + 1900, mo, d, 0, 0, 0)
+                            + secs);
+  tv->tv_usec = usecs;
+
+  return (0);
+}
+
+
+static int
+ts_clf(textfile_t *tf, const char *p, const char *end, struct timeval *tv)
+{
+  int y, mo, d;
+  long secs, usecs;
+
+  p = memchr(p, '[', end - p);
+  if (p == NULL)
+    return (-1);
+  p++;
+  if (get_digits(&p, end, 2, &d) || expect(&p, end, '/'))
+    return (-1);
+  if (end - p < 3 || (mo = ts_month(p)) < 0)
+    return (-1);
+  p += 3;
+  if (expect(&p, end, '/')
+      || get_digits(&p, end, 4, &y) || expect(&p, end, ':')
+      || get_time(&p, end, &secs, &usecs))
+    return (-1);
+  if (p < end && *p == ' ')
+    p++;
+  tv->tv_sec = ts_mkgmtime(y, mo, d, 0, 0, 0) + secs - get_tzoff(&p, end);
+  tv->tv_usec = usecs;
+
+  return (0);
+}
+
+
+static int
+ts_epoch(textfile_t *tf, const char *p, const char *end, struct timeval *tv)
+{
+  const char *a;
+  long secs = 0;
+  long usecs = 0;
+  int n;
+
+  /* audit(1792429646.123:42) */
+  for (a = p; a + 6 <= end && a < p + 64; a++)
+    if (*a == 'a' && !strncmp(a, "audit(", 6)) {
+      p = a + 6;
+      break ;
+    }
+  for (n = 0; p < end && *p >= '0' && *p <= '9'; p++, n++)
+    secs = secs * 10 + (*p - '0');
+  if (n < 9 || n > 11)
+    return (-1);
+  if (p < end && *p == '.') {
+    p++;
+    for (n = 0; p < end && *p >= '0' && *p <= '9'; p++, n++)
+      if (n < 6)
+        usecs = usecs * 10 + (*p - '0');
+    for ( ; n < 6; n++)
+      usecs *= 10;
+  }
+  tv->tv_sec = secs;
+  tv->tv_usec = usecs;
+
+  return (0);
+}
+
+
+typedef int (*ts_extractor_t)(textfile_t *tf, const char *p, const char *end,
+                              struct timeval *tv);
+
+static ts_extractor_t ts_extractors_g[TEXTFILE_TS_FORMATS] = {
+  NULL, ts_iso8601, ts_syslog, ts_clf, ts_epoch
+};
+
+
+/**
+ ** Get the next line of a file to merge, and its timestamp.
+ ** The format of the file is found on its first line with a timestamp.
+ **/
+static int
+merge_next_line(textfile_t *tf, int flush)
+{
+  const char *end;
+  int f;
+
+  if (!read_line(tf, flush))
+    return (0);
+
+  end = tf->cur + tf->cur_len;
+  if (tf->ts_fmt != TEXTFILE_TS_AUTO) {
+    ts_extractors_g[tf->ts_fmt](tf, tf->cur, end, &tf->ts);
+    return (1);
+  }
+  for (f = TEXTFILE_TS_AUTO + 1; f < TEXTFILE_TS_FORMATS; f++) {
+    if (ts_extractors_g[f](tf, tf->cur, end, &tf->ts) == 0) {
+      DebugLog(DF_MOD, DS_INFO, "File [%s]: %s timestamps\n",
+               tf->filename, ts_format_names_g[f]);
+      tf->ts_fmt = f;
+      break ;
+    }
+  }
+
+  return (1);
+}
+
+
+static int
+merge_before(const textfile_t *a, const textfile_t *b)
+{
+  if (timercmp(&a->ts, &b->ts, !=))
+    return (timercmp(&a->ts, &b->ts, <));
+
+  return (a->rank < b->rank);
+}
+
+
+static void
+merge_sift_down(textfile_t **heap, int n, int i)
+{
+  textfile_t *tf;
+  int c;
+
+  tf = heap[i];
+  while ((c = 2 * i + 1) < n) {
+    if (c + 1 < n && merge_before(heap[c + 1], heap[c]))
+      c++;
+    if (!merge_before(heap[c], tf))
+      break ;
+    heap[i] = heap[c];
+    i = c;
+  }
+  heap[i] = tf;
+}
+
+
+/**
+ ** Post the lines of all the files, in timestamp order.
+ **/
+static void
+merge_files(orchids_t *ctx, mod_entry_t *mod)
+{
+  textfile_config_t *cfg = mod->config;
+  textfile_t **heap;
+  textfile_t *tf;
+  unsigned long lines;
+  int flush;
+  int files;
+  int n;
+  int i;
+
+  files = 0;
+  for (tf = cfg->file_list; tf; tf = tf->next)
+    files++;
+  heap = Xmalloc((files + 1) * sizeof (textfile_t *));
+
+  /* Keep the last unfinished lines if we go on reading the files */
+  flush = cfg->exit_process_all_data;
+
+  n = 0;
+  for (tf = cfg->file_list, i = 0; tf; tf = tf->next, i++) {
+    tf->rank = i;
+    tf->ts_fmt = cfg->ts_format;
+    if (tf->buf == NULL)
+      tf->buf = Xmalloc(TEXTFILE_READ_SZ);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fileno(tf->fd), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    if (merge_next_line(tf, flush))
+      heap[n++] = tf;
+  }
+  for (i = n / 2 - 1; i >= 0; i--)
+    merge_sift_down(heap, n, i);
+
+  lines = 0;
+  while (n > 0) {
+    tf = heap[0];
+    post_line(ctx, mod, tf);
+    lines++;
+    if (!merge_next_line(tf, flush))
+      heap[0] = heap[--n];
+    if (n > 0)
+      merge_sift_down(heap, n, 0);
+  }
+  Xfree(heap);
+
+  DebugLog(DF_MOD, DS_NOTICE, "merged %lu lines from %i files\n",
+           lines, files);
+}
+
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+/*
+** inotify backend: a file is only read when the kernel says it was
+** modified, and then drained in large reads, lines being split in
+** the read buffer.  Idle files cost nothing.
+*/
+
+#define TEXTFILE_FILE_EVENTS (IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF)
+#define TEXTFILE_DIR_EVENTS  (IN_CREATE | IN_MOVED_TO)
+
+/**
+ ** Read all the new data of a file.
+ **/
+static void
+drain_file(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf)
+{
+  struct stat st;
+
+  if (tf->fd == NULL)
+    return ;
+
+  if (fstat(fileno(tf->fd), &st) == 0 && st.st_size < tf->offset) {
+    DebugLog(DF_MOD, DS_NOTICE,
+             "File [%s] has been truncated (%lu->%lu) rewinding\n",
+             tf->filename, (unsigned long) tf->offset,
+             (unsigned long) st.st_size);
+    lseek(fileno(tf->fd), 0, SEEK_SET);
+    tf->offset = 0;
+    tf->read_off = tf->write_off = 0;
+    tf->flags &= ~TEXTFILE_LINE_TOO_LONG;
+  }
+
+  while (read_line(tf, 0))
+    post_line(ctx, mod, tf);
+}
+
+
+/**
+ ** (Re)open a file and watch it.
+ ** @return 0, or -1 if the file does not exist (yet).
+ **/
+static int
+open_watched_file(textfile_config_t *cfg, textfile_t *tf)
+{
+  int fd;
+
+  fd = open(tf->path, O_RDONLY);
+  if (fd < 0)
+    return (-1);
+
+  tf->fd = fdopen(fd, "r");
+  tf->wd = inotify_add_watch(cfg->inotify_fd, tf->path, TEXTFILE_FILE_EVENTS);
+  if (tf->wd < 0)
+    DebugLog(DF_MOD, DS_ERROR, "inotify_add_watch(%s): %s\n",
+             tf->path, strerror(errno));
+  Xfstat(fd, &tf->file_stat);
+
+  return (0);
+}
+
+
+/**
+ ** The file was renamed or removed (rotation): read what was written
+ ** to it, then go on with the new file, or wait until it is created.
+ **/
+static void
+rotate_file(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf)
+{
+  textfile_config_t *cfg = mod->config;
+  char *slash;
+
+  drain_file(ctx, mod, tf);
+  /* Last line without newline */
+  if (read_line(tf, 1))
+    post_line(ctx, mod, tf);
+
+  DebugLog(DF_MOD, DS_NOTICE, "File [%s] rotated, reopening\n", tf->filename);
+  if (tf->wd >= 0)
+    inotify_rm_watch(cfg->inotify_fd, tf->wd);
+  fclose(tf->fd);
+  tf->fd = NULL;
+  tf->wd = -1;
+  tf->offset = 0;
+  tf->read_off = tf->write_off = 0;
+  tf->flags &= ~TEXTFILE_LINE_TOO_LONG;
+  tf->line = 0;
+
+  if (open_watched_file(cfg, tf) == 0) {
+    drain_file(ctx, mod, tf);
+    return ;
+  }
+
+  if (tf->dir_wd < 0) {
+    slash = tf->base - 1;
+    *slash = '\0';
+    tf->dir_wd = inotify_add_watch(cfg->inotify_fd,
+                                   tf->path[0] ? tf->path : "/",
+                                   TEXTFILE_DIR_EVENTS);
+    *slash = '/';
+  }
+}
+
+
+static int
+textfile_inotify_callback(orchids_t *ctx, mod_entry_t *mod, int fd, void *data)
+{
+  textfile_config_t *cfg = mod->config;
+  char buf[4096]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *ev;
+  textfile_t *tf;
+  ssize_t sz;
+  char *p;
+
+  DebugLog(DF_MOD, DS_TRACE, "textfile_inotify_callback();\n");
+
+  while ((sz = read(fd, buf, sizeof (buf))) > 0) {
+    for (p = buf; p < buf + sz; p += sizeof (*ev) + ev->len) {
+      ev = (const struct inotify_event *) p;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        DebugLog(DF_MOD, DS_WARN, "inotify queue overflow\n");
+        for (tf = cfg->file_list; tf; tf = tf->next)
+          drain_file(ctx, mod, tf);
+        continue ;
+      }
+
+      for (tf = cfg->file_list; tf; tf = tf->next) {
+        if (tf->wd == ev->wd && tf->fd) {
+          if (ev->mask & IN_MODIFY)
+            drain_file(ctx, mod, tf);
+          if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF))
+            rotate_file(ctx, mod, tf);
+        } else if (tf->dir_wd == ev->wd && tf->fd == NULL
+                   && ev->len > 0 && !strcmp(ev->name, tf->base)) {
+          if (open_watched_file(cfg, tf) == 0)
+            drain_file(ctx, mod, tf);
+        }
+      }
+    }
+  }
+
+  if (sz < 0 && errno != EAGAIN && errno != EINTR) {
+    DebugLog(DF_MOD, DS_ERROR, "read(inotify): %s\n", strerror(errno));
+    return (-1);
+  }
+
+  return (0);
+}
+
+
+/**
+ ** Watch the regular files with inotify.
+ ** @return 0, or -1 if inotify is not available.
+ **/
+static int
+setup_inotify(orchids_t *ctx, mod_entry_t *mod)
+{
+  textfile_config_t *cfg = mod->config;
+  textfile_t *tf;
+
+  cfg->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (cfg->inotify_fd < 0) {
+    DebugLog(DF_MOD, DS_WARN, "inotify_init1(): %s, polling files\n",
+             strerror(errno));
+    return (-1);
+  }
+
+  for (tf = cfg->file_list; tf; tf = tf->next) {
+    if (tf->gz_pid)
+      continue ;
+    tf->wd = inotify_add_watch(cfg->inotify_fd, tf->path,
+                               TEXTFILE_FILE_EVENTS);
+    if (tf->wd < 0)
+      DebugLog(DF_MOD, DS_ERROR, "inotify_add_watch(%s): %s\n",
+               tf->path, strerror(errno));
+    tf->dir_wd = -1;
+    tf->buf = Xmalloc(TEXTFILE_READ_SZ);
+  }
+
+  add_input_descriptor(ctx, mod, textfile_inotify_callback,
+                       cfg->inotify_fd, NULL);
+
+  return (0);
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
 static int
 textsocket_try_reconnect(orchids_t *ctx, rtaction_t *e)
 {
@@ -300,20 +1149,22 @@ textsocket_callback(orchids_t *ctx, mod_entry_t *mod, int fd, void *data)
             {
 	      ovm_var_t *attr[TF_FIELDS];
 	      event_t *event;
+	      event_arena_t *arena;
 	      size_t len;
 
 	      memset(attr, 0, sizeof(attr));
+	      arena = event_arena(ctx, NULL);
 
-	      attr[F_LINE_NUM] = ovm_int_new();
+	      attr[F_LINE_NUM] = ovm_int_new_arena(arena);
 	      attr[F_LINE_NUM]->flags |= TYPE_MONO;
 	      INT(attr[F_LINE_NUM]) = f->line;
 
-	      attr[F_FILE] = ovm_vstr_new();
+	      attr[F_FILE] = ovm_vstr_new_arena(arena);
 	      VSTR(attr[F_FILE]) = f->filename;
 	      VSTRLEN(attr[F_FILE]) = f->filename_len;
 
 	      len = p-pstart;
-	      attr[F_LINE] = ovm_str_new(len);
+	      attr[F_LINE] = ovm_str_new_arena(arena, len);
 	      memcpy (STR(attr[F_LINE]), pstart, len);
 	      STR(attr[F_LINE])[len] = '\0';
 
@@ -355,7 +1206,10 @@ textfile_preconfig(orchids_t *ctx, mod_entry_t *mod)
   DebugLog(DF_MOD, DS_INFO, "load() textfile@%p\n", (void *) &mod_textfile);
 
   mod_cfg = Xzmalloc(sizeof (textfile_config_t));
-  add_polled_input_callback(ctx, mod, textfile_callback, NULL);
+#ifdef HAVE_SYS_INOTIFY_H
+  mod_cfg->use_inotify = 1;
+#endif
+  mod_cfg->inotify_fd = -1;
 
   register_fields(ctx, mod, tf_fields, TF_FIELDS);
 
@@ -373,6 +1227,16 @@ textfile_postconfig(orchids_t *ctx, mod_entry_t *mod)
 
   cfg = (textfile_config_t *)mod->config;
 
+#ifdef HAVE_SYS_INOTIFY_H
+  if (cfg->use_inotify && cfg->file_list && setup_inotify(ctx, mod) == 0) {
+    DebugLog(DF_MOD, DS_INFO, "Watching files with inotify\n");
+    return ;
+  }
+#endif
+  cfg->use_inotify = 0;
+
+  add_polled_input_callback(ctx, mod, textfile_callback, NULL);
+
   /* register real-time action for file polling, if requested. */
   DebugLog(DF_MOD, DS_INFO, "Activating file polling\n");
   register_rtcallback(ctx,
@@ -393,8 +1257,39 @@ textfile_postcompil(orchids_t *ctx, mod_entry_t *mod)
 
   cfg = (textfile_config_t *)mod->config;
 
+  if (cfg->merge_by_time) {
+    merge_files(ctx, mod);
+    if (cfg->exit_process_all_data)
+      textfile_exit(ctx);
+    return ;
+  }
+
+  /* Compressed files are archives: read them at once */
+  for (tf = cfg->file_list; tf; tf = tf->next)
+    if (tf->gz_pid) {
+      DebugLog(DF_MOD, DS_DEBUG, "process compressed file : %s\n",
+               tf->filename);
+      drain_archive(ctx, mod, tf);
+    }
+
+#ifdef HAVE_SYS_INOTIFY_H
+  if (cfg->use_inotify) {
+    for (tf = cfg->file_list; tf; tf = tf->next) {
+      if (tf->gz_pid)
+        continue ;
+      DebugLog(DF_MOD, DS_DEBUG, "process file : %s\n", tf->filename);
+      drain_file(ctx, mod, tf);
+    }
+    if (cfg->exit_process_all_data)
+      textfile_exit(ctx);
+    return ;
+  }
+#endif
+
   /* if we don't have to compute hashes, just fseek to the end-of-file */
   for (tf = cfg->file_list; tf; tf = tf->next) {
+    if (tf->gz_pid)
+      continue ;
     DebugLog(DF_MOD, DS_DEBUG, "process file : %s\n", tf->filename);
     /* read and process new lines */
     process_new_lines(ctx, mod, tf);
@@ -484,8 +1379,29 @@ add_input_file(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
       f = Xzmalloc(sizeof (textfile_t));
       f->filename = strdup(dir->args);
       f->filename_len = strlen(dir->args);
-      f->fd = Xfopen(filepath, "r");
-      Xfstat(fileno(f->fd), &f->file_stat);
+      f->ts_cache = ts_cache_init_g;
+      f->path = strdup(filepath);
+      f->base = strrchr(f->path, '/') + 1;
+      f->wd = -1;
+      f->dir_wd = -1;
+      if (is_gzip_file(filepath)) {
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+        f->fd = open_gzip_file(f, filepath);
+        f->file_stat = sbuf;
+        f->buf = Xmalloc(TEXTFILE_READ_SZ);
+#else
+        DebugLog(DF_MOD, DS_ERROR,
+                 "mod_textfile: '%s' is compressed, and zlib support "
+                 "is not compiled in.\n", filepath);
+        Xfree(f->path);
+        Xfree(f->filename);
+        Xfree(f);
+        return;
+#endif
+      } else {
+        f->fd = Xfopen(filepath, "r");
+        Xfstat(fileno(f->fd), &f->file_stat);
+      }
 
       DebugLog(DF_MOD, DS_INFO, "adding file '%s' to polled inputs (fp=%p fd=%i).\n",
            f->filename, f->fd, fileno(f->fd));
@@ -548,6 +1464,46 @@ set_poll_period(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
 }
 
 
+static void
+set_use_inotify(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  DebugLog(DF_MOD, DS_INFO, "setting UseInotify to %s\n", dir->args);
+
+#ifndef HAVE_SYS_INOTIFY_H
+  if (atoi(dir->args))
+    DebugLog(DF_MOD, DS_WARN, "inotify not supported, polling files\n");
+#else
+  ((textfile_config_t *)mod->config)->use_inotify = atoi(dir->args) != 0;
+#endif
+}
+
+
+static void
+set_merge_by_time(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  DebugLog(DF_MOD, DS_INFO, "setting MergeByTime to %s\n", dir->args);
+
+  ((textfile_config_t *)mod->config)->merge_by_time = atoi(dir->args) != 0;
+}
+
+
+static void
+set_timestamp_format(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int f;
+
+  DebugLog(DF_MOD, DS_INFO, "setting TimestampFormat to %s\n", dir->args);
+
+  for (f = 0; f < TEXTFILE_TS_FORMATS; f++)
+    if (!strcmp(dir->args, ts_format_names_g[f])) {
+      ((textfile_config_t *)mod->config)->ts_format = f;
+      return ;
+    }
+
+  DebugLog(DF_MOD, DS_ERROR, "unknown timestamp format '%s'\n", dir->args);
+}
+
+
 static int
 rtaction_read_files(orchids_t *ctx, rtaction_t *e)
 {
@@ -578,6 +1534,9 @@ static mod_cfg_cmd_t textfile_dir[] =
   { "ProcessAll", set_process_all, "Process all lines from start" },
   { "ExitAfterProcessAll", set_exit_process_all, "Exit after processing all files" },
   { "SetPollPeriod", set_poll_period, "Set poll period in second for files" },
+  { "UseInotify", set_use_inotify, "Watch files with inotify instead of polling" },
+  { "MergeByTime", set_merge_by_time, "Read all files at once, in timestamp order" },
+  { "TimestampFormat", set_timestamp_format, "auto, iso8601, syslog, clf or epoch" },
   { "INPUT", add_input_file, "Add a file as input source" },
   { NULL, NULL }
 };
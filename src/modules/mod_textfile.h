@@ -43,6 +43,24 @@
 #define DEFAULT_MODTEXT_POLL_PERIOD 10
 #define INITIAL_MODTEXT_POLL_DELAY  0
 
+// Read buffer of files watched with inotify or merged (at least 2*MAX_LINE_SZ)
+#define TEXTFILE_READ_SZ (65536 + MAX_LINE_SZ)
+
+// gzip-compressed files: decompression buffer, and pipe from the
+// decompressing child
+#define TEXTFILE_GZ_BUF_SZ (256 * 1024)
+#define TEXTFILE_PIPE_SZ   (1024 * 1024)
+
+/*
+** timestamp formats, for MergeByTime
+*/
+#define TEXTFILE_TS_AUTO    0
+#define TEXTFILE_TS_ISO8601 1 /* 2026-10-19T17:07:26.123+02:00 */
+#define TEXTFILE_TS_SYSLOG  2 /* Oct 19 17:07:26 */
+#define TEXTFILE_TS_CLF     3 /* [19/Oct/2026:17:07:26 +0200] */
+#define TEXTFILE_TS_EPOCH   4 /* 1792429646.123, or audit(1792429646.123:42) */
+#define TEXTFILE_TS_FORMATS 5
+
 typedef struct textfile_s textfile_t;
 struct textfile_s
 {
@@ -54,6 +72,29 @@ struct textfile_s
   unsigned int line;
   unsigned char hash[HASH_SIZE];
   unsigned char eof;
+  /* inotify backend */
+  char *path;           /* real path, to reopen the file after rotation */
+  char *base;           /* last component of path */
+  int wd;               /* watch on the file, -1 if not open */
+  int dir_wd;           /* watch on its directory, after a rotation */
+  off_t offset;         /* offset of the end of buf */
+#define TEXTFILE_LINE_TOO_LONG 0x1
+  int flags;
+  char *buf;
+  size_t read_off;
+  size_t write_off;
+  /* MergeByTime */
+  int rank;             /* position in the file list, breaks ties */
+  int ts_fmt;           /* timestamp format, found on the first line */
+  struct timeval ts;    /* timestamp of the current line */
+  ts_cache_t ts_cache;
+  char *cur;            /* current line, in buf */
+  size_t cur_len;
+  /* gzip-compressed file, read from a decompressing child */
+  pid_t gz_pid;         /* 0 if not compressed, -1 once finished */
+  int gz_status;        /* pipe of the exit status of the child */
+  struct timeval gz_start;
+  struct timeval gz_end;
 };
 
 typedef struct textfile_config_s textfile_config_t;
@@ -63,6 +104,10 @@ struct textfile_config_s
   int process_all_data;
   int exit_process_all_data;
   int poll_period;
+  int use_inotify;
+  int inotify_fd;
+  int merge_by_time;
+  int ts_format;
   struct textfile_s *file_list;
 };
 
@@ -83,7 +128,8 @@ struct textsock_s
 };
 
 static void
-textfile_buildevent(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf, char *buf);
+textfile_buildevent(orchids_t *ctx, mod_entry_t *mod, textfile_t *tf,
+                    const char *buf, size_t len);
 
 
 static int
@@ -118,10 +164,26 @@ static void
 set_poll_period(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
 
 
+static void
+set_use_inotify(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+static void
+set_merge_by_time(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+static void
+set_timestamp_format(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
 static int
 rtaction_read_files(orchids_t *ctx, rtaction_t *e);
 
 
+int
+mod_textfile_stats(orchids_t *ctx, mod_entry_t *mod, void *params);
+
+
 #endif /* MOD_TEXTFILE_H */
 
 /*
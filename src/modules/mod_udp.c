@@ -27,6 +27,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <errno.h>
 
 #include "orchids.h"
 
@@ -38,7 +39,7 @@ input_module_t mod_udp;
 
 
 static int
-create_udp_socket(int udp_port)
+create_udp_socket(int udp_port, int reuseport)
 {
   int fd, on = 1;
   struct sockaddr_in sin;
@@ -50,6 +51,10 @@ create_udp_socket(int udp_port)
   sin.sin_port = htons(udp_port);
 
   Xsetsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+  if (reuseport)
+    Xsetsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+#endif
 
   Xbind(fd, (struct sockaddr *) &sin, sizeof(sin));
 
@@ -57,48 +62,69 @@ create_udp_socket(int udp_port)
 }
 
 
+/*
+** Read a burst of datagrams at once: the time of reception is taken
+** once per burst, and the values of each event go to its arena.
+*/
 static int
 udp_callback(orchids_t *ctx, mod_entry_t *mod, int fd, void *data)
 {
+  udp_cfg_t *cfg = mod->config;
+  udp_socket_t *sock = data;
   ovm_var_t *attr[UDP_FIELDS];
-  char buf[8194];
-  socklen_t sz;
-  struct sockaddr_in from;
-  socklen_t len;
+  event_arena_t *arena;
+  struct sockaddr_in *from;
+  struct timeval now;
+  uint32_t drops;
+  dgram_t *dg;
   event_t *event;
+  int n;
+  int i;
 
   DebugLog(DF_MOD, DS_TRACE, "udp_callback()\n");
 
-  memset(attr, 0, sizeof(attr));
+  drops = sock->drops;
+  n = dgram_recv(cfg->ring, fd, &sock->drops);
+  if (n < 0) {
+    DebugLog(DF_MOD, DS_ERROR, "recvmmsg(): %s\n", strerror(errno));
+    return (0);
+  }
+  mod->lost += sock->drops - drops;
+
+  DebugLog(DF_MOD, DS_TRACE, "read %i datagrams\n", n);
 
-  len = sizeof (struct sockaddr_in);
-  memset(&from, 0, sizeof (struct sockaddr_in));
-  sz = Xrecvfrom(fd,buf,8192,0, (struct sockaddr *)&from, &len);
-  buf[sz] = '\0';
+  gettimeofday(&now, NULL);
+  for (i = 0; i < n; i++) {
+    dg = &cfg->ring->dgram[i];
+    from = (struct sockaddr_in *)&dg->from;
+    memset(attr, 0, sizeof(attr));
+    arena = event_arena(ctx, NULL);
 
-  DebugLog(DF_MOD, DS_TRACE, "read size = %i\n", sz);
+    attr[F_EVENT] = ovm_int_new_arena(arena);
+    attr[F_EVENT]->flags |= TYPE_MONO;
+    INT(attr[F_EVENT]) = (long) mod->posts;
 
-  attr[F_EVENT] = ovm_int_new();
-  attr[F_EVENT]->flags |= TYPE_MONO;
-  INT(attr[F_EVENT]) = (long) mod->posts;
+    attr[F_TIME] = ovm_timeval_new_arena(arena);
+    attr[F_TIME]->flags |= TYPE_MONO;
+    TIMEVAL(attr[F_TIME]) = now;
 
-  attr[F_TIME] = ovm_timeval_new();
-  attr[F_TIME]->flags |= TYPE_MONO;
-  gettimeofday( &(TIMEVAL(attr[F_TIME])) , NULL);
+    attr[F_SRC_ADDR] = ovm_ipv4_new_arena(arena);
+    IPV4(attr[F_SRC_ADDR]) = from->sin_addr;
 
-  attr[F_SRC_ADDR] = ovm_ipv4_new();
-  IPV4(attr[F_SRC_ADDR]) = from.sin_addr;
+    attr[F_SRC_PORT] = ovm_int_new_arena(arena);
+    INT(attr[F_SRC_PORT]) = ntohs(from->sin_port);
 
-  attr[F_DST_PORT] = ovm_int_new();
-  INT(attr[F_DST_PORT]) = (int) data;
+    attr[F_DST_PORT] = ovm_int_new_arena(arena);
+    INT(attr[F_DST_PORT]) = sock->port;
 
-  attr[F_MSG] = ovm_bstr_new(sz);
-  memcpy(BSTR(attr[F_MSG]), buf, sz);
+    attr[F_MSG] = ovm_bstr_new_arena(arena, dg->len);
+    memcpy(BSTR(attr[F_MSG]), dg->buf, dg->len);
 
-  event = NULL;
-  add_fields_to_event(ctx, mod, &event, attr, UDP_FIELDS);
+    event = NULL;
+    add_fields_to_event(ctx, mod, &event, attr, UDP_FIELDS);
 
-  post_event(ctx, mod, event);
+    post_event(ctx, mod, event);
+  }
 
   return (0);
 }
@@ -118,18 +144,61 @@ static field_t udp_fields[] = {
 static void *
 udp_preconfig(orchids_t *ctx, mod_entry_t *mod)
 {
+  udp_cfg_t *cfg;
+
   DebugLog(DF_MOD, DS_DEBUG, "load() udp@%p\n", (void *) &mod_udp);
 
   register_fields(ctx, mod, udp_fields, UDP_FIELDS);
 
-  return (NULL);
+  cfg = Xzmalloc(sizeof (udp_cfg_t));
+  cfg->batch = DGRAM_DEFAULT_BATCH;
+  cfg->rcvbuf = 0;
+  cfg->sockets = DEFAULT_UDP_SOCKETS;
+
+  return (cfg);
+}
+
+
+/*
+** Sockets are created once all the directives are read, so that the
+** socket options don't depend on the order of the directives.
+*/
+static void
+udp_postconfig(orchids_t *ctx, mod_entry_t *mod)
+{
+  udp_cfg_t *cfg = mod->config;
+  udp_socket_t *sock;
+  udp_socket_t *ports;
+  udp_socket_t *next;
+  int i;
+
+  if (cfg->socks == NULL)
+    return ;
+
+  cfg->ring = dgram_ring_new(cfg->batch);
+
+  ports = cfg->socks;
+  cfg->socks = NULL;
+  for ( ; ports; ports = next) {
+    next = ports->next;
+    for (i = 0; i < cfg->sockets; i++) {
+      sock = (i == 0) ? ports : Xzmalloc(sizeof (udp_socket_t));
+      sock->port = ports->port;
+      sock->fd = create_udp_socket(sock->port, cfg->sockets > 1);
+      dgram_socket_setup(sock->fd, cfg->rcvbuf);
+      sock->next = cfg->socks;
+      cfg->socks = sock;
+      add_input_descriptor(ctx, mod, udp_callback, sock->fd, sock);
+    }
+  }
 }
 
 
 static void
 add_listen_port(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
 {
-  int sd;
+  udp_cfg_t *cfg = mod->config;
+  udp_socket_t *sock;
   int port;
 
   port = atoi(dir->args);
@@ -140,14 +209,68 @@ add_listen_port(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
     return ;
   }
 
-  sd = create_udp_socket(port);
-  add_input_descriptor(ctx, mod, udp_callback, sd, (void *)port);
+  sock = Xzmalloc(sizeof (udp_socket_t));
+  sock->port = port;
+  sock->fd = -1;
+  sock->next = cfg->socks;
+  cfg->socks = sock;
+}
+
+
+static void
+set_recv_batch(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting RecvBatch to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 1)
+    value = 1;
+  ((udp_cfg_t *)mod->config)->batch = value;
+}
+
+
+static void
+set_recv_buffer(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting RecvBuffer to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 0)
+    value = 0;
+  ((udp_cfg_t *)mod->config)->rcvbuf = value;
+}
+
+
+static void
+set_port_sockets(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int value;
+
+  DebugLog(DF_MOD, DS_INFO, "setting PortSockets to %s\n", dir->args);
+
+  value = atoi(dir->args);
+  if (value < 1)
+    value = 1;
+#ifndef SO_REUSEPORT
+  if (value > 1) {
+    DebugLog(DF_MOD, DS_WARN, "SO_REUSEPORT not supported, using 1 socket\n");
+    value = 1;
+  }
+#endif
+  ((udp_cfg_t *)mod->config)->sockets = value;
 }
 
 
 static mod_cfg_cmd_t udp_dir[] = {
   { "AddListenPort", add_listen_port, "Add a listen port for udp input" },
   { "INPUT", add_listen_port, "Add a listen port for udp input" },
+  { "RecvBatch", set_recv_batch, "Max datagrams read per wakeup" },
+  { "RecvBuffer", set_recv_buffer, "Socket receive buffer size (bytes)" },
+  { "PortSockets", set_port_sockets, "Sockets per port (SO_REUSEPORT)" },
   { NULL, NULL }
 };
 
@@ -160,7 +283,7 @@ input_module_t mod_udp = {
   NULL,
   udp_dir,
   udp_preconfig,
-  NULL,
+  udp_postconfig,
   NULL
 };
 
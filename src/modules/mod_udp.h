@@ -19,6 +19,8 @@
 
 #include "orchids.h"
 
+#include "dgram.h"
+
 #define UDP_FIELDS 7
 #define F_EVENT    0
 #define F_TIME     1
@@ -28,8 +30,42 @@
 #define F_DST_PORT 5
 #define F_MSG      6
 
+#define DEFAULT_UDP_SOCKETS 1
+
+/**
+ ** @struct udp_socket_s
+ **   A listening socket.
+ **/
+/**   @var udp_socket_s::next
+ **     Next socket.
+ **/
+/**   @var udp_socket_s::port
+ **     UDP port.
+ **/
+/**   @var udp_socket_s::fd
+ **     The socket, -1 until the end of the configuration.
+ **/
+/**   @var udp_socket_s::drops
+ **     Last value of the kernel drop counter of the socket.
+ **/
+typedef struct udp_socket_s udp_socket_t;
+struct udp_socket_s {
+  udp_socket_t *next;
+  int port;
+  int fd;
+  uint32_t drops;
+};
+
+typedef struct udp_cfg_s {
+  int batch; // max datagrams read per wakeup
+  int rcvbuf; // socket receive buffer size, 0 for the default
+  int sockets; // sockets per port, SO_REUSEPORT if more than one
+  udp_socket_t *socks;
+  dgram_ring_t *ring;
+} udp_cfg_t;
+
 static int
-create_udp_socket(int udp_port);
+create_udp_socket(int udp_port, int reuseport);
 
 
 static int
@@ -40,6 +76,10 @@ static void *
 udp_preconfig(orchids_t *ctx, mod_entry_t *mod);
 
 
+static void
+udp_postconfig(orchids_t *ctx, mod_entry_t *mod);
+
+
 static void
 add_listen_port(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
 
@@ -133,6 +133,35 @@ struct config_directive_s
   uint32_t            line;
 };
 
+/**
+ ** @struct event_arena_s
+ **   Bump allocator holding the fields of one event: event nodes,
+ **   scalar values and copied strings, and the active_event_t record.
+ **   The first chunk is the arena itself; further chunks are only
+ **   allocated if it is full.  All chunks are freed at once with the
+ **   event.
+ **/
+/**   @var event_arena_s::next
+ **     Next chunk.
+ **/
+/**   @var event_arena_s::cur
+ **     Chunk being filled (in the first chunk only).
+ **/
+/**   @var event_arena_s::used
+ **     Bytes used in this chunk, header included.
+ **/
+/**   @var event_arena_s::size
+ **     Size of this chunk, header included.
+ **/
+typedef struct event_arena_s event_arena_t;
+struct event_arena_s
+{
+  event_arena_t *next;
+  event_arena_t *cur;
+  size_t         used;
+  size_t         size;
+};
+
 /**
  ** @struct event_s
  **   Type of event built by dissection modules an injected in engine.
@@ -147,12 +176,16 @@ struct config_directive_s
 /**   @var event_s::next
  **     Next field of event.
  **/
+/**   @var event_s::arena
+ **     Arena holding this node, or NULL if it was allocated alone.
+ **/
 typedef struct event_s event_t;
 struct event_s
 {
-  int32_t    field_id;
-  ovm_var_t *value;
-  event_t   *next;
+  int32_t        field_id;
+  ovm_var_t     *value;
+  event_t       *next;
+  event_arena_t *arena;
 };
 
 /**
@@ -172,6 +205,13 @@ struct event_s
 /**   @var active_event_s::refs
  **     The number of state instance that references this event
  **/
+/**   @var active_event_s::mem_size
+ **     Estimated memory footprint of the event (for the memory governor).
+ **     Zero until the event is first referenced by a state instance.
+ **/
+/**   @var active_event_s::arena
+ **     Arena of the event, holding this record too, or NULL.
+ **/
 typedef struct active_event_s active_event_t;
 struct active_event_s
 {
@@ -179,6 +219,8 @@ struct active_event_s
   active_event_t *next;
   active_event_t *prev;
   int32_t         refs;
+  size_t          mem_size;
+  event_arena_t  *arena;
 };
 
 typedef struct orchids_s orchids_t;
@@ -262,13 +304,20 @@ struct field_record_s
 
 #define SF_NOFLAGS  0x00000000
 #define SF_PRUNED   0x00000002
+/* state is the destination of a cut (set by the rule compiler) */
+#define SF_CUTDEST  0x00000004
 #define SF_PATHMARK 0xF0000000
 
 #define THREAD_BUMP     0x00000001
 #define THREAD_ONLYONCE 0x00000002
 #define THREAD_KILLED   0x00000004
 
+/* the source thread is killed after passing the transition: a later
+ * match would only give a redundant, longer run */
+#define TRANS_NO_BACKTRACK 0x00000001
+
 #define RULE_INUSE     0x00000008
+#define RULE_EVICTED   0x00000010
 
 #define THREAD_IS_ONLYONCE(t) ((t)->flags & THREAD_ONLYONCE)
 #define THREAD_IS_KILLED(t) ((t)->flags & THREAD_KILLED)
@@ -318,6 +367,9 @@ typedef struct rule_compiler_s rule_compiler_t;
 /**   @var transition_s::global_id
  **     Transition identifier in rule.
  **/
+/**   @var transition_s::flags
+ **     Static analysis flags (TRANS_NO_BACKTRACK).
+ **/
 struct transition_s
 {
   state_t *dest;
@@ -327,6 +379,7 @@ struct transition_s
   bytecode_t *eval_code;
   int32_t id;
   int32_t global_id;
+  uint32_t flags;
 };
 
 
@@ -419,6 +472,25 @@ struct state_s
 /**   @var rule_s::id
  **     Rule identifier
  **/
+/**   @var rule_s::mem_used
+ **     Memory accounted to all instances of this rule (state instances,
+ **     environments and retained events), in bytes.
+ **/
+/**   @var rule_s::mem_limit
+ **     Per-rule memory budget, in bytes (0 means no limit).
+ **/
+/**   @var rule_s::priority
+ **     Rule priority for the memory governor.  When the lowest-priority
+ **     eviction policy is selected, instances of rules with the lowest
+ **     priority are evicted first.
+ **/
+/**   @var rule_s::evicted
+ **     Number of instances of this rule evicted by the memory governor.
+ **/
+/**   @var rule_s::checksum
+ **     CRC32 of the compiled rule (byte code, constants, states and
+ **     transitions), used to recognise unchanged rules on reload.
+ **/
 struct rule_s
 {
   char             *filename;
@@ -447,6 +519,13 @@ struct rule_s
   int32_t          *sync_vars;
   int32_t           sync_vars_sz;
 
+  size_t            mem_used;
+  size_t            mem_limit;
+  int32_t           priority;
+  uint32_t          evicted;
+
+  uint32_t          checksum;
+
   /* XXX add rule stats here ??? */
 };
 
@@ -502,6 +581,14 @@ struct sync_lock_list_s {
 /**   @var rule_instance_s::flags
  **     Flags.
  **/
+/**   @var rule_instance_s::mem_used
+ **     Memory used by the state instances and environments of this
+ **     rule instance, in bytes.
+ **/
+/**   @var rule_instance_s::mem_events
+ **     Memory of the events retained by this rule instance, in bytes.
+ **     Events shared with other rule instances are counted in each of them.
+ **/
 struct rule_instance_s
 {
   rule_t *rule;
@@ -519,6 +606,8 @@ struct rule_instance_s
   uint32_t          flags;
   /* List of state instance that have synchronisation locks */
   sync_lock_list_t *sync_lock_list;
+  size_t            mem_used;
+  size_t            mem_events;
 };
 
 
@@ -634,6 +723,14 @@ struct wait_thread_s
 /**   @var rulefile_s::name
  **     Filename.
  **/
+/**   @var rulefile_s::mtime
+ **     Modification time of the file when it was last compiled.
+ **/
+/**   @var rulefile_s::rules_nb
+ **     Number of rules compiled from this file.  Rules are kept in
+ **     rule file order, so these are the next rules_nb rules of the
+ **     rule list.
+ **/
 /**   @var rulefile_s::next
  **     Next rule file.
  **/
@@ -641,6 +738,8 @@ typedef struct rulefile_s rulefile_t;
 struct rulefile_s
 {
   char       *name;
+  time_t      mtime;
+  int32_t     rules_nb;
   rulefile_t *next;
 };
 
@@ -813,6 +912,69 @@ struct conditional_dissector_record_s {
   void     *data;
 };
 
+#define QUEUE_DROP_NEWEST 0
+#define QUEUE_DROP_OLDEST 1
+#define QUEUE_SAMPLE      2
+
+/**
+ ** @struct input_queue_s
+ **   Bounded ingestion queue between a module and post_event().
+ **   Events posted by the module are queued, and drained in a round-robin
+ **   fashion by the main loop, so that a flooding source can't starve the
+ **   others.  When the queue is full, events are dropped according to
+ **   the drop policy.
+ **/
+/**   @var input_queue_s::ring
+ **     Circular buffer of queued events.
+ **/
+/**   @var input_queue_s::size
+ **     Capacity of the queue.
+ **/
+/**   @var input_queue_s::head
+ **     Index of the oldest queued event.
+ **/
+/**   @var input_queue_s::count
+ **     Number of queued events.
+ **/
+/**   @var input_queue_s::policy
+ **     Drop policy: #QUEUE_DROP_NEWEST, #QUEUE_DROP_OLDEST or #QUEUE_SAMPLE.
+ **     With #QUEUE_SAMPLE, only one event out of sample_n is accepted
+ **     when the queue is more than half full.
+ **/
+/**   @var input_queue_s::sample_n
+ **     Sampling rate for #QUEUE_SAMPLE.
+ **/
+/**   @var input_queue_s::sample_cnt
+ **     Sampling counter.
+ **/
+/**   @var input_queue_s::accepted
+ **     Number of events accepted in the queue.
+ **/
+/**   @var input_queue_s::dropped
+ **     Number of dropped events.
+ **/
+/**   @var input_queue_s::high_water
+ **     Highest number of queued events.
+ **/
+/**   @var input_queue_s::stamps
+ **     Arrival times of the queued events (same indices as ring).
+ **/
+typedef struct input_queue_s input_queue_t;
+struct input_queue_s
+{
+  event_t       **ring;
+  timeval_t      *stamps;
+  size_t          size;
+  size_t          head;
+  size_t          count;
+  int             policy;
+  unsigned int    sample_n;
+  unsigned int    sample_cnt;
+  unsigned long   accepted;
+  unsigned long   dropped;
+  size_t          high_water;
+};
+
 /**
  ** @struct mod_entry_s
  **   A module entry registered in the module manager.
@@ -841,12 +1003,25 @@ struct conditional_dissector_record_s {
 /**   @var mod_entry_s::posts
  **     Some values for statistics
  **/
+/**   @var mod_entry_s::lost
+ **     Number of events lost before reaching the module, e.g.
+ **     datagrams dropped by the kernel.
+ **/
 /**   @var mod_entry_s::mod_id
  **     Module identifier.
  **/
 /**   @var mod_entry_s::dlhandle
  **     The handle returned by dlopen().
  **/
+/**   @var mod_entry_s::queue
+ **     Ingestion queue of this module, or NULL if events are posted
+ **     directly.
+ **/
+/**   @var mod_entry_s::latency
+ **     Latency histograms of the events posted by this module,
+ **     allocated with the first event (see latency.c).
+ **/
+typedef struct mod_latency_s mod_latency_t;
 struct mod_entry_s
 {
   int32_t                num_fields;
@@ -858,8 +1033,11 @@ struct mod_entry_s
   void                  *data;
   input_module_t        *mod;
   unsigned long          posts;
+  unsigned long          lost;
   int32_t                mod_id;
   void                  *dlhandle;
+  input_queue_t         *queue;
+  mod_latency_t         *latency;
 };
 
 
@@ -928,6 +1106,125 @@ struct reportmod_s {
   SLIST_ENTRY(reportmod_t) list;
 };
 
+typedef struct report_snapshot_s report_snapshot_t;
+
+/**
+ ** @struct report_queue_s
+ ** Queue of reports waiting for the report writer (see report_queue.c).
+ **/
+/**   @var report_queue_s::size
+ **     Maximum number of queued reports (0: reports are synchronous).
+ **/
+/**   @var report_queue_s::batch
+ **     Number of queued reports that triggers a write.
+ **/
+/**   @var report_queue_s::sync
+ **     TRUE if the writer calls sync() after each batch.
+ **/
+/**   @var report_queue_s::head
+ **     First queued report.
+ **/
+/**   @var report_queue_s::tail
+ **     Last queued report.
+ **/
+/**   @var report_queue_s::len
+ **     Number of queued reports.
+ **/
+/**   @var report_queue_s::peak
+ **     Highest observed queue length.
+ **/
+/**   @var report_queue_s::dropped
+ **     Number of reports dropped because the queue was full.
+ **/
+/**   @var report_queue_s::batches
+ **     Number of batches handed to a writer.
+ **/
+/**   @var report_queue_s::writer
+ **     Process id of the last writer.
+ **/
+typedef struct report_queue_s report_queue_t;
+struct report_queue_s
+{
+  size_t             size;
+  size_t             batch;
+  int                sync;
+  report_snapshot_t *head;
+  report_snapshot_t *tail;
+  size_t             len;
+  size_t             peak;
+  uint32_t           dropped;
+  uint32_t           batches;
+  pid_t              writer;
+};
+
+
+#define MEMGOV_EVICT_OLDEST    0
+#define MEMGOV_EVICT_LRU       1
+#define MEMGOV_EVICT_PRIORITY  2
+
+/**
+ ** @struct mem_governor_s
+ **   Memory governor state.  Memory used by the analysis engine (state
+ **   instances, environments and retained events) is accounted here
+ **   and per rule (rule_s::mem_used).  When the soft limit is exceeded,
+ **   rule instances are evicted according to the eviction policy.  When
+ **   the hard limit is exceeded, incoming events are also shed.
+ **/
+/**   @var mem_governor_s::soft_limit
+ **     Soft memory budget in bytes (0 means no limit).
+ **/
+/**   @var mem_governor_s::hard_limit
+ **     Hard memory budget in bytes (0 means no limit).
+ **/
+/**   @var mem_governor_s::policy
+ **     Eviction policy: #MEMGOV_EVICT_OLDEST, #MEMGOV_EVICT_LRU or
+ **     #MEMGOV_EVICT_PRIORITY.
+ **/
+/**   @var mem_governor_s::inst_used
+ **     Memory used by state instances and environments.
+ **/
+/**   @var mem_governor_s::event_used
+ **     Memory used by retained (active) events.
+ **/
+/**   @var mem_governor_s::peak
+ **     Highest observed memory usage.
+ **/
+/**   @var mem_governor_s::evicted_instances
+ **     Total number of evicted rule instances.
+ **/
+/**   @var mem_governor_s::evicted_bytes
+ **     Total amount of memory released by evictions.
+ **/
+/**   @var mem_governor_s::shed_events
+ **     Number of events dropped because the hard limit was exceeded.
+ **/
+/**   @var mem_governor_s::shedding
+ **     TRUE while incoming events are being shed.
+ **/
+/**   @var mem_governor_s::rule_budgets
+ **     TRUE if at least one rule has its own memory budget.
+ **/
+/**   @var mem_governor_s::rule_cfg
+ **     Per-rule settings (priority, memory limit) from the configuration
+ **     file, indexed by rule name.  They are bound to the compiled rules
+ **     by memgov_bind_rules().
+ **/
+typedef struct mem_governor_s mem_governor_t;
+struct mem_governor_s
+{
+  size_t     soft_limit;
+  size_t     hard_limit;
+  int        policy;
+  size_t     inst_used;
+  size_t     event_used;
+  size_t     peak;
+  uint32_t   evicted_instances;
+  size_t     evicted_bytes;
+  uint32_t   shed_events;
+  bool_t     shedding;
+  bool_t     rule_budgets;
+  strhash_t *rule_cfg;
+};
 
 /**
  ** @struct orchids_s
@@ -1115,6 +1412,73 @@ struct reportmod_s {
  **     The Orchids daemon lock file.  This is used to prevent
  **     accidental multiple instance of the daemon.
  **/
+/**   @var orchids_s::memgov
+ **     The memory governor state.
+ **/
+/**   @var orchids_s::queued_events
+ **     Total number of events waiting in module ingestion queues.
+ **/
+/**   @var orchids_s::new_event_arena
+ **     Arena handed out for an event being built, not yet holding
+ **     any event node (see event_arena()).
+ **/
+/**   @var orchids_s::checkpoint_file
+ **     Engine state checkpoint file, or NULL if checkpoints are disabled.
+ **/
+/**   @var orchids_s::checkpoint_period
+ **     Period of engine state checkpoints, in seconds
+ **     (0: only checkpoint on SIGTERM).
+ **/
+/**   @var orchids_s::retired_rules
+ **     Rules replaced by a reload whose instances are still running
+ **     (drain policy).  They are freed once their last instance dies.
+ **/
+/**   @var orchids_s::reload_policy
+ **     What to do with live instances of rules changed by a reload
+ **     (RULE_RELOAD_DRAIN or RULE_RELOAD_KILL).
+ **/
+/**   @var orchids_s::rule_cache_dir
+ **     Directory of the precompiled rule image cache, or NULL if
+ **     disabled.
+ **/
+/**   @var orchids_s::report_queue
+ **     Reports waiting to be written.
+ **/
+/**   @var orchids_s::windows
+ **     Window aggregators of the rules, by rule and window names
+ **     (see window_aggr.c).
+ **/
+/**   @var orchids_s::window_max_keys
+ **     Maximum number of keys of a window aggregator (0: no limit).
+ **/
+/**   @var orchids_s::sketches
+ **     Shared sketches of the rules, by rule and sketch names (see
+ **     sketch.c).
+ **/
+/**   @var orchids_s::hll_precision
+ **     Default precision of HyperLogLog sketches.
+ **/
+/**   @var orchids_s::cms_width
+ **     Default width of Count-Min sketches.
+ **/
+/**   @var orchids_s::cms_depth
+ **     Default depth of Count-Min sketches.
+ **/
+/**   @var orchids_s::topk_size
+ **     Default size of top-k sketches.
+ **/
+/**   @var orchids_s::ipsets
+ **     IPv4 address sets, by name (see ipset.c).
+ **/
+/**   @var orchids_s::input_time
+ **     Arrival time of the input data being processed: set when
+ **     select() returns, and at the beginning of each loop for
+ **     real-time actions.  Cleared outside of the main loop.
+ **/
+/**   @var orchids_s::inject_usec
+ **     Time spent in inject_event(), in microseconds, accumulated
+ **     while an event is dispatched (see latency.c).
+ **/
 struct orchids_s
 {
   timeval_t    start_time;
@@ -1199,6 +1563,36 @@ struct orchids_s
   SLIST_HEAD(preevthooklist, hook_list_elmt_t) pre_evt_hook_list;
   SLIST_HEAD(postevthooklist, hook_list_elmt_t) post_evt_hook_list;
   SLIST_HEAD(list, reportmod_t) reportmod_list;
+
+  mem_governor_t memgov;
+
+  size_t queued_events;
+
+  event_arena_t *new_event_arena;
+
+  char   *checkpoint_file;
+  time_t  checkpoint_period;
+
+  rule_t *retired_rules;
+  int     reload_policy;
+
+  char   *rule_cache_dir;
+
+  report_queue_t report_queue;
+
+  strhash_t    *windows;
+  size_t        window_max_keys;
+
+  strhash_t    *sketches;
+  int           hll_precision;
+  int           cms_width;
+  int           cms_depth;
+  int           topk_size;
+
+  strhash_t    *ipsets;
+
+  timeval_t     input_time;
+  unsigned long inject_usec;
 };
 
 
@@ -1558,6 +1952,24 @@ get_opcode_name(bytecode_t opcode);
 void
 fprintf_bytecode(FILE *fp, bytecode_t *bytecode);
 
+/**
+ ** Length of an ovm instruction, in bytecode_t words (opcode and
+ ** operand).
+ ** @param opcode  The instruction opcode.
+ ** @return  The instruction length.
+ **/
+int
+ovm_insn_len(bytecode_t opcode);
+
+/**
+ ** Compute the length of an ovm byte code, in bytecode_t words,
+ ** including the final OP_END.
+ ** @param bytecode  Byte code to measure.
+ ** @return  The byte code length.
+ **/
+size_t
+ovm_bytecode_len(bytecode_t *bytecode);
+
 void
 fprintf_bytecode_short(FILE *fp, bytecode_t *bytecode);
 
@@ -37,8 +37,13 @@
 
 #include "orchids.h"
 #include "orchids_defaults.h"
+#include "latency.h"
+#include "window_aggr.h"
+#include "sketch.h"
+#include "ipset.h"
 
 #include "engine.h"
+#include "mem_governor.h"
 #include "mod_mgr.h"
 #include "rule_compiler.h"
 
@@ -140,6 +145,9 @@ new_orchids_context(void)
 
   /* Register core VM functions */
   register_core_functions(ctx);
+  register_window_functions(ctx);
+  register_sketch_functions(ctx);
+  register_ipset_functions(ctx);
 
   /* initialise other stuffs here... */
   set_lexer_context(ctx->rule_compiler);
@@ -151,6 +159,20 @@ new_orchids_context(void)
 
   ctx->modules_dir = DEFAULT_MODULES_DIR;
 
+  ctx->report_queue.size = DEFAULT_REPORT_QUEUE_SIZE;
+  ctx->report_queue.batch = DEFAULT_REPORT_BATCH_SIZE;
+
+  ctx->windows = new_strhash(1024);
+  ctx->window_max_keys = DEFAULT_WINDOW_MAX_KEYS;
+
+  ctx->sketches = new_strhash(1024);
+  ctx->hll_precision = DEFAULT_HLL_PRECISION;
+  ctx->cms_width = DEFAULT_CMS_WIDTH;
+  ctx->cms_depth = DEFAULT_CMS_DEPTH;
+  ctx->topk_size = DEFAULT_TOPK_SIZE;
+
+  ctx->ipsets = new_strhash(64);
+
   return (ctx);
 }
 
@@ -436,18 +458,223 @@ free_fields(ovm_var_t **tbl_event, size_t s)
   int i;
 
   for (i = 0; i < s; ++i)
-    if ((tbl_event[i] != NULL) && (tbl_event[i] != F_NOT_NEEDED))
+    if ((tbl_event[i] != NULL) && (tbl_event[i] != F_NOT_NEEDED)
+        && !(FLAGS(tbl_event[i]) & TYPE_ARENA))
       Xfree(tbl_event[i]);
 }
 
 
+#define EVENT_ARENA_ALIGN(sz) (((sz) + sizeof (void *) - 1) \
+                               & ~(sizeof (void *) - 1))
+
+static event_arena_t *
+new_event_arena(size_t size)
+{
+  event_arena_t *a;
+
+  a = Xmalloc(size);
+  a->next = NULL;
+  a->cur = a;
+  a->used = EVENT_ARENA_ALIGN(sizeof (event_arena_t));
+  a->size = size;
+
+  return (a);
+}
+
+
+void
+free_event_arena(event_arena_t *arena)
+{
+  event_arena_t *next;
+
+  for ( ; arena; arena = next) {
+    next = arena->next;
+    Xfree(arena);
+  }
+}
+
+
+void *
+event_arena_alloc(event_arena_t *arena, size_t size)
+{
+  event_arena_t *c;
+  void *p;
+
+  size = EVENT_ARENA_ALIGN(size);
+  c = arena->cur;
+  if (c->used + size > c->size) {
+    c = new_event_arena(EVENT_ARENA_ALIGN(sizeof (event_arena_t))
+                        + (size > EVENT_ARENA_CHUNK_SIZE ?
+                           size : EVENT_ARENA_CHUNK_SIZE));
+    c->next = arena->next;
+    arena->next = c;
+    arena->cur = c;
+  }
+  p = (char *) c + c->used;
+  c->used += size;
+
+  return (p);
+}
+
+
+/**
+ ** Find the arena of an event, if any.
+ **/
+static event_arena_t *
+find_event_arena(event_t *event)
+{
+  for ( ; event; event = event->next)
+    if (event->arena)
+      return (event->arena);
+
+  return (NULL);
+}
+
+
+event_arena_t *
+event_arena(orchids_t *ctx, event_t *event)
+{
+  event_arena_t *a;
+
+  a = find_event_arena(event);
+  if (a)
+    return (a);
+
+  if (ctx->new_event_arena == NULL)
+    ctx->new_event_arena = new_event_arena(EVENT_ARENA_CHUNK_SIZE);
+
+  return (ctx->new_event_arena);
+}
+
+
+static ovm_var_t *
+arena_var_new(event_arena_t *arena, uint32_t type, size_t size)
+{
+  ovm_var_t *var;
+
+  var = event_arena_alloc(arena, size);
+  memset(var, 0, size);
+  var->type = type;
+  var->flags = TYPE_ARENA;
+
+  return (var);
+}
+
+
+ovm_var_t *
+ovm_int_new_arena(event_arena_t *arena)
+{
+  if (arena == NULL)
+    return (ovm_int_new());
+  return (arena_var_new(arena, T_INT, sizeof (ovm_int_t)));
+}
+
+
+ovm_var_t *
+ovm_uint_new_arena(event_arena_t *arena)
+{
+  if (arena == NULL)
+    return (ovm_uint_new());
+  return (arena_var_new(arena, T_UINT, sizeof (ovm_uint_t)));
+}
+
+
+ovm_var_t *
+ovm_str_new_arena(event_arena_t *arena, size_t size)
+{
+  ovm_var_t *str;
+
+  if (arena == NULL)
+    return (ovm_str_new(size));
+  /* remove STR_PAD_LEN for padding, add 1 for '\0' */
+  str = arena_var_new(arena, T_STR,
+                      sizeof (ovm_str_t) - STR_PAD_LEN + 1 + size);
+  STRLEN(str) = size;
+
+  return (str);
+}
+
+
+ovm_var_t *
+ovm_bstr_new_arena(event_arena_t *arena, size_t size)
+{
+  ovm_var_t *bstr;
+
+  if (arena == NULL)
+    return (ovm_bstr_new(size));
+  bstr = arena_var_new(arena, T_BSTR,
+                       sizeof (ovm_bstr_t) - STR_PAD_LEN + size);
+  BSTRLEN(bstr) = size;
+
+  return (bstr);
+}
+
+
+ovm_var_t *
+ovm_vstr_new_arena(event_arena_t *arena)
+{
+  if (arena == NULL)
+    return (ovm_vstr_new());
+  return (arena_var_new(arena, T_VSTR, sizeof (ovm_vstr_t)));
+}
+
+
+ovm_var_t *
+ovm_vbstr_new_arena(event_arena_t *arena)
+{
+  if (arena == NULL)
+    return (ovm_vbstr_new());
+  return (arena_var_new(arena, T_VBSTR, sizeof (ovm_vbstr_t)));
+}
+
+
+ovm_var_t *
+ovm_ctime_new_arena(event_arena_t *arena)
+{
+  if (arena == NULL)
+    return (ovm_ctime_new());
+  return (arena_var_new(arena, T_CTIME, sizeof (ovm_ctime_t)));
+}
+
+
+ovm_var_t *
+ovm_timeval_new_arena(event_arena_t *arena)
+{
+  if (arena == NULL)
+    return (ovm_timeval_new());
+  return (arena_var_new(arena, T_TIMEVAL, sizeof (ovm_timeval_t)));
+}
+
+
+ovm_var_t *
+ovm_ipv4_new_arena(event_arena_t *arena)
+{
+  if (arena == NULL)
+    return (ovm_ipv4_new());
+  return (arena_var_new(arena, T_IPV4, sizeof (ovm_ipv4_t)));
+}
+
+
 void
 add_fields_to_event_stride(orchids_t *ctx, mod_entry_t *mod,
 			   event_t **event, ovm_var_t **tbl_event,
 			   size_t from, size_t to)
 {
+  event_arena_t *arena;
+  int handed_out;
   int i, j;
 
+  /* New nodes go to the arena of the event, or to the one handed out
+   * for the values of a new event. */
+  arena = find_event_arena(*event);
+  handed_out = (arena == NULL);
+  if (handed_out) {
+    arena = ctx->new_event_arena;
+    if (arena == NULL)
+      arena = new_event_arena(EVENT_ARENA_CHUNK_SIZE);
+    ctx->new_event_arena = NULL;
+  }
+
   for (i = from; i < to; ++i) {
     /* Handle filled fields */
     j = i - from;
@@ -458,17 +685,23 @@ add_fields_to_event_stride(orchids_t *ctx, mod_entry_t *mod,
       if (ctx->global_fields[ mod->first_field_pos + i].active) {
         event_t *new_evt;
 
-        new_evt = Xmalloc(sizeof (event_t));
+        new_evt = event_arena_alloc(arena, sizeof (event_t));
         new_evt->field_id = mod->first_field_pos + i;
         new_evt->value = tbl_event[j];
         new_evt->next = *event;
+        new_evt->arena = arena;
         *event = new_evt;
       } else { /* drop data */
         DebugLog(DF_CORE, DS_TRACE, "free disabled attribute.\n");
-        Xfree(tbl_event[j]);
+        FREE_VAR(tbl_event[j]);
       }
     }
   }
+
+  /* No node holds the arena: hand it out again, since values of other
+   * fields of the event may live there, until a node takes it. */
+  if (handed_out && (*event == NULL || (*event)->arena != arena))
+    ctx->new_event_arena = arena;
 }
 
 void
@@ -507,22 +740,220 @@ fprintf_event(FILE *fp, const orchids_t *ctx, const event_t *event)
 void
 free_event(event_t *event)
 {
+  event_arena_t *arena;
   event_t *e;
 
+  arena = NULL;
   while (event) {
     e = event->next;
     FREE_VAR(event->value);
-    Xfree(event);
+    if (event->arena == NULL)
+      Xfree(event);
+    else if (arena == NULL)
+      arena = event->arena;
     event = e;
   }
+
+  if (arena)
+    free_event_arena(arena);
+}
+
+
+event_t *
+concat_events(event_t *first, event_t *second)
+{
+  event_arena_t *a1;
+  event_arena_t *a2;
+  event_arena_t *c;
+  event_t *e;
+
+  if (first == NULL)
+    return (second);
+
+  /* The arena of the result is the first one found: it adopts the
+   * chunks of the other one, so that they are freed together. */
+  a1 = find_event_arena(first);
+  a2 = find_event_arena(second);
+  if (a1 && a2 && a1 != a2) {
+    for (c = a2; c->next; c = c->next)
+      ;
+    c->next = a1->next;
+    a1->next = a2;
+  }
+
+  for (e = first; e->next; e = e->next)
+    ;
+  e->next = second;
+
+  return (first);
+}
+
+
+active_event_t *
+new_active_event(event_t *event)
+{
+  event_arena_t *arena;
+  active_event_t *ae;
+
+  arena = find_event_arena(event);
+  if (arena == NULL)
+    return (Xzmalloc(sizeof (active_event_t)));
+
+  ae = event_arena_alloc(arena, sizeof (active_event_t));
+  memset(ae, 0, sizeof (active_event_t));
+  ae->arena = arena;
+
+  return (ae);
+}
+
+
+void
+free_active_event(active_event_t *active_event)
+{
+  if (active_event->arena) {
+    /* The record is freed with the arena */
+    if (active_event->event)
+      free_event(active_event->event);
+    else
+      free_event_arena(active_event->arena);
+    return ;
+  }
+
+  if (active_event->event)
+    free_event(active_event->event);
+  Xfree(active_event);
+}
+
+
+static void
+dispatch_event(orchids_t *ctx, mod_entry_t *sender, event_t *event,
+               const timeval_t *arrival);
+
+
+input_queue_t *
+new_input_queue(size_t size, int policy, unsigned int sample_n)
+{
+  input_queue_t *q;
+
+  q = Xzmalloc(sizeof (input_queue_t));
+  q->ring = Xzmalloc(size * sizeof (event_t *));
+  q->stamps = Xzmalloc(size * sizeof (timeval_t));
+  q->size = size;
+  q->policy = policy;
+  q->sample_n = sample_n > 0 ? sample_n : 1;
+
+  return (q);
+}
+
+
+static void
+enqueue_event(orchids_t *ctx, mod_entry_t *sender, event_t *event,
+              const timeval_t *arrival)
+{
+  input_queue_t *q;
+
+  q = sender->queue;
+
+  if (q->policy == QUEUE_SAMPLE && q->count >= q->size / 2) {
+    /* Overloaded: keep one event out of sample_n */
+    if (++q->sample_cnt < q->sample_n) {
+      q->dropped++;
+      free_event(event);
+      return ;
+    }
+    q->sample_cnt = 0;
+  }
+
+  if (q->count == q->size) {
+    if (q->policy == QUEUE_DROP_OLDEST) {
+      DebugLog(DF_CORE, DS_DEBUG, "queue of module '%s' full, drop oldest\n",
+               sender->mod->name);
+      free_event(q->ring[q->head]);
+      q->head = (q->head + 1) % q->size;
+      q->count--;
+      ctx->queued_events--;
+    }
+    else {
+      DebugLog(DF_CORE, DS_DEBUG, "queue of module '%s' full, drop newest\n",
+               sender->mod->name);
+      q->dropped++;
+      free_event(event);
+      return ;
+    }
+    q->dropped++;
+  }
+
+  q->ring[(q->head + q->count) % q->size] = event;
+  q->stamps[(q->head + q->count) % q->size] = *arrival;
+  q->count++;
+  q->accepted++;
+  if (q->count > q->high_water)
+    q->high_water = q->count;
+  ctx->queued_events++;
+}
+
+
+void
+drain_input_queues(orchids_t *ctx, size_t budget)
+{
+  int i;
+  input_queue_t *q;
+  event_t *event;
+  timeval_t arrival;
+  bool_t again;
+
+  /* Round-robin over module queues, one event per module per round,
+   * so that a flooding source can't starve the others. */
+  do {
+    again = FALSE;
+    for (i = 0; i < ctx->loaded_modules && budget > 0; i++) {
+      q = ctx->mods[i].queue;
+      if (q == NULL || q->count == 0)
+        continue ;
+      event = q->ring[q->head];
+      arrival = q->stamps[q->head];
+      q->ring[q->head] = NULL;
+      q->head = (q->head + 1) % q->size;
+      q->count--;
+      ctx->queued_events--;
+      budget--;
+      dispatch_event(ctx, &ctx->mods[i], event, &arrival);
+      again = TRUE;
+    }
+  } while (again && budget > 0 && ctx->queued_events > 0);
 }
 
 
 void
 post_event(orchids_t *ctx, mod_entry_t *sender, event_t *event)
+{
+  timeval_t arrival;
+
+  /* Events read outside of the main loop arrive now */
+  if (ctx->input_time.tv_sec != 0)
+    arrival = ctx->input_time;
+  else
+    gettimeofday(&arrival, NULL);
+
+  /* Queues are only drained by the real-time main loop */
+  if (sender->queue && ctx->off_line_mode == MODE_ONLINE) {
+    enqueue_event(ctx, sender, event, &arrival);
+    return ;
+  }
+
+  dispatch_event(ctx, sender, event, &arrival);
+}
+
+
+static void
+dispatch_event(orchids_t *ctx, mod_entry_t *sender, event_t *event,
+               const timeval_t *arrival)
 {
   int ret;
   conditional_dissector_record_t *cond_dissect;
+  timeval_t start;
+  timeval_t end;
+  unsigned long inject_usec;
 
   DebugLog(DF_CORE, DS_INFO,
            "post_event() -- sender->mod_id = %i\n", sender->mod_id);
@@ -530,6 +961,15 @@ post_event(orchids_t *ctx, mod_entry_t *sender, event_t *event)
   /* XXX: add some stats here (correct/incorrect events, posts, injections) */
   sender->posts++;
 
+  /* Load shedding: don't dissect events we would drop anyway */
+  if (memgov_shed_event(ctx, sender, event))
+    return ;
+
+  /* Nested dispatches (sub-dissectors posting events) account their
+   * own injections, which also count for this one */
+  gettimeofday(&start, NULL);
+  inject_usec = ctx->inject_usec;
+
   if (sender->dissect) {
     /* check for unconditional dissector */
     DebugLog(DF_CORE, DS_DEBUG, "Call unconditional sub-dissector.\n");
@@ -566,8 +1006,42 @@ post_event(orchids_t *ctx, mod_entry_t *sender, event_t *event)
     DebugLog(DF_CORE, DS_TRACE, "--> Injection into analysis engine -->\n");
     inject_event(ctx, event);
   }
+
+  gettimeofday(&end, NULL);
+  latency_record(ctx, sender, arrival, &start, &end,
+                 ctx->inject_usec - inject_usec);
+}
+
+void
+fprintf_input_queues_stats(FILE *fp, const orchids_t *ctx)
+{
+  int i;
+  const input_queue_t *q;
+  static const char *policy_str[] = { "newest", "oldest", "sample" };
+
+  fprintf(fp,
+          "--------------------+------------+----------+------------+----------+-----------+-------\n");
+  fprintf(fp,
+          "             module |      posts |     lost |   accepted |  dropped |    queued | drop\n");
+  fprintf(fp,
+          "--------------------+------------+----------+------------+----------+-----------+-------\n");
+  for (i = 0; i < ctx->loaded_modules; i++) {
+    q = ctx->mods[i].queue;
+    if (q == NULL) {
+      fprintf(fp, "%19.19s | %10lu | %8lu |          - |        - |         - | -\n",
+              ctx->mods[i].mod->name, ctx->mods[i].posts, ctx->mods[i].lost);
+      continue ;
+    }
+    fprintf(fp, "%19.19s | %10lu | %8lu | %10lu | %8lu | %4zu/%-4zu | %s\n",
+            ctx->mods[i].mod->name, ctx->mods[i].posts, ctx->mods[i].lost,
+            q->accepted, q->dropped, q->count, q->size,
+            policy_str[q->policy]);
+  }
+  fprintf(fp,
+          "--------------------+------------+----------+------------+----------+-----------+-------\n");
 }
 
+
 #ifndef ORCHIDS_DEMO
 
 void
@@ -660,9 +1134,19 @@ fprintf_orchids_stats(FILE *fp, const orchids_t *ctx)
   fprintf(fp, "     active threads : %u\n", ctx->threads);
   fprintf(fp, "     ovm stack size : %zd\n", ctx->ovm_stack->size);
   fprintf(fp, "            reports : %u\n", ctx->reports);
+  fprintf(fp, "  engine memory use : %zu (peak %zu)\n",
+          MEMGOV_USED(ctx), ctx->memgov.peak);
+  fprintf(fp, "  evicted instances : %u\n", ctx->memgov.evicted_instances);
+  fprintf(fp, "        shed events : %u\n", ctx->memgov.shed_events);
+  fprintf(fp, "      queued events : %zu\n", ctx->queued_events);
+  fprintf(fp, "     queued reports : %zu (peak %zu)\n",
+          ctx->report_queue.len, ctx->report_queue.peak);
+  fprintf(fp, "    dropped reports : %u\n", ctx->report_queue.dropped);
+  fprintf(fp, "     report batches : %u\n", ctx->report_queue.batches);
   fprintf(fp,
           "--------------------+"
           "-------------------------------------------------------\n");
+  fprintf_input_queues_stats(fp, ctx);
 }
 
 #else /* #ifndef ORCHIDS_DEMO */
@@ -314,6 +314,76 @@ void
 free_fields(ovm_var_t **tbl_event, size_t s);
 
 
+/**
+ ** Get the arena where a dissector may allocate the values of the
+ ** fields it adds to an event.  Values allocated there are freed
+ ** with the event, all at once: they must not be freed individually
+ ** (free_fields() and issdl_free() skip them), and must be copied
+ ** with issdl_clone() if they are to outlive the event.
+ **
+ ** @param ctx   Orchids application context.
+ ** @param event The event being dissected, or NULL for a new event.
+ ** @return The arena of the event.
+ **/
+event_arena_t *
+event_arena(orchids_t *ctx, event_t *event);
+
+
+/**
+ ** Allocate memory in an event arena.
+ **
+ ** @param arena The event arena.
+ ** @param size  Size to allocate.
+ ** @return A pointer to the allocated memory (not zeroed).
+ **/
+void *
+event_arena_alloc(event_arena_t *arena, size_t size);
+
+
+/**
+ ** Free all the chunks of an event arena.
+ **
+ ** @param arena The event arena.
+ **/
+void
+free_event_arena(event_arena_t *arena);
+
+
+/**
+ ** Value constructors allocating in an event arena.  They fall back
+ ** to ovm_int_new() etc. if the arena is NULL.
+ **
+ ** @param arena The event arena, or NULL.
+ ** @return A new value, flagged TYPE_ARENA.
+ **/
+ovm_var_t *
+ovm_int_new_arena(event_arena_t *arena);
+
+ovm_var_t *
+ovm_uint_new_arena(event_arena_t *arena);
+
+ovm_var_t *
+ovm_str_new_arena(event_arena_t *arena, size_t size);
+
+ovm_var_t *
+ovm_bstr_new_arena(event_arena_t *arena, size_t size);
+
+ovm_var_t *
+ovm_vstr_new_arena(event_arena_t *arena);
+
+ovm_var_t *
+ovm_vbstr_new_arena(event_arena_t *arena);
+
+ovm_var_t *
+ovm_ctime_new_arena(event_arena_t *arena);
+
+ovm_var_t *
+ovm_timeval_new_arena(event_arena_t *arena);
+
+ovm_var_t *
+ovm_ipv4_new_arena(event_arena_t *arena);
+
+
 
 /**
  ** Append part of an event with a given property table filled
@@ -378,6 +448,42 @@ void
 free_event(event_t *event);
 
 
+/**
+ ** Concatenate two events, e.g. to aggregate several records in a
+ ** single event.  If both events have an arena, the arena of the
+ ** first one takes over the chunks of the second one.  Where both
+ ** events have a value for a field, the engine sees the one of the
+ ** second event.
+ **
+ ** @param first  The first event.
+ ** @param second The event appended to the first one.
+ ** @return The concatenated event.
+ **/
+event_t *
+concat_events(event_t *first, event_t *second);
+
+
+/**
+ ** Allocate the active event record of an event, in the event arena
+ ** if it has one.
+ **
+ ** @param event The event.
+ ** @return A zeroed active event record.
+ **/
+active_event_t *
+new_active_event(event_t *event);
+
+
+/**
+ ** Free an active event record and its event.  If the event lives in
+ ** an arena, this is a single free of the arena chunks.
+ **
+ ** @param active_event The active event record.
+ **/
+void
+free_active_event(active_event_t *active_event);
+
+
 /**
  ** Post an event.
  ** If module has registered a sub-dissector, the function will call it.
@@ -391,6 +497,42 @@ free_event(event_t *event);
 void
 post_event(orchids_t *ctx, mod_entry_t *sender, event_t *event);
 
+
+/**
+ ** Create a bounded ingestion queue for a module.  Once the queue is
+ ** attached to a module entry (mod_entry_s::queue), events posted by
+ ** this module are queued by post_event() and dispatched later by
+ ** drain_input_queues().
+ **
+ ** @param size      The capacity of the queue.
+ ** @param policy    The drop policy (#QUEUE_DROP_NEWEST,
+ **                  #QUEUE_DROP_OLDEST or #QUEUE_SAMPLE).
+ ** @param sample_n  Sampling rate, for #QUEUE_SAMPLE.
+ ** @return A new input queue.
+ **/
+input_queue_t *
+new_input_queue(size_t size, int policy, unsigned int sample_n);
+
+
+/**
+ ** Dispatch queued events, taking one event per module in turn.
+ **
+ ** @param ctx     Orchids application context.
+ ** @param budget  The maximum number of events to dispatch.
+ **/
+void
+drain_input_queues(orchids_t *ctx, size_t budget);
+
+
+/**
+ ** Print per-module post and ingestion queue counters on a stream.
+ **
+ ** @param fp  The stdio stream to print on.
+ ** @param ctx The Orchids application context.
+ **/
+void
+fprintf_input_queues_stats(FILE *fp, const orchids_t *ctx);
+
 /**
  ** Print the Orchids application statistics to a stdio stream.
  ** Displayed info are: real uptime, user cpu time, system cpu time
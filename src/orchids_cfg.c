@@ -40,6 +40,10 @@
 #include "safelib.h"
 #include "mod_mgr.h"
 #include "lang.h"
+#include "mem_governor.h"
+#include "rule_reload.h"
+#include "sketch.h"
+#include "ipset.h"
 
 #include "orchids.h"
 
@@ -348,6 +352,192 @@ static void
 set_nice(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
 
 
+/**
+ ** Handler for the MemorySoftLimit configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_memory_soft_limit(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the MemoryHardLimit configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_memory_hard_limit(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the MemoryEvictPolicy configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_memory_evict_policy(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the RulePriority configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_rule_priority(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the RuleMemoryLimit configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_rule_memory_limit(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the IngestQueue configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_ingest_queue(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the CheckpointFile configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_checkpoint_file(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the CheckpointPeriod configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_checkpoint_period(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the ReportQueueSize configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_report_queue_size(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the ReportBatchSize configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_report_batch_size(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the ReportSync configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_report_sync(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the WindowMaxKeys configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_window_max_keys(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+/**
+ ** Handler for the HLLPrecision configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_hll_precision(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+/**
+ ** Handler for the CountMinWidth configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_cms_width(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+/**
+ ** Handler for the CountMinDepth configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_cms_depth(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+/**
+ ** Handler for the TopKSize configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_topk_size(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the IPSet configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+add_ipset(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the RuleReloadPolicy configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_rule_reload_policy(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
+/**
+ ** Handler for the RuleCacheDir configuration directive.
+ ** @param ctx  A pointer to the Orchids application context.
+ ** @param mod  A pointer to the current module being configured.
+ ** @param dir  A pointer to the configuration directive record.
+ **/
+static void
+set_rule_cache_dir(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir);
+
+
 void
 proceed_pre_config(orchids_t *ctx)
 {
@@ -1045,6 +1235,351 @@ set_nice(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
   }
 }
 
+static void
+set_memory_soft_limit(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  DebugLog(DF_CORE, DS_INFO, "setting memory soft limit '%s'\n", dir->args);
+
+  if (memgov_parse_size(dir->args, &ctx->memgov.soft_limit) != RETURN_SUCCESS)
+    DebugLog(DF_CORE, DS_ERROR,
+             "Ignored invalid MemorySoftLimit '%s'\n", dir->args);
+}
+
+static void
+set_memory_hard_limit(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  DebugLog(DF_CORE, DS_INFO, "setting memory hard limit '%s'\n", dir->args);
+
+  if (memgov_parse_size(dir->args, &ctx->memgov.hard_limit) != RETURN_SUCCESS)
+    DebugLog(DF_CORE, DS_ERROR,
+             "Ignored invalid MemoryHardLimit '%s'\n", dir->args);
+}
+
+static void
+set_memory_evict_policy(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  DebugLog(DF_CORE, DS_INFO, "setting eviction policy to '%s'\n", dir->args);
+
+  if (!strcasecmp("oldest", dir->args))
+    ctx->memgov.policy = MEMGOV_EVICT_OLDEST;
+  else if (!strcasecmp("lru", dir->args))
+    ctx->memgov.policy = MEMGOV_EVICT_LRU;
+  else if (!strcasecmp("priority", dir->args))
+    ctx->memgov.policy = MEMGOV_EVICT_PRIORITY;
+  else
+    DebugLog(DF_CORE, DS_ERROR,
+             "Ignored unknown eviction policy '%s' "
+             "(oldest, lru or priority)\n",
+             dir->args);
+}
+
+/**
+ ** Split the arguments of a "<rule name> <value>" directive.
+ ** @return The value part, or NULL if it is missing.
+ **/
+static char *
+split_rule_directive(config_directive_t *dir, char **rule_name)
+{
+  char *s;
+
+  s = dir->args;
+  *rule_name = s;
+  while (*s && !isblank(*s))
+    s++;
+  while (*s && isblank(*s))
+    *(s++) = '\0';
+
+  if (*s == '\0') {
+    DebugLog(DF_CORE, DS_ERROR,
+             "%s:%i: %s: missing value (syntax: %s <rule> <value>)\n",
+             dir->file, dir->line, dir->directive, dir->directive);
+    return (NULL);
+  }
+
+  return (s);
+}
+
+static void
+set_rule_priority(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  char *rule_name;
+  char *value;
+
+  value = split_rule_directive(dir, &rule_name);
+  if (value == NULL)
+    return ;
+
+  DebugLog(DF_CORE, DS_INFO,
+           "setting priority of rule '%s' to %s\n", rule_name, value);
+
+  memgov_get_rule_cfg(ctx, rule_name)->priority = atoi(value);
+}
+
+static void
+set_rule_memory_limit(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  char *rule_name;
+  char *value;
+  size_t limit;
+
+  value = split_rule_directive(dir, &rule_name);
+  if (value == NULL)
+    return ;
+
+  DebugLog(DF_CORE, DS_INFO,
+           "setting memory limit of rule '%s' to %s\n", rule_name, value);
+
+  if (memgov_parse_size(value, &limit) != RETURN_SUCCESS) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "Ignored invalid RuleMemoryLimit '%s'\n", value);
+    return ;
+  }
+  memgov_get_rule_cfg(ctx, rule_name)->mem_limit = limit;
+}
+
+static void
+set_ingest_queue(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  char mod_name[64];
+  char policy_str[32];
+  unsigned long size;
+  unsigned int sample_n;
+  int policy;
+  int n;
+  mod_entry_t *m;
+
+  policy_str[0] = '\0';
+  sample_n = 1;
+  n = sscanf(dir->args, "%63s %lu %31s %u",
+             mod_name, &size, policy_str, &sample_n);
+  if (n < 2 || size == 0) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "%s:%i: syntax: IngestQueue <module> <size> "
+             "[drop-newest|drop-oldest|sample <N>]\n",
+             dir->file, dir->line);
+    return ;
+  }
+
+  if (n == 2 || !strcasecmp("drop-newest", policy_str))
+    policy = QUEUE_DROP_NEWEST;
+  else if (!strcasecmp("drop-oldest", policy_str))
+    policy = QUEUE_DROP_OLDEST;
+  else if (!strcasecmp("sample", policy_str) && n == 4 && sample_n > 0)
+    policy = QUEUE_SAMPLE;
+  else {
+    DebugLog(DF_CORE, DS_ERROR,
+             "%s:%i: IngestQueue: unknown drop policy '%s'\n",
+             dir->file, dir->line, policy_str);
+    return ;
+  }
+
+  m = find_module_entry(ctx, mod_name);
+  if (!m) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "IngestQueue : unknown module (%s)\n", mod_name);
+    return ;
+  }
+  if (m->queue) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "IngestQueue : module %s already has a queue\n", mod_name);
+    return ;
+  }
+
+  DebugLog(DF_CORE, DS_INFO,
+           "setting ingestion queue for module %s (size %lu, policy %i)\n",
+           mod_name, size, policy);
+
+  m->queue = new_input_queue(size, policy, sample_n);
+}
+
+static void
+set_checkpoint_file(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  DebugLog(DF_CORE, DS_INFO, "setting checkpoint file to '%s'\n", dir->args);
+
+  ctx->checkpoint_file = dir->args;
+}
+
+static void
+set_checkpoint_period(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  ctx->checkpoint_period = atoi(dir->args);
+
+  if (ctx->checkpoint_period < 0) {
+    DebugLog(DF_CORE, DS_WARN,
+             "Warning, negative CheckpointPeriod, periodic checkpoints disabled\n");
+    ctx->checkpoint_period = 0;
+  }
+}
+
+static void
+set_report_queue_size(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int size;
+
+  size = atoi(dir->args);
+  if (size < 0) {
+    DebugLog(DF_CORE, DS_WARN,
+             "Warning, negative ReportQueueSize, reports are synchronous\n");
+    size = 0;
+  }
+  DebugLog(DF_CORE, DS_INFO, "setting report queue size to %i\n", size);
+  ctx->report_queue.size = size;
+}
+
+static void
+set_report_batch_size(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int batch;
+
+  batch = atoi(dir->args);
+  if (batch <= 0) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "%s:%i: ReportBatchSize must be positive\n",
+             dir->file, dir->line);
+    return ;
+  }
+  ctx->report_queue.batch = batch;
+}
+
+static void
+set_report_sync(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  ctx->report_queue.sync = atoi(dir->args) ? TRUE : FALSE;
+}
+
+static void
+set_window_max_keys(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int keys;
+
+  keys = atoi(dir->args);
+  if (keys < 0) {
+    DebugLog(DF_CORE, DS_WARN,
+             "Warning, negative WindowMaxKeys, number of keys not limited\n");
+    keys = 0;
+  }
+  DebugLog(DF_CORE, DS_INFO, "setting window max keys to %i\n", keys);
+  ctx->window_max_keys = keys;
+}
+
+static void
+set_hll_precision(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int p;
+
+  p = atoi(dir->args);
+  if (p < HLL_MIN_PRECISION || p > HLL_MAX_PRECISION) {
+    DebugLog(DF_CORE, DS_WARN,
+             "Warning, HLLPrecision must be in [%i, %i], using %i\n",
+             HLL_MIN_PRECISION, HLL_MAX_PRECISION, DEFAULT_HLL_PRECISION);
+    p = DEFAULT_HLL_PRECISION;
+  }
+  DebugLog(DF_CORE, DS_INFO, "setting HyperLogLog precision to %i\n", p);
+  ctx->hll_precision = p;
+}
+
+static void
+set_cms_width(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int w;
+
+  w = atoi(dir->args);
+  if (w <= 0 || w > CMS_MAX_COUNTERS / ctx->cms_depth) {
+    DebugLog(DF_CORE, DS_WARN,
+             "Warning, bad CountMinWidth, using %i\n", DEFAULT_CMS_WIDTH);
+    w = DEFAULT_CMS_WIDTH;
+  }
+  DebugLog(DF_CORE, DS_INFO, "setting Count-Min width to %i\n", w);
+  ctx->cms_width = w;
+}
+
+static void
+set_cms_depth(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int d;
+
+  d = atoi(dir->args);
+  if (d <= 0 || d > CMS_MAX_COUNTERS / ctx->cms_width) {
+    DebugLog(DF_CORE, DS_WARN,
+             "Warning, bad CountMinDepth, using %i\n", DEFAULT_CMS_DEPTH);
+    d = DEFAULT_CMS_DEPTH;
+  }
+  DebugLog(DF_CORE, DS_INFO, "setting Count-Min depth to %i\n", d);
+  ctx->cms_depth = d;
+}
+
+static void
+set_topk_size(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  int k;
+
+  k = atoi(dir->args);
+  if (k <= 0 || k > TOPK_MAX_SIZE) {
+    DebugLog(DF_CORE, DS_WARN,
+             "Warning, TopKSize must be in [1, %i], using %i\n",
+             TOPK_MAX_SIZE, DEFAULT_TOPK_SIZE);
+    k = DEFAULT_TOPK_SIZE;
+  }
+  DebugLog(DF_CORE, DS_INFO, "setting top-k size to %i\n", k);
+  ctx->topk_size = k;
+}
+
+static void
+add_ipset(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  char name[256];
+  char path[PATH_MAX];
+  long period;
+  int ret;
+
+  period = 0;
+  ret = sscanf(dir->args, "%255s %4095s %li", name, path, &period);
+  if (ret < 2 || period < 0) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "IPSet: Bad argument format (name file [reload period])\n");
+    return ;
+  }
+
+  DebugLog(DF_CORE, DS_INFO, "loading IP set '%s' from '%s'\n", name, path);
+  if (ipset_declare(ctx, name, path, period) == NULL)
+    DebugLog(DF_CORE, DS_ERROR, "IPSet: can't load '%s'\n", path);
+}
+
+static void
+set_rule_reload_policy(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  if (!strcasecmp("drain", dir->args))
+    ctx->reload_policy = RULE_RELOAD_DRAIN;
+  else if (!strcasecmp("kill", dir->args))
+    ctx->reload_policy = RULE_RELOAD_KILL;
+  else {
+    DebugLog(DF_CORE, DS_ERROR,
+             "%s:%i: RuleReloadPolicy: unknown policy '%s' (drain or kill)\n",
+             dir->file, dir->line, dir->args);
+    return ;
+  }
+
+  DebugLog(DF_CORE, DS_INFO, "setting rule reload policy to %s\n", dir->args);
+}
+
+static void
+set_rule_cache_dir(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
+{
+  struct stat st;
+
+  if (stat(dir->args, &st) || !S_ISDIR(st.st_mode)) {
+    DebugLog(DF_CORE, DS_ERROR,
+             "%s:%i: RuleCacheDir: '%s' is not a directory, cache disabled\n",
+             dir->file, dir->line, dir->args);
+    return ;
+  }
+
+  DebugLog(DF_CORE, DS_INFO, "setting rule cache directory to '%s'\n",
+           dir->args);
+  ctx->rule_cache_dir = dir->args;
+}
+
 static void
 add_input_source(orchids_t *ctx, mod_entry_t *mod, config_directive_t *dir)
 {
@@ -1190,6 +1725,25 @@ static mod_cfg_cmd_t config_dir_g[] =
   { "SetModuleDir", set_modules_dir, "Set the modules directory" },
   { "SetLockFile", set_lock_file, "Set the lock file name" },
   { "MaxMemorySize", set_max_memory_limit, "Set maximum memory limit" },
+  { "MemorySoftLimit", set_memory_soft_limit, "Set the engine memory budget (start evicting rule instances)" },
+  { "MemoryHardLimit", set_memory_hard_limit, "Set the engine memory hard limit (start shedding events)" },
+  { "MemoryEvictPolicy", set_memory_evict_policy, "Set the rule instance eviction policy (oldest, lru, priority)" },
+  { "RulePriority", set_rule_priority, "Set the eviction priority of a rule" },
+  { "RuleMemoryLimit", set_rule_memory_limit, "Set the memory budget of a rule" },
+  { "IngestQueue", set_ingest_queue, "Add a bounded ingestion queue to a module" },
+  { "CheckpointFile", set_checkpoint_file, "Set the engine state checkpoint file (warm restart)" },
+  { "CheckpointPeriod", set_checkpoint_period, "Set the engine state checkpoint period (in seconds)" },
+  { "RuleReloadPolicy", set_rule_reload_policy, "Set what happens to instances of reloaded rules (drain, kill)" },
+  { "RuleCacheDir", set_rule_cache_dir, "Set the precompiled rule image cache directory" },
+  { "ReportQueueSize", set_report_queue_size, "Set the maximum number of queued reports (0: synchronous reports)" },
+  { "ReportBatchSize", set_report_batch_size, "Set the number of reports written at once" },
+  { "ReportSync", set_report_sync, "Sync the disks after each batch of reports" },
+  { "WindowMaxKeys", set_window_max_keys, "Set the maximum number of keys of a window aggregator (0: no limit)" },
+  { "HLLPrecision", set_hll_precision, "Set the default precision of HyperLogLog sketches" },
+  { "CountMinWidth", set_cms_width, "Set the default width of Count-Min sketches" },
+  { "CountMinDepth", set_cms_depth, "Set the default depth of Count-Min sketches" },
+  { "TopKSize", set_topk_size, "Set the default size of top-k sketches" },
+  { "IPSet", add_ipset, "Load a named set of IPv4 addresses and networks" },
   { "ResolveIP", set_resolve_ip, "Enable/Disable DNS name resolution" },
   { "Nice", set_nice, "Set the process priority"},
   { "INPUT", add_input_source, "Add an input source module"},
@@ -1332,6 +1886,8 @@ proceed_post_compil(orchids_t *ctx)
       mod->post_compil(ctx, &ctx->mods[mod_id]);
   }
 
+  memgov_bind_rules(ctx);
+
   gettimeofday(&ctx->postcompil_time, NULL);
   Timer_Sub(&diff_time, &ctx->postcompil_time, &ctx->compil_time);
   /* move this into orchids stats */
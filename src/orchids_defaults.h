@@ -44,6 +44,27 @@
 
 #define DEFAULT_TIMEOUT 600
 
+/* Maximum number of events drained from the ingestion queues
+ * per main loop iteration */
+#define DEFAULT_QUEUE_DRAIN_BUDGET 256
+
+/* Size of the first chunk of an event arena, in bytes */
+#define EVENT_ARENA_CHUNK_SIZE 1024
+
+/* Report queue: maximum number of queued reports, and number of
+ * reports written by a writer at once */
+#define DEFAULT_REPORT_QUEUE_SIZE 1024
+#define DEFAULT_REPORT_BATCH_SIZE 64
+
+/* Maximum number of keys of a window aggregator */
+#define DEFAULT_WINDOW_MAX_KEYS 65536
+
+/* Default sketch sizes (hll_new(), cms_new(), topk_new() with size 0) */
+#define DEFAULT_HLL_PRECISION 12
+#define DEFAULT_CMS_WIDTH 2048
+#define DEFAULT_CMS_DEPTH 4
+#define DEFAULT_TOPK_SIZE 32
+
 /* #define PATH_TO_DOT "/usr/local/bin/dot" */
 /* #define PATH_TO_EPSTOPDF "/usr/bin/epstopdf" */
 /* #define PATH_TO_CONVERT "/usr/X11R6/bin/convert" */
@@ -27,6 +27,7 @@
 
 #include "ovm.h"
 #include "ovm_priv.h"
+#include "mem_governor.h"
 
 #define NULL_VAR (param->state->state->rule->static_env[	\
 		    param->ctx->rule_compiler->static_null_res_id	\
@@ -269,6 +270,36 @@ fprintf_bytecode(FILE *fp, bytecode_t *bytecode)
   return ;
 }
 
+int
+ovm_insn_len(bytecode_t opcode)
+{
+  switch (opcode) {
+    case OP_PUSH:
+    case OP_POP:
+    case OP_PUSHSTATIC:
+    case OP_PUSHFIELD:
+    case OP_CALL:
+    case OP_JMP:
+    case OP_POPCJMP:
+      return (2);
+
+    default:
+      return (1);
+  }
+}
+
+size_t
+ovm_bytecode_len(bytecode_t *bytecode)
+{
+  size_t pos;
+
+  pos = 0;
+  while (bytecode[pos] != OP_END)
+    pos += ovm_insn_len(bytecode[pos]);
+
+  return (pos + 1);
+}
+
 void
 fprintf_bytecode_short(FILE *fp, bytecode_t *bytecode)
 {
@@ -511,14 +542,20 @@ ovm_pop(isn_param_t *param)
 
   /* if a temp value is already bounded to this var, free it. */
   if (*var && CAN_FREE_VAR(*var)) {
+    MEMGOV_RELEASE(param->ctx, param->state->rule_instance,
+                   memgov_var_size(*var));
     Xfree(*var);
   }
 
   *var = stack_pop(param->ctx->ovm_stack);
 
   /* mark value as bounded */
-  if (*var)
+  if (*var) {
     FLAGS(*var) &= ~TYPE_NOTBOUND;
+    if (CAN_FREE_VAR(*var))
+      MEMGOV_CHARGE(param->ctx, param->state->rule_instance,
+                    memgov_var_size(*var));
+  }
 
   /* XXX: if *var can be freed, we must clone it. (ref can be dup) */
 
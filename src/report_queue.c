@@ -0,0 +1,408 @@
+/**
+ ** @file report_queue.c
+ ** Asynchronous report output.
+ **
+ ** Report output callbacks (IODEF documents, HTML reports...) build
+ ** DOM trees and write files: run from issdl_report(), inside the
+ ** virtual machine, they stall the engine exactly when alerts
+ ** spike.  Instead, report_state() takes a snapshot of the reported state
+ ** path and queues it.  Queued reports are written in batches by a
+ ** child process, so that the main loop is only blocked for the
+ ** fork(), as for checkpoints.
+ **
+ ** The snapshot is taken by value: events and environments are
+ ** copied (virtual strings become real strings), since the rule
+ ** instance may be cut, evicted or killed before the report is
+ ** written.  Values that can't be cloned (regular expressions,
+ ** external data) are shared.
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "orchids.h"
+#include "lang.h"
+#include "evt_mgr.h"
+#include "orchids_api.h"
+
+#include "report_queue.h"
+
+/**
+ ** @struct report_snapshot_s
+ ** A queued report: a copy of the reported state path.
+ **/
+struct report_snapshot_s
+{
+  report_snapshot_t *next;
+  state_instance_t  *state;
+  rule_instance_t    rule_instance;
+  ovm_var_t        **owned;
+  size_t             owned_nb;
+  size_t             owned_sz;
+};
+
+static pid_t report_pid_g = 0;
+static orchids_t *report_ctx_g = NULL;
+static uint32_t report_dropped_logged_g = 0;
+
+
+static ovm_var_t *
+snapshot_var(report_snapshot_t *snap, ovm_var_t *var)
+{
+  ovm_var_t *res;
+
+  if (var == NULL)
+    return (NULL);
+
+  switch (TYPE(var)) {
+  case T_VSTR:
+    res = ovm_str_new(VSTRLEN(var));
+    memcpy(STR(res), VSTR(var), VSTRLEN(var));
+    break;
+  case T_VBSTR:
+    res = ovm_bstr_new(VBSTRLEN(var));
+    memcpy(BSTR(res), VBSTR(var), VBSTRLEN(var));
+    break;
+  default:
+    if (issdlgettypes()[TYPE(var)].clone == NULL)
+      return (var);
+    res = issdl_clone(var);
+    if (res == NULL)
+      return (var);
+  }
+
+  if (snap->owned_nb == snap->owned_sz) {
+    snap->owned_sz = snap->owned_sz ? 2 * snap->owned_sz : 16;
+    snap->owned = Xrealloc(snap->owned,
+                           snap->owned_sz * sizeof (ovm_var_t *));
+  }
+  snap->owned[ snap->owned_nb++ ] = res;
+
+  return (res);
+}
+
+
+static ovm_var_t **
+snapshot_env(report_snapshot_t *snap, ovm_var_t **env, int env_sz)
+{
+  ovm_var_t **res;
+  int i;
+
+  if (env == NULL || env_sz <= 0)
+    return (NULL);
+
+  res = Xmalloc(env_sz * sizeof (ovm_var_t *));
+  for (i = 0; i < env_sz; i++)
+    res[i] = snapshot_var(snap, env[i]);
+
+  return (res);
+}
+
+
+static active_event_t *
+snapshot_event(report_snapshot_t *snap, active_event_t *ae)
+{
+  active_event_t *res;
+  event_t **last;
+  event_t *e;
+  event_t *copy;
+
+  if (ae == NULL)
+    return (NULL);
+
+  res = Xzmalloc(sizeof (active_event_t));
+  res->refs = ae->refs;
+  for (last = &res->event, e = ae->event; e; e = e->next) {
+    copy = Xzmalloc(sizeof (event_t));
+    copy->field_id = e->field_id;
+    copy->value = snapshot_var(snap, e->value);
+    *last = copy;
+    last = &copy->next;
+  }
+
+  return (res);
+}
+
+
+static report_snapshot_t *
+snapshot_state_path(state_instance_t *state)
+{
+  report_snapshot_t *snap;
+  state_instance_t *si;
+  state_instance_t *copy;
+  state_instance_t **last;
+  int env_sz;
+
+  snap = Xzmalloc(sizeof (report_snapshot_t));
+  snap->rule_instance = *state->rule_instance;
+  snap->rule_instance.next = NULL;
+  snap->rule_instance.queue_head = NULL;
+  snap->rule_instance.queue_tail = NULL;
+  snap->rule_instance.state_list = NULL;
+  snap->rule_instance.sync_lock_list = NULL;
+  env_sz = state->rule_instance->rule->dynamic_env_sz;
+
+  for (last = &snap->state, si = state; si; si = si->parent) {
+    copy = Xzmalloc(sizeof (state_instance_t));
+    copy->state = si->state;
+    copy->rule_instance = &snap->rule_instance;
+    copy->event_level = si->event_level;
+    copy->flags = si->flags;
+    copy->event = snapshot_event(snap, si->event);
+    copy->inherit_env = snapshot_env(snap, si->inherit_env, env_sz);
+    copy->current_env = snapshot_env(snap, si->current_env, env_sz);
+    *last = copy;
+    last = &copy->parent;
+    snap->rule_instance.first_state = copy;
+  }
+
+  return (snap);
+}
+
+
+static void
+free_snapshot(report_snapshot_t *snap)
+{
+  state_instance_t *si;
+  state_instance_t *next_si;
+  event_t *e;
+  event_t *next_e;
+  size_t i;
+
+  for (si = snap->state; si; si = next_si) {
+    next_si = si->parent;
+    if (si->event) {
+      for (e = si->event->event; e; e = next_e) {
+        next_e = e->next;
+        Xfree(e);
+      }
+      Xfree(si->event);
+    }
+    if (si->inherit_env)
+      Xfree(si->inherit_env);
+    if (si->current_env)
+      Xfree(si->current_env);
+    Xfree(si);
+  }
+  for (i = 0; i < snap->owned_nb; i++)
+    issdl_free(snap->owned[i]);
+  if (snap->owned)
+    Xfree(snap->owned);
+  Xfree(snap);
+}
+
+
+static void
+call_report_outputs(orchids_t *ctx, state_instance_t *state)
+{
+  reportmod_t *r;
+
+  SLIST_FOREACH(r, &ctx->reportmod_list, list) {
+    r->cb(ctx, r->mod, r->data, state);
+  }
+}
+
+
+void
+report_state(orchids_t *ctx, state_instance_t *state)
+{
+  report_queue_t *q = &ctx->report_queue;
+  report_snapshot_t *snap;
+
+  if (q->size == 0) {
+    call_report_outputs(ctx, state);
+    return ;
+  }
+
+  if (q->len >= q->size) {
+    q->dropped++;
+    return ;
+  }
+
+  snap = snapshot_state_path(state);
+  if (q->tail)
+    q->tail->next = snap;
+  else
+    q->head = snap;
+  q->tail = snap;
+  q->len++;
+  if (q->len > q->peak)
+    q->peak = q->len;
+
+  if (q->len >= q->batch)
+    report_queue_flush(ctx);
+}
+
+
+static void
+write_reports(orchids_t *ctx, report_snapshot_t *snap)
+{
+  for ( ; snap; snap = snap->next)
+    call_report_outputs(ctx, snap->state);
+}
+
+
+static void
+free_reports(report_queue_t *q)
+{
+  report_snapshot_t *snap;
+  report_snapshot_t *next;
+
+  for (snap = q->head; snap; snap = next) {
+    next = snap->next;
+    free_snapshot(snap);
+  }
+  q->head = NULL;
+  q->tail = NULL;
+  q->len = 0;
+}
+
+
+/**
+ ** The writer works on a copy-on-write image of the queue, and
+ ** exits: reports are freed in the parent as soon as it is forked.
+ ** Writers are reaped by the SIGCHLD handler.
+ **/
+void
+report_queue_flush(orchids_t *ctx)
+{
+  report_queue_t *q = &ctx->report_queue;
+  pid_t pid;
+
+  if (q->dropped != report_dropped_logged_g) {
+    DebugLog(DF_CORE, DS_WARN, "report queue full: %u reports dropped\n",
+             q->dropped - report_dropped_logged_g);
+    report_dropped_logged_g = q->dropped;
+  }
+
+  if (q->len == 0)
+    return ;
+
+  if (q->writer > 0 && kill(q->writer, 0) == 0)
+    return ;
+
+  fflush(NULL);
+  pid = fork();
+  if (pid == 0) {
+    write_reports(ctx, q->head);
+    if (q->sync)
+      sync();
+    _exit(EXIT_SUCCESS);
+  }
+  if (pid < 0) {
+    DebugLog(DF_CORE, DS_WARN, "report writer: fork(): %s\n",
+             strerror(errno));
+    write_reports(ctx, q->head);
+  }
+  else
+    q->writer = pid;
+
+  DebugLog(DF_CORE, DS_DEBUG, "report writer: %zu reports\n", q->len);
+  q->batches++;
+  free_reports(q);
+}
+
+
+static int
+rtaction_report_flush(orchids_t *ctx, rtaction_t *e)
+{
+  report_queue_flush(ctx);
+
+  e->date = ctx->cur_loop_time;
+  e->date.tv_sec += 1;
+  register_rtaction(ctx, e);
+
+  return (0);
+}
+
+
+/**
+ ** Write the remaining reports at exit (e.g. ExitAfterProcessAll),
+ ** in the main process only: forked children exit too.
+ **/
+static void
+report_queue_atexit(void)
+{
+  report_queue_t *q;
+
+  if (report_ctx_g == NULL || getpid() != report_pid_g)
+    return ;
+
+  q = &report_ctx_g->report_queue;
+  write_reports(report_ctx_g, q->head);
+  free_reports(q);
+}
+
+
+void
+report_queue_setup(orchids_t *ctx)
+{
+  if (ctx->off_line_mode != MODE_ONLINE)
+    ctx->report_queue.size = 0;
+
+  if (ctx->report_queue.size == 0)
+    return ;
+
+  if (ctx->report_queue.batch == 0
+      || ctx->report_queue.batch > ctx->report_queue.size)
+    ctx->report_queue.batch = ctx->report_queue.size;
+
+  report_ctx_g = ctx;
+  report_pid_g = getpid();
+  atexit(report_queue_atexit);
+  register_rtcallback(ctx, rtaction_report_flush, NULL, 1);
+}
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -0,0 +1,91 @@
+/**
+ ** @file report_queue.h
+ ** Public definitions for report_queue.c
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef REPORT_QUEUE_H
+#define REPORT_QUEUE_H
+
+#include "orchids.h"
+
+
+/**
+ ** Report a state instance: call the report output callbacks, either
+ ** at once (synchronous reports), or later, on a snapshot of the
+ ** state path taken now.  If the queue is full, the report is
+ ** dropped.
+ **
+ ** @param ctx   Orchids application context.
+ ** @param state The reported state instance.
+ **/
+void
+report_state(orchids_t *ctx, state_instance_t *state);
+
+
+/**
+ ** Hand the queued reports to a writer process.  Nothing is done
+ ** while the previous writer is still running: reports keep on
+ ** being queued.
+ **
+ ** @param ctx Orchids application context.
+ **/
+void
+report_queue_flush(orchids_t *ctx);
+
+
+/**
+ ** Set up the report queue: periodic flushes, and a last flush at
+ ** exit.  Reports stay synchronous in off-line mode.
+ **
+ ** @param ctx Orchids application context.
+ **/
+void
+report_queue_setup(orchids_t *ctx);
+
+
+#endif /* REPORT_QUEUE_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -31,6 +31,7 @@
 #include "orchids.h"
 #include "lang.h"
 #include "rule_compiler.h"
+#include "rule_image.h"
 #include "issdl.tab.h"
 #include "ovm.h"
 
@@ -45,9 +46,6 @@ extern char *issdlcurrentfile_g;
 /* XXX: static function prototype definition:
  * (should be moved in a private header) */
 
-static void
-compile_and_add_rulefile(orchids_t *ctx, char *rulefile);
-
 static void
 compile_state_ast(rule_compiler_t *ctx,
                   rule_t *rule,
@@ -90,9 +88,6 @@ compile_bytecode_cond(node_expr_t *expr, bytecode_buffer_t *code,
 static void
 statics_add(rule_compiler_t *ctx, ovm_var_t *data);
 
-static void
-build_fields_hash(orchids_t *ctx);
-
 static void
 build_functions_hash(orchids_t *ctx);
 
@@ -190,6 +185,8 @@ void
 compile_rules(orchids_t *ctx)
 {
   rulefile_t *rulefile;
+  struct stat filestat;
+  int32_t rules;
 
   DebugLog(DF_OLC, DS_NOTICE, "*** beginning rule compilation ***\n");
 
@@ -197,8 +194,19 @@ compile_rules(orchids_t *ctx)
   /* XXX functions hash construction moved to register_lang_function() */
   build_functions_hash(ctx);
 
-  for (rulefile = ctx->rulefile_list; rulefile; rulefile = rulefile->next)
+  if (ctx->rule_cache_dir) {
+    compile_rules_cached(ctx);
+    gettimeofday(&ctx->compil_time, NULL);
+    return ;
+  }
+
+  for (rulefile = ctx->rulefile_list; rulefile; rulefile = rulefile->next) {
+    Xstat(rulefile->name, &filestat);
+    rulefile->mtime = filestat.st_mtime;
+    rules = ctx->rule_compiler->rules;
     compile_and_add_rulefile(ctx, rulefile->name);
+    rulefile->rules_nb = ctx->rule_compiler->rules - rules;
+  }
 
   gettimeofday(&ctx->compil_time, NULL);
 
@@ -208,7 +216,7 @@ compile_rules(orchids_t *ctx)
 
 
 #ifdef ENABLE_PREPROC
-static char *
+char *
 get_preproc_cmd(orchids_t *ctx, const char *filename)
 {
   preproc_cmd_t *c;
@@ -231,50 +239,57 @@ get_preproc_cmd(orchids_t *ctx, const char *filename)
 #endif /* ENABLE_PREPROC */
 
 
-/**
- * Lex/yacc parser entry point.
- * @param ctx Orchids context.
- * @param rulefile File to parse.
- **/
-static void
+void
 compile_and_add_rulefile(orchids_t *ctx, char *rulefile)
 {
+  FILE *fp;
   int ret;
 #ifdef ENABLE_PREPROC
   const char *ppcmd;
   char cmd[4096];
 #endif /* ENABLE_PREPROC */
 
-  DebugLog(DF_OLC, DS_NOTICE, "Compiling rule file '%s'\n", rulefile);
-
-  /* set some compiler context values */
-  ctx->rule_compiler->currfile = rulefile;
-  issdlcurrentfile_g = strdup(rulefile);
-  issdllineno_g = 1;
 #ifdef ENABLE_PREPROC
   ppcmd = get_preproc_cmd(ctx, rulefile);
   DebugLog(DF_OLC, DS_NOTICE, "Using the preproc cmd '%s'.\n", ppcmd);
   snprintf(cmd, sizeof (cmd), "%s %s", ppcmd, rulefile);
-  issdlin = Xpopen(cmd, "r");
+  fp = Xpopen(cmd, "r");
 #else
-    issdlin = Xfopen(rulefile, "r");
+    fp = Xfopen(rulefile, "r");
 #endif /* ENABLE_PREPROC */
 
-  /* parse rule file */
-  ret = issdlparse();
-  if (ret > 0) {
-    DebugLog(DF_OLC, DS_FATAL,
-             "Error while compiling rule file '%s'\n", rulefile);
-    exit(EXIT_FAILURE);
-  }
+  compile_and_add_rulestream(ctx, rulefile, fp);
 
 #ifdef ENABLE_PREPROC
-  ret = Xpclose(issdlin);
+  ret = Xpclose(fp);
   if (ret > 0) {
     DebugLog(DF_OLC, DS_ERROR, "error: preprocessor returned %i.\n", ret);
     exit(EXIT_FAILURE);
   }
 #endif /* ENABLE_PREPROC */
+}
+
+
+void
+compile_and_add_rulestream(orchids_t *ctx, char *rulefile, FILE *fp)
+{
+  int ret;
+
+  DebugLog(DF_OLC, DS_NOTICE, "Compiling rule file '%s'\n", rulefile);
+
+  /* set some compiler context values */
+  ctx->rule_compiler->currfile = rulefile;
+  issdlcurrentfile_g = strdup(rulefile);
+  issdllineno_g = 1;
+  issdlin = fp;
+
+  /* parse rule file */
+  ret = issdlparse();
+  if (ret > 0) {
+    DebugLog(DF_OLC, DS_FATAL,
+             "Error while compiling rule file '%s'\n", rulefile);
+    exit(EXIT_FAILURE);
+  }
 
   gettimeofday(&ctx->last_rule_act, NULL);
 }
@@ -712,6 +727,7 @@ build_fieldname(rule_compiler_t *ctx, char *fieldname)
     DebugLog(DF_OLC, DS_FATAL, "field %s not registered\n", fieldname);
     exit(EXIT_FAILURE);
   }
+  f->active = TRUE;
 
   n = Xmalloc(sizeof (node_expr_t));
   n->type = NODE_FIELD;
@@ -737,7 +753,7 @@ build_varname(rule_compiler_t *ctx, char *varname)
 
   /* if it's doesn't exist, add it to the hash table */
   if (tmp == NULL) {
-    n->sym.res_id = ctx->rule_env->elmts;
+    n->sym.res_id = strhash_elmts(ctx->rule_env);
     strhash_add(ctx->rule_env, n, varname);
     dynamic_add(ctx, varname);
   } else {
@@ -1017,23 +1033,23 @@ build_regex(rule_compiler_t *ctx, char *regex_str)
 }
 
 
-/**
- * Build the field name hash table.
- * @param ctx Orchids context.
- **/
-static void
+void
 build_fields_hash(orchids_t *ctx)
 {
   strhash_t *h;
   int        f;
+  ohash_stats_t stats;
 
   h = ctx->rule_compiler->fields_hash;
-  for (f = 0; f < ctx->num_fields; f++)
+  /* Fields may have been registered since the last call (rule reload):
+   * only add the new ones. */
+  for (f = strhash_elmts(h); f < ctx->num_fields; f++)
     strhash_add(h, &ctx->global_fields[f], ctx->global_fields[f].name);
 
+  strhash_get_stats(h, &stats);
   DebugLog(DF_OLC, DS_INFO,
-           "build_fields_hash(): size: %i elems: %i collides: %i\n",
-           h->size, h->elmts, strhash_collide_count(h));
+           "build_fields_hash(): size: %zu elems: %zu displaced: %zu max probe: %zu\n",
+           stats.size, stats.elmts, stats.displaced, stats.max_probe);
 }
 
 
@@ -1048,6 +1064,7 @@ build_functions_hash(orchids_t *ctx)
   issdl_function_t *func_tbl;
   int               f;
   int               nf;
+  ohash_stats_t     stats;
 
   h = ctx->rule_compiler->functions_hash;
   func_tbl = ctx->vm_func_tbl;
@@ -1060,9 +1077,10 @@ build_functions_hash(orchids_t *ctx)
     strhash_add(h, &func_tbl[f], func_tbl[f].name);
   }
 
+  strhash_get_stats(h, &stats);
   DebugLog(DF_OLC, DS_INFO,
-           "build_functions_hash(): size: %i elems: %i collides: %i\n",
-           h->size, h->elmts, strhash_collide_count(h));
+           "build_functions_hash(): size: %zu elems: %zu displaced: %zu max probe: %zu\n",
+           stats.size, stats.elmts, stats.displaced, stats.max_probe);
 }
 
 
@@ -1081,25 +1099,6 @@ build_concat_string(char *str1, char *str2)
 }
 
 
-static unsigned long
-datahash_pjw(unsigned long h, void *key, size_t keylen)
-{
-  unsigned long g;
-  char *p;
-
-  p = (char *) key;
-  for (; keylen > 0; keylen--) {
-    h = (h << 4) + *p++;
-    if ((g = h & 0xF0000000U) != 0) {
-      h = h ^ (g >> 28);
-      h = h ^ g;
-    }
-  }
-
-  return (h);
-}
-
-
 static unsigned long
 objhash_rule_instance(void *state_inst)
 {
@@ -1121,9 +1120,9 @@ objhash_rule_instance(void *state_inst)
     else
       var = si->inherit_env[ sync_var ];
 
-    h = datahash_pjw(h, &sync_var, sizeof (sync_var));
-    h = datahash_pjw(h, &TYPE(var), sizeof (TYPE(var)));
-    h = datahash_pjw(h, issdl_get_data(var), issdl_get_data_len(var));
+    h = hash_mm64_seed(h, (hkey_t *)&sync_var, sizeof (sync_var));
+    h = hash_mm64_seed(h, (hkey_t *)&TYPE(var), sizeof (TYPE(var)));
+    h = hash_mm64_seed(h, issdl_get_data(var), issdl_get_data_len(var));
   }
 
   DebugLog(DF_ENG, DS_INFO, "Hashed state instance %p hcode=0x%08lx\n",
@@ -1183,6 +1182,206 @@ objhash_rule_instance_cmp(void *state_inst1, void *state_inst2)
 }
 
 
+objhash_t *
+new_sync_lock_hash(void)
+{
+  objhash_t *h;
+
+  h = new_objhash( 1021 );
+  h->hash = objhash_rule_instance;
+  h->cmp = objhash_rule_instance_cmp;
+
+  return (h);
+}
+
+
+/**
+ ** Test if a state of a rule can be reached from another one (or is
+ ** this one), following the transitions of the syntax tree.
+ ** @param ctx Rule compiler context.
+ ** @param node_rule Rule node abstract syntax tree.
+ ** @param from Source state node.
+ ** @param to Destination state node.
+ ** @return TRUE if @a to is reachable from @a from.
+ **/
+static int
+state_is_reachable(rule_compiler_t *ctx, node_rule_t *node_rule,
+                   node_state_t *from, node_state_t *to)
+{
+  node_state_t **stack;
+  node_state_t *s;
+  node_state_t *d;
+  char *seen;
+  size_t states_nb;
+  size_t sp;
+  size_t t;
+  int found;
+
+  states_nb = 1;
+  if (node_rule->statelist)
+    states_nb += node_rule->statelist->states_nb;
+  seen = Xzmalloc(states_nb);
+  stack = Xmalloc(states_nb * sizeof (node_state_t *));
+
+  found = FALSE;
+  sp = 0;
+  stack[sp++] = from;
+  seen[from->state_id] = 1;
+  while (sp > 0) {
+    s = stack[--sp];
+    if (s == to) {
+      found = TRUE;
+      break ;
+    }
+    if (s->translist == NULL)
+      continue ;
+    for (t = 0; t < s->translist->trans_nb; t++) {
+      if (s->translist->trans[t]->dest == NULL)
+        continue ;
+      d = strhash_get(ctx->statenames_hash, s->translist->trans[t]->dest);
+      if (d && !seen[d->state_id]) {
+        seen[d->state_id] = 1;
+        stack[sp++] = d;
+      }
+    }
+  }
+
+  Xfree(seen);
+  Xfree(stack);
+
+  return (found);
+}
+
+
+static void
+resolve_cuts_actions(rule_compiler_t *ctx, node_rule_t *node_rule,
+                     node_state_t *state, node_actionlist_t *actionlist);
+
+/**
+ ** Resolve the cuts of an expression: the state name argument of
+ ** cut() is checked, and replaced by the state identifier, so that
+ ** issdl_cut() doesn't compare names at run-time.  The destination
+ ** state must lead to the state doing the cut, otherwise the cut
+ ** would prune the whole rule instance.
+ ** @param ctx Rule compiler context.
+ ** @param node_rule Rule node abstract syntax tree.
+ ** @param state State node containing the expression.
+ ** @param expr Expression node abstract syntax tree.
+ **/
+static void
+resolve_cuts_expr(rule_compiler_t *ctx, node_rule_t *node_rule,
+                  node_state_t *state, node_expr_t *expr)
+{
+  node_expr_t *param;
+  node_state_t *dest;
+  ovm_var_t *id;
+  size_t i;
+
+  if (expr == NULL)
+    return ;
+
+  switch (expr->type)
+  {
+    case NODE_ASSOC:
+      resolve_cuts_expr(ctx, node_rule, state, expr->bin.rval);
+      break;
+
+    case NODE_BINOP:
+    case NODE_COND:
+      resolve_cuts_expr(ctx, node_rule, state, expr->bin.lval);
+      resolve_cuts_expr(ctx, node_rule, state, expr->bin.rval);
+      break;
+
+    case NODE_IFSTMT:
+      resolve_cuts_expr(ctx, node_rule, state, expr->ifstmt.cond);
+      resolve_cuts_actions(ctx, node_rule, state, expr->ifstmt.then);
+      resolve_cuts_actions(ctx, node_rule, state, expr->ifstmt.els);
+      break;
+
+    case NODE_CALL:
+      if (expr->call.paramlist)
+        for (i = 0; i < expr->call.paramlist->params_nb; i++)
+          resolve_cuts_expr(ctx, node_rule, state,
+                            expr->call.paramlist->params[i]);
+
+      if (strcmp(expr->call.symbol, "cut"))
+        break;
+
+      if (expr->call.paramlist == NULL
+          || expr->call.paramlist->params_nb != 1
+          || expr->call.paramlist->params[0]->type != NODE_CONST
+          || TYPE((ovm_var_t *)expr->call.paramlist->params[0]->term.data)
+             != T_STR) {
+        DebugLog(DF_OLC, DS_FATAL,
+                 "cut() in state '%s' expects a state name\n", state->name);
+        exit(EXIT_FAILURE);
+      }
+      param = expr->call.paramlist->params[0];
+
+      dest = strhash_get(ctx->statenames_hash, STR(param->term.data));
+      if (dest == NULL) {
+        DebugLog(DF_OLC, DS_FATAL,
+                 "cut() in state '%s': undefined state reference '%s'\n",
+                 state->name, STR(param->term.data));
+        exit(EXIT_FAILURE);
+      }
+      if (!state_is_reachable(ctx, node_rule, dest, state)) {
+        DebugLog(DF_OLC, DS_FATAL,
+                 "cut() in state '%s': state '%s' doesn't lead to it\n",
+                 state->name, dest->name);
+        exit(EXIT_FAILURE);
+      }
+
+      DebugLog(DF_OLC, DS_TRACE, "resolve cut %s -> %s %i\n",
+               state->name, dest->name, dest->state_id);
+      dest->flags |= SF_CUTDEST;
+
+      id = ovm_int_new();
+      id->flags |= TYPE_CONST;
+      INT(id) = dest->state_id;
+      issdl_free(param->term.data);
+      param->term.data = id;
+      ctx->statics[ param->term.res_id ] = id;
+      break;
+  }
+}
+
+
+static void
+resolve_cuts_actions(rule_compiler_t *ctx, node_rule_t *node_rule,
+                     node_state_t *state, node_actionlist_t *actionlist)
+{
+  size_t a;
+
+  if (actionlist == NULL)
+    return ;
+
+  for (a = 0; a < actionlist->actions_nb; a++)
+    resolve_cuts_expr(ctx, node_rule, state, actionlist->actions[a]);
+}
+
+
+/**
+ ** Resolve the cuts of a state: in its actions and in the conditions
+ ** of its transitions.
+ ** @param ctx Rule compiler context.
+ ** @param node_rule Rule node abstract syntax tree.
+ ** @param state State node.
+ **/
+static void
+resolve_cuts_state(rule_compiler_t *ctx, node_rule_t *node_rule,
+                   node_state_t *state)
+{
+  size_t t;
+
+  resolve_cuts_actions(ctx, node_rule, state, state->actionlist);
+  if (state->translist)
+    for (t = 0; t < state->translist->trans_nb; t++)
+      resolve_cuts_expr(ctx, node_rule, state,
+                        state->translist->trans[t]->cond);
+}
+
+
 void
 compile_and_add_rule_ast(rule_compiler_t *ctx, node_rule_t *node_rule)
 {
@@ -1206,14 +1405,22 @@ compile_and_add_rule_ast(rule_compiler_t *ctx, node_rule_t *node_rule)
 
   Xstat(node_rule->file, &filestat);
 
+  /* Resolve cuts first: this rewrites constants, and flags the
+   * destination states. */
+  if (node_rule->init) {
+    resolve_cuts_state(ctx, node_rule, node_rule->init);
+    if (node_rule->statelist)
+      for (s = 0; s < node_rule->statelist->states_nb; s++)
+        resolve_cuts_state(ctx, node_rule, node_rule->statelist->states[s]);
+  }
+
   rule = Xzmalloc(sizeof (rule_t));
   rule->filename = node_rule->file;
   rule->file_mtime = filestat.st_mtime;
   rule->name = node_rule->name;
   rule->lineno = node_rule->line;
   rule->static_env_sz = ctx->statics_nb;
-  rule->dynamic_env_sz = ctx->rule_env->elmts;
-  rule->id = ctx->rules;
+  rule->dynamic_env_sz = strhash_elmts(ctx->rule_env);
 
   /* Allocate static env */
   rule->static_env = Xmalloc(rule->static_env_sz * sizeof (ovm_var_t *));
@@ -1247,10 +1454,7 @@ compile_and_add_rule_ast(rule_compiler_t *ctx, node_rule_t *node_rule)
                sync_var->sym.res_id);
       rule->sync_vars[s] = sync_var->sym.res_id;
     }
-    rule->sync_lock = new_objhash( 1021 );
-    rule->sync_lock->hash = objhash_rule_instance;
-    rule->sync_lock->cmp = objhash_rule_instance_cmp;
-    /* XXX: should dynamically resize sync_lock hash. */
+    rule->sync_lock = new_sync_lock_hash();
   }
 
   /* Compile init state */
@@ -1286,10 +1490,22 @@ compile_and_add_rule_ast(rule_compiler_t *ctx, node_rule_t *node_rule)
     }
   }
 
+  set_backtrack_flags(rule);
+
   DebugLog(DF_OLC, DS_INFO,
            "----- end of compilation of rule \"%s\" (from file %s:%i) -----\n",
            node_rule->name, ctx->currfile, node_rule->line);
 
+  rule->checksum = rule_checksum(rule);
+
+  add_rule(ctx, rule);
+}
+
+
+void
+add_rule(rule_compiler_t *ctx, rule_t *rule)
+{
+  rule->id = ctx->rules;
   strhash_add(ctx->rulenames_hash, rule, rule->name);
 
   if (ctx->first_rule)
@@ -1302,6 +1518,127 @@ compile_and_add_rule_ast(rule_compiler_t *ctx, node_rule_t *node_rule)
 }
 
 
+uint32_t
+rule_checksum(rule_t *rule)
+{
+  issdl_type_t *types;
+  ovm_var_t *var;
+  bytecode_t *code;
+  unsigned int crc;
+  int32_t dest;
+  int s;
+  int t;
+
+  crc = 0;
+  for (s = 0; s < rule->state_nb; s++) {
+    code = rule->state[s].action;
+    if (code)
+      crc = crc32(crc, (char *) code,
+                  ovm_bytecode_len(code) * sizeof (bytecode_t));
+    for (t = 0; t < rule->state[s].trans_nb; t++) {
+      code = rule->state[s].trans[t].eval_code;
+      if (code)
+        crc = crc32(crc, (char *) code,
+                    ovm_bytecode_len(code) * sizeof (bytecode_t));
+    }
+  }
+
+  types = issdlgettypes();
+  crc = crc32(crc, (char *) &rule->static_env_sz,
+              sizeof (rule->static_env_sz));
+  for (s = STATICS_SHARED; s < rule->static_env_sz; s++) {
+    var = rule->static_env[s];
+    crc = crc32(crc, (char *) &TYPE(var), sizeof (TYPE(var)));
+    if (types[TYPE(var)].get_data && types[TYPE(var)].get_data_len)
+      crc = crc32(crc, issdl_get_data(var), issdl_get_data_len(var));
+  }
+
+  crc = crc32(crc, (char *) &rule->dynamic_env_sz,
+              sizeof (rule->dynamic_env_sz));
+  for (s = 0; s < rule->dynamic_env_sz; s++)
+    crc = crc32(crc, rule->var_name[s], strlen(rule->var_name[s]));
+
+  crc = crc32(crc, (char *) &rule->sync_vars_sz, sizeof (rule->sync_vars_sz));
+  if (rule->sync_vars_sz > 0)
+    crc = crc32(crc, (char *) rule->sync_vars,
+                rule->sync_vars_sz * sizeof (int32_t));
+
+  crc = crc32(crc, (char *) &rule->state_nb, sizeof (rule->state_nb));
+  for (s = 0; s < rule->state_nb; s++) {
+    crc = crc32(crc, rule->state[s].name, strlen(rule->state[s].name));
+    crc = crc32(crc, (char *) &rule->state[s].flags,
+                sizeof (rule->state[s].flags));
+    crc = crc32(crc, (char *) &rule->state[s].trans_nb,
+                sizeof (rule->state[s].trans_nb));
+    for (t = 0; t < rule->state[s].trans_nb; t++) {
+      dest = rule->state[s].trans[t].dest - rule->state;
+      crc = crc32(crc, (char *) &dest, sizeof (dest));
+    }
+  }
+
+  return (crc);
+}
+
+
+void
+set_backtrack_flags(rule_t *rule)
+{
+  transition_t *trans;
+  int s;
+  int t;
+
+  for (s = 0; s < rule->state_nb; s++)
+    for (t = 0; t < rule->state[s].trans_nb; t++) {
+      trans = &rule->state[s].trans[t];
+      trans->flags &= ~TRANS_NO_BACKTRACK;
+      /* If the destination is fully blocking AND doesn't bind a field
+       * value to a free variable, this is THE shortest run: next
+       * matches would be redundant.  Unless the destination is cut,
+       * which would leave no run at all. */
+      if (trans->dest != NULL
+          && trans->dest->trans_nb > 0
+          && !(trans->dest->flags & BYTECODE_HAVE_PUSHFIELD)
+          && !(trans->dest->flags & SF_CUTDEST))
+        trans->flags |= TRANS_NO_BACKTRACK;
+    }
+}
+
+
+void
+free_rule(rule_t *rule)
+{
+  state_t *state;
+  int s;
+  int t;
+
+  for (s = 0; s < rule->state_nb; s++) {
+    state = &rule->state[s];
+    if (state->action)
+      Xfree(state->action);
+    for (t = 0; t < state->trans_nb; t++) {
+      if (state->trans[t].eval_code)
+        Xfree(state->trans[t].eval_code);
+      if (state->trans[t].required_fields)
+        Xfree(state->trans[t].required_fields);
+    }
+    if (state->trans)
+      Xfree(state->trans);
+  }
+  Xfree(rule->state);
+
+  for (s = STATICS_SHARED; s < rule->static_env_sz; s++)
+    issdl_free(rule->static_env[s]);
+  Xfree(rule->static_env);
+  if (rule->var_name)
+    Xfree(rule->var_name);
+  if (rule->sync_vars)
+    Xfree(rule->sync_vars);
+  if (rule->sync_lock)
+    free_objhash(rule->sync_lock);
+  Xfree(rule);
+}
+
+
 /**
  * Compile a state node abstract syntax tree.
  * @param ctx Rule compiler context.
@@ -1865,7 +2202,7 @@ compiler_reset(rule_compiler_t *ctx)
   clear_strhash(ctx->statenames_hash, NULL);
   clear_strhash(ctx->rule_env, NULL);
   // Need to keep the two boolean values and the null variables
-  ctx->statics_nb = 5;
+  ctx->statics_nb = STATICS_SHARED;
   ctx->dyn_var_name_nb = 0;
 }
 
@@ -1881,7 +2218,7 @@ fprintf_rule_environment(FILE *fp, rule_compiler_t *ctx)
     fprintf(fp, "res_id: %3i: ", i);
     fprintf_issdl_val(fp, ctx->statics[i]);
   }
-  fprintf(fp, "  dynamic environment size : %i\n", ctx->rule_env->elmts);
+  fprintf(fp, "  dynamic environment size : %i\n", strhash_elmts(ctx->rule_env));
 }
 
 
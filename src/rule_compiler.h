@@ -37,6 +37,9 @@
 
 #define LABELS_MAX	2048
 
+/* Statics shared by all rules: 1, 0, null, param error, regex error */
+#define STATICS_SHARED 5
+
 
 #define EXIT_IF_BYTECODE_BUFF_FULL(x)		\
   do { \
@@ -653,6 +656,88 @@ void
 compile_rules(orchids_t *ctx);
 
 
+/**
+ ** Lex/yacc parser entry point: compile a rule file and append its
+ ** rules to the rule list.  Exits on compilation errors.
+ **
+ ** @param ctx Orchids application context.
+ ** @param rulefile File to parse.
+ **/
+void
+compile_and_add_rulefile(orchids_t *ctx, char *rulefile);
+
+
+/**
+ ** Compile rules from an already opened (and preprocessed) stream,
+ ** and append them to the rule list.  Exits on compilation errors.
+ **
+ ** @param ctx Orchids application context.
+ ** @param rulefile Name of the rule file, for messages.
+ ** @param fp The rule source.
+ **/
+void
+compile_and_add_rulestream(orchids_t *ctx, char *rulefile, FILE *fp);
+
+
+#ifdef ENABLE_PREPROC
+/**
+ ** Return the preprocessor command for a rule file, according to its
+ ** suffix (see the AddPreprocessorCmd directive).
+ **
+ ** @param ctx Orchids application context.
+ ** @param filename The rule file name.
+ ** @return The preprocessor command.
+ **/
+char *
+get_preproc_cmd(orchids_t *ctx, const char *filename);
+#endif /* ENABLE_PREPROC */
+
+
+/**
+ ** Add the fields registered since the last call to the field name
+ ** hash table of the rule compiler.
+ **
+ ** @param ctx Orchids application context.
+ **/
+void
+build_fields_hash(orchids_t *ctx);
+
+
+/**
+ ** Free a compiled rule: its states, transitions, byte code and
+ ** constants.  The rule must no longer be in the rule list nor have
+ ** any instance.  Names, which belong to the syntax tree, are kept.
+ **
+ ** @param rule The rule to free.
+ **/
+void
+free_rule(rule_t *rule);
+
+
+/**
+ ** Compute the checksum of a compiled rule: a CRC32 of its byte code
+ ** and of everything the byte code refers to (constants, variable
+ ** names, synchronization variables, states and transitions).
+ **
+ ** @param rule The compiled rule.
+ ** @return The rule checksum.
+ **/
+uint32_t
+rule_checksum(rule_t *rule);
+
+
+/**
+ ** Compute the static analysis flags of the transitions of a compiled
+ ** rule: a transition doesn't need backtracking (TRANS_NO_BACKTRACK)
+ ** if its destination waits for an event, doesn't bind a field value
+ ** and isn't the destination of a cut.
+ **
+ ** @param rule The compiled rule.
+ **/
+void
+set_backtrack_flags(rule_t *rule);
+
+
 /**
  * Build a rule node.
  * @param  sym          The rule name (symbol).
@@ -1001,6 +1086,25 @@ void
 compile_and_add_rule_ast(rule_compiler_t *ctx, node_rule_t *node_rule);
 
 
+/**
+ * Append a compiled rule to the rule list, give it the next rule
+ * identifier and register its name.
+ * @param ctx Rule compiler context.
+ * @param rule The rule to add.
+ **/
+void
+add_rule(rule_compiler_t *ctx, rule_t *rule);
+
+
+/**
+ * Create the hash table of state instances holding a lock over
+ * the synchronization variables of a rule.
+ * @return A new synchronization lock hash table.
+ **/
+objhash_t *
+new_sync_lock_hash(void);
+
+
 /**
  * Reset a compiler context.
  * The compiler context need to be reseted for each new rule.
@@ -0,0 +1,946 @@
+/**
+ ** @file rule_image.c
+ ** Precompiled rule image cache.
+ **
+ ** Compiling a rule file means running an external preprocessor,
+ ** the ISSDL parser and the byte code compiler.  With hundreds of
+ ** rule files, this dominates startup time.  When a rule cache
+ ** directory is configured (RuleCacheDir), the compiled rules of each
+ ** file are saved into an image, named after a hash of the
+ ** preprocessed source and of the Orchids version.  On the next
+ ** start, the image is mmap()ed and loaded instead of compiling.
+ **
+ ** Field and function identifiers depend on the loaded modules, so an
+ ** image carries the names (and types) of the fields and functions
+ ** known when it was written: byte code and required field arrays are
+ ** relocated at load time, and the image is rejected if a field or
+ ** function it uses no longer exists.
+ **
+ ** All rule files are preprocessed first, by parallel preprocessor
+ ** processes (one per CPU), since the preprocessed text is needed to
+ ** compute the image key.
+ **
+ **   header     magic, version, sizeof (bytecode_t), source length
+ **              and CRC32, Orchids version
+ **   fields     name and type of each field
+ **   functions  name of each function
+ **   rules      name, file, line, constants (issdl_save()), variable
+ **              names, sync variables, states and transitions with
+ **              their byte code
+ **   trailer    magic
+ **
+ ** @version 0.1
+ ** @ingroup compiler
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h> /* for PATH_MAX */
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "orchids.h"
+#include "lang.h"
+#include "ovm.h"
+#include "rule_compiler.h"
+
+#include "rule_image.h"
+
+#ifdef PACKAGE_VERSION
+# define RULE_IMAGE_ORCHIDS_VERSION PACKAGE_VERSION
+#else
+# define RULE_IMAGE_ORCHIDS_VERSION "unknown"
+#endif
+
+/** Sanity bound on string lengths in an image. */
+#define RULE_IMAGE_MAX_STR (1 << 20)
+
+
+typedef struct rimg_reader_s rimg_reader_t;
+struct rimg_reader_s
+{
+  orchids_t *ctx;
+  FILE      *fp;
+  int        err;
+  int32_t   *field_map;   /* image field id -> current field id */
+  int32_t    fields_nb;
+  int32_t   *func_map;    /* image function id -> current function id */
+  int32_t    funcs_nb;
+};
+
+
+/*
+** Writer
+*/
+
+#define PUT(fp, x) fwrite(&(x), sizeof (x), 1, (fp))
+
+static void
+put_u32(FILE *fp, uint32_t v)
+{
+  PUT(fp, v);
+}
+
+static void
+put_i32(FILE *fp, int32_t v)
+{
+  PUT(fp, v);
+}
+
+static void
+put_str(FILE *fp, const char *s)
+{
+  uint32_t len;
+
+  len = strlen(s);
+  PUT(fp, len);
+  fwrite(s, len, 1, fp);
+}
+
+static void
+put_bytecode(FILE *fp, bytecode_t *code)
+{
+  uint32_t len;
+
+  len = code ? ovm_bytecode_len(code) : 0;
+  PUT(fp, len);
+  if (len)
+    fwrite(code, sizeof (bytecode_t), len, fp);
+}
+
+
+static void
+write_rule(FILE *fp, rule_t *rule)
+{
+  state_t *state;
+  transition_t *trans;
+  int s;
+  int t;
+
+  put_str(fp, rule->name);
+  put_str(fp, rule->filename);
+  put_i32(fp, rule->lineno);
+  put_u32(fp, rule->checksum);
+
+  put_i32(fp, rule->static_env_sz);
+  for (s = STATICS_SHARED; s < rule->static_env_sz; s++)
+    issdl_save(fp, rule->static_env[s]);
+
+  put_i32(fp, rule->dynamic_env_sz);
+  for (s = 0; s < rule->dynamic_env_sz; s++)
+    put_str(fp, rule->var_name[s]);
+
+  put_i32(fp, rule->sync_vars_sz);
+  for (s = 0; s < rule->sync_vars_sz; s++)
+    put_i32(fp, rule->sync_vars[s]);
+
+  put_i32(fp, rule->state_nb);
+  for (s = 0; s < rule->state_nb; s++) {
+    state = &rule->state[s];
+    put_str(fp, state->name);
+    put_i32(fp, state->line);
+    put_u32(fp, state->flags);
+    put_bytecode(fp, state->action);
+    put_i32(fp, state->trans_nb);
+    for (t = 0; t < state->trans_nb; t++) {
+      trans = &state->trans[t];
+      put_i32(fp, trans->dest - rule->state);
+      put_i32(fp, trans->id);
+      put_i32(fp, trans->global_id);
+      put_i32(fp, trans->required_fields_nb);
+      fwrite(trans->required_fields, sizeof (int32_t),
+             trans->required_fields_nb, fp);
+      put_bytecode(fp, trans->eval_code);
+    }
+  }
+}
+
+
+int
+rule_image_save(orchids_t *ctx, const char *path, rule_t *first,
+                size_t src_len, uint32_t src_crc)
+{
+  issdl_type_t *types;
+  char tmp[PATH_MAX];
+  FILE *fp;
+  rule_t *r;
+  uint64_t len;
+  uint32_t n;
+  int err;
+  int i;
+
+  /* All constants must be serializable */
+  types = issdlgettypes();
+  n = 0;
+  for (r = first; r; r = r->next) {
+    for (i = STATICS_SHARED; i < r->static_env_sz; i++) {
+      if (types[TYPE(r->static_env[i])].save == NULL) {
+        DebugLog(DF_OLC, DS_INFO,
+                 "rule cache: rule '%s' has a %s constant, not cached\n",
+                 r->name, STRTYPE(r->static_env[i]));
+        return (-1);
+      }
+    }
+    n++;
+  }
+
+  snprintf(tmp, sizeof (tmp), "%s.%i.tmp", path, (int) getpid());
+  fp = Xfopen(tmp, "w");
+  if (fp == NULL) {
+    DebugLog(DF_OLC, DS_WARN,
+             "rule cache: can't open '%s': %s\n", tmp, strerror(errno));
+    return (-1);
+  }
+
+  /* header */
+  put_u32(fp, RULE_IMAGE_MAGIC);
+  put_u32(fp, RULE_IMAGE_VERSION);
+  put_u32(fp, sizeof (bytecode_t));
+  len = src_len;
+  PUT(fp, len);
+  put_u32(fp, src_crc);
+  put_str(fp, RULE_IMAGE_ORCHIDS_VERSION);
+
+  /* symbols */
+  put_i32(fp, ctx->num_fields);
+  for (i = 0; i < ctx->num_fields; i++) {
+    put_str(fp, ctx->global_fields[i].name);
+    put_i32(fp, ctx->global_fields[i].type);
+  }
+  put_i32(fp, ctx->vm_func_tbl_sz);
+  for (i = 0; i < ctx->vm_func_tbl_sz; i++)
+    put_str(fp, ctx->vm_func_tbl[i].name);
+
+  /* rules */
+  put_u32(fp, n);
+  for (r = first; r; r = r->next)
+    write_rule(fp, r);
+
+  put_u32(fp, RULE_IMAGE_MAGIC);
+
+  err = ferror(fp);
+  if (fclose(fp))
+    err = 1;
+  if (err || rename(tmp, path)) {
+    DebugLog(DF_OLC, DS_WARN,
+             "rule cache: error while writing '%s'\n", path);
+    unlink(tmp);
+    return (-1);
+  }
+
+  DebugLog(DF_OLC, DS_INFO, "rule cache: wrote %u rules to '%s'\n", n, path);
+
+  return (RETURN_SUCCESS);
+}
+
+
+/*
+** Reader
+*/
+
+#define GET(r, x) \
+  do { \
+    if (fread(&(x), sizeof (x), 1, (r)->fp) != 1) \
+      (r)->err = 1; \
+  } while (0)
+
+static uint32_t
+get_u32(rimg_reader_t *r)
+{
+  uint32_t v;
+
+  v = 0;
+  GET(r, v);
+
+  return (v);
+}
+
+static int32_t
+get_i32(rimg_reader_t *r)
+{
+  int32_t v;
+
+  v = 0;
+  GET(r, v);
+
+  return (v);
+}
+
+static char *
+get_str(rimg_reader_t *r)
+{
+  uint32_t len;
+  char *s;
+
+  len = get_u32(r);
+  if (r->err || len > RULE_IMAGE_MAX_STR) {
+    r->err = 1;
+    return (NULL);
+  }
+  s = Xmalloc(len + 1);
+  if (len && fread(s, len, 1, r->fp) != 1) {
+    r->err = 1;
+    Xfree(s);
+    return (NULL);
+  }
+  s[len] = '\0';
+
+  return (s);
+}
+
+
+/**
+ ** Read a byte code and relocate its field and function operands.
+ **/
+static bytecode_t *
+get_bytecode(rimg_reader_t *r, rule_t *rule)
+{
+  bytecode_t *code;
+  uint32_t len;
+  uint32_t pos;
+  bytecode_t op;
+
+  len = get_u32(r);
+  if (r->err || len == 0)
+    return (NULL);
+  code = Xmalloc(len * sizeof (bytecode_t));
+  if (fread(code, sizeof (bytecode_t), len, r->fp) != len
+      || code[len - 1] != OP_END) {
+    r->err = 1;
+    Xfree(code);
+    return (NULL);
+  }
+
+  for (pos = 0; pos < len - 1; pos += ovm_insn_len(op)) {
+    op = code[pos];
+    if (ovm_insn_len(op) == 1)
+      continue ;
+    if (pos + 1 >= len - 1) {
+      r->err = 1;
+      break ;
+    }
+    switch (op) {
+      case OP_PUSHFIELD:
+        if (code[pos + 1] >= (bytecode_t) r->fields_nb
+            || r->field_map[ code[pos + 1] ] < 0)
+          r->err = 1;
+        else
+          code[pos + 1] = r->field_map[ code[pos + 1] ];
+        break ;
+
+      case OP_CALL:
+        if (code[pos + 1] >= (bytecode_t) r->funcs_nb
+            || r->func_map[ code[pos + 1] ] < 0)
+          r->err = 1;
+        else
+          code[pos + 1] = r->func_map[ code[pos + 1] ];
+        break ;
+
+      case OP_PUSHSTATIC:
+        if (code[pos + 1] >= (bytecode_t) rule->static_env_sz)
+          r->err = 1;
+        break ;
+
+      case OP_PUSH:
+      case OP_POP:
+        if (code[pos + 1] >= (bytecode_t) rule->dynamic_env_sz)
+          r->err = 1;
+        break ;
+    }
+  }
+
+  return (code);
+}
+
+
+static rule_t *
+read_rule(rimg_reader_t *r)
+{
+  rule_compiler_t *rc;
+  rule_t *rule;
+  state_t *state;
+  transition_t *trans;
+  uint32_t checksum;
+  int32_t dest;
+  int32_t n;
+  int s;
+  int t;
+  int i;
+
+  rc = r->ctx->rule_compiler;
+  rule = Xzmalloc(sizeof (rule_t));
+  rule->name = get_str(r);
+  rule->filename = get_str(r);
+  rule->lineno = get_i32(r);
+  checksum = get_u32(r);
+  if (r->err)
+    goto fail;
+
+  n = get_i32(r);
+  if (r->err || n < STATICS_SHARED || n > RULE_IMAGE_MAX_STR)
+    goto fail;
+  rule->static_env = Xzmalloc(n * sizeof (ovm_var_t *));
+  rule->static_env_sz = n;
+  for (s = 0; s < STATICS_SHARED; s++)
+    rule->static_env[s] = rc->statics[s];
+  for (s = STATICS_SHARED; s < n; s++) {
+    rule->static_env[s] = issdl_restore(r->fp);
+    if (rule->static_env[s] == NULL)
+      goto fail;
+  }
+
+  n = get_i32(r);
+  if (r->err || n < 0 || n > RULE_IMAGE_MAX_STR)
+    goto fail;
+  if (n > 0) {
+    rule->var_name = Xzmalloc(n * sizeof (char *));
+    rule->dynamic_env_sz = n;
+    for (s = 0; s < n; s++)
+      if ((rule->var_name[s] = get_str(r)) == NULL)
+        goto fail;
+  }
+
+  n = get_i32(r);
+  if (r->err || n < 0 || n > rule->dynamic_env_sz)
+    goto fail;
+  if (n > 0) {
+    rule->sync_vars = Xmalloc(n * sizeof (int32_t));
+    rule->sync_vars_sz = n;
+    for (s = 0; s < n; s++) {
+      rule->sync_vars[s] = get_i32(r);
+      if (rule->sync_vars[s] < 0
+          || rule->sync_vars[s] >= rule->dynamic_env_sz)
+        r->err = 1;
+    }
+    rule->sync_lock = new_sync_lock_hash();
+  }
+
+  n = get_i32(r);
+  if (r->err || n <= 0 || n > RULE_IMAGE_MAX_STR)
+    goto fail;
+  rule->state = Xzmalloc(n * sizeof (state_t));
+  rule->state_nb = n;
+  for (s = 0; s < rule->state_nb && !r->err; s++) {
+    state = &rule->state[s];
+    state->id = s;
+    state->rule = rule;
+    state->name = get_str(r);
+    state->line = get_i32(r);
+    state->flags = get_u32(r);
+    state->action = get_bytecode(r, rule);
+    n = get_i32(r);
+    if (r->err || n < 0 || n > RULE_IMAGE_MAX_STR)
+      goto fail;
+    if (n == 0)
+      continue ;
+    state->trans = Xzmalloc(n * sizeof (transition_t));
+    state->trans_nb = n;
+    rule->trans_nb += n;
+    for (t = 0; t < state->trans_nb && !r->err; t++) {
+      trans = &state->trans[t];
+      dest = get_i32(r);
+      if (dest < 0 || dest >= rule->state_nb)
+        r->err = 1;
+      else
+        trans->dest = &rule->state[dest];
+      trans->id = get_i32(r);
+      trans->global_id = get_i32(r);
+      n = get_i32(r);
+      if (r->err || n < 0 || n > r->fields_nb)
+        goto fail;
+      if (n > 0) {
+        trans->required_fields = Xmalloc(n * sizeof (int32_t));
+        trans->required_fields_nb = n;
+        for (i = 0; i < n; i++) {
+          dest = get_i32(r);
+          if (dest < 0 || dest >= r->fields_nb || r->field_map[dest] < 0)
+            r->err = 1;
+          else
+            trans->required_fields[i] = r->field_map[dest];
+        }
+      }
+      trans->eval_code = get_bytecode(r, rule);
+    }
+  }
+  if (r->err)
+    goto fail;
+
+  set_backtrack_flags(rule);
+
+  /* Relocation changes the byte code, so the checksum does not
+   * match the stored one if any identifier moved. */
+  rule->checksum = rule_checksum(rule);
+  if (rule->checksum != checksum)
+    DebugLog(DF_OLC, DS_DEBUG, "rule cache: rule '%s' relocated\n",
+             rule->name);
+
+  return (rule);
+
+ fail:
+  r->err = 1;
+  free_rule(rule);
+  return (NULL);
+}
+
+
+/**
+ ** Map the image symbols to the current field and function
+ ** identifiers.  Missing symbols are mapped to -1: this is only an
+ ** error if a rule uses them.
+ **/
+static void
+read_symbols(rimg_reader_t *r)
+{
+  orchids_t *ctx;
+  field_record_t *f;
+  issdl_function_t *func;
+  char *name;
+  int32_t type;
+  int32_t i;
+
+  ctx = r->ctx;
+  r->fields_nb = get_i32(r);
+  if (r->err || r->fields_nb < 0 || r->fields_nb > RULE_IMAGE_MAX_STR) {
+    r->err = 1;
+    return ;
+  }
+  r->field_map = Xmalloc((r->fields_nb + 1) * sizeof (int32_t));
+  for (i = 0; i < r->fields_nb && !r->err; i++) {
+    name = get_str(r);
+    type = get_i32(r);
+    if (name == NULL)
+      return ;
+    f = strhash_get(ctx->rule_compiler->fields_hash, name);
+    r->field_map[i] = (f && f->type == type) ? f->id : -1;
+    Xfree(name);
+  }
+
+  r->funcs_nb = get_i32(r);
+  if (r->err || r->funcs_nb < 0 || r->funcs_nb > RULE_IMAGE_MAX_STR) {
+    r->err = 1;
+    return ;
+  }
+  r->func_map = Xmalloc((r->funcs_nb + 1) * sizeof (int32_t));
+  for (i = 0; i < r->funcs_nb && !r->err; i++) {
+    name = get_str(r);
+    if (name == NULL)
+      return ;
+    func = strhash_get(ctx->rule_compiler->functions_hash, name);
+    r->func_map[i] = func ? func->id : -1;
+    Xfree(name);
+  }
+}
+
+
+static void
+activate_rule_fields(orchids_t *ctx, rule_t *rule)
+{
+  transition_t *trans;
+  bytecode_t *code;
+  size_t pos;
+  int s;
+  int t;
+  int i;
+
+  for (s = 0; s < rule->state_nb; s++) {
+    code = rule->state[s].action;
+    for (pos = 0; code && code[pos] != OP_END; pos += ovm_insn_len(code[pos]))
+      if (code[pos] == OP_PUSHFIELD)
+        ctx->global_fields[ code[pos + 1] ].active = TRUE;
+    for (t = 0; t < rule->state[s].trans_nb; t++) {
+      trans = &rule->state[s].trans[t];
+      for (i = 0; i < trans->required_fields_nb; i++)
+        ctx->global_fields[ trans->required_fields[i] ].active = TRUE;
+    }
+  }
+}
+
+
+int
+rule_image_load(orchids_t *ctx, const char *path,
+                size_t src_len, uint32_t src_crc)
+{
+  rimg_reader_t r;
+  struct stat st;
+  struct stat filestat;
+  rule_t **rules;
+  rule_t *other;
+  uint64_t len;
+  uint32_t n;
+  uint32_t i;
+  char *version;
+  void *map;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return (-1);
+  if (fstat(fd, &st) || st.st_size == 0) {
+    close(fd);
+    return (-1);
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    DebugLog(DF_OLC, DS_WARN, "rule cache: mmap('%s'): %s\n",
+             path, strerror(errno));
+    return (-1);
+  }
+
+  memset(&r, 0, sizeof (r));
+  r.ctx = ctx;
+  r.fp = fmemopen(map, st.st_size, "r");
+  if (r.fp == NULL) {
+    munmap(map, st.st_size);
+    return (-1);
+  }
+
+  rules = NULL;
+  n = 0;
+  len = 0;
+  if (get_u32(&r) != RULE_IMAGE_MAGIC
+      || get_u32(&r) != RULE_IMAGE_VERSION
+      || get_u32(&r) != sizeof (bytecode_t))
+    r.err = 1;
+  GET(&r, len);
+  if (len != src_len || get_u32(&r) != src_crc)
+    r.err = 1;
+  version = get_str(&r);
+  if (version == NULL || strcmp(version, RULE_IMAGE_ORCHIDS_VERSION))
+    r.err = 1;
+  if (version)
+    Xfree(version);
+
+  if (!r.err)
+    read_symbols(&r);
+
+  if (!r.err) {
+    n = get_u32(&r);
+    if (n > RULE_IMAGE_MAX_STR)
+      r.err = 1;
+  }
+  if (!r.err) {
+    rules = Xzmalloc((n + 1) * sizeof (rule_t *));
+    for (i = 0; i < n && !r.err; i++)
+      rules[i] = read_rule(&r);
+    if (!r.err && get_u32(&r) != RULE_IMAGE_MAGIC)
+      r.err = 1;
+  }
+
+  fclose(r.fp);
+  munmap(map, st.st_size);
+  if (r.field_map)
+    Xfree(r.field_map);
+  if (r.func_map)
+    Xfree(r.func_map);
+
+  if (r.err) {
+    DebugLog(DF_OLC, DS_INFO, "rule cache: '%s' rejected\n", path);
+    for (i = 0; rules && i < n; i++)
+      if (rules[i])
+        free_rule(rules[i]);
+    if (rules)
+      Xfree(rules);
+    return (-1);
+  }
+
+  for (i = 0; i < n; i++) {
+    other = strhash_get(ctx->rule_compiler->rulenames_hash, rules[i]->name);
+    if (other) {
+      DebugLog(DF_OLC, DS_FATAL,
+               "rule %s already defined in %s:%i\n",
+               rules[i]->name, other->filename, other->lineno);
+      exit(EXIT_FAILURE);
+    }
+    if (stat(rules[i]->filename, &filestat) == 0)
+      rules[i]->file_mtime = filestat.st_mtime;
+    activate_rule_fields(ctx, rules[i]);
+    add_rule(ctx->rule_compiler, rules[i]);
+  }
+  Xfree(rules);
+
+  gettimeofday(&ctx->last_rule_act, NULL);
+
+  return (RETURN_SUCCESS);
+}
+
+
+/*
+** Parallel preprocessing
+*/
+
+static char *
+read_whole_file(const char *path, size_t *len)
+{
+  struct stat st;
+  char *buf;
+  FILE *fp;
+
+  fp = Xfopen(path, "r");
+  if (fp == NULL)
+    return (NULL);
+  if (fstat(fileno(fp), &st)) {
+    fclose(fp);
+    return (NULL);
+  }
+  buf = Xmalloc(st.st_size + 1);
+  *len = fread(buf, 1, st.st_size, fp);
+  buf[*len] = '\0';
+  fclose(fp);
+
+  return (buf);
+}
+
+
+#ifdef ENABLE_PREPROC
+/**
+ ** Run the preprocessor of each rule file, at most one process per
+ ** CPU at a time, each writing into a temporary file of the cache
+ ** directory.  SIGCHLD is blocked meanwhile, so that the SIGCHLD
+ ** handler does not reap our children.
+ **/
+static char **
+preprocess_rulefiles(orchids_t *ctx, int files, size_t *lens)
+{
+  rulefile_t *rf;
+  rulefile_t **rfs;
+  char **texts;
+  char (*tmp)[PATH_MAX];
+  char cmd[4096];
+  pid_t *pids;
+  pid_t pid;
+  sigset_t mask;
+  sigset_t oldmask;
+  long jobs;
+  int running;
+  int status;
+  int fd;
+  int f;
+  int i;
+
+  jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (jobs < 1)
+    jobs = 1;
+
+  texts = Xzmalloc((files + 1) * sizeof (char *));
+  tmp = Xzmalloc((files + 1) * sizeof (*tmp));
+  pids = Xzmalloc((files + 1) * sizeof (pid_t));
+  rfs = Xzmalloc((files + 1) * sizeof (rulefile_t *));
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, &oldmask);
+  fflush(NULL);
+
+  running = 0;
+  f = 0;
+  rf = ctx->rulefile_list;
+  while (rf || running > 0) {
+    if (rf && running < jobs) {
+      snprintf(tmp[f], PATH_MAX, "%s/pp.XXXXXX", ctx->rule_cache_dir);
+      fd = mkstemp(tmp[f]);
+      if (fd < 0) {
+        DebugLog(DF_OLC, DS_FATAL, "rule cache: mkstemp(%s): %s\n",
+                 tmp[f], strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+      snprintf(cmd, sizeof (cmd), "%s %s",
+               get_preproc_cmd(ctx, rf->name), rf->name);
+      pid = fork();
+      if (pid == 0) {
+        dup2(fd, STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", cmd, (char *) NULL);
+        _exit(127);
+      }
+      close(fd);
+      if (pid < 0) {
+        DebugLog(DF_OLC, DS_FATAL, "rule cache: fork(): %s\n",
+                 strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+      rfs[f] = rf;
+      pids[f++] = pid;
+      running++;
+      rf = rf->next;
+      continue ;
+    }
+
+    pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue ;
+      break ;
+    }
+    for (i = 0; i < f; i++)
+      if (pids[i] == pid)
+        break ;
+    if (i == f)
+      continue ; /* not one of ours */
+    running--;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      DebugLog(DF_OLC, DS_ERROR,
+               "error: preprocessor returned %i for '%s'.\n",
+               WEXITSTATUS(status), rfs[i]->name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  sigprocmask(SIG_SETMASK, &oldmask, NULL);
+
+  for (i = 0; i < files; i++) {
+    texts[i] = read_whole_file(tmp[i], &lens[i]);
+    unlink(tmp[i]);
+    if (texts[i] == NULL) {
+      DebugLog(DF_OLC, DS_FATAL, "rule cache: can't read '%s'\n", tmp[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  Xfree(rfs);
+  Xfree(pids);
+  Xfree(tmp);
+
+  return (texts);
+}
+#else
+static char **
+preprocess_rulefiles(orchids_t *ctx, int files, size_t *lens)
+{
+  rulefile_t *rf;
+  char **texts;
+  int f;
+
+  texts = Xzmalloc((files + 1) * sizeof (char *));
+  for (rf = ctx->rulefile_list, f = 0; rf; rf = rf->next, f++) {
+    texts[f] = read_whole_file(rf->name, &lens[f]);
+    if (texts[f] == NULL) {
+      DebugLog(DF_OLC, DS_FATAL, "can't read rule file '%s': %s\n",
+               rf->name, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  return (texts);
+}
+#endif /* ENABLE_PREPROC */
+
+
+void
+compile_rules_cached(orchids_t *ctx)
+{
+  rule_compiler_t *rc;
+  rulefile_t *rf;
+  struct stat filestat;
+  char path[PATH_MAX];
+  char **texts;
+  size_t *lens;
+  rule_t *last;
+  hcode_t key;
+  uint32_t crc;
+  int32_t base;
+  FILE *fp;
+  int files;
+  int hits;
+  int f;
+
+  rc = ctx->rule_compiler;
+  files = 0;
+  for (rf = ctx->rulefile_list; rf; rf = rf->next)
+    files++;
+
+  lens = Xzmalloc((files + 1) * sizeof (size_t));
+  texts = preprocess_rulefiles(ctx, files, lens);
+
+  hits = 0;
+  for (rf = ctx->rulefile_list, f = 0; rf; rf = rf->next, f++) {
+    Xstat(rf->name, &filestat);
+    rf->mtime = filestat.st_mtime;
+    base = rc->rules;
+
+    key = hash_mm64((hkey_t *) RULE_IMAGE_ORCHIDS_VERSION,
+                    strlen(RULE_IMAGE_ORCHIDS_VERSION));
+    key = hash_mm64_seed(key, (hkey_t *) texts[f], lens[f]);
+    crc = crc32(0, texts[f], lens[f]);
+    snprintf(path, sizeof (path), "%s/%016lx%s",
+             ctx->rule_cache_dir, (unsigned long) key, RULE_IMAGE_SUFFIX);
+
+    if (rule_image_load(ctx, path, lens[f], crc) == RETURN_SUCCESS) {
+      DebugLog(DF_OLC, DS_INFO, "rule cache: '%s' loaded from '%s'\n",
+               rf->name, path);
+      hits++;
+    }
+    else {
+      last = rc->last_rule;
+      fp = fmemopen(texts[f], lens[f], "r");
+      if (fp == NULL) {
+        DebugLog(DF_OLC, DS_FATAL, "fmemopen(): %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+      compile_and_add_rulestream(ctx, rf->name, fp);
+      fclose(fp);
+      rule_image_save(ctx, path, last ? last->next : rc->first_rule,
+                      lens[f], crc);
+    }
+    rf->rules_nb = rc->rules - base;
+    Xfree(texts[f]);
+  }
+
+  DebugLog(DF_OLC, DS_NOTICE, "rule cache: %i/%i rule files loaded from '%s'\n",
+           hits, files, ctx->rule_cache_dir);
+
+  Xfree(texts);
+  Xfree(lens);
+}
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
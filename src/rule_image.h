@@ -0,0 +1,110 @@
+/**
+ ** @file rule_image.h
+ ** Public definitions for rule_image.c
+ **
+ ** @version 0.1
+ ** @ingroup compiler
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef RULE_IMAGE_H
+#define RULE_IMAGE_H
+
+#include "orchids.h"
+
+/** Rule image magic number ("ORIM"). */
+#define RULE_IMAGE_MAGIC   0x4f52494d
+/** Rule image format version. */
+#define RULE_IMAGE_VERSION 2
+/** Rule image file name suffix. */
+#define RULE_IMAGE_SUFFIX  ".rimg"
+
+
+/**
+ ** Compile all rule files using the precompiled rule image cache
+ ** (RuleCacheDir directive).  Rule files are first preprocessed, in
+ ** parallel.  For each file, the image keyed by a hash of the
+ ** preprocessed source is loaded if it exists, and its field and
+ ** function identifiers are relocated; otherwise the file is compiled
+ ** and its image written.
+ **
+ ** @param ctx Orchids application context.
+ **/
+void
+compile_rules_cached(orchids_t *ctx);
+
+
+/**
+ ** Write the image of a list of compiled rules.
+ **
+ ** @param ctx   Orchids application context.
+ ** @param path  Image file name.
+ ** @param first First rule to write; all rules up to the end of the
+ **   rule list are written.
+ ** @param src_len Length of the preprocessed source.
+ ** @param src_crc CRC32 of the preprocessed source.
+ ** @return RETURN_SUCCESS, or a negative value if the rules can't be
+ **   saved (unsupported constant type, I/O error).
+ **/
+int
+rule_image_save(orchids_t *ctx, const char *path, rule_t *first,
+                size_t src_len, uint32_t src_crc);
+
+
+/**
+ ** Load a rule image and add its rules to the rule list.
+ **
+ ** @param ctx   Orchids application context.
+ ** @param path  Image file name.
+ ** @param src_len Expected length of the preprocessed source.
+ ** @param src_crc Expected CRC32 of the preprocessed source.
+ ** @return RETURN_SUCCESS, or a negative value if the image is
+ **   missing, stale or invalid (no rule is added in this case).
+ **/
+int
+rule_image_load(orchids_t *ctx, const char *path,
+                size_t src_len, uint32_t src_crc);
+
+
+#endif /* RULE_IMAGE_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
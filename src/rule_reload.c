@@ -0,0 +1,417 @@
+/**
+ ** @file rule_reload.c
+ ** Hot rule reload.
+ **
+ ** On SIGHUP, or on the 'reload' command of mod_remoteadm, the rule
+ ** files modified since they were compiled are recompiled, between
+ ** two events.  Each new rule is compared, by name and by the
+ ** checksum of its compiled form, to the rules previously compiled
+ ** from the same file: unchanged rules keep their rule_t, so their
+ ** running instances go on as if nothing happened.  The other old
+ ** rules are retired: with the drain policy (default), their
+ ** instances keep running until they die, and the rule is freed
+ ** afterwards; with the kill policy, their instances are freed at
+ ** once.
+ **
+ ** The rule compiler exits on errors, so the new rule files are
+ ** first compiled in a forked child.  The reload only takes place
+ ** if the child succeeds.
+ **
+ ** @version 0.1
+ ** @ingroup compiler
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "orchids.h"
+#include "engine.h"
+#include "evt_mgr.h"
+#include "rule_compiler.h"
+#include "mem_governor.h"
+
+#include "rule_reload.h"
+
+
+static volatile sig_atomic_t rule_reload_sighup_g = 0;
+
+
+static void
+append_rule(rule_compiler_t *rc, rule_t *rule)
+{
+  rule->next = NULL;
+  rule->id = rc->rules++;
+  if (rc->first_rule)
+    rc->last_rule->next = rule;
+  else
+    rc->first_rule = rule;
+  rc->last_rule = rule;
+}
+
+
+/**
+ ** Unlink from a list of old rules the one with the same name and
+ ** the same compiled form as a new rule.
+ **/
+static rule_t *
+take_unchanged_rule(rule_t **old, rule_t *rule)
+{
+  rule_t **prev;
+  rule_t *r;
+
+  for (prev = old; (r = *prev) != NULL; prev = &r->next) {
+    if (r->checksum == rule->checksum && !strcmp(r->name, rule->name)) {
+      *prev = r->next;
+      return (r);
+    }
+  }
+
+  return (NULL);
+}
+
+
+static void
+retire_rule(orchids_t *ctx, rule_t *rule)
+{
+  rule_instance_t *ri;
+
+  rule->id = -1;
+
+  if (rule->instances > 0 && ctx->reload_policy == RULE_RELOAD_KILL) {
+    for (ri = ctx->first_rule_instance; ri; ri = ri->next)
+      if (ri->rule == rule)
+        ri->flags |= RULE_EVICTED;
+    evict_rule_instances(ctx);
+  }
+
+  if (rule->instances > 0) {
+    DebugLog(DF_OLC, DS_NOTICE,
+             "rule '%s' retired, draining %i instances\n",
+             rule->name, rule->instances);
+    rule->next = ctx->retired_rules;
+    ctx->retired_rules = rule;
+    return ;
+  }
+
+  free_rule(rule);
+}
+
+
+static void
+free_drained_rules(orchids_t *ctx)
+{
+  rule_t **prev;
+  rule_t *r;
+
+  prev = &ctx->retired_rules;
+  while ((r = *prev) != NULL) {
+    if (r->instances > 0) {
+      prev = &r->next;
+      continue ;
+    }
+    DebugLog(DF_OLC, DS_INFO, "retired rule '%s' drained\n", r->name);
+    *prev = r->next;
+    free_rule(r);
+  }
+}
+
+
+/**
+ ** Rebuild the rule list, in rule file order: rules of unchanged
+ ** files are kept as they are, changed files are recompiled.
+ ** @param ctx     Orchids application context.
+ ** @param mtimes  Current modification time of each rule file.
+ ** @param dry_run Only compile (in the validation child): don't
+ **   swap rules nor touch rule instances.
+ ** @return The number of recompiled files.
+ **/
+static int
+reload_rulefiles(orchids_t *ctx, time_t *mtimes, int dry_run)
+{
+  rule_compiler_t *rc;
+  rulefile_t *rf;
+  rule_t **runs;
+  rule_t **tail;
+  rule_t *r;
+  rule_t *next;
+  rule_t *prev;
+  rule_t *kept_rule;
+  int32_t base;
+  int32_t i;
+  int files;
+  int f;
+  int changed;
+  int kept;
+  int retired;
+
+  rc = ctx->rule_compiler;
+
+  files = 0;
+  for (rf = ctx->rulefile_list; rf; rf = rf->next)
+    files++;
+
+  /* Split the rule list into per-file runs, and forget the names of
+   * all the rules being recompiled first, so that a rule can move
+   * from a changed file to another. */
+  runs = Xzmalloc((files + 1) * sizeof (rule_t *));
+  r = rc->first_rule;
+  for (rf = ctx->rulefile_list, f = 0; rf; rf = rf->next, f++) {
+    tail = &runs[f];
+    for (i = 0; i < rf->rules_nb && r; i++) {
+      if (mtimes[f] != rf->mtime)
+        strhash_del(rc->rulenames_hash, r->name);
+      *tail = r;
+      tail = &r->next;
+      r = r->next;
+    }
+    *tail = NULL;
+  }
+  rc->first_rule = NULL;
+  rc->last_rule = NULL;
+  rc->rules = 0;
+
+  build_fields_hash(ctx);
+
+  changed = 0;
+  kept = 0;
+  retired = 0;
+  for (rf = ctx->rulefile_list, f = 0; rf; rf = rf->next, f++) {
+    if (mtimes[f] == rf->mtime) {
+      for (r = runs[f]; r; r = next) {
+        next = r->next;
+        append_rule(rc, r);
+      }
+      continue ;
+    }
+
+    changed++;
+    prev = rc->last_rule;
+    base = rc->rules;
+    compile_and_add_rulefile(ctx, rf->name);
+    rf->mtime = mtimes[f];
+    rf->rules_nb = rc->rules - base;
+    if (dry_run)
+      continue ;
+
+    /* Put the old rule_t back in place of unchanged rules */
+    for (r = prev ? prev->next : rc->first_rule; r; prev = r, r = next) {
+      next = r->next;
+      kept_rule = take_unchanged_rule(&runs[f], r);
+      if (kept_rule == NULL) {
+        DebugLog(DF_OLC, DS_NOTICE, "rule '%s' loaded\n", r->name);
+        continue ;
+      }
+      kept_rule->next = next;
+      kept_rule->id = r->id;
+      kept_rule->filename = r->filename;
+      kept_rule->file_mtime = r->file_mtime;
+      kept_rule->lineno = r->lineno;
+      if (prev)
+        prev->next = kept_rule;
+      else
+        rc->first_rule = kept_rule;
+      if (rc->last_rule == r)
+        rc->last_rule = kept_rule;
+      strhash_del(rc->rulenames_hash, r->name);
+      strhash_add(rc->rulenames_hash, kept_rule, kept_rule->name);
+      free_rule(r);
+      r = kept_rule;
+      kept++;
+    }
+
+    for (r = runs[f]; r; r = next) {
+      next = r->next;
+      retire_rule(ctx, r);
+      retired++;
+    }
+  }
+  Xfree(runs);
+
+  if (!dry_run) {
+    memgov_bind_rules(ctx);
+    DebugLog(DF_OLC, DS_NOTICE,
+             "rules reloaded: %i files recompiled, %i rules unchanged, "
+             "%i retired, %i rules\n", changed, kept, retired, rc->rules);
+  }
+
+  return (changed);
+}
+
+
+/**
+ ** Compile the changed rule files in a child process.  SIGCHLD is
+ ** blocked meanwhile, so that the child is not reaped by the
+ ** SIGCHLD handler before we get its exit status.
+ **/
+static int
+validate_rulefiles(orchids_t *ctx, time_t *mtimes)
+{
+  sigset_t mask;
+  sigset_t oldmask;
+  pid_t pid;
+  int status;
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+  fflush(NULL);
+  pid = fork();
+  if (pid == 0) {
+    reload_rulefiles(ctx, mtimes, TRUE);
+    _exit(EXIT_SUCCESS);
+  }
+  if (pid < 0) {
+    DebugLog(DF_OLC, DS_ERROR, "reload: fork(): %s\n", strerror(errno));
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    return (-1);
+  }
+
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  sigprocmask(SIG_SETMASK, &oldmask, NULL);
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+    return (-1);
+
+  return (0);
+}
+
+
+int
+reload_rules(orchids_t *ctx)
+{
+  rulefile_t *rf;
+  struct stat filestat;
+  time_t *mtimes;
+  int changed;
+  int files;
+  int f;
+
+  files = 0;
+  for (rf = ctx->rulefile_list; rf; rf = rf->next)
+    files++;
+
+  changed = 0;
+  mtimes = Xzmalloc((files + 1) * sizeof (time_t));
+  for (rf = ctx->rulefile_list, f = 0; rf; rf = rf->next, f++) {
+    if (stat(rf->name, &filestat)) {
+      DebugLog(DF_OLC, DS_ERROR, "reload: can't stat rule file '%s': %s\n",
+               rf->name, strerror(errno));
+      Xfree(mtimes);
+      return (-1);
+    }
+    mtimes[f] = filestat.st_mtime;
+    if (mtimes[f] != rf->mtime)
+      changed++;
+  }
+
+  if (changed == 0) {
+    DebugLog(DF_OLC, DS_NOTICE, "reload: no rule file changed\n");
+    Xfree(mtimes);
+    return (0);
+  }
+
+  if (validate_rulefiles(ctx, mtimes)) {
+    DebugLog(DF_OLC, DS_ERROR,
+             "reload: rule files don't compile, keeping the current rules\n");
+    Xfree(mtimes);
+    return (-1);
+  }
+
+  changed = reload_rulefiles(ctx, mtimes, FALSE);
+  Xfree(mtimes);
+
+  return (changed);
+}
+
+
+static void
+rule_reload_sighup(int signo)
+{
+  rule_reload_sighup_g = 1;
+}
+
+
+static int
+rtaction_rule_reload(orchids_t *ctx, rtaction_t *e)
+{
+  if (rule_reload_sighup_g) {
+    rule_reload_sighup_g = 0;
+    DebugLog(DF_OLC, DS_NOTICE, "SIGHUP received: reloading rules\n");
+    reload_rules(ctx);
+  }
+
+  if (ctx->retired_rules)
+    free_drained_rules(ctx);
+
+  e->date = ctx->cur_loop_time;
+  e->date.tv_sec += 1;
+  register_rtaction(ctx, e);
+
+  return (0);
+}
+
+
+void
+rule_reload_setup(orchids_t *ctx)
+{
+  if (ctx->off_line_mode != MODE_ONLINE)
+    return ;
+
+  Xsignal(SIGHUP, rule_reload_sighup);
+  register_rtcallback(ctx, rtaction_rule_reload, NULL, 1);
+}
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -0,0 +1,91 @@
+/**
+ ** @file rule_reload.h
+ ** Public definitions for rule_reload.c
+ **
+ ** @version 0.1
+ ** @ingroup compiler
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef RULE_RELOAD_H
+#define RULE_RELOAD_H
+
+#include "orchids.h"
+
+/** Let running instances of changed rules finish (default). */
+#define RULE_RELOAD_DRAIN 0
+/** Kill running instances of changed rules at reload time. */
+#define RULE_RELOAD_KILL  1
+
+
+/**
+ ** Recompile the rule files modified since they were last compiled,
+ ** and swap the new rule definitions in.  Rules whose compiled form
+ ** did not change keep their rule_t, hence their running instances.
+ ** Instances of changed or removed rules are drained or killed
+ ** according to orchids_s::reload_policy.
+ **
+ ** The new rule files are first compiled in a forked child: if they
+ ** don't compile, nothing is changed.
+ ** Must be called between two events.
+ **
+ ** @param ctx Orchids application context.
+ ** @return The number of recompiled rule files, or a negative value
+ **   if the new rules don't compile.
+ **/
+int
+reload_rules(orchids_t *ctx);
+
+
+/**
+ ** Install the SIGHUP handler triggering a rule reload, and the
+ ** real-time action that polls it and frees drained rules.
+ **
+ ** @param ctx Orchids application context.
+ **/
+void
+rule_reload_setup(orchids_t *ctx);
+
+
+#endif /* RULE_RELOAD_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
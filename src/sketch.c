@@ -0,0 +1,1118 @@
+/**
+ ** @file sketch.c
+ ** Probabilistic sketches for the ISSDL language.
+ **
+ ** Detecting scans and sprays needs "distinct destinations per
+ ** source" and "most frequent sources", which exact rule state can
+ ** only express with memory growing with the attack.  Sketches
+ ** answer these questions approximately, in fixed memory, with a
+ ** constant cost per event:
+ **   - HyperLogLog (T_HLL) estimates the number of distinct values,
+ **     with a standard error of 1.04/sqrt(2^precision);
+ **   - Count-Min (T_CMS) estimates the frequency of a value, never
+ **     under-estimating it (conservative update);
+ **   - top-k (T_TOPK) monitors the k most frequent values, using the
+ **     Space-Saving algorithm.
+ **
+ ** Sketches are ISSDL values, usually bound to rule variables.  A
+ ** sketch created with a non-empty name is shared by all the instances
+ ** of the rule (names are local to a rule), e.g.
+ **   $dsts = hll_new("dsts", 12);
+ **   $n = hll_add($dsts, .ip.dst);
+ ** Sketches of the same type and dimensions can be merged, with
+ ** sketch_merge() or the '+' operator.  A size of 0 in the
+ ** constructors stands for the default (HLLPrecision, CountMinWidth,
+ ** CountMinDepth and TopKSize directives).
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "orchids.h"
+#include "safelib.h"
+#include "hash.h"
+#include "strhash.h"
+#include "lang.h"
+
+#include "sketch.h"
+
+
+static uint64_t
+sketch_hash(ovm_var_t *val)
+{
+  return ((uint64_t)hash_mm64_seed(0, issdl_get_data(val),
+                                   issdl_get_data_len(val)));
+}
+
+
+/*
+** HyperLogLog
+*/
+
+ovm_var_t *
+ovm_hll_new(int precision)
+{
+  ovm_hll_t *h;
+
+  h = Xzmalloc(sizeof (ovm_hll_t) + (1 << precision));
+  h->type = T_HLL;
+  h->precision = precision;
+  h->hist[0] = 1 << precision;
+
+  return (OVM_VAR(h));
+}
+
+
+static void
+hll_add_hash(ovm_hll_t *h, uint64_t x)
+{
+  uint64_t w;
+  uint32_t idx;
+  uint8_t rank;
+
+  idx = x >> (64 - h->precision);
+  w = x << h->precision;
+  rank = w ? __builtin_clzll(w) + 1 : 64 - h->precision + 1;
+
+  if (rank > h->regs[idx]) {
+    h->hist[ h->regs[idx] ]--;
+    h->hist[rank]++;
+    h->regs[idx] = rank;
+  }
+}
+
+
+static long
+hll_estimate(ovm_hll_t *h)
+{
+  double m;
+  double alpha;
+  double sum;
+  double e;
+  int r;
+
+  m = 1 << h->precision;
+  switch (h->precision) {
+  case 4:
+    alpha = 0.673;
+    break ;
+  case 5:
+    alpha = 0.697;
+    break ;
+  case 6:
+    alpha = 0.709;
+    break ;
+  default:
+    alpha = 0.7213 / (1.0 + 1.079 / m);
+  }
+
+  /* The register histogram avoids scanning the registers */
+  sum = 0.0;
+  for (r = 0; r <= 64 - (int)h->precision + 1; r++)
+    if (h->hist[r])
+      sum += ldexp(h->hist[r], -r);
+
+  e = alpha * m * m / sum;
+
+  /* Small range correction: linear counting */
+  if (e <= 2.5 * m && h->hist[0] != 0)
+    e = m * log(m / h->hist[0]);
+
+  return ((long)(e + 0.5));
+}
+
+
+/*
+** Count-Min
+*/
+
+ovm_var_t *
+ovm_cms_new(int width, int depth)
+{
+  ovm_cms_t *c;
+
+  c = Xzmalloc(sizeof (ovm_cms_t) + (size_t)width * depth * sizeof (uint32_t));
+  c->type = T_CMS;
+  c->width = width;
+  c->depth = depth;
+
+  return (OVM_VAR(c));
+}
+
+
+/**
+ ** Counter of a value in a row: double hashing from one 64-bit hash.
+ **/
+#define CMS_COUNTER(c, x, i)                                            \
+  (&(c)->counters[ (i) * (c)->width                                     \
+                   + ((uint32_t)(x) + (i) * (uint32_t)((x) >> 32))      \
+                     % (c)->width ])
+
+
+static uint32_t
+cms_estimate(ovm_cms_t *c, uint64_t x)
+{
+  uint32_t min;
+  uint32_t i;
+
+  min = UINT32_MAX;
+  for (i = 0; i < c->depth; i++)
+    if (*CMS_COUNTER(c, x, i) < min)
+      min = *CMS_COUNTER(c, x, i);
+
+  return (min);
+}
+
+
+static uint32_t
+cms_add_hash(ovm_cms_t *c, uint64_t x, uint32_t amount)
+{
+  uint32_t est;
+  uint32_t *cnt;
+  uint32_t i;
+
+  /* Conservative update: only raise the counters up to the new
+   * estimate, to limit over-estimation. */
+  est = cms_estimate(c, x);
+  est = (UINT32_MAX - est < amount) ? UINT32_MAX : est + amount;
+  for (i = 0; i < c->depth; i++) {
+    cnt = CMS_COUNTER(c, x, i);
+    if (*cnt < est)
+      *cnt = est;
+  }
+  c->total += amount;
+
+  return (est);
+}
+
+
+/*
+** Top-k (Space-Saving)
+*/
+
+#define TOPK_SLOTS(t)  ((uint32_t *)&(t)->heap[(t)->k])
+#define TOPK_MASK(t)   ((1U << (t)->index_bits) - 1)
+
+static size_t
+topk_size(uint32_t k, uint32_t index_bits)
+{
+  return (sizeof (ovm_topk_t) + k * sizeof (topk_entry_t)
+          + (sizeof (uint32_t) << index_bits));
+}
+
+
+ovm_var_t *
+ovm_topk_new(int k)
+{
+  ovm_topk_t *t;
+  uint32_t bits;
+
+  /* At least 2k index slots */
+  for (bits = 1; (1U << bits) < 2U * k; bits++)
+    ;
+
+  t = Xzmalloc(topk_size(k, bits));
+  t->type = T_TOPK;
+  t->k = k;
+  t->index_bits = bits;
+
+  return (OVM_VAR(t));
+}
+
+
+static int
+topk_find(ovm_topk_t *t, uint64_t x)
+{
+  uint32_t *slots;
+  uint32_t i;
+
+  slots = TOPK_SLOTS(t);
+  for (i = x & TOPK_MASK(t); slots[i]; i = (i + 1) & TOPK_MASK(t))
+    if (t->heap[ slots[i] - 1 ].hash == x)
+      return (i);
+
+  return (-1);
+}
+
+
+static void
+topk_index_add(ovm_topk_t *t, uint64_t x, uint32_t pos)
+{
+  uint32_t *slots;
+  uint32_t i;
+
+  slots = TOPK_SLOTS(t);
+  for (i = x & TOPK_MASK(t); slots[i]; i = (i + 1) & TOPK_MASK(t))
+    ;
+  slots[i] = pos + 1;
+}
+
+
+static void
+topk_index_del(ovm_topk_t *t, uint32_t i)
+{
+  uint32_t *slots;
+  uint32_t mask;
+  uint32_t home;
+  uint32_t j;
+
+  slots = TOPK_SLOTS(t);
+  mask = TOPK_MASK(t);
+
+  /* Backward shift deletion (linear probing) */
+  for (j = (i + 1) & mask; slots[j]; j = (j + 1) & mask) {
+    home = t->heap[ slots[j] - 1 ].hash & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      slots[i] = slots[j];
+      i = j;
+    }
+  }
+  slots[i] = 0;
+}
+
+
+static void
+topk_swap(ovm_topk_t *t, uint32_t a, uint32_t b)
+{
+  topk_entry_t tmp;
+
+  TOPK_SLOTS(t)[ topk_find(t, t->heap[a].hash) ] = b + 1;
+  TOPK_SLOTS(t)[ topk_find(t, t->heap[b].hash) ] = a + 1;
+  tmp = t->heap[a];
+  t->heap[a] = t->heap[b];
+  t->heap[b] = tmp;
+}
+
+
+static void
+topk_sift_down(ovm_topk_t *t, uint32_t pos)
+{
+  uint32_t c;
+
+  for (;;) {
+    c = 2 * pos + 1;
+    if (c >= t->n)
+      return ;
+    if (c + 1 < t->n && t->heap[c + 1].count < t->heap[c].count)
+      c++;
+    if (t->heap[pos].count <= t->heap[c].count)
+      return ;
+    topk_swap(t, pos, c);
+    pos = c;
+  }
+}
+
+
+static void
+topk_sift_up(ovm_topk_t *t, uint32_t pos)
+{
+  while (pos > 0 && t->heap[(pos - 1) / 2].count > t->heap[pos].count) {
+    topk_swap(t, pos, (pos - 1) / 2);
+    pos = (pos - 1) / 2;
+  }
+}
+
+
+static void
+topk_set_value(topk_entry_t *e, uint64_t x, ovm_var_t *val)
+{
+  size_t len;
+
+  len = issdl_get_data_len(val);
+  e->hash = x;
+  e->vtype = TYPE(val);
+  e->len = len < TOPK_VALUE_SZ ? len : TOPK_VALUE_SZ;
+  memcpy(e->val, issdl_get_data(val), e->len);
+}
+
+
+static uint64_t
+topk_add_value(ovm_topk_t *t, ovm_var_t *val, uint64_t amount)
+{
+  topk_entry_t *e;
+  uint64_t x;
+  uint32_t pos;
+  int i;
+
+  x = sketch_hash(val);
+  t->total += amount;
+
+  i = topk_find(t, x);
+  if (i >= 0) {
+    pos = TOPK_SLOTS(t)[i] - 1;
+    t->heap[pos].count += amount;
+    topk_sift_down(t, pos);
+    return (t->heap[ TOPK_SLOTS(t)[i] - 1 ].count);
+  }
+
+  if (t->n < t->k) {
+    pos = t->n++;
+    e = &t->heap[pos];
+    topk_set_value(e, x, val);
+    e->count = amount;
+    e->error = 0;
+    topk_index_add(t, x, pos);
+    topk_sift_up(t, pos);
+    return (amount);
+  }
+
+  /* Replace the least frequent value, inheriting its count */
+  e = &t->heap[0];
+  topk_index_del(t, topk_find(t, e->hash));
+  e->error = e->count;
+  e->count += amount;
+  topk_set_value(e, x, val);
+  topk_index_add(t, x, 0);
+  topk_sift_down(t, 0);
+
+  return (t->heap[ TOPK_SLOTS(t)[ topk_find(t, x) ] - 1 ].count);
+}
+
+
+static int
+topk_entry_cmp(const void *a, const void *b)
+{
+  const topk_entry_t *ea = a;
+  const topk_entry_t *eb = b;
+
+  if (ea->count != eb->count)
+    return (ea->count < eb->count ? 1 : -1);
+
+  return (0);
+}
+
+
+/**
+ ** Copy the entries of a top-k sketch, most frequent first.
+ **/
+static topk_entry_t *
+topk_sorted(ovm_topk_t *t)
+{
+  topk_entry_t *s;
+
+  s = Xmalloc((t->n ? t->n : 1) * sizeof (topk_entry_t));
+  memcpy(s, t->heap, t->n * sizeof (topk_entry_t));
+  qsort(s, t->n, sizeof (topk_entry_t), topk_entry_cmp);
+
+  return (s);
+}
+
+
+static ovm_var_t *
+topk_entry_value(topk_entry_t *e)
+{
+  ovm_var_t *res;
+
+  switch (e->vtype) {
+  case T_INT:
+    res = ovm_int_new();
+    break ;
+  case T_UINT:
+    res = ovm_uint_new();
+    break ;
+  case T_IPV4:
+    res = ovm_ipv4_new();
+    break ;
+  case T_CTIME:
+    res = ovm_ctime_new();
+    break ;
+  case T_STR:
+  case T_VSTR:
+    res = ovm_str_new(e->len);
+    memcpy(STR(res), e->val, e->len);
+    return (res);
+  default:
+    res = ovm_bstr_new(e->len);
+    memcpy(BSTR(res), e->val, e->len);
+    return (res);
+  }
+
+  if (e->len == issdl_get_data_len(res))
+    memcpy(issdl_get_data(res), e->val, e->len);
+
+  return (res);
+}
+
+
+/*
+** Generic sketch type handlers
+*/
+
+void *
+sketch_get_data(ovm_var_t *var)
+{
+  return (var);
+}
+
+
+size_t
+sketch_get_data_len(ovm_var_t *var)
+{
+  switch (TYPE(var)) {
+  case T_HLL:
+    return (sizeof (ovm_hll_t) + (1 << HLL(var)->precision));
+  case T_CMS:
+    return (sizeof (ovm_cms_t)
+            + (size_t)CMS(var)->width * CMS(var)->depth * sizeof (uint32_t));
+  case T_TOPK:
+    return (topk_size(TOPK(var)->k, TOPK(var)->index_bits));
+  }
+
+  return (0);
+}
+
+
+ovm_var_t *
+sketch_clone(ovm_var_t *var)
+{
+  ovm_var_t *res;
+  size_t len;
+
+  len = sketch_get_data_len(var);
+  res = Xmalloc(len);
+  memcpy(res, var, len);
+  FLAGS(res) = TYPE_CANFREE | TYPE_NOTBOUND;
+
+  return (res);
+}
+
+
+static ovm_var_t *
+topk_merge(ovm_topk_t *a, ovm_topk_t *b)
+{
+  ovm_topk_t *res;
+  topk_entry_t *all;
+  uint32_t n;
+  uint32_t i;
+  uint32_t j;
+
+  /* Sum the counts of the values monitored by both sketches */
+  all = Xmalloc((a->n + b->n + 1) * sizeof (topk_entry_t));
+  memcpy(all, a->heap, a->n * sizeof (topk_entry_t));
+  n = a->n;
+  for (i = 0; i < b->n; i++) {
+    for (j = 0; j < a->n; j++)
+      if (all[j].hash == b->heap[i].hash)
+        break ;
+    if (j < a->n) {
+      all[j].count += b->heap[i].count;
+      all[j].error += b->heap[i].error;
+    }
+    else
+      all[n++] = b->heap[i];
+  }
+  qsort(all, n, sizeof (topk_entry_t), topk_entry_cmp);
+
+  res = TOPK(ovm_topk_new(a->k));
+  res->total = a->total + b->total;
+  res->n = n < res->k ? n : res->k;
+  /* Least frequent first: a sorted array is a heap */
+  for (i = 0; i < res->n; i++) {
+    res->heap[i] = all[res->n - 1 - i];
+    topk_index_add(res, res->heap[i].hash, i);
+  }
+  Xfree(all);
+
+  return (OVM_VAR(res));
+}
+
+
+ovm_var_t *
+sketch_merge(ovm_var_t *var1, ovm_var_t *var2)
+{
+  ovm_var_t *res;
+  size_t i;
+  size_t n;
+  int r;
+
+  if (TYPE(var1) != TYPE(var2))
+    return (NULL);
+
+  switch (TYPE(var1)) {
+  case T_HLL:
+    if (HLL(var1)->precision != HLL(var2)->precision)
+      return (NULL);
+    res = ovm_hll_new(HLL(var1)->precision);
+    n = 1 << HLL(var1)->precision;
+    HLL(res)->hist[0] = 0;
+    for (i = 0; i < n; i++) {
+      r = HLL(var1)->regs[i] > HLL(var2)->regs[i]
+        ? HLL(var1)->regs[i] : HLL(var2)->regs[i];
+      HLL(res)->regs[i] = r;
+      HLL(res)->hist[r]++;
+    }
+    break ;
+
+  case T_CMS:
+    if (CMS(var1)->width != CMS(var2)->width
+        || CMS(var1)->depth != CMS(var2)->depth)
+      return (NULL);
+    res = ovm_cms_new(CMS(var1)->width, CMS(var1)->depth);
+    n = (size_t)CMS(var1)->width * CMS(var1)->depth;
+    for (i = 0; i < n; i++)
+      CMS(res)->counters[i] =
+        (UINT32_MAX - CMS(var1)->counters[i] < CMS(var2)->counters[i])
+        ? UINT32_MAX : CMS(var1)->counters[i] + CMS(var2)->counters[i];
+    CMS(res)->total = CMS(var1)->total + CMS(var2)->total;
+    break ;
+
+  case T_TOPK:
+    if (TOPK(var1)->k != TOPK(var2)->k)
+      return (NULL);
+    res = topk_merge(TOPK(var1), TOPK(var2));
+    break ;
+
+  default:
+    return (NULL);
+  }
+
+  FLAGS(res) |= TYPE_CANFREE | TYPE_NOTBOUND;
+
+  return (res);
+}
+
+
+int
+sketch_save(FILE *fp, ovm_var_t *var)
+{
+  unsigned long len;
+
+  len = sketch_get_data_len(var);
+  if (fwrite(&len, sizeof (len), 1, fp) != 1
+      || fwrite(var, len, 1, fp) != 1)
+    return (-1);
+
+  return (0);
+}
+
+
+/**
+ ** Size of a sketch, from its header (whose type and dimensions are
+ ** checked), or 0 if the header is invalid.
+ **/
+static size_t
+sketch_header_len(ovm_var_t *var)
+{
+  ovm_topk_t *t;
+  uint32_t bits;
+
+  switch (TYPE(var)) {
+  case T_HLL:
+    if (HLL(var)->precision < HLL_MIN_PRECISION
+        || HLL(var)->precision > HLL_MAX_PRECISION)
+      return (0);
+    break ;
+  case T_CMS:
+    if (CMS(var)->width == 0 || CMS(var)->depth == 0
+        || (uint64_t)CMS(var)->width * CMS(var)->depth > CMS_MAX_COUNTERS)
+      return (0);
+    break ;
+  case T_TOPK:
+    t = TOPK(var);
+    if (t->k == 0 || t->k > TOPK_MAX_SIZE || t->n > t->k)
+      return (0);
+    /* Same index size as ovm_topk_new() */
+    for (bits = 1; (1U << bits) < 2U * t->k; bits++)
+      ;
+    if (t->index_bits != bits)
+      return (0);
+    break ;
+  default:
+    return (0);
+  }
+
+  return (sketch_get_data_len(var));
+}
+
+
+ovm_var_t *
+sketch_restore(FILE *fp)
+{
+  union {
+    ovm_hll_t  hll;
+    ovm_cms_t  cms;
+    ovm_topk_t topk;
+  } hdr;
+  ovm_var_t *var;
+  unsigned long len;
+  size_t hlen;
+  uint32_t *slots;
+  uint32_t i;
+
+  /* Read and check the header before trusting the saved length */
+  if (fread(&len, sizeof (len), 1, fp) != 1
+      || fread(&hdr, 2 * sizeof (uint32_t), 1, fp) != 1)
+    return (NULL);
+  switch (hdr.hll.type) {
+  case T_HLL:
+    hlen = sizeof (ovm_hll_t);
+    break ;
+  case T_CMS:
+    hlen = sizeof (ovm_cms_t);
+    break ;
+  case T_TOPK:
+    hlen = sizeof (ovm_topk_t);
+    break ;
+  default:
+    return (NULL);
+  }
+  if (len < hlen
+      || fread((char *)&hdr + 2 * sizeof (uint32_t),
+               hlen - 2 * sizeof (uint32_t), 1, fp) != 1
+      || sketch_header_len(OVM_VAR(&hdr)) != len)
+    return (NULL);
+
+  var = Xmalloc(len);
+  memcpy(var, &hdr, hlen);
+  if (len > hlen && fread((char *)var + hlen, len - hlen, 1, fp) != 1) {
+    Xfree(var);
+    return (NULL);
+  }
+
+  /* Top-k index slots are heap positions + 1 */
+  if (TYPE(var) == T_TOPK) {
+    slots = TOPK_SLOTS(TOPK(var));
+    for (i = 0; i <= TOPK_MASK(TOPK(var)); i++)
+      if (slots[i] > TOPK(var)->n) {
+        Xfree(var);
+        return (NULL);
+      }
+  }
+  FLAGS(var) = 0;
+
+  return (var);
+}
+
+
+void
+fprintf_sketch(FILE *fp, ovm_var_t *var)
+{
+  topk_entry_t *s;
+  ovm_var_t *v;
+  uint32_t i;
+
+  switch (TYPE(var)) {
+  case T_HLL:
+    fprintf(fp, "hll[%u]: ~%li distinct values\n",
+            HLL(var)->precision, hll_estimate(HLL(var)));
+    break ;
+
+  case T_CMS:
+    fprintf(fp, "cms[%ux%u]: %llu\n", CMS(var)->width, CMS(var)->depth,
+            (unsigned long long)CMS(var)->total);
+    break ;
+
+  case T_TOPK:
+    fprintf(fp, "topk[%u]: %llu\n", TOPK(var)->k,
+            (unsigned long long)TOPK(var)->total);
+    s = topk_sorted(TOPK(var));
+    for (i = 0; i < TOPK(var)->n; i++) {
+      fprintf(fp, "  %3u: %llu (+/- %llu) ", i + 1,
+              (unsigned long long)s[i].count,
+              (unsigned long long)s[i].error);
+      v = topk_entry_value(&s[i]);
+      fprintf_issdl_val(fp, v);
+      issdl_free(v);
+    }
+    Xfree(s);
+    break ;
+  }
+}
+
+
+/*
+** ISSDL functions
+*/
+
+/**
+ ** Find or create the shared sketch of a rule.  Returns NULL and sets
+ ** *shared to FALSE if the name is empty (private sketch).
+ **/
+static ovm_var_t *
+get_shared_sketch(orchids_t *ctx, state_instance_t *state,
+                  ovm_var_t *name, bool_t *shared, char *buf)
+{
+  size_t len;
+
+  *shared = FALSE;
+  if (TYPE(name) != T_STR && TYPE(name) != T_VSTR)
+    return (NULL);
+  len = issdl_get_data_len(name);
+  if (len == 0)
+    return (NULL);
+
+  *shared = TRUE;
+  snprintf(buf, SKETCH_NAME_SZ, "%s/%.*s", state->state->rule->name,
+           (int)len, (char *)issdl_get_data(name));
+
+  return (strhash_get(ctx->sketches, buf));
+}
+
+
+/**
+ ** Return a new private sketch, or register it as a shared sketch
+ ** (never freed).
+ **/
+static void
+push_new_sketch(orchids_t *ctx, ovm_var_t *sk, bool_t shared, char *name)
+{
+  if (shared) {
+    FLAGS(sk) = 0;
+    strhash_add(ctx->sketches, sk, Xstrdup(name));
+    DebugLog(DF_ENG, DS_INFO, "new shared %s sketch %s (%zu bytes)\n",
+             STRTYPE(sk), name, sketch_get_data_len(sk));
+  }
+  else
+    FLAGS(sk) |= TYPE_CANFREE | TYPE_NOTBOUND;
+
+  stack_push(ctx->ovm_stack, sk);
+}
+
+
+static void
+push_int(orchids_t *ctx, long v)
+{
+  ovm_var_t *res;
+
+  res = ovm_int_new();
+  INT(res) = v;
+  FLAGS(res) |= TYPE_CANFREE | TYPE_NOTBOUND;
+  stack_push(ctx->ovm_stack, res);
+}
+
+
+static void
+issdl_hll_new(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *name, *precision;
+  ovm_var_t *sk;
+  char buf[SKETCH_NAME_SZ];
+  bool_t shared;
+  int p;
+
+  name = stack_pop(ctx->ovm_stack);
+  precision = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(name) || IS_NULL(precision) || TYPE(precision) != T_INT) {
+    DebugLog(DF_ENG, DS_ERROR, "hll_new(name, precision): parameter error\n");
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  }
+  else if ((sk = get_shared_sketch(ctx, state, name, &shared, buf)))
+    stack_push(ctx->ovm_stack, sk);
+  else {
+    p = INT(precision) ? INT(precision) : ctx->hll_precision;
+    if (p < HLL_MIN_PRECISION || p > HLL_MAX_PRECISION) {
+      DebugLog(DF_ENG, DS_ERROR, "hll_new(): precision must be in [%i, %i]\n",
+               HLL_MIN_PRECISION, HLL_MAX_PRECISION);
+      ISSDL_RETURN_PARAM_ERROR(ctx, state);
+    }
+    else
+      push_new_sketch(ctx, ovm_hll_new(p), shared, buf);
+  }
+
+  FREE_IF_NEEDED(name);
+  FREE_IF_NEEDED(precision);
+}
+
+
+static void
+issdl_hll_add(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *h, *val;
+
+  h = stack_pop(ctx->ovm_stack);
+  val = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(h) || TYPE(h) != T_HLL || IS_NULL(val))
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else {
+    hll_add_hash(HLL(h), sketch_hash(val));
+    push_int(ctx, hll_estimate(HLL(h)));
+  }
+
+  FREE_IF_NEEDED(h);
+  FREE_IF_NEEDED(val);
+}
+
+
+static void
+issdl_hll_count(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *h;
+
+  h = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(h) || TYPE(h) != T_HLL)
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else
+    push_int(ctx, hll_estimate(HLL(h)));
+
+  FREE_IF_NEEDED(h);
+}
+
+
+static void
+issdl_cms_new(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *name, *width, *depth;
+  ovm_var_t *sk;
+  char buf[SKETCH_NAME_SZ];
+  bool_t shared;
+  long w;
+  long d;
+
+  name = stack_pop(ctx->ovm_stack);
+  width = stack_pop(ctx->ovm_stack);
+  depth = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(name) || IS_NULL(width) || TYPE(width) != T_INT
+      || IS_NULL(depth) || TYPE(depth) != T_INT) {
+    DebugLog(DF_ENG, DS_ERROR,
+             "cms_new(name, width, depth): parameter error\n");
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  }
+  else if ((sk = get_shared_sketch(ctx, state, name, &shared, buf)))
+    stack_push(ctx->ovm_stack, sk);
+  else {
+    w = INT(width) ? INT(width) : ctx->cms_width;
+    d = INT(depth) ? INT(depth) : ctx->cms_depth;
+    if (w <= 0 || d <= 0 || w * d > CMS_MAX_COUNTERS) {
+      DebugLog(DF_ENG, DS_ERROR,
+               "cms_new(): width x depth must be in [1, %i]\n",
+               CMS_MAX_COUNTERS);
+      ISSDL_RETURN_PARAM_ERROR(ctx, state);
+    }
+    else
+      push_new_sketch(ctx, ovm_cms_new(w, d), shared, buf);
+  }
+
+  FREE_IF_NEEDED(name);
+  FREE_IF_NEEDED(width);
+  FREE_IF_NEEDED(depth);
+}
+
+
+static void
+issdl_cms_add(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *c, *val, *amount;
+
+  c = stack_pop(ctx->ovm_stack);
+  val = stack_pop(ctx->ovm_stack);
+  amount = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(c) || TYPE(c) != T_CMS || IS_NULL(val)
+      || IS_NULL(amount) || TYPE(amount) != T_INT || INT(amount) < 0)
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else
+    push_int(ctx, cms_add_hash(CMS(c), sketch_hash(val), INT(amount)));
+
+  FREE_IF_NEEDED(c);
+  FREE_IF_NEEDED(val);
+  FREE_IF_NEEDED(amount);
+}
+
+
+static void
+issdl_cms_count(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *c, *val;
+
+  c = stack_pop(ctx->ovm_stack);
+  val = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(c) || TYPE(c) != T_CMS || IS_NULL(val))
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else
+    push_int(ctx, cms_estimate(CMS(c), sketch_hash(val)));
+
+  FREE_IF_NEEDED(c);
+  FREE_IF_NEEDED(val);
+}
+
+
+static void
+issdl_topk_new(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *name, *size;
+  ovm_var_t *sk;
+  char buf[SKETCH_NAME_SZ];
+  bool_t shared;
+  long k;
+
+  name = stack_pop(ctx->ovm_stack);
+  size = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(name) || IS_NULL(size) || TYPE(size) != T_INT) {
+    DebugLog(DF_ENG, DS_ERROR, "topk_new(name, k): parameter error\n");
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  }
+  else if ((sk = get_shared_sketch(ctx, state, name, &shared, buf)))
+    stack_push(ctx->ovm_stack, sk);
+  else {
+    k = INT(size) ? INT(size) : ctx->topk_size;
+    if (k <= 0 || k > TOPK_MAX_SIZE) {
+      DebugLog(DF_ENG, DS_ERROR, "topk_new(): k must be in [1, %i]\n",
+               TOPK_MAX_SIZE);
+      ISSDL_RETURN_PARAM_ERROR(ctx, state);
+    }
+    else
+      push_new_sketch(ctx, ovm_topk_new(k), shared, buf);
+  }
+
+  FREE_IF_NEEDED(name);
+  FREE_IF_NEEDED(size);
+}
+
+
+static void
+issdl_topk_add(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *t, *val;
+
+  t = stack_pop(ctx->ovm_stack);
+  val = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(t) || TYPE(t) != T_TOPK || IS_NULL(val))
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else
+    push_int(ctx, topk_add_value(TOPK(t), val, 1));
+
+  FREE_IF_NEEDED(t);
+  FREE_IF_NEEDED(val);
+}
+
+
+/**
+ ** Rank of a value among the monitored values of a top-k sketch (1
+ ** for the most frequent), or 0 if it isn't monitored.
+ **/
+static void
+issdl_topk_rank(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *t, *val;
+  uint64_t count;
+  uint32_t rank;
+  uint32_t i;
+  int slot;
+
+  t = stack_pop(ctx->ovm_stack);
+  val = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(t) || TYPE(t) != T_TOPK || IS_NULL(val))
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else {
+    rank = 0;
+    slot = topk_find(TOPK(t), sketch_hash(val));
+    if (slot >= 0) {
+      count = TOPK(t)->heap[ TOPK_SLOTS(TOPK(t))[slot] - 1 ].count;
+      rank = 1;
+      for (i = 0; i < TOPK(t)->n; i++)
+        if (TOPK(t)->heap[i].count > count)
+          rank++;
+    }
+    push_int(ctx, rank);
+  }
+
+  FREE_IF_NEEDED(t);
+  FREE_IF_NEEDED(val);
+}
+
+
+/**
+ ** Value of a given rank in a top-k sketch (1 for the most frequent).
+ **/
+static void
+issdl_topk_value(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *t, *rank;
+  ovm_var_t *res;
+  topk_entry_t *s;
+
+  t = stack_pop(ctx->ovm_stack);
+  rank = stack_pop(ctx->ovm_stack);
+
+  if (IS_NULL(t) || TYPE(t) != T_TOPK || IS_NULL(rank)
+      || TYPE(rank) != T_INT || INT(rank) <= 0
+      || INT(rank) > TOPK(t)->n)
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else {
+    s = topk_sorted(TOPK(t));
+    res = topk_entry_value(&s[ INT(rank) - 1 ]);
+    Xfree(s);
+    FLAGS(res) |= TYPE_CANFREE | TYPE_NOTBOUND;
+    stack_push(ctx->ovm_stack, res);
+  }
+
+  FREE_IF_NEEDED(t);
+  FREE_IF_NEEDED(rank);
+}
+
+
+static void
+issdl_sketch_merge(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *s1, *s2;
+  ovm_var_t *res;
+
+  s1 = stack_pop(ctx->ovm_stack);
+  s2 = stack_pop(ctx->ovm_stack);
+
+  res = NULL;
+  if (!IS_NULL(s1) && !IS_NULL(s2))
+    res = sketch_merge(s1, s2);
+  if (res)
+    stack_push(ctx->ovm_stack, res);
+  else {
+    DebugLog(DF_ENG, DS_ERROR,
+             "sketch_merge(): sketches of different types or sizes\n");
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  }
+
+  FREE_IF_NEEDED(s1);
+  FREE_IF_NEEDED(s2);
+}
+
+
+void
+register_sketch_functions(orchids_t *ctx)
+{
+  register_lang_function(ctx, issdl_hll_new, "hll_new", 2,
+                         "create a HyperLogLog sketch (distinct count)");
+  register_lang_function(ctx, issdl_hll_add, "hll_add", 2,
+                         "add a value to a HyperLogLog sketch");
+  register_lang_function(ctx, issdl_hll_count, "hll_count", 1,
+                         "estimate the number of distinct values");
+  register_lang_function(ctx, issdl_cms_new, "cms_new", 3,
+                         "create a Count-Min sketch (frequencies)");
+  register_lang_function(ctx, issdl_cms_add, "cms_add", 3,
+                         "add an amount to the frequency of a value");
+  register_lang_function(ctx, issdl_cms_count, "cms_count", 2,
+                         "estimate the frequency of a value");
+  register_lang_function(ctx, issdl_topk_new, "topk_new", 2,
+                         "create a top-k sketch (heavy hitters)");
+  register_lang_function(ctx, issdl_topk_add, "topk_add", 2,
+                         "add a value to a top-k sketch");
+  register_lang_function(ctx, issdl_topk_rank, "topk_rank", 2,
+                         "rank of a value in a top-k sketch");
+  register_lang_function(ctx, issdl_topk_value, "topk_value", 2,
+                         "value of a given rank in a top-k sketch");
+  register_lang_function(ctx, issdl_sketch_merge, "sketch_merge", 2,
+                         "merge two sketches");
+}
@@ -0,0 +1,166 @@
+/**
+ ** @file sketch.h
+ ** Public definitions for sketch.c
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdio.h>
+
+#include "orchids.h"
+#include "lang.h"
+
+/** Smallest HyperLogLog precision (16 registers, 26% error). */
+#define HLL_MIN_PRECISION 4
+/** Largest HyperLogLog precision (65536 registers, 0.4% error). */
+#define HLL_MAX_PRECISION 16
+/** Largest number of counters of a Count-Min sketch. */
+#define CMS_MAX_COUNTERS  (1 << 24)
+/** Largest size of a top-k sketch. */
+#define TOPK_MAX_SIZE     4096
+/** Size of the buffer for shared sketch names (rule name/sketch name). */
+#define SKETCH_NAME_SZ    256
+
+
+/**
+ ** Create a HyperLogLog sketch.
+ ** @param precision Number of index bits, between HLL_MIN_PRECISION
+ **   and HLL_MAX_PRECISION.
+ ** @return A new T_HLL value.
+ **/
+ovm_var_t *
+ovm_hll_new(int precision);
+
+
+/**
+ ** Create a Count-Min sketch.
+ ** @param width Number of counters per row.
+ ** @param depth Number of rows.
+ ** @return A new T_CMS value.
+ **/
+ovm_var_t *
+ovm_cms_new(int width, int depth);
+
+
+/**
+ ** Create a top-k sketch.
+ ** @param k Number of monitored values.
+ ** @return A new T_TOPK value.
+ **/
+ovm_var_t *
+ovm_topk_new(int k);
+
+
+/**
+ ** Binary data accessor of sketches (the whole sketch).
+ **/
+void *
+sketch_get_data(ovm_var_t *var);
+
+
+/**
+ ** Size of a sketch, in bytes.
+ **/
+size_t
+sketch_get_data_len(ovm_var_t *var);
+
+
+/**
+ ** Merge two sketches of the same type and dimensions (the '+'
+ ** operator on sketches).
+ ** @return A new sketch, or NULL if the sketches can't be merged.
+ **/
+ovm_var_t *
+sketch_merge(ovm_var_t *var1, ovm_var_t *var2);
+
+
+/**
+ ** Copy a sketch.
+ **/
+ovm_var_t *
+sketch_clone(ovm_var_t *var);
+
+
+/**
+ ** Write a sketch (for engine checkpoints).
+ ** @return 0 on success, -1 on error.
+ **/
+int
+sketch_save(FILE *fp, ovm_var_t *var);
+
+
+/**
+ ** Read a sketch written by sketch_save().
+ ** @return The sketch, or NULL on error.
+ **/
+ovm_var_t *
+sketch_restore(FILE *fp);
+
+
+/**
+ ** Print a summary of a sketch: estimate, or heavy hitters.
+ **/
+void
+fprintf_sketch(FILE *fp, ovm_var_t *var);
+
+
+/**
+ ** Register the sketch functions of the ISSDL language:
+ **   hll_new(name, precision), hll_add(hll, value), hll_count(hll),
+ **   cms_new(name, width, depth), cms_add(cms, value, amount),
+ **   cms_count(cms, value), topk_new(name, k), topk_add(topk, value),
+ **   topk_rank(topk, value), topk_value(topk, rank) and
+ **   sketch_merge(sketch1, sketch2).
+ **
+ ** @param ctx Orchids application context.
+ **/
+void
+register_sketch_functions(orchids_t *ctx);
+
+
+#endif /* SKETCH_H */
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
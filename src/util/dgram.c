@@ -0,0 +1,212 @@
+/**
+ ** @file dgram.c
+ ** Batched datagram reception: a burst of datagrams is read with one
+ ** system call (recvmmsg()) into preallocated buffers, instead of one
+ ** select() round trip and one recvfrom() per datagram.
+ **
+ ** @version 0.1
+ ** @ingroup util
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* for recvmmsg() */
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "safelib.h"
+#include "debuglog.h"
+
+#include "dgram.h"
+
+/* Room for the SO_RXQ_OVFL counter */
+#define DGRAM_CTRL_SIZE 32
+
+
+dgram_ring_t *
+dgram_ring_new(int slots)
+{
+  dgram_ring_t *ring;
+  int i;
+
+  if (slots < 1)
+    slots = 1;
+  ring = Xzmalloc(sizeof (dgram_ring_t));
+  ring->slots = slots;
+  ring->dgram = Xzmalloc(slots * sizeof (dgram_t));
+  ring->data = Xmalloc(slots * DGRAM_MAX_SIZE);
+  ring->iov = Xzmalloc(slots * sizeof (struct iovec));
+  ring->ctrl = Xzmalloc(slots * DGRAM_CTRL_SIZE);
+  for (i = 0; i < slots; i++) {
+    ring->dgram[i].buf = ring->data + i * DGRAM_MAX_SIZE;
+    ring->iov[i].iov_base = ring->dgram[i].buf;
+    ring->iov[i].iov_len = DGRAM_MAX_SIZE;
+  }
+#ifdef HAVE_RECVMMSG
+  ring->msgs = Xzmalloc(slots * sizeof (struct mmsghdr));
+#endif
+
+  return (ring);
+}
+
+
+void
+dgram_ring_free(dgram_ring_t *ring)
+{
+#ifdef HAVE_RECVMMSG
+  Xfree(ring->msgs);
+#endif
+  Xfree(ring->ctrl);
+  Xfree(ring->iov);
+  Xfree(ring->data);
+  Xfree(ring->dgram);
+  Xfree(ring);
+}
+
+
+void
+dgram_socket_setup(int fd, int rcvbuf)
+{
+  int on = 1;
+
+  if (rcvbuf > 0
+      && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof (rcvbuf)))
+    DebugLog(DF_MOD, DS_WARN, "setsockopt(SO_RCVBUF, %i): %s\n",
+             rcvbuf, strerror(errno));
+#ifdef SO_RXQ_OVFL
+  if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof (on)))
+    DebugLog(DF_MOD, DS_INFO, "setsockopt(SO_RXQ_OVFL): %s\n",
+             strerror(errno));
+#else
+  (void) on;
+#endif
+}
+
+
+/* Get the kernel drop counter from the ancillary data of a message */
+static void
+dgram_drops(struct msghdr *msg, uint32_t *drops)
+{
+#ifdef SO_RXQ_OVFL
+  struct cmsghdr *cmsg;
+
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+      memcpy(drops, CMSG_DATA(cmsg), sizeof (uint32_t));
+#endif
+}
+
+
+static void
+dgram_init_msg(dgram_ring_t *ring, int i, struct msghdr *msg)
+{
+  memset(msg, 0, sizeof (*msg));
+  msg->msg_name = &ring->dgram[i].from;
+  msg->msg_namelen = sizeof (ring->dgram[i].from);
+  msg->msg_iov = &ring->iov[i];
+  msg->msg_iovlen = 1;
+  msg->msg_control = ring->ctrl + i * DGRAM_CTRL_SIZE;
+  msg->msg_controllen = DGRAM_CTRL_SIZE;
+}
+
+
+int
+dgram_recv(dgram_ring_t *ring, int fd, uint32_t *drops)
+{
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr *msgs = ring->msgs;
+  int i;
+  int n;
+
+  for (i = 0; i < ring->slots; i++)
+    dgram_init_msg(ring, i, &msgs[i].msg_hdr);
+
+  do
+    n = recvmmsg(fd, msgs, ring->slots, MSG_DONTWAIT, NULL);
+  while (n < 0 && errno == EINTR);
+  if (n < 0)
+    return (errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1);
+
+  for (i = 0; i < n; i++) {
+    ring->dgram[i].len = msgs[i].msg_len;
+    ring->dgram[i].fromlen = msgs[i].msg_hdr.msg_namelen;
+    dgram_drops(&msgs[i].msg_hdr, drops);
+  }
+
+  return (n);
+#else
+  struct msghdr msg;
+  ssize_t len;
+  int n;
+
+  for (n = 0; n < ring->slots; n++) {
+    dgram_init_msg(ring, n, &msg);
+    len = recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (len < 0 && errno == EINTR) {
+      n--;
+      continue ;
+    }
+    if (len < 0) {
+      if (n > 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+        break ;
+      return (-1);
+    }
+    ring->dgram[n].len = len;
+    ring->dgram[n].fromlen = msg.msg_namelen;
+    dgram_drops(&msg, drops);
+  }
+
+  return (n);
+#endif
+}
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
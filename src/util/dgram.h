@@ -0,0 +1,162 @@
+/**
+ ** @file dgram.h
+ ** Batched datagram reception.
+ **
+ ** @version 0.1
+ ** @ingroup util
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef DGRAM_H
+#define DGRAM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/** Default number of datagrams read per wakeup. */
+#define DGRAM_DEFAULT_BATCH 32
+/** Max size of a datagram; longer ones are truncated. */
+#define DGRAM_MAX_SIZE      8192
+
+/**
+ ** @struct dgram_s
+ **   A received datagram.
+ **/
+/**   @var dgram_s::buf
+ **     Datagram data, in the receive ring.
+ **/
+/**   @var dgram_s::len
+ **     Datagram length.
+ **/
+/**   @var dgram_s::from
+ **     Source address.
+ **/
+/**   @var dgram_s::fromlen
+ **     Length of the source address.
+ **/
+typedef struct dgram_s dgram_t;
+struct dgram_s {
+  char                    *buf;
+  size_t                   len;
+  struct sockaddr_storage  from;
+  socklen_t                fromlen;
+};
+
+/**
+ ** @struct dgram_ring_s
+ **   Preallocated buffers for the datagrams read by one call to
+ **   dgram_recv().  The buffers are reused by the next call: the
+ **   caller copies what it keeps.
+ **/
+/**   @var dgram_ring_s::slots
+ **     Max number of datagrams read per call.
+ **/
+/**   @var dgram_ring_s::dgram
+ **     The datagrams.
+ **/
+/**   @var dgram_ring_s::data
+ **     Datagram buffers, DGRAM_MAX_SIZE bytes each.
+ **/
+/**   @var dgram_ring_s::msgs
+ **     Message headers for recvmmsg().
+ **/
+/**   @var dgram_ring_s::iov
+ **     One iovec per datagram buffer.
+ **/
+/**   @var dgram_ring_s::ctrl
+ **     Ancillary data buffers (kernel drop counters).
+ **/
+typedef struct dgram_ring_s dgram_ring_t;
+struct dgram_ring_s {
+  int              slots;
+  dgram_t         *dgram;
+  char            *data;
+  void            *msgs;
+  struct iovec    *iov;
+  char            *ctrl;
+};
+
+
+/**
+ ** Allocate a receive ring.
+ ** @param slots Max number of datagrams read at once.
+ ** @return A new receive ring.
+ **/
+dgram_ring_t *
+dgram_ring_new(int slots);
+
+
+/**
+ ** Free a receive ring.
+ ** @param ring The receive ring.
+ **/
+void
+dgram_ring_free(dgram_ring_t *ring);
+
+
+/**
+ ** Set the receive buffer size of a datagram socket, and ask the
+ ** kernel for the number of datagrams it dropped (SO_RXQ_OVFL).
+ ** @param fd     The socket.
+ ** @param rcvbuf Receive buffer size in bytes, 0 to keep the default.
+ **/
+void
+dgram_socket_setup(int fd, int rcvbuf);
+
+
+/**
+ ** Read the pending datagrams of a socket, up to the number of slots
+ ** of the ring, without blocking: one recvmmsg() call where
+ ** available, else a loop of recvfrom().
+ ** @param ring  The receive ring; the datagrams are ring->dgram[0..].
+ ** @param fd    The socket.
+ ** @param drops In: last value of the kernel drop counter of the
+ **   socket.  Out: its current value.
+ ** @return The number of datagrams read, or -1 on error.
+ **/
+int
+dgram_recv(dgram_ring_t *ring, int fd, uint32_t *drops);
+
+
+#endif /* DGRAM_H */
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -21,46 +21,62 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "safelib.h"
 
 #include "hash.h"
 
 
+static int
+hash_keycmp(void *cmpdata, ohash_slot_t *slot, void *key, size_t keylen)
+{
+  return (keylen != slot->keylen || memcmp(key, slot->key, keylen));
+}
+
+
 hash_t *
 new_hash(size_t hsize)
 {
   hash_t *h;
 
   h = Xmalloc(sizeof (hash_t));
-  h->size = hsize;
-  h->elmts = 0;
   h->hash = DEFAULT_HASH_FUNCTION;
-  h->htable = Xzmalloc(hsize * sizeof (hash_elmt_t *));
+  ohash_init(&h->tbl, hsize, hash_keycmp, h);
 
   return (h);
 }
 
 
+static int
+hash_free_slot(ohash_slot_t *slot, void *data)
+{
+  void (*elmt_free)(void *e) = data;
+
+  elmt_free(slot->data);
+
+  return (0);
+}
+
+
 void
 clear_hash(hash_t *hash, void (*elmt_free)(void *e))
 {
-  int i;
-  hash_elmt_t *tmp;
-  hash_elmt_t *tmp_next;
-
-  for (i = 0; i < hash->size; i++) {
-    tmp = hash->htable[i];
-    while (tmp) {
-      tmp_next = tmp->next;
-      if (elmt_free)
-        elmt_free(tmp->data);
-      Xfree(tmp);
-      tmp = tmp_next;
-    }
-  }
-  hash->elmts = 0;
-  memset(hash->htable, 0, hash->size * sizeof (void *));
+  if (elmt_free)
+    ohash_walk(&hash->tbl, hash_free_slot, elmt_free);
+  ohash_clear(&hash->tbl);
+}
+
+
+static int
+hash_array_slot(ohash_slot_t *slot, void *data)
+{
+  void ***array = data;
+
+  **array = slot->data;
+  (*array)++;
+
+  return (0);
 }
 
 
@@ -68,22 +84,11 @@ void *
 hash_to_array(hash_t *hash)
 {
   void **array;
-  hash_elmt_t *helmt;
-  int elmts;
-  int i;
-  int hsize;
-  int j;
+  void **cur;
 
-  hsize = hash->size;
-  elmts = hash->elmts;
-  array = Xmalloc(elmts * sizeof (void *));
-  j = 0;
-  for (i = 0; i < hsize; i++) {
-    for (helmt = hash->htable[i]; helmt; helmt = helmt->next) {
-      array[j] = helmt->data;
-      j++;
-    }
-  }
+  array = Xmalloc(hash->tbl.elmts * sizeof (void *));
+  cur = array;
+  ohash_walk(&hash->tbl, hash_array_slot, &cur);
 
   return (array);
 }
@@ -92,22 +97,9 @@ hash_to_array(hash_t *hash)
 void
 free_hash(hash_t *hash, void (*elmt_free)(void *e))
 {
-  int i;
-  hash_elmt_t *tmp;
-  hash_elmt_t *tmp_next;
-
-  for (i = 0; i < hash->size; i++) {
-    tmp = hash->htable[i];
-    while (tmp) {
-      tmp_next = tmp->next;
-      if (elmt_free)
-        elmt_free(tmp->data);
-      Xfree(tmp);
-      tmp = tmp_next;
-    }
-  }
-
-  Xfree(hash->htable);
+  if (elmt_free)
+    ohash_walk(&hash->tbl, hash_free_slot, elmt_free);
+  ohash_destroy(&hash->tbl);
   Xfree(hash);
 }
 
@@ -115,68 +107,30 @@ free_hash(hash_t *hash, void (*elmt_free)(void *e))
 void
 hash_resize(hash_t *hash, size_t newsize)
 {
-  hash_elmt_t **old_htable;
-  int i;
-
-  old_htable = hash->htable;
-  hash->htable = Xzmalloc(newsize * sizeof (hash_elmt_t *));
-
-  for (i = 0; i < hash->size; ++i) {
-    hash_elmt_t *tmp;
-
-    for (tmp = old_htable[i]; tmp; tmp = tmp->next) {
-      hcode_t hcode;
-
-      hcode = hash->hash(tmp->key, tmp->keylen) % newsize;
-      tmp->next = hash->htable[hcode];
-      hash->htable[hcode] = tmp;
-    }
-  }
-
-  Xfree(old_htable);
-  hash->size = newsize;
+  ohash_resize(&hash->tbl, newsize);
 }
 
 
 void
 hash_add(hash_t *hash, void *data, void *key, size_t keylen)
 {
-  hash_elmt_t *elmt;
-  hcode_t hcode;
-
-  elmt = Xmalloc(sizeof (hash_elmt_t));
-  elmt->key = (hkey_t *) key;
-  elmt->keylen = keylen;
-  elmt->data = data;
-
-  hcode = hash->hash((hkey_t *) key, keylen) % hash->size;
-  elmt->next = hash->htable[hcode];
-  hash->htable[hcode] = elmt;
-  hash->elmts++;
+  ohash_insert(&hash->tbl, hash->hash((hkey_t *) key, keylen),
+               key, keylen, data);
 }
 
 
 void *
 hash_check_and_add(hash_t *hash, void *data, void *key, size_t keylen)
 {
-  hash_elmt_t *elmt;
+  ohash_slot_t *slot;
   hcode_t hcode;
 
-  elmt = hash->htable[hash->hash((hkey_t *)key, keylen) % hash->size];
-  for (; elmt; elmt = elmt->next) {
-    if (keylen == elmt->keylen && !memcmp(key, elmt->key, keylen))
-      return (elmt->data);
-  }
-
-  elmt = Xmalloc(sizeof (hash_elmt_t));
-  elmt->key = (hkey_t *) key;
-  elmt->keylen = keylen;
-  elmt->data = data;
+  hcode = hash->hash((hkey_t *) key, keylen);
+  slot = ohash_lookup(&hash->tbl, hcode, key, keylen);
+  if (slot)
+    return (slot->data);
 
-  hcode = hash->hash((hkey_t *) key, keylen) % hash->size;
-  elmt->next = hash->htable[hcode];
-  hash->htable[hcode] = elmt;
-  hash->elmts++;
+  ohash_insert(&hash->tbl, hcode, key, keylen, data);
 
   return (NULL);
 }
@@ -185,17 +139,15 @@ hash_check_and_add(hash_t *hash, void *data, void *key, size_t keylen)
 void *
 hash_update(hash_t *hash, void *new_data, void *key, size_t keylen)
 {
-  hash_elmt_t *elmt;
+  ohash_slot_t *slot;
   void *old_data;
 
-  elmt = hash->htable[hash->hash(key, keylen) % hash->size];
-  for (; elmt; elmt = elmt->next) {
-    if (keylen == elmt->keylen && !memcmp(key, elmt->key, keylen)) {
-      old_data = elmt->data;
-      elmt->data = new_data;
+  slot = ohash_lookup(&hash->tbl, hash->hash(key, keylen), key, keylen);
+  if (slot) {
+    old_data = slot->data;
+    slot->data = new_data;
 
-      return (old_data);
-    }
+    return (old_data);
   }
 
   return (NULL);
@@ -205,29 +157,20 @@ hash_update(hash_t *hash, void *new_data, void *key, size_t keylen)
 void *
 hash_update_or_add(hash_t *hash, void *new_data, void *key, size_t keylen)
 {
-  hash_elmt_t *elmt;
+  ohash_slot_t *slot;
   void *old_data;
   hcode_t hcode;
 
-  elmt = hash->htable[hash->hash(key, keylen) % hash->size];
-  for (; elmt; elmt = elmt->next) {
-    if (keylen == elmt->keylen && !memcmp(key, elmt->key, keylen)) {
-      old_data = elmt->data;
-      elmt->data = new_data;
+  hcode = hash->hash(key, keylen);
+  slot = ohash_lookup(&hash->tbl, hcode, key, keylen);
+  if (slot) {
+    old_data = slot->data;
+    slot->data = new_data;
 
-      return (old_data);
-    }
+    return (old_data);
   }
 
-  elmt = Xmalloc(sizeof (hash_elmt_t));
-  elmt->key = key;
-  elmt->keylen = keylen;
-  elmt->data = new_data;
-
-  hcode = hash->hash(key, keylen) % hash->size;
-  elmt->next = hash->htable[hcode];
-  hash->htable[hcode] = elmt;
-  hash->elmts++;
+  ohash_insert(&hash->tbl, hcode, key, keylen, new_data);
 
   return (NULL);
 }
@@ -236,87 +179,100 @@ hash_update_or_add(hash_t *hash, void *new_data, void *key, size_t keylen)
 void *
 hash_del(hash_t *hash, void *key, size_t keylen)
 {
-  hash_elmt_t **head;
-  hash_elmt_t  *elmt;
-  hash_elmt_t  *prev;
-  void         *data;
-
-  prev = NULL;
-  head = &hash->htable[hash->hash(key, keylen) % hash->size];
-  for (elmt = *head; elmt; elmt = elmt->next) {
-    if (keylen == elmt->keylen && !memcmp(key, elmt->key, keylen)) {
-      data = elmt->data;
-      if (prev)
-        prev->next = elmt->next;
-      else
-        *head = elmt->next;
-      Xfree(elmt);
-
-      return (data);
-    }
-    prev = elmt;
-  }
-
-  return (NULL);
+  return (ohash_remove(&hash->tbl, hash->hash(key, keylen), key, keylen));
 }
 
 
 void *
 hash_get(hash_t *hash, void *key, size_t keylen)
 {
-  hash_elmt_t *elmt;
+  ohash_slot_t *slot;
 
-  elmt = hash->htable[hash->hash((hkey_t *)key, keylen) % hash->size];
-  for (; elmt; elmt = elmt->next) {
-    if (keylen == elmt->keylen && !memcmp(key, elmt->key, keylen))
-      return (elmt->data);
-  }
+  slot = ohash_lookup(&hash->tbl, hash->hash((hkey_t *)key, keylen),
+                      key, keylen);
 
-  return (NULL);
+  return (slot ? slot->data : NULL);
+}
+
+
+typedef struct hash_clone_s hash_clone_t;
+struct hash_clone_s
+{
+  hash_t *dst;
+  void *(*clone)(void *elmt);
+};
+
+
+static int
+hash_clone_slot(ohash_slot_t *slot, void *data)
+{
+  hash_clone_t *hc = data;
+
+  /* reuse the stored hash code: no need to rehash the key */
+  ohash_insert(&hc->dst->tbl, slot->hcode, slot->key, slot->keylen,
+               hc->clone(slot->data));
+
+  return (0);
 }
 
 
 hash_t *
 hash_clone(hash_t *hash, void *(clone)(void *elmt))
 {
-  hash_t *h;
-  hash_elmt_t *tmp;
-  int i;
-  int hsize;
-  void *data;
- 
+  hash_clone_t hc;
+
   if (clone == NULL)
     return (NULL);
 
-  hsize = hash->size;
-  h = new_hash(hsize);
-  for (i = 0; i < hsize; i++) {
-    for (tmp = hash->htable[i]; tmp; tmp = tmp->next) {
-      data = clone(tmp->data);
-      hash_add(h, data, tmp->key, tmp->keylen);
-    }
-  }
+  hc.dst = new_hash(hash->tbl.size);
+  hc.dst->hash = hash->hash;
+  hc.clone = clone;
+  ohash_walk(&hash->tbl, hash_clone_slot, &hc);
 
-  return (h);
+  return (hc.dst);
+}
+
+
+typedef struct hash_walk_s hash_walk_t;
+struct hash_walk_s
+{
+  hash_walk_func_t func;
+  void *data;
+};
+
+
+static int
+hash_walk_slot(ohash_slot_t *slot, void *data)
+{
+  hash_walk_t *hw = data;
+
+  return (hw->func(slot->data, hw->data));
 }
 
 
 int
 hash_walk(hash_t *hash, hash_walk_func_t func, void *data)
 {
-  int   i;
+  hash_walk_t hw;
 
-  for (i = 0; i < hash->size; i++) {
-    hash_elmt_t *tmp;
-    int status;
+  hw.func = func;
+  hw.data = data;
 
-    for (tmp = hash->htable[i]; tmp; tmp = tmp->next) {
-      if ((status = func(tmp->data, data)) != 0)
-        return (status);
-    }
-  }
+  return (ohash_walk(&hash->tbl, hash_walk_slot, &hw));
+}
 
-  return (0);
+
+int
+hash_elmts(hash_t *hash)
+{
+  return (hash->tbl.elmts);
+}
+
+
+void
+hash_get_stats(hash_t *hash, ohash_stats_t *stats)
+{
+  ohash_get_stats(&hash->tbl, stats);
 }
 
 
@@ -899,24 +855,62 @@ hash_kazlib(hkey_t *key, size_t keylen)
 }
 
 
-int
-hash_collide_count(hash_t *hash)
-{
-  int   count;
-  int   i;
-
-  count = 0;
-  for (i = 0; i < hash->size; i++) {
-    hash_elmt_t *tmp;
+/* MurmurHash64A, by Austin Appleby (public domain).  Processes the
+   key 8 bytes at a time, and the final avalanche makes every output
+   bit depend on every input bit, which is what power-of-two open
+   addressing tables need.  Default hash function. */
+hcode_t
+hash_mm64_seed(hcode_t seed, hkey_t *key, size_t keylen)
+{
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  uint64_t h;
+  uint64_t k;
+  const hkey_t *end;
+
+  h = (uint64_t)seed ^ (keylen * m);
+  end = key + (keylen & ~(size_t)7);
+  for ( ; key != end; key += 8) {
+    memcpy(&k, key, sizeof (k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+
+  switch (keylen & 7) {
+  case 7: h ^= (uint64_t)key[6] << 48;
+    /* FALLTHROUGH */
+  case 6: h ^= (uint64_t)key[5] << 40;
+    /* FALLTHROUGH */
+  case 5: h ^= (uint64_t)key[4] << 32;
+    /* FALLTHROUGH */
+  case 4: h ^= (uint64_t)key[3] << 24;
+    /* FALLTHROUGH */
+  case 3: h ^= (uint64_t)key[2] << 16;
+    /* FALLTHROUGH */
+  case 2: h ^= (uint64_t)key[1] << 8;
+    /* FALLTHROUGH */
+  case 1: h ^= (uint64_t)key[0];
+    h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return ((hcode_t)h);
+}
 
-    for (tmp = hash->htable[i]; tmp; tmp = tmp->next)
-      if (tmp->next)
-        count++;
-  }
 
-  return (count);
+hcode_t
+hash_mm64(hkey_t *key, size_t keylen)
+{
+  return (hash_mm64_seed(0, key, keylen));
 }
 
+
 #if 0
 int
 print_elmt(void *elmt, void *dummy)
@@ -930,6 +924,7 @@ void
 hash_test(void)
 {
   hash_t *h;
+  ohash_stats_t stats;
   char buf[1024];
   int i;
 
@@ -941,16 +936,8 @@ hash_test(void)
   }
   hash_walk(h, print_elmt, NULL);
 
-  printf("collides : %i\n", hash_collide_count(h));
-}
-
-void
-fprintf_hash_info(FILE *fp, hash_t *h)
-{
-  fprintf(fp, "htable = %p\n", h->htable);
-  fprintf(fp, "size = %i\n", h->size);
-  fprintf(fp, "elmts = %i\n", h->elmts);
-  fprintf(fp, "hfunc = %p\n", h->hash);
+  hash_get_stats(h, &stats);
+  fprintf_ohash_stats(stdout, "hash_test", &stats);
 }
 
 #endif /* DEBUG */
@@ -17,30 +17,32 @@
 #ifndef HASH_H
 #define HASH_H
 
-#define DEFAULT_HASH_FUNCTION hash_djb
+#include "ohash.h"
+
+#define DEFAULT_HASH_FUNCTION hash_mm64
 
 /* key are arbitraty binary data (unsigned char) */
 typedef unsigned char hkey_t;
 
-typedef unsigned long hcode_t;
-
-typedef struct hash_elmt_s hash_elmt_t;
-struct hash_elmt_s
-{
-  hkey_t *key;
-  size_t keylen;
-  void *data;
-  hash_elmt_t *next;
-};
+typedef ohcode_t hcode_t;
 
 typedef hcode_t (*hashfunc_t)(hkey_t *key, size_t keylen);
 
+/**
+ ** @struct hash_s
+ **   Binary key hash table, stored in an open addressing table.
+ **   Keys are not copied.
+ **/
+/**   @var hash_s::tbl
+ **     The open addressing table.
+ **/
+/**   @var hash_s::hash
+ **     Hash function.
+ **/
 typedef struct hash_s hash_t;
 struct hash_s
 {
-  hash_elmt_t **htable;
-  size_t size;
-  int elmts;
+  ohash_t tbl;
   hashfunc_t hash;
 };
 
@@ -50,6 +52,7 @@ hash_t *new_hash(size_t hsize);
 void hash_resize(hash_t *hash, size_t newsize);
 void clear_hash(hash_t *hash, void (*elmt_free)(void *e));
 void free_hash(hash_t *hash, void (*elmt_free)(void *e));
+void *hash_to_array(hash_t *hash);
 void hash_add(hash_t *hash, void *data, void *key, size_t keylen);
 void *hash_check_and_add(hash_t *hash, void *data, void *key, size_t keylen);
 void *hash_del(hash_t *hash, void *key, size_t keylen);
@@ -58,8 +61,11 @@ void *hash_update(hash_t *hash, void *new_data, void *key, size_t keylen);
 void *hash_update_or_add(hash_t *hash, void *new_data, void *key, size_t keylen);
 hash_t *hash_clone(hash_t *hash, void *(clone)(void *elmt));
 int hash_walk(hash_t *hash, hash_walk_func_t func, void *data);
-int hash_collide_count(hash_t *hash);
+int hash_elmts(hash_t *hash);
+void hash_get_stats(hash_t *hash, ohash_stats_t *stats);
 
+hcode_t hash_mm64(hkey_t *key, size_t keylen);
+hcode_t hash_mm64_seed(hcode_t seed, hkey_t *key, size_t keylen);
 hcode_t hash_pjw(hkey_t *key, size_t keylen);
 hcode_t hash_pjw_typo(hkey_t *key, size_t keylen);
 hcode_t hash_pow(hkey_t *key, size_t keylen);
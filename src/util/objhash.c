@@ -24,8 +24,18 @@
 
 #include "safelib.h"
 
+#include "hash.h"
 #include "objhash.h"
 
+static int
+objhash_keycmp(void *cmpdata, ohash_slot_t *slot, void *key, size_t keylen)
+{
+  objhash_t *h = cmpdata;
+
+  return (h->cmp(key, slot->key));
+}
+
+
 /*
  * Default behaviour for hashing strings.
  */
@@ -35,120 +45,90 @@ new_objhash(size_t hsize)
   objhash_t *h;
 
   h = Xmalloc(sizeof (objhash_t));
-  h->size = hsize;
-  h->elmts = 0;
   h->hash = DEFAULT_OBJHASH_FUNCTION;
   h->cmp = DEFAULT_OBJCMP_FUNCTION;
-  h->htable = Xzmalloc(hsize * sizeof (objhash_elmt_t *));
+  ohash_init(&h->tbl, hsize, objhash_keycmp, h);
 
   return (h);
 }
 
 void
-objhash_resize(objhash_t *hash, size_t newsize)
+free_objhash(objhash_t *hash)
 {
-  objhash_elmt_t **old_htable;
-  int i;
-
-  /* XXX: Not tested !!! */
-  printf("Not tested !...\n");
-
-  old_htable = hash->htable;
-  hash->htable = Xzmalloc(newsize * sizeof (objhash_elmt_t *));
-
-  for (i = 0; i < hash->size; ++i)
-    {
-      objhash_elmt_t *tmp;
-
-      for (tmp = old_htable[i]; tmp; tmp = tmp->next)
-        {
-          unsigned long hcode;
-
-          hcode = hash->hash(tmp->key) % newsize;
-          tmp->next = hash->htable[hcode];
-          hash->htable[hcode] = tmp;
-        }
-    }
+  ohash_destroy(&hash->tbl);
+  Xfree(hash);
+}
 
-  Xfree(old_htable);
-  hash->size = newsize;
+void
+objhash_resize(objhash_t *hash, size_t newsize)
+{
+  ohash_resize(&hash->tbl, newsize);
 }
 
 void
 objhash_add(objhash_t *hash, void *data, void *key)
 {
-  objhash_elmt_t *elmt;
-  unsigned long hcode;
-
-  elmt = Xmalloc(sizeof (objhash_elmt_t));
-  elmt->key = key;
-  elmt->data = data;
-
-  hcode = hash->hash(key) % hash->size;
-  elmt->next = hash->htable[hcode];
-  hash->htable[hcode] = elmt;
-  hash->elmts++;
+  ohash_insert(&hash->tbl, hash->hash(key), key, 0, data);
 }
 
 void *
 objhash_del(objhash_t *hash, void *key)
 {
-  objhash_elmt_t **head;
-  objhash_elmt_t  *elmt;
-  objhash_elmt_t  *prev;
-  void            *data;
-
-  prev = NULL;
-  head = &hash->htable[hash->hash(key) % hash->size];
-  for (elmt = *head; elmt; elmt = elmt->next) {
-    if (!hash->cmp(key, elmt->key)) {
-      data = elmt->data;
-      if (prev)
-        prev->next = elmt->next;
-      else
-        *head = elmt->next;
-      Xfree(elmt);
-
-      return (data);
-    }
-    prev = elmt;
-  }
-
-  return (NULL);
+  return (ohash_remove(&hash->tbl, hash->hash(key), key, 0));
 }
 
 
 void *
 objhash_get(objhash_t *hash, void *key)
 {
-  objhash_elmt_t *elmt;
+  ohash_slot_t *slot;
 
-  elmt = hash->htable[hash->hash(key) % hash->size];
-  for (; elmt; elmt = elmt->next) {
-      if (!hash->cmp(key, elmt->key))
-        return (elmt->data);
-    }
+  slot = ohash_lookup(&hash->tbl, hash->hash(key), key, 0);
+
+  return (slot ? slot->data : NULL);
+}
+
+
+typedef struct objhash_walk_s objhash_walk_t;
+struct objhash_walk_s
+{
+  int (*func)(void *elmt, void *data);
+  void *data;
+};
+
+
+static int
+objhash_walk_slot(ohash_slot_t *slot, void *data)
+{
+  objhash_walk_t *hw = data;
 
-  return (NULL);
+  return (hw->func(slot->data, hw->data));
 }
 
+
 int
 objhash_walk(objhash_t *hash, int (func)(void *elmt, void *data), void *data)
 {
-  int   i;
+  objhash_walk_t hw;
 
-  for (i = 0; i < hash->size; i++)
-    {
-      objhash_elmt_t *tmp;
-      int status;
-
-      for (tmp = hash->htable[i]; tmp; tmp = tmp->next)
-        {
-          if ((status = func(tmp->data, data)) != 0)
-            return (status);
-        }
-    }
-  return (0);
+  hw.func = func;
+  hw.data = data;
+
+  return (ohash_walk(&hash->tbl, objhash_walk_slot, &hw));
+}
+
+
+int
+objhash_elmts(objhash_t *hash)
+{
+  return (hash->tbl.elmts);
+}
+
+
+void
+objhash_get_stats(objhash_t *hash, ohash_stats_t *stats)
+{
+  ohash_get_stats(&hash->tbl, stats);
 }
 
 
@@ -156,6 +136,13 @@ objhash_walk(objhash_t *hash, int (func)(void *elmt, void *data), void *data)
 ** fast hash function samples
 */
 
+/* MurmurHash64A over a C string (see hash_mm64()) */
+unsigned long
+objhash_mm64(void *key)
+{
+  return (hash_mm64((hkey_t *)key, strlen(key)));
+}
+
 unsigned long
 objhash_pjw(void *key)
 {
@@ -181,25 +168,6 @@ objhash_cmp(void *obj1, void *obj2)
 }
 
 
-int
-objhash_collide_count(objhash_t *hash)
-{
-  int   count;
-  int   i;
-
-  count = 0;
-  for (i = 0; i < hash->size; i++)
-    {
-      objhash_elmt_t *tmp;
-
-      for (tmp = hash->htable[i]; tmp; tmp = tmp->next)
-        if (tmp->next)
-          count++;
-    }
-
-  return (count);
-}
-
 #if 0
 int
 print_elmt(void *elmt, void *dummy)
@@ -213,28 +181,20 @@ void
 objhash_test(void)
 {
   objhash_t *h;
+  ohash_stats_t stats;
   char buf[1024];
   int i;
 
   h = new_objhash(2053);
-  h->hash = hash_pow;
   for (i = 0; i < 1000; i++)
     {
       sprintf(buf, "%i", i * 65599);
-      objhash_add(h, (void *)(i * 65599), buf, strlen(buf));
+      objhash_add(h, (void *)(i * 65599), strdup(buf));
     }
   objhash_walk(h, print_elmt, NULL);
 
-  printf("collides : %i\n", objhash_collide_count(h));
-}
-
-void
-fprintf_objhash_info(FILE *fp, objhash_t *h)
-{
-  fprintf(fp, "htable = %p\n", h->htable);
-  fprintf(fp, "size = %i\n", h->size);
-  fprintf(fp, "elmts = %i\n", h->elmts);
-  fprintf(fp, "hfunc = %p\n", h->hash);
+  objhash_get_stats(h, &stats);
+  fprintf_ohash_stats(stdout, "objhash_test", &stats);
 }
 
 #endif /* DEBUG */
@@ -17,38 +17,48 @@
 #ifndef OBJHASH_H
 #define OBJHASH_H
 
-#define DEFAULT_OBJHASH_FUNCTION objhash_pjw
-#define DEFAULT_OBJCMP_FUNCTION objhash_cmp
+#include "ohash.h"
 
-typedef struct objhash_elmt_s objhash_elmt_t;
-struct objhash_elmt_s
-{
-  void *key;
-  void *data;
-  objhash_elmt_t *next;
-};
+#define DEFAULT_OBJHASH_FUNCTION objhash_mm64
+#define DEFAULT_OBJCMP_FUNCTION objhash_cmp
 
 typedef unsigned long (*objhashfunc_t)(void *key);
 typedef int (*objhashcmp_t)(void *obj1, void *obj2);
 
+/**
+ ** @struct objhash_s
+ **   Object hash table, stored in an open addressing table.
+ **   The hash and comparison functions may be changed before the
+ **   first insertion.
+ **/
+/**   @var objhash_s::tbl
+ **     The open addressing table.
+ **/
+/**   @var objhash_s::hash
+ **     Hash function.
+ **/
+/**   @var objhash_s::cmp
+ **     Key comparison function (returns 0 on equal keys).
+ **/
 typedef struct objhash_s objhash_t;
 struct objhash_s
 {
-  objhash_elmt_t **htable;
-  size_t size;
-  int elmts;
+  ohash_t tbl;
   objhashfunc_t hash;
   objhashcmp_t cmp;
 };
 
 objhash_t *new_objhash(size_t hsize);
+void free_objhash(objhash_t *hash);
 void objhash_resize(objhash_t *hash, size_t newsize);
 void objhash_add(objhash_t *hash, void *data, void *key);
 void *objhash_get(objhash_t *hash, void *key);
 void *objhash_del(objhash_t *hash, void *key);
 int objhash_walk(objhash_t *hash, int (func)(void *elmt, void *data), void *data);
-int objhash_collide_count(objhash_t *hash);
+int objhash_elmts(objhash_t *hash);
+void objhash_get_stats(objhash_t *hash, ohash_stats_t *stats);
 
+unsigned long objhash_mm64(void *key);
 unsigned long objhash_pjw(void *key);
 int objhash_cmp(void *obj1, void *obj2);
 
@@ -0,0 +1,424 @@
+/**
+ ** @file ohash.c
+ ** Open addressing hash table core.
+ **
+ ** Robin Hood linear probing: on insertion, an element which is
+ ** farther from its initial bucket than the resident element takes
+ ** its slot, and the resident continues probing.  This bounds the
+ ** variance of probe lengths and gives an early termination test on
+ ** lookup misses.  Deletion uses backward shifting, so there are
+ ** no tombstones.
+ **
+ ** When the table has to grow, the old slot array is kept and drained
+ ** by OHASH_REHASH_STEP slots on each insertion or deletion.  The
+ ** migration always stops on an empty slot, so that each cluster of
+ ** the old array is either fully migrated or untouched, and lookups
+ ** in the old array remain valid.
+ **
+ ** @version 0.1
+ ** @ingroup util
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "safelib.h"
+
+#include "ohash.h"
+
+
+/* Final mix of the hash code.  Hash functions provided by users
+   (e.g. pointer hashes, or PJW on small binary keys) have poor low
+   bits, and we index power-of-two tables with the low bits. */
+static size_t
+ohash_mix(ohcode_t h)
+{
+#if ULONG_MAX > 0xffffffffUL
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdUL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53UL;
+  h ^= h >> 33;
+#else
+  h ^= h >> 16;
+  h *= 0x85ebca6bUL;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35UL;
+  h ^= h >> 16;
+#endif
+
+  return ((size_t)h);
+}
+
+
+static size_t
+ohash_round_size(size_t n)
+{
+  size_t s;
+
+  for (s = OHASH_MIN_SIZE; s < n; s <<= 1)
+    ;
+
+  return (s);
+}
+
+
+static void
+slots_insert(ohash_slot_t *slots, size_t mask, ohash_slot_t *elmt)
+{
+  ohash_slot_t cur;
+  ohash_slot_t tmp;
+  size_t pos;
+
+  cur = *elmt;
+  cur.dib = 1;
+  pos = ohash_mix(cur.hcode) & mask;
+  for (;;) {
+    if (slots[pos].dib == 0) {
+      slots[pos] = cur;
+      return ;
+    }
+    if (slots[pos].dib < cur.dib) {
+      tmp = slots[pos];
+      slots[pos] = cur;
+      cur = tmp;
+    }
+    pos = (pos + 1) & mask;
+    cur.dib++;
+  }
+}
+
+
+static ohash_slot_t *
+slots_lookup(ohash_t *h, ohash_slot_t *slots, size_t mask,
+             ohcode_t hcode, void *key, size_t keylen)
+{
+  ohash_slot_t *s;
+  size_t pos;
+  uint32_t dib;
+
+  pos = ohash_mix(hcode) & mask;
+  for (dib = 1; ; dib++, pos = (pos + 1) & mask) {
+    s = &slots[pos];
+    /* Robin Hood invariant: the key would have taken this slot */
+    if (s->dib < dib)
+      return (NULL);
+    if (s->hcode == hcode && !h->cmp(h->cmp_data, s, key, keylen))
+      return (s);
+  }
+}
+
+
+static void
+slots_remove(ohash_slot_t *slots, size_t mask, size_t pos)
+{
+  size_t next;
+
+  for (next = (pos + 1) & mask; slots[next].dib > 1; next = (next + 1) & mask) {
+    slots[pos] = slots[next];
+    slots[pos].dib--;
+    pos = next;
+  }
+  memset(&slots[pos], 0, sizeof (ohash_slot_t));
+}
+
+
+static void
+ohash_rehash_step(ohash_t *h, size_t budget)
+{
+  ohash_slot_t *s;
+
+  while (h->old_slots) {
+    s = &h->old_slots[h->old_pos];
+    if (s->dib) {
+      slots_insert(h->slots, h->size - 1, s);
+      s->dib = 0;
+    }
+    else if (budget == 0) {
+      /* only stop between two clusters */
+      return ;
+    }
+    h->old_pos = (h->old_pos + 1) & (h->old_size - 1);
+    if (budget > 0)
+      budget--;
+    if (--h->old_left == 0) {
+      Xfree(h->old_slots);
+      h->old_slots = NULL;
+      h->old_size = 0;
+    }
+  }
+}
+
+
+static void
+ohash_start_rehash(ohash_t *h, size_t newsize)
+{
+  size_t pos;
+
+  /* finish any pending migration first */
+  ohash_rehash_step(h, (size_t)-1);
+
+  h->old_slots = h->slots;
+  h->old_size = h->size;
+  h->slots = Xzmalloc(newsize * sizeof (ohash_slot_t));
+  h->size = newsize;
+
+  if (h->elmts == 0) {
+    Xfree(h->old_slots);
+    h->old_slots = NULL;
+    h->old_size = 0;
+    return ;
+  }
+
+  /* start migration on an empty slot (there is always one, since
+     the load factor is below 1) */
+  for (pos = 0; h->old_slots[pos].dib != 0; pos++)
+    ;
+  h->old_pos = pos;
+  h->old_left = h->old_size;
+}
+
+
+void
+ohash_init(ohash_t *h, size_t hsize, ohash_keycmp_t cmp, void *cmpdata)
+{
+  h->size = ohash_round_size(hsize);
+  h->slots = Xzmalloc(h->size * sizeof (ohash_slot_t));
+  h->elmts = 0;
+  h->old_slots = NULL;
+  h->old_size = 0;
+  h->old_pos = 0;
+  h->old_left = 0;
+  h->cmp = cmp;
+  h->cmp_data = cmpdata;
+}
+
+
+void
+ohash_destroy(ohash_t *h)
+{
+  if (h->old_slots)
+    Xfree(h->old_slots);
+  Xfree(h->slots);
+  h->old_slots = NULL;
+  h->slots = NULL;
+  h->elmts = 0;
+}
+
+
+void
+ohash_clear(ohash_t *h)
+{
+  if (h->old_slots) {
+    Xfree(h->old_slots);
+    h->old_slots = NULL;
+    h->old_size = 0;
+    h->old_left = 0;
+  }
+  memset(h->slots, 0, h->size * sizeof (ohash_slot_t));
+  h->elmts = 0;
+}
+
+
+void
+ohash_resize(ohash_t *h, size_t newsize)
+{
+  size_t minsize;
+
+  minsize = (h->elmts * OHASH_LOAD_DEN) / OHASH_LOAD_NUM + 1;
+  if (newsize < minsize)
+    newsize = minsize;
+  newsize = ohash_round_size(newsize);
+  if (newsize == h->size)
+    return ;
+
+  ohash_start_rehash(h, newsize);
+}
+
+
+void
+ohash_insert(ohash_t *h, ohcode_t hcode, void *key, size_t keylen, void *data)
+{
+  ohash_slot_t elmt;
+
+  if ((h->elmts + 1) * OHASH_LOAD_DEN > h->size * OHASH_LOAD_NUM)
+    ohash_start_rehash(h, h->size << 1);
+  else if (h->old_slots)
+    ohash_rehash_step(h, OHASH_REHASH_STEP);
+
+  elmt.hcode = hcode;
+  elmt.key = key;
+  elmt.keylen = keylen;
+  elmt.data = data;
+  slots_insert(h->slots, h->size - 1, &elmt);
+  h->elmts++;
+}
+
+
+ohash_slot_t *
+ohash_lookup(ohash_t *h, ohcode_t hcode, void *key, size_t keylen)
+{
+  ohash_slot_t *s;
+
+  /* Lookups never migrate slots, so that they are safe inside walks */
+  s = slots_lookup(h, h->slots, h->size - 1, hcode, key, keylen);
+  if (s == NULL && h->old_slots)
+    s = slots_lookup(h, h->old_slots, h->old_size - 1, hcode, key, keylen);
+
+  return (s);
+}
+
+
+void *
+ohash_remove(ohash_t *h, ohcode_t hcode, void *key, size_t keylen)
+{
+  ohash_slot_t *s;
+  void *data;
+
+  if (h->old_slots)
+    ohash_rehash_step(h, OHASH_REHASH_STEP);
+
+  s = slots_lookup(h, h->slots, h->size - 1, hcode, key, keylen);
+  if (s) {
+    data = s->data;
+    slots_remove(h->slots, h->size - 1, s - h->slots);
+    h->elmts--;
+    return (data);
+  }
+
+  if (h->old_slots) {
+    s = slots_lookup(h, h->old_slots, h->old_size - 1, hcode, key, keylen);
+    if (s) {
+      data = s->data;
+      slots_remove(h->old_slots, h->old_size - 1, s - h->old_slots);
+      h->elmts--;
+      return (data);
+    }
+  }
+
+  return (NULL);
+}
+
+
+int
+ohash_walk(ohash_t *h, ohash_slot_walk_t func, void *data)
+{
+  size_t i;
+  int status;
+
+  for (i = 0; i < h->size; i++) {
+    if (h->slots[i].dib && (status = func(&h->slots[i], data)) != 0)
+      return (status);
+  }
+
+  if (h->old_slots) {
+    for (i = 0; i < h->old_size; i++) {
+      if (h->old_slots[i].dib && (status = func(&h->old_slots[i], data)) != 0)
+        return (status);
+    }
+  }
+
+  return (0);
+}
+
+
+static int
+ohash_stats_slot(ohash_slot_t *slot, void *data)
+{
+  ohash_stats_t *stats;
+  size_t probe;
+
+  stats = data;
+  probe = slot->dib;
+  if (probe > 1)
+    stats->displaced++;
+  if (probe > stats->max_probe)
+    stats->max_probe = probe;
+  stats->total_probe += probe;
+  if (probe > OHASH_PROBE_HIST)
+    probe = OHASH_PROBE_HIST;
+  stats->probe_hist[probe - 1]++;
+
+  return (0);
+}
+
+
+void
+ohash_get_stats(ohash_t *h, ohash_stats_t *stats)
+{
+  memset(stats, 0, sizeof (ohash_stats_t));
+  stats->size = h->size + h->old_size;
+  stats->elmts = h->elmts;
+  stats->rehashing = (h->old_slots != NULL);
+  ohash_walk(h, ohash_stats_slot, stats);
+}
+
+
+void
+fprintf_ohash_stats(FILE *fp, const char *name, ohash_stats_t *stats)
+{
+  int i;
+
+  fprintf(fp, "%s: size: %zu elems: %zu load: %.2f displaced: %zu "
+          "probe max: %zu mean: %.2f%s\n",
+          name, stats->size, stats->elmts,
+          stats->size ? (double)stats->elmts / stats->size : 0.0,
+          stats->displaced, stats->max_probe,
+          stats->elmts ? (double)stats->total_probe / stats->elmts : 0.0,
+          stats->rehashing ? " (rehashing)" : "");
+  fprintf(fp, "%s: probe length histogram:", name);
+  for (i = 0; i < OHASH_PROBE_HIST; i++)
+    fprintf(fp, " %s%i:%zu",
+            i == OHASH_PROBE_HIST - 1 ? ">=" : "", i + 1, stats->probe_hist[i]);
+  fprintf(fp, "\n");
+}
+
+
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
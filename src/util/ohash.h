@@ -0,0 +1,222 @@
+/**
+ ** @file ohash.h
+ ** Header for the open addressing hash table core.
+ **
+ ** This is the storage shared by the hash.c, strhash.c and objhash.c
+ ** front-ends: a linear-probing Robin Hood table with power-of-two
+ ** sizes and an incremental rehash, so that a table growth never
+ ** rehashes all elements in one single call.
+ **
+ ** @version 0.1
+ ** @ingroup util
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef OHASH_H
+#define OHASH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Maximum load factor, as a fraction of OHASH_LOAD_DEN */
+#define OHASH_LOAD_NUM 7
+#define OHASH_LOAD_DEN 8
+
+/* Number of old slots moved to the new table by each operation
+   while an incremental rehash is in progress */
+#define OHASH_REHASH_STEP 4
+
+/* Minimum table size (must be a power of two) */
+#define OHASH_MIN_SIZE 8
+
+/* Size of the probe length histogram in ohash_stats_t */
+#define OHASH_PROBE_HIST 8
+
+typedef unsigned long ohcode_t;
+
+/**
+ ** @struct ohash_slot_s
+ **   A slot of an open addressing table.
+ **/
+/**   @var ohash_slot_s::hcode
+ **     Full hash code of the key, so that rehashing and probing
+ **     never call the hash function nor the comparison function
+ **     on a mismatching hash.
+ **/
+/**   @var ohash_slot_s::key
+ **     The key (owned by the caller).
+ **/
+/**   @var ohash_slot_s::keylen
+ **     Key length (only meaningful for binary keys).
+ **/
+/**   @var ohash_slot_s::data
+ **     The data associated to the key.
+ **/
+/**   @var ohash_slot_s::dib
+ **     Distance to initial bucket plus one, 0 for an empty slot.
+ **/
+typedef struct ohash_slot_s ohash_slot_t;
+struct ohash_slot_s
+{
+  ohcode_t  hcode;
+  void     *key;
+  size_t    keylen;
+  void     *data;
+  uint32_t  dib;
+};
+
+typedef struct ohash_s ohash_t;
+
+/**
+ ** @typedef ohash_keycmp_t
+ **   Key comparison function: return 0 if the key stored in slot
+ **   is equal to (key, keylen).  cmpdata is ohash_s::cmp_data.
+ **/
+typedef int (*ohash_keycmp_t)(void *cmpdata, ohash_slot_t *slot,
+                              void *key, size_t keylen);
+
+/**
+ ** @typedef ohash_slot_walk_t
+ **   Slot walk callback type.  A non-zero return stops the walk.
+ **/
+typedef int (*ohash_slot_walk_t)(ohash_slot_t *slot, void *data);
+
+/**
+ ** @struct ohash_s
+ **   Open addressing table.
+ **/
+/**   @var ohash_s::slots
+ **     Current slot array.
+ **/
+/**   @var ohash_s::size
+ **     Size of the current slot array (a power of two).
+ **/
+/**   @var ohash_s::elmts
+ **     Total number of elements (current and old arrays).
+ **/
+/**   @var ohash_s::old_slots
+ **     Slot array being drained by an incremental rehash, or NULL.
+ **/
+/**   @var ohash_s::old_size
+ **     Size of ohash_s::old_slots.
+ **/
+/**   @var ohash_s::old_pos
+ **     Next old slot to migrate.
+ **/
+/**   @var ohash_s::old_left
+ **     Number of old slots still to be visited.
+ **/
+/**   @var ohash_s::cmp
+ **     Key comparison function.
+ **/
+/**   @var ohash_s::cmp_data
+ **     First argument passed to ohash_s::cmp.
+ **/
+struct ohash_s
+{
+  ohash_slot_t   *slots;
+  size_t          size;
+  int             elmts;
+  ohash_slot_t   *old_slots;
+  size_t          old_size;
+  size_t          old_pos;
+  size_t          old_left;
+  ohash_keycmp_t  cmp;
+  void           *cmp_data;
+};
+
+/**
+ ** @struct ohash_stats_s
+ **   Occupancy and probe length report, replaces the former
+ **   *_collide_count() functions of the chained tables.
+ **/
+/**   @var ohash_stats_s::size
+ **     Number of slots (current plus old array while rehashing).
+ **/
+/**   @var ohash_stats_s::elmts
+ **     Number of elements.
+ **/
+/**   @var ohash_stats_s::displaced
+ **     Number of elements not stored in their initial bucket.
+ **/
+/**   @var ohash_stats_s::max_probe
+ **     Longest probe sequence (in slots) needed to find an element.
+ **/
+/**   @var ohash_stats_s::total_probe
+ **     Sum of probe lengths, for computing the mean.
+ **/
+/**   @var ohash_stats_s::probe_hist
+ **     Histogram of probe lengths: entry i counts the elements found
+ **     after i+1 probes, the last entry counts all longer probes.
+ **/
+/**   @var ohash_stats_s::rehashing
+ **     Non-zero if an incremental rehash is in progress.
+ **/
+typedef struct ohash_stats_s ohash_stats_t;
+struct ohash_stats_s
+{
+  size_t size;
+  size_t elmts;
+  size_t displaced;
+  size_t max_probe;
+  size_t total_probe;
+  size_t probe_hist[OHASH_PROBE_HIST];
+  int    rehashing;
+};
+
+void ohash_init(ohash_t *h, size_t hsize, ohash_keycmp_t cmp, void *cmpdata);
+void ohash_destroy(ohash_t *h);
+void ohash_clear(ohash_t *h);
+void ohash_resize(ohash_t *h, size_t newsize);
+void ohash_insert(ohash_t *h, ohcode_t hcode, void *key, size_t keylen,
+                  void *data);
+ohash_slot_t *ohash_lookup(ohash_t *h, ohcode_t hcode,
+                           void *key, size_t keylen);
+void *ohash_remove(ohash_t *h, ohcode_t hcode, void *key, size_t keylen);
+int ohash_walk(ohash_t *h, ohash_slot_walk_t func, void *data);
+void ohash_get_stats(ohash_t *h, ohash_stats_t *stats);
+void fprintf_ohash_stats(FILE *fp, const char *name, ohash_stats_t *stats);
+
+#endif /* OHASH_H */
+
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -24,43 +24,59 @@
 
 #include "safelib.h"
 
+#include "hash.h"
 #include "strhash.h"
 
 
+static int
+strhash_keycmp(void *cmpdata, ohash_slot_t *slot, void *key, size_t keylen)
+{
+  return (strcmp(key, slot->key));
+}
+
+
 strhash_t *
 new_strhash(size_t hsize)
 {
   strhash_t *h;
 
   h = Xmalloc(sizeof (strhash_t));
-  h->size = hsize;
-  h->elmts = 0;
   h->hash = DEFAULT_STRHASH_FUNCTION;
-  h->htable = Xzmalloc(hsize * sizeof (strhash_elmt_t *));
+  ohash_init(&h->tbl, hsize, strhash_keycmp, h);
 
   return (h);
 }
 
 
+static int
+strhash_free_slot(ohash_slot_t *slot, void *data)
+{
+  void (*elmt_free)(void *e) = data;
+
+  elmt_free(slot->data);
+
+  return (0);
+}
+
+
 void
 clear_strhash(strhash_t *hash, void (*elmt_free)(void *e))
 {
-  int i;
-  strhash_elmt_t *tmp;
-  strhash_elmt_t *tmp_next;
-
-  for (i = 0; i < hash->size; i++) {
-    tmp = hash->htable[i];
-    while (tmp) {
-      tmp_next = tmp->next;
-      if (elmt_free)
-        elmt_free(tmp->data);
-      Xfree(tmp);
-      tmp = tmp_next;
-    }
-  }
-  hash->elmts = 0;
-  memset(hash->htable, 0, hash->size * sizeof (void *));
+  if (elmt_free)
+    ohash_walk(&hash->tbl, strhash_free_slot, elmt_free);
+  ohash_clear(&hash->tbl);
+}
+
+
+static int
+strhash_array_slot(ohash_slot_t *slot, void *data)
+{
+  void ***array = data;
+
+  **array = slot->data;
+  (*array)++;
+
+  return (0);
 }
 
 
@@ -68,22 +84,11 @@ void *
 strhash_to_array(strhash_t *hash)
 {
   void **array;
-  strhash_elmt_t *helmt;
-  int elmts;
-  int i;
-  int hsize;
-  int j;
+  void **cur;
 
-  hsize = hash->size;
-  elmts = hash->elmts;
-  array = Xmalloc(elmts * sizeof (void *));
-  j = 0;
-  for (i = 0; i < hsize; i++) {
-    for (helmt = hash->htable[i]; helmt; helmt = helmt->next) {
-      array[j] = helmt->data;
-      j++;
-    }
-  }
+  array = Xmalloc(hash->tbl.elmts * sizeof (void *));
+  cur = array;
+  ohash_walk(&hash->tbl, strhash_array_slot, &cur);
 
   return (array);
 }
@@ -92,22 +97,9 @@ strhash_to_array(strhash_t *hash)
 void
 free_strhash(strhash_t *hash, void (*elmt_free)(void *e))
 {
-  int i;
-  strhash_elmt_t *tmp;
-  strhash_elmt_t *tmp_next;
-
-  for (i = 0; i < hash->size; i++) {
-    tmp = hash->htable[i];
-    while (tmp) {
-      tmp_next = tmp->next;
-      if (elmt_free)
-        elmt_free(tmp->data);
-      Xfree(tmp);
-      tmp = tmp_next;
-    }
-  }
-
-  Xfree(hash->htable);
+  if (elmt_free)
+    ohash_walk(&hash->tbl, strhash_free_slot, elmt_free);
+  ohash_destroy(&hash->tbl);
   Xfree(hash);
 }
 
@@ -115,66 +107,29 @@ free_strhash(strhash_t *hash, void (*elmt_free)(void *e))
 void
 strhash_resize(strhash_t *hash, size_t newsize)
 {
-  strhash_elmt_t **old_htable;
-  int i;
-
-  old_htable = hash->htable;
-  hash->htable = Xzmalloc(newsize * sizeof (strhash_elmt_t *));
-
-  for (i = 0; i < hash->size; ++i) {
-    strhash_elmt_t *tmp;
-
-    for (tmp = old_htable[i]; tmp; tmp = tmp->next) {
-      strhcode_t hcode;
-
-      hcode = hash->hash(tmp->key) % newsize;
-      tmp->next = hash->htable[hcode];
-      hash->htable[hcode] = tmp;
-    }
-  }
-
-  Xfree(old_htable);
-  hash->size = newsize;
+  ohash_resize(&hash->tbl, newsize);
 }
 
 
 void
 strhash_add(strhash_t *hash, void *data, char *key)
 {
-  strhash_elmt_t *elmt;
-  strhcode_t hcode;
-
-  elmt = Xmalloc(sizeof (strhash_elmt_t));
-  elmt->key = key;
-  elmt->data = data;
-
-  hcode = hash->hash(key) % hash->size;
-  elmt->next = hash->htable[hcode];
-  hash->htable[hcode] = elmt;
-  hash->elmts++;
+  ohash_insert(&hash->tbl, hash->hash(key), key, 0, data);
 }
 
 
 void *
 strhash_check_and_add(strhash_t *hash, void *data, char *key)
 {
-  strhash_elmt_t *elmt;
+  ohash_slot_t *slot;
   strhcode_t hcode;
 
-  elmt = hash->htable[hash->hash(key) % hash->size];
-  for (; elmt; elmt = elmt->next) {
-    if (!strcmp(key, elmt->key))
-      return (elmt->data);
-  }
+  hcode = hash->hash(key);
+  slot = ohash_lookup(&hash->tbl, hcode, key, 0);
+  if (slot)
+    return (slot->data);
 
-  elmt = Xmalloc(sizeof (strhash_elmt_t));
-  elmt->key = key;
-  elmt->data = data;
-
-  hcode = hash->hash(key) % hash->size;
-  elmt->next = hash->htable[hcode];
-  hash->htable[hcode] = elmt;
-  hash->elmts++;
+  ohash_insert(&hash->tbl, hcode, key, 0, data);
 
   return (NULL);
 }
@@ -183,17 +138,15 @@ strhash_check_and_add(strhash_t *hash, void *data, char *key)
 void *
 strhash_update(strhash_t *hash, void *new_data, char *key)
 {
-  strhash_elmt_t *elmt;
+  ohash_slot_t *slot;
   void *old_data;
 
-  elmt = hash->htable[hash->hash(key) % hash->size];
-  for (; elmt; elmt = elmt->next) {
-    if (!strcmp(key, elmt->key)) {
-      old_data = elmt->data;
-      elmt->data = new_data;
+  slot = ohash_lookup(&hash->tbl, hash->hash(key), key, 0);
+  if (slot) {
+    old_data = slot->data;
+    slot->data = new_data;
 
-      return (old_data);
-    }
+    return (old_data);
   }
 
   return (NULL);
@@ -203,28 +156,20 @@ strhash_update(strhash_t *hash, void *new_data, char *key)
 void *
 strhash_update_or_add(strhash_t *hash, void *new_data, char *key)
 {
-  strhash_elmt_t *elmt;
+  ohash_slot_t *slot;
   void *old_data;
   strhcode_t hcode;
 
-  elmt = hash->htable[hash->hash(key) % hash->size];
-  for (; elmt; elmt = elmt->next) {
-    if (!strcmp(key, elmt->key)) {
-      old_data = elmt->data;
-      elmt->data = new_data;
+  hcode = hash->hash(key);
+  slot = ohash_lookup(&hash->tbl, hcode, key, 0);
+  if (slot) {
+    old_data = slot->data;
+    slot->data = new_data;
 
-      return (old_data);
-    }
+    return (old_data);
   }
 
-  elmt = Xmalloc(sizeof (strhash_elmt_t));
-  elmt->key = key;
-  elmt->data = new_data;
-
-  hcode = hash->hash(key) % hash->size;
-  elmt->next = hash->htable[hcode];
-  hash->htable[hcode] = elmt;
-  hash->elmts++;
+  ohash_insert(&hash->tbl, hcode, key, 0, new_data);
 
   return (NULL);
 }
@@ -233,87 +178,98 @@ strhash_update_or_add(strhash_t *hash, void *new_data, char *key)
 void *
 strhash_del(strhash_t *hash, char *key)
 {
-  strhash_elmt_t **head;
-  strhash_elmt_t  *elmt;
-  strhash_elmt_t  *prev;
-  void            *data;
-
-  prev = NULL;
-  head = &hash->htable[hash->hash(key) % hash->size];
-  for (elmt = *head; elmt; elmt = elmt->next) {
-    if (!strcmp(key, elmt->key)) {
-      data = elmt->data;
-      if (prev)
-        prev->next = elmt->next;
-      else
-        *head = elmt->next;
-      Xfree(elmt);
-
-      return (data);
-    }
-    prev = elmt;
-  }
-
-  return (NULL);
+  return (ohash_remove(&hash->tbl, hash->hash(key), key, 0));
 }
 
 
 void *
 strhash_get(strhash_t *hash, char *key)
 {
-  strhash_elmt_t *elmt;
+  ohash_slot_t *slot;
 
-  elmt = hash->htable[hash->hash(key) % hash->size];
-  for ( ; elmt; elmt = elmt->next) {
-    if (!strcmp(key, elmt->key))
-      return (elmt->data);
-  }
+  slot = ohash_lookup(&hash->tbl, hash->hash(key), key, 0);
 
-  return (NULL);
+  return (slot ? slot->data : NULL);
+}
+
+
+typedef struct strhash_clone_s strhash_clone_t;
+struct strhash_clone_s
+{
+  strhash_t *dst;
+  void *(*clone)(void *elmt);
+};
+
+
+static int
+strhash_clone_slot(ohash_slot_t *slot, void *data)
+{
+  strhash_clone_t *hc = data;
+
+  ohash_insert(&hc->dst->tbl, slot->hcode, slot->key, 0,
+               hc->clone(slot->data));
+
+  return (0);
 }
 
 
 strhash_t *
 strhash_clone(strhash_t *hash, void *(clone)(void *elmt))
 {
-  strhash_t *h;
-  strhash_elmt_t *tmp;
-  int i;
-  int hsize;
-  void *data;
+  strhash_clone_t hc;
 
   if (clone == NULL)
     return (NULL);
 
-  hsize = hash->size;
-  h = new_strhash(hsize);
-  for (i = 0; i < hsize; i++) {
-    for (tmp = hash->htable[i]; tmp; tmp = tmp->next) {
-      data = clone(tmp->data);
-      strhash_add(h, data, tmp->key);
-    }
-  }
+  hc.dst = new_strhash(hash->tbl.size);
+  hc.dst->hash = hash->hash;
+  hc.clone = clone;
+  ohash_walk(&hash->tbl, strhash_clone_slot, &hc);
 
-  return (h);
+  return (hc.dst);
+}
+
+
+typedef struct strhash_walk_s strhash_walk_t;
+struct strhash_walk_s
+{
+  int (*func)(void *elmt, void *data);
+  void *data;
+};
+
+
+static int
+strhash_walk_slot(ohash_slot_t *slot, void *data)
+{
+  strhash_walk_t *hw = data;
+
+  return (hw->func(slot->data, hw->data));
 }
 
 
 int
 strhash_walk(strhash_t *hash, int (func)(void *elmt, void *data), void *data)
 {
-  int i;
+  strhash_walk_t hw;
 
-  for (i = 0; i < hash->size; i++) {
-    strhash_elmt_t *tmp;
-    int status;
+  hw.func = func;
+  hw.data = data;
 
-    for (tmp = hash->htable[i]; tmp; tmp = tmp->next) {
-      if ((status = func(tmp->data, data)) != 0)
-        return (status);
-    }
-  }
+  return (ohash_walk(&hash->tbl, strhash_walk_slot, &hw));
+}
 
-  return (0);
+
+int
+strhash_elmts(strhash_t *hash)
+{
+  return (hash->tbl.elmts);
+}
+
+
+void
+strhash_get_stats(strhash_t *hash, ohash_stats_t *stats)
+{
+  ohash_get_stats(&hash->tbl, stats);
 }
 
 
@@ -321,6 +277,15 @@ strhash_walk(strhash_t *hash, int (func)(void *elmt, void *data), void *data)
 ** fast hash function samples
 */
 
+/* MurmurHash64A over the string bytes (see hash_mm64()).
+   Default hash function. */
+strhcode_t
+strhash_mm64(char *key)
+{
+  return (hash_mm64((hkey_t *)key, strlen(key)));
+}
+
+
 /* Peter J. Weinberger with the 24 corrected to 28 in the dragon book */
 strhcode_t
 strhash_pjw(char *key)
@@ -792,24 +757,6 @@ strhash_kazlib(char *key)
 }
 
 
-int
-strhash_collide_count(strhash_t *hash)
-{
-  int count;
-  int i;
-
-  count = 0;
-  for (i = 0; i < hash->size; i++) {
-    strhash_elmt_t *tmp;
-
-    for (tmp = hash->htable[i]; tmp; tmp = tmp->next)
-      if (tmp->next)
-        count++;
-  }
-
-  return (count);
-}
-
 #if 0
 int
 print_elmt(void *elmt, void *dummy)
@@ -820,30 +767,23 @@ print_elmt(void *elmt, void *dummy)
 }
 
 void
-hash_test(void)
+strhash_test(void)
 {
   strhash_t *h;
+  ohash_stats_t stats;
   char buf[1024];
   int i;
 
-  h = new_hash(2053);
-  h->hash = hash_pow;
+  h = new_strhash(2053);
+  h->hash = strhash_pow;
   for (i = 0; i < 1000; i++) {
     sprintf(buf, "%i", i * 65599);
-    hash_add(h, (void *)(i * 65599), buf, strlen(buf));
+    strhash_add(h, (void *)(i * 65599), strdup(buf));
   }
-  hash_walk(h, print_elmt, NULL);
-
-  printf("collides : %i\n", hash_collide_count(h));
-}
+  strhash_walk(h, print_elmt, NULL);
 
-void
-fprintf_hash_info(FILE *fp, strhash_t *h)
-{
-  fprintf(fp, "htable = %p\n", h->htable);
-  fprintf(fp, "size = %i\n", h->size);
-  fprintf(fp, "elmts = %i\n", h->elmts);
-  fprintf(fp, "hfunc = %p\n", h->hash);
+  strhash_get_stats(h, &stats);
+  fprintf_ohash_stats(stdout, "strhash_test", &stats);
 }
 
 #endif /* DEBUG */
@@ -17,25 +17,28 @@
 #ifndef STRHASH_H
 #define STRHASH_H
 
-#define DEFAULT_STRHASH_FUNCTION strhash_djb
+#include "ohash.h"
 
-typedef struct strhash_elmt_s strhash_elmt_t;
-struct strhash_elmt_s
-{
-  char *key;
-  void *data;
-  strhash_elmt_t *next;
-};
+#define DEFAULT_STRHASH_FUNCTION strhash_mm64
 
-typedef unsigned long strhcode_t;
+typedef ohcode_t strhcode_t;
 typedef strhcode_t (*strhashfunc_t)(char *key);
 
+/**
+ ** @struct strhash_s
+ **   String key hash table, stored in an open addressing table.
+ **   Keys are not copied.
+ **/
+/**   @var strhash_s::tbl
+ **     The open addressing table.
+ **/
+/**   @var strhash_s::hash
+ **     Hash function.
+ **/
 typedef struct strhash_s strhash_t;
 struct strhash_s
 {
-  strhash_elmt_t **htable;
-  size_t size;
-  int elmts;
+  ohash_t tbl;
   strhashfunc_t hash;
 };
 
@@ -52,8 +55,10 @@ void *strhash_update_or_add(strhash_t *hash, void *new_data, char *key);
 void *strhash_del(strhash_t *hash, char *key);
 strhash_t *strhash_clone(strhash_t *hash, void *(clone)(void *elmt));
 int strhash_walk(strhash_t *hash, int (func)(void *elmt, void *data), void *data);
-int strhash_collide_count(strhash_t *hash);
+int strhash_elmts(strhash_t *hash);
+void strhash_get_stats(strhash_t *hash, ohash_stats_t *stats);
 
+strhcode_t strhash_mm64(char *key);
 strhcode_t strhash_pjw(char *key);
 strhcode_t strhash_pjw_typo(char *key);
 strhcode_t strhash_pow(char *key);
@@ -0,0 +1,410 @@
+/**
+ ** @file timestamp.c
+ ** Fast cached timestamp parsing.
+ **
+ ** Log dissectors used to fill a struct tm and call mktime() on every
+ ** event.  mktime() normalizes the fields, takes the time zone lock
+ ** and checks the TZ environment variable each time.  The parsers
+ ** below decode the fields directly, compute the time since the
+ ** Epoch with integer arithmetic, and only call mktime() to get the
+ ** local time zone offset, once per hour of log time.  They also
+ ** memoize the last date parsed: consecutive events mostly share the
+ ** same second.
+ **
+ ** @version 0.1
+ ** @ingroup util
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timestamp.h"
+
+#define TS_KEY(a, b, c) \
+  ((unsigned long)(a) | ((unsigned long)(b) << 8) | ((unsigned long)(c) << 16))
+
+/* Perfect hash of the month abbreviations (Avr included) */
+#define TS_MONTH_HASH(a, b, c) ((((a) + 28 * (b) + (c)) >> 2) & 31)
+
+typedef struct ts_month_s ts_month_t;
+struct ts_month_s
+{
+  unsigned long key;
+  int mon;
+};
+
+static const ts_month_t ts_month_g[32] = {
+  [ 0] = { TS_KEY('J', 'u', 'l'),  6 },
+  [ 1] = { TS_KEY('J', 'u', 'n'),  5 },
+  [ 5] = { TS_KEY('O', 'c', 't'),  9 },
+  [ 6] = { TS_KEY('A', 'v', 'r'),  3 },
+  [12] = { TS_KEY('D', 'e', 'c'), 11 },
+  [13] = { TS_KEY('F', 'e', 'b'),  1 },
+  [19] = { TS_KEY('S', 'e', 'p'),  8 },
+  [21] = { TS_KEY('J', 'a', 'n'),  0 },
+  [22] = { TS_KEY('M', 'a', 'r'),  2 },
+  [24] = { TS_KEY('M', 'a', 'y'),  4 },
+  [26] = { TS_KEY('N', 'o', 'v'), 10 },
+  [28] = { TS_KEY('A', 'p', 'r'),  3 },
+  [29] = { TS_KEY('A', 'u', 'g'),  7 },
+};
+
+
+int
+ts_month(const char *s)
+{
+  const unsigned char *u;
+  const ts_month_t *m;
+  unsigned long match;
+
+  u = (const unsigned char *) s;
+  m = &ts_month_g[TS_MONTH_HASH(u[0], u[1], u[2])];
+  match = -(unsigned long)(m->key == TS_KEY(u[0], u[1], u[2]));
+
+  return ((int)((m->mon + 1) & match) - 1);
+}
+
+
+/* Two digits; *bad is set to non-zero if they aren't digits */
+static inline int
+ts_2digits(const char *s, unsigned int *bad)
+{
+  unsigned int a;
+  unsigned int b;
+
+  a = (unsigned char) s[0] - '0';
+  b = (unsigned char) s[1] - '0';
+  *bad |= (a > 9) | (b > 9);
+
+  return (a * 10 + b);
+}
+
+
+static inline int
+ts_4digits(const char *s, unsigned int *bad)
+{
+  return (ts_2digits(s, bad) * 100 + ts_2digits(s + 2, bad));
+}
+
+
+/* Day of the month, with a leading space or digit: ' ' & 0x0f is 0 */
+static inline int
+ts_mday(const char *s, unsigned int *bad)
+{
+  unsigned int a;
+  unsigned int b;
+
+  a = (unsigned char) s[0];
+  b = (unsigned char) s[1] - '0';
+  *bad |= ((a != ' ') & (a - '0' > 9)) | (b > 9);
+
+  return ((a & 0x0f) * 10 + b);
+}
+
+
+static inline unsigned int
+ts_check_fields(int mon, int mday, int hour, int min, int sec)
+{
+  return ((mon < 0) | (mday < 1) | (mday > 31) |
+          (hour > 23) | (min > 59) | (sec > 60));
+}
+
+
+time_t
+ts_mkgmtime(int year, int mon, int mday, int hour, int min, int sec)
+{
+  long y;
+  long era;
+  long yoe;
+  long doy;
+  long days;
+
+  /* Days from the civil date, with years starting in March */
+  mon++;
+  y = year - (mon <= 2);
+  era = (y >= 0 ? y : y - 399) / 400;
+  yoe = y - era * 400;
+  doy = (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5 + mday - 1;
+  days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+
+  return ((time_t) days * 86400 + hour * 3600 + min * 60 + sec);
+}
+
+
+time_t
+ts_localtime(ts_cache_t *c, time_t naive)
+{
+  struct tm tm;
+  time_t hour;
+  time_t t;
+
+  hour = naive - ((naive % 3600) + 3600) % 3600;
+  if (hour != c->tz_hour) {
+    gmtime_r(&hour, &tm);
+    tm.tm_isdst = -1;
+    t = mktime(&tm);
+    c->tz_off = (t == (time_t) -1) ? 0 : hour - t;
+    c->tz_hour = hour;
+  }
+
+  return (naive - c->tz_off);
+}
+
+
+static inline int
+ts_memo_get(ts_cache_t *c, const char *s, size_t len, time_t *t)
+{
+  if (c->memo_len != len || memcmp(c->memo, s, len))
+    return (0);
+  *t = c->memo_time;
+  return (1);
+}
+
+
+static inline void
+ts_memo_put(ts_cache_t *c, const char *s, size_t len, time_t t)
+{
+  memcpy(c->memo, s, len);
+  c->memo_len = len;
+  c->memo_time = t;
+}
+
+
+static void
+ts_set_ref(ts_cache_t *c, time_t now)
+{
+  struct tm tm;
+
+  if (now < c->ref_until && now + 3600 >= c->ref_until)
+    return ;
+
+  localtime_r(&now, &tm);
+  if (tm.tm_year + 1900 != c->ref_year || tm.tm_mon != c->ref_mon)
+    c->memo_len = 0;
+  c->ref_year = tm.tm_year + 1900;
+  c->ref_mon = tm.tm_mon;
+  c->ref_until = now + 3600;
+}
+
+
+int
+ts_parse_syslog(ts_cache_t *c, const char *s, time_t now, time_t *t)
+{
+  unsigned int bad;
+  int year;
+  int mon;
+  int mday;
+  int hour;
+  int min;
+  int sec;
+
+  ts_set_ref(c, now);
+  if (ts_memo_get(c, s, TS_SYSLOG_LEN, t))
+    return (0);
+
+  bad = (s[3] != ' ') | (s[6] != ' ') | (s[9] != ':') | (s[12] != ':');
+  mon = ts_month(s);
+  mday = ts_mday(s + 4, &bad);
+  hour = ts_2digits(s + 7, &bad);
+  min = ts_2digits(s + 10, &bad);
+  sec = ts_2digits(s + 13, &bad);
+  if (bad | ts_check_fields(mon, mday, hour, min, sec))
+    return (-1);
+
+  year = c->ref_year - (mon - c->ref_mon > 6) + (c->ref_mon - mon > 6);
+  *t = ts_localtime(c, ts_mkgmtime(year, mon, mday, hour, min, sec));
+  ts_memo_put(c, s, TS_SYSLOG_LEN, *t);
+
+  return (0);
+}
+
+
+int
+ts_parse_ctime(ts_cache_t *c, const char *s, time_t *t)
+{
+  unsigned int bad;
+  int year;
+  int mon;
+  int mday;
+  int hour;
+  int min;
+  int sec;
+
+  if (ts_memo_get(c, s, TS_CTIME_LEN, t))
+    return (0);
+
+  bad = (s[3] != ' ') | (s[6] != ' ') | (s[9] != ':') | (s[12] != ':')
+    | (s[15] != ' ');
+  mon = ts_month(s);
+  mday = ts_mday(s + 4, &bad);
+  hour = ts_2digits(s + 7, &bad);
+  min = ts_2digits(s + 10, &bad);
+  sec = ts_2digits(s + 13, &bad);
+  year = ts_4digits(s + 16, &bad);
+  if (bad | ts_check_fields(mon, mday, hour, min, sec))
+    return (-1);
+
+  *t = ts_localtime(c, ts_mkgmtime(year, mon, mday, hour, min, sec));
+  ts_memo_put(c, s, TS_CTIME_LEN, *t);
+
+  return (0);
+}
+
+
+/* Up to 6 digits of a fraction of second, as microseconds */
+static const char *
+ts_parse_usec(const char *s, const char *end, long *usec)
+{
+  long scale;
+  long u;
+
+  u = 0;
+  for (scale = 100000; s < end && (unsigned int)(*s - '0') <= 9; s++) {
+    u += (*s - '0') * scale;
+    scale /= 10;
+  }
+  *usec = u;
+
+  return (s);
+}
+
+
+const char *
+ts_parse_iso8601(ts_cache_t *c, const char *s, size_t len, struct timeval *tv)
+{
+  const char *end;
+  unsigned int bad;
+  time_t naive;
+  long usec;
+  long off;
+  int year;
+  int mon;
+  int mday;
+  int hour;
+  int min;
+  int sec;
+  int sign;
+
+  if (len < TS_ISO8601_LEN)
+    return (NULL);
+  end = s + len;
+
+  /* The memo holds the date read as UTC: the zone may vary. */
+  if (!ts_memo_get(c, s, TS_ISO8601_LEN, &naive)) {
+    bad = (s[4] != '-') | (s[7] != '-') | (s[13] != ':') | (s[16] != ':')
+      | ((s[10] != 'T') & (s[10] != 't') & (s[10] != ' '));
+    year = ts_4digits(s, &bad);
+    mon = ts_2digits(s + 5, &bad) - 1;
+    mday = ts_2digits(s + 8, &bad);
+    hour = ts_2digits(s + 11, &bad);
+    min = ts_2digits(s + 14, &bad);
+    sec = ts_2digits(s + 17, &bad);
+    if (bad | ts_check_fields(mon, mday, hour, min, sec) | (mon > 11))
+      return (NULL);
+    naive = ts_mkgmtime(year, mon, mday, hour, min, sec);
+    ts_memo_put(c, s, TS_ISO8601_LEN, naive);
+  }
+  s += TS_ISO8601_LEN;
+
+  usec = 0;
+  if (s < end && (*s == '.' || *s == ',')) {
+    s = ts_parse_usec(s + 1, end, &usec);
+    while (s < end && (unsigned int)(*s - '0') <= 9)
+      s++;
+  }
+
+  if (s < end && (*s == 'Z' || *s == 'z')) {
+    tv->tv_sec = naive;
+    s++;
+  }
+  else if (s + 3 <= end && (*s == '+' || *s == '-')) {
+    sign = (*s == '-') ? -1 : 1;
+    bad = 0;
+    off = ts_2digits(s + 1, &bad) * 3600;
+    s += 3;
+    if (s < end && *s == ':')
+      s++;
+    if (s + 2 <= end && (unsigned int)(*s - '0') <= 9) {
+      off += ts_2digits(s, &bad) * 60;
+      s += 2;
+    }
+    if (bad)
+      return (NULL);
+    tv->tv_sec = naive - sign * off;
+  }
+  else
+    tv->tv_sec = ts_localtime(c, naive);
+  tv->tv_usec = usec;
+
+  return (s);
+}
+
+
+const char *
+ts_parse_epoch(const char *s, struct timeval *tv)
+{
+  time_t sec;
+  long usec;
+
+  sec = 0;
+  for ( ; (unsigned int)(*s - '0') <= 9; s++)
+    sec = sec * 10 + (*s - '0');
+
+  usec = 0;
+  if (*s == '.') {
+    s = ts_parse_usec(s + 1, s + 1 + 6, &usec);
+    while ((unsigned int)(*s - '0') <= 9)
+      s++;
+  }
+  tv->tv_sec = sec;
+  tv->tv_usec = usec;
+
+  return (s);
+}
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
@@ -0,0 +1,217 @@
+/**
+ ** @file timestamp.h
+ ** Fast cached timestamp parsing.
+ **
+ ** @version 0.1
+ ** @ingroup util
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <time.h>
+
+/** Longest date text memoized by a timestamp cache. */
+#define TS_MEMO_MAX 32
+
+/** Length of a BSD syslog date ("Mmm dd hh:mm:ss"). */
+#define TS_SYSLOG_LEN 15
+/** Length of a ctime() date without the week day ("Mmm dd hh:mm:ss yyyy"). */
+#define TS_CTIME_LEN 20
+/** Length of an ISO 8601 date up to the seconds ("yyyy-mm-ddThh:mm:ss"). */
+#define TS_ISO8601_LEN 19
+
+/**
+ ** @struct ts_cache_s
+ **   Timestamp parser state.  Each dissector keeps its own.
+ **   Consecutive log lines mostly share the same second: the text of
+ **   the last date parsed and its value are memoized.  The local
+ **   time zone offset is computed (with mktime()) once per hour of
+ **   log time, and the reference year used for dates without a year
+ **   once per hour of wall-clock time.
+ **/
+/**   @var ts_cache_s::memo
+ **     Text of the last date parsed.
+ **/
+/**   @var ts_cache_s::memo_len
+ **     Length of ts_cache_s::memo, 0 if empty.
+ **/
+/**   @var ts_cache_s::memo_time
+ **     Value of the last date parsed.
+ **/
+/**   @var ts_cache_s::tz_hour
+ **     Hour (in seconds since the Epoch, read as UTC) for which
+ **     ts_cache_s::tz_off is valid.
+ **/
+/**   @var ts_cache_s::tz_off
+ **     Local time zone offset at ts_cache_s::tz_hour.
+ **/
+/**   @var ts_cache_s::ref_until
+ **     Time until which ts_cache_s::ref_year and ts_cache_s::ref_mon
+ **     are valid.
+ **/
+/**   @var ts_cache_s::ref_year
+ **     Reference year, for dates without a year.
+ **/
+/**   @var ts_cache_s::ref_mon
+ **     Reference month (0-11), for dates without a year.
+ **/
+typedef struct ts_cache_s ts_cache_t;
+struct ts_cache_s
+{
+  char   memo[TS_MEMO_MAX];
+  size_t memo_len;
+  time_t memo_time;
+  time_t tz_hour;
+  time_t tz_off;
+  time_t ref_until;
+  int    ref_year;
+  int    ref_mon;
+};
+
+/** Static initializer of a timestamp cache. */
+#define TS_CACHE_INITIALIZER { { 0 }, 0, 0, -1, 0, 0, 0, 0 }
+
+
+/**
+ ** Decode an english month abbreviation ("Jan" ... "Dec", and the
+ ** french "Avr"), without branching on the characters.
+ **
+ ** @param s  The three characters of the month.
+ ** @return The month (0-11), or -1.
+ **/
+int
+ts_month(const char *s);
+
+
+/**
+ ** Seconds since the Epoch of a date in UTC.  Replaces timegm().
+ **
+ ** @param year  Year, e.g. 2026.
+ ** @param mon   Month, 0-11.
+ ** @param mday  Day of the month, 1-31.
+ ** @param hour  Hours.
+ ** @param min   Minutes.
+ ** @param sec   Seconds.
+ ** @return Seconds since the Epoch.
+ **/
+time_t
+ts_mkgmtime(int year, int mon, int mday, int hour, int min, int sec);
+
+
+/**
+ ** Convert a date in local time, given as the result of ts_mkgmtime()
+ ** on its fields, to seconds since the Epoch.  Replaces mktime(),
+ ** which is only called once per hour of log time.
+ **
+ ** @param c      Timestamp cache.
+ ** @param naive  ts_mkgmtime() of the local date.
+ ** @return Seconds since the Epoch.
+ **/
+time_t
+ts_localtime(ts_cache_t *c, time_t naive);
+
+
+/**
+ ** Parse a BSD syslog date "Mmm dd hh:mm:ss", in local time.  The
+ ** year is inferred from the reference time: a date more than six
+ ** months after (resp. before) it is taken in the previous (resp.
+ ** next) year, so that logs written around the new year get the
+ ** right one.
+ **
+ ** @param c    Timestamp cache.
+ ** @param s    Date text, at least TS_SYSLOG_LEN characters.
+ ** @param now  Reference time, usually the current time.
+ ** @param t    Where to store the result.
+ ** @return 0 on success, -1 if the date is malformed.
+ **/
+int
+ts_parse_syslog(ts_cache_t *c, const char *s, time_t now, time_t *t);
+
+
+/**
+ ** Parse a ctime() date without the week day "Mmm dd hh:mm:ss yyyy",
+ ** in local time.
+ **
+ ** @param c  Timestamp cache.
+ ** @param s  Date text, at least TS_CTIME_LEN characters.
+ ** @param t  Where to store the result.
+ ** @return 0 on success, -1 if the date is malformed.
+ **/
+int
+ts_parse_ctime(ts_cache_t *c, const char *s, time_t *t);
+
+
+/**
+ ** Parse an RFC 3339 / ISO 8601 date
+ ** "yyyy-mm-dd[T ]hh:mm:ss[.frac][Z|(+|-)hh[:]mm]".  Dates without a
+ ** time zone are in local time.
+ **
+ ** @param c    Timestamp cache.
+ ** @param s    Date text.
+ ** @param len  Length of the text available.
+ ** @param tv   Where to store the result.
+ ** @return A pointer to the character after the date, or NULL if
+ **   the date is malformed.
+ **/
+const char *
+ts_parse_iso8601(ts_cache_t *c, const char *s, size_t len, struct timeval *tv);
+
+
+/**
+ ** Parse a date in seconds since the Epoch with an optional
+ ** fraction, "12345.678", without going through floating point.
+ **
+ ** @param s   Date text.
+ ** @param tv  Where to store the result.
+ ** @return A pointer to the character after the date.
+ **/
+const char *
+ts_parse_epoch(const char *s, struct timeval *tv);
+
+
+#endif /* TIMESTAMP_H */
+
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */
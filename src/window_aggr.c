@@ -0,0 +1,611 @@
+/**
+ ** @file window_aggr.c
+ ** Keyed time window aggregators for the ISSDL language.
+ **
+ ** Threshold rules ("N events from the same source within T seconds")
+ ** used to need one rule instance per key, with a self-looping state
+ ** and a path tree growing with each event.  Window aggregators keep
+ ** one ring of bucket counters per key instead: a window of width T
+ ** with B buckets counts events (or sums values) in time slots of T/B
+ ** seconds, and the aggregate over the window is the sum of the last
+ ** B slots.  With B = 1, the window is a tumbling window; with B > 1
+ ** it slides by T/B seconds.  The memory used is O(keys x buckets),
+ ** whatever the number of events.
+ **
+ ** A window is declared by its first use in a rule, e.g.
+ **   expect (.sshd.action == "Failed"
+ **           && window_count("fail", .sshd.src_ip, .syslog.time, 60, 6) == 100)
+ **     goto alert;
+ ** Window names are local to a rule, and later uses of a window
+ ** ignore its width and number of buckets.  Windows survive rule
+ ** reloads.  Times are taken from the events (ctime, timeval or
+ ** integer values), so that offline analysis gets the same results;
+ ** the main loop time is used when the time is undefined or negative.
+ **
+ ** Since conditions of a rule are evaluated by all its waiting
+ ** threads, an event is added only once to a key of a window.
+ **
+ ** Threshold crossings are conditions (window_count(...) == N, or
+ ** window_crossed()), so the actions of the state reached on a
+ ** crossing run once per crossing.  These actions may emit a
+ ** meta-event with the build_event(), set_event_field() and
+ ** inject_event() functions of mod_metaevent.
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "orchids.h"
+#include "safelib.h"
+#include "strhash.h"
+#include "lang.h"
+
+#include "window_aggr.h"
+
+
+static const char *window_kind_g[] = { "count", "sum", "distinct" };
+
+
+/**
+ ** Time of an event, in seconds.  Negative times (which would give
+ ** negative bucket indexes) are treated as undefined times.
+ **/
+static time_t
+window_time(orchids_t *ctx, ovm_var_t *t)
+{
+  time_t tm;
+
+  tm = -1;
+  if (!IS_NULL(t)) {
+    switch (TYPE(t)) {
+    case T_CTIME:
+      tm = CTIME(t);
+      break ;
+    case T_TIMEVAL:
+      tm = TIMEVAL(t).tv_sec;
+      break ;
+    case T_INT:
+      tm = (time_t)INT(t);
+      break ;
+    case T_UINT:
+      tm = (time_t)UINT(t);
+      break ;
+    }
+  }
+  if (tm >= 0)
+    return (tm);
+
+  if (ctx->cur_loop_time.tv_sec != 0)
+    return (ctx->cur_loop_time.tv_sec);
+
+  return (time(NULL));
+}
+
+
+static void
+free_window_key(window_t *w, window_key_t *k)
+{
+  window_value_t *v;
+
+  if (k->values) {
+    while ((v = DTAILQ_FIRST(&k->values_lru)) != NULL) {
+      DTAILQ_REMOVE(&k->values_lru, v, lru);
+      Xfree(v);
+    }
+    free_hash(k->values, NULL);
+  }
+
+  hash_del(w->keys, k->key, k->keylen);
+  DTAILQ_REMOVE(&w->lru, k, lru);
+  w->nkeys--;
+  Xfree(k);
+}
+
+
+/**
+ ** Free the keys whose buckets are all older than the window
+ ** ending at a given time slot.
+ **/
+static void
+expire_window_keys(window_t *w, time_t slot)
+{
+  window_key_t *k;
+
+  while ((k = DTAILQ_FIRST(&w->lru)) != NULL
+         && k->head + w->nbuckets <= slot)
+    free_window_key(w, k);
+}
+
+
+/**
+ ** Move the window of a key forward, to end at a given time slot,
+ ** clearing the buckets falling out of the window.
+ **/
+static void
+advance_window_key(window_t *w, window_key_t *k, time_t slot)
+{
+  window_value_t *v;
+  time_t n;
+  int i;
+
+  if (slot <= k->head)
+    return ;
+
+  if (w->kind == WINDOW_DISTINCT) {
+    while ((v = DTAILQ_FIRST(&k->values_lru)) != NULL
+           && v->slot + w->nbuckets <= slot) {
+      DTAILQ_REMOVE(&k->values_lru, v, lru);
+      hash_del(k->values, v->data, v->len);
+      Xfree(v);
+      k->total--;
+    }
+    k->head = slot;
+    return ;
+  }
+
+  n = slot - k->head;
+  if (n >= w->nbuckets) {
+    memset(k->buckets, 0, w->nbuckets * sizeof (long));
+    k->total = 0;
+  }
+  else {
+    for (i = 1; i <= n; i++) {
+      k->total -= k->buckets[(k->head + i) % w->nbuckets];
+      k->buckets[(k->head + i) % w->nbuckets] = 0;
+    }
+  }
+  k->head = slot;
+}
+
+
+static window_key_t *
+get_window_key(orchids_t *ctx, window_t *w, ovm_var_t *key,
+               time_t slot, bool_t create)
+{
+  window_key_t *k;
+  void *data;
+  size_t len;
+  size_t sz;
+
+  data = issdl_get_data(key);
+  len = issdl_get_data_len(key);
+
+  k = hash_get(w->keys, data, len);
+  if (k != NULL || !create)
+    return (k);
+
+  if (w->nkeys >= ctx->window_max_keys && ctx->window_max_keys > 0) {
+    DebugLog(DF_ENG, DS_DEBUG, "window %s: too many keys, evict oldest\n",
+             w->name);
+    free_window_key(w, DTAILQ_FIRST(&w->lru));
+    w->evicted++;
+  }
+
+  sz = sizeof (window_key_t);
+  if (w->kind != WINDOW_DISTINCT)
+    sz += w->nbuckets * sizeof (long);
+  k = Xzmalloc(sz + len);
+  k->key = (char *)k + sz;
+  memcpy(k->key, data, len);
+  k->keylen = len;
+  k->head = slot;
+  if (w->kind == WINDOW_DISTINCT) {
+    k->values = new_hash(16);
+    DTAILQ_INIT(&k->values_lru);
+  }
+
+  hash_add(w->keys, k, k->key, k->keylen);
+  DTAILQ_INSERT_TAIL(&w->lru, k, lru);
+  w->nkeys++;
+
+  return (k);
+}
+
+
+/**
+ ** Add a value seen at a given time slot to the window of a key.
+ **/
+static void
+window_key_add(orchids_t *ctx, window_t *w, window_key_t *k,
+               time_t slot, long amount, ovm_var_t *val)
+{
+  window_value_t *v;
+  void *data;
+  size_t len;
+
+  /* Already added by another thread of the rule */
+  if (k->last_event == ctx->events)
+    return ;
+  k->last_event = ctx->events;
+
+  advance_window_key(w, k, slot);
+  k->before = k->total;
+
+  DTAILQ_REMOVE(&w->lru, k, lru);
+  DTAILQ_INSERT_TAIL(&w->lru, k, lru);
+
+  /* Late event, out of the window */
+  if (slot + w->nbuckets <= k->head)
+    return ;
+
+  if (w->kind != WINDOW_DISTINCT) {
+    k->buckets[slot % w->nbuckets] += amount;
+    k->total += amount;
+    return ;
+  }
+
+  data = issdl_get_data(val);
+  len = issdl_get_data_len(val);
+  v = hash_get(k->values, data, len);
+  if (v != NULL) {
+    if (slot > v->slot) {
+      v->slot = slot;
+      DTAILQ_REMOVE(&k->values_lru, v, lru);
+      DTAILQ_INSERT_TAIL(&k->values_lru, v, lru);
+    }
+    return ;
+  }
+
+  v = Xzmalloc(sizeof (window_value_t) + len);
+  v->slot = slot;
+  v->len = len;
+  memcpy(v->data, data, len);
+  hash_add(k->values, v, v->data, len);
+  DTAILQ_INSERT_TAIL(&k->values_lru, v, lru);
+  k->total++;
+}
+
+
+/**
+ ** Find a window of the rule of a state instance, creating it if
+ ** it doesn't exist and kind isn't negative.
+ **/
+static window_t *
+get_window(orchids_t *ctx, state_instance_t *state, ovm_var_t *name,
+           int kind, ovm_var_t *width, ovm_var_t *nbuckets)
+{
+  window_t *w;
+  char full_name[WINDOW_NAME_SZ];
+
+  if (IS_NULL(name) || TYPE(name) != T_STR) {
+    DebugLog(DF_ENG, DS_ERROR, "window name must be a string\n");
+    return (NULL);
+  }
+
+  snprintf(full_name, sizeof (full_name), "%s/%.*s",
+           state->state->rule->name, (int)STRLEN(name), STR(name));
+
+  w = strhash_get(ctx->windows, full_name);
+  if (w != NULL) {
+    if (kind >= 0 && w->kind != kind) {
+      DebugLog(DF_ENG, DS_ERROR, "window %s is a %s window, not a %s window\n",
+               w->name, window_kind_g[w->kind], window_kind_g[kind]);
+      return (NULL);
+    }
+    return (w);
+  }
+
+  if (kind < 0)
+    return (NULL);
+
+  if (IS_NULL(width) || TYPE(width) != T_INT || INT(width) <= 0
+      || IS_NULL(nbuckets) || TYPE(nbuckets) != T_INT
+      || INT(nbuckets) <= 0 || INT(nbuckets) > WINDOW_MAX_BUCKETS) {
+    DebugLog(DF_ENG, DS_ERROR,
+             "window %s: width must be positive, buckets between 1 and %i\n",
+             full_name, WINDOW_MAX_BUCKETS);
+    return (NULL);
+  }
+
+  w = Xzmalloc(sizeof (window_t));
+  w->name = Xstrdup(full_name);
+  w->kind = kind;
+  w->width = INT(width);
+  w->nbuckets = INT(nbuckets);
+  w->slot_width = (w->width + w->nbuckets - 1) / w->nbuckets;
+  w->keys = new_hash(1024);
+  DTAILQ_INIT(&w->lru);
+  strhash_add(ctx->windows, w, w->name);
+
+  DebugLog(DF_ENG, DS_INFO, "new %s window %s: %li s, %i bucket(s) of %li s\n",
+           window_kind_g[kind], w->name, (long)w->width, w->nbuckets,
+           (long)w->slot_width);
+
+  return (w);
+}
+
+
+/**
+ ** Common part of the window functions: add the current event to
+ ** the window of a key, and return the window.
+ **/
+static window_t *
+window_update(orchids_t *ctx, state_instance_t *state, int kind,
+              ovm_var_t *name, ovm_var_t *key, ovm_var_t *val,
+              ovm_var_t *t, ovm_var_t *width, ovm_var_t *nbuckets,
+              window_key_t **kp)
+{
+  window_t *w;
+  window_key_t *k;
+  time_t slot;
+  long amount;
+
+  *kp = NULL;
+
+  w = get_window(ctx, state, name, kind, width, nbuckets);
+  if (w == NULL || IS_NULL(key))
+    return (NULL);
+
+  amount = 1;
+  if (kind == WINDOW_SUM) {
+    if (IS_NULL(val))
+      return (NULL);
+    switch (TYPE(val)) {
+    case T_INT:
+      amount = INT(val);
+      break ;
+    case T_UINT:
+      amount = (long)UINT(val);
+      break ;
+    case T_COUNTER:
+      amount = (long)COUNTER(val);
+      break ;
+    case T_FLOAT:
+      amount = (long)FLOAT(val);
+      break ;
+    default:
+      DebugLog(DF_ENG, DS_ERROR, "window %s: can't sum %s values\n",
+               w->name, STRTYPE(val));
+      return (NULL);
+    }
+  }
+  else if (kind == WINDOW_DISTINCT && IS_NULL(val))
+    return (NULL);
+
+  slot = window_time(ctx, t) / w->slot_width;
+  expire_window_keys(w, slot);
+  k = get_window_key(ctx, w, key, slot, TRUE);
+  window_key_add(ctx, w, k, slot, amount, val);
+  *kp = k;
+
+  return (w);
+}
+
+
+static void
+window_push_int(orchids_t *ctx, long v)
+{
+  ovm_var_t *res;
+
+  res = ovm_int_new();
+  INT(res) = v;
+  FLAGS(res) |= TYPE_CANFREE | TYPE_NOTBOUND;
+  stack_push(ctx->ovm_stack, res);
+}
+
+
+/**
+ ** window_count(name, key, time, width, buckets): count the current
+ ** event, and return the number of events of the key in the window.
+ **/
+static void
+issdl_window_count(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *name, *key, *t, *width, *nbuckets;
+  window_key_t *k;
+
+  name = stack_pop(ctx->ovm_stack);
+  key = stack_pop(ctx->ovm_stack);
+  t = stack_pop(ctx->ovm_stack);
+  width = stack_pop(ctx->ovm_stack);
+  nbuckets = stack_pop(ctx->ovm_stack);
+
+  if (window_update(ctx, state, WINDOW_COUNT, name, key, NULL,
+                    t, width, nbuckets, &k))
+    window_push_int(ctx, k->total);
+  else
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+
+  FREE_IF_NEEDED(name);
+  FREE_IF_NEEDED(key);
+  FREE_IF_NEEDED(t);
+  FREE_IF_NEEDED(width);
+  FREE_IF_NEEDED(nbuckets);
+}
+
+
+/**
+ ** window_sum(name, key, value, time, width, buckets): add a value,
+ ** and return the sum of the values of the key in the window.
+ **/
+static void
+issdl_window_sum(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *name, *key, *val, *t, *width, *nbuckets;
+  window_key_t *k;
+
+  name = stack_pop(ctx->ovm_stack);
+  key = stack_pop(ctx->ovm_stack);
+  val = stack_pop(ctx->ovm_stack);
+  t = stack_pop(ctx->ovm_stack);
+  width = stack_pop(ctx->ovm_stack);
+  nbuckets = stack_pop(ctx->ovm_stack);
+
+  if (window_update(ctx, state, WINDOW_SUM, name, key, val,
+                    t, width, nbuckets, &k))
+    window_push_int(ctx, k->total);
+  else
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+
+  FREE_IF_NEEDED(name);
+  FREE_IF_NEEDED(key);
+  FREE_IF_NEEDED(val);
+  FREE_IF_NEEDED(t);
+  FREE_IF_NEEDED(width);
+  FREE_IF_NEEDED(nbuckets);
+}
+
+
+/**
+ ** window_distinct(name, key, value, time, width, buckets): add a
+ ** value, and return the number of distinct values of the key in the
+ ** window.
+ **/
+static void
+issdl_window_distinct(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *name, *key, *val, *t, *width, *nbuckets;
+  window_key_t *k;
+
+  name = stack_pop(ctx->ovm_stack);
+  key = stack_pop(ctx->ovm_stack);
+  val = stack_pop(ctx->ovm_stack);
+  t = stack_pop(ctx->ovm_stack);
+  width = stack_pop(ctx->ovm_stack);
+  nbuckets = stack_pop(ctx->ovm_stack);
+
+  if (window_update(ctx, state, WINDOW_DISTINCT, name, key, val,
+                    t, width, nbuckets, &k))
+    window_push_int(ctx, k->total);
+  else
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+
+  FREE_IF_NEEDED(name);
+  FREE_IF_NEEDED(key);
+  FREE_IF_NEEDED(val);
+  FREE_IF_NEEDED(t);
+  FREE_IF_NEEDED(width);
+  FREE_IF_NEEDED(nbuckets);
+}
+
+
+/**
+ ** window_rate(name, key, time, width, buckets): count the current
+ ** event, and return the rate of events of the key in the window, in
+ ** events per second (float).
+ **/
+static void
+issdl_window_rate(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *name, *key, *t, *width, *nbuckets;
+  ovm_var_t *res;
+  window_key_t *k;
+  window_t *w;
+
+  name = stack_pop(ctx->ovm_stack);
+  key = stack_pop(ctx->ovm_stack);
+  t = stack_pop(ctx->ovm_stack);
+  width = stack_pop(ctx->ovm_stack);
+  nbuckets = stack_pop(ctx->ovm_stack);
+
+  w = window_update(ctx, state, WINDOW_COUNT, name, key, NULL,
+                    t, width, nbuckets, &k);
+  if (w) {
+    res = ovm_float_new();
+    FLOAT(res) = (float)k->total / (w->slot_width * w->nbuckets);
+    FLAGS(res) |= TYPE_CANFREE | TYPE_NOTBOUND;
+    stack_push(ctx->ovm_stack, res);
+  }
+  else
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+
+  FREE_IF_NEEDED(name);
+  FREE_IF_NEEDED(key);
+  FREE_IF_NEEDED(t);
+  FREE_IF_NEEDED(width);
+  FREE_IF_NEEDED(nbuckets);
+}
+
+
+/**
+ ** window_crossed(name, key, threshold): return true if the current
+ ** event made the aggregate of the key reach the threshold, from
+ ** below.  This fires once per crossing, even when the aggregate
+ ** jumps over the threshold (sums).
+ **/
+static void
+issdl_window_crossed(orchids_t *ctx, state_instance_t *state)
+{
+  ovm_var_t *name, *key, *thres;
+  window_key_t *k;
+  window_t *w;
+
+  name = stack_pop(ctx->ovm_stack);
+  key = stack_pop(ctx->ovm_stack);
+  thres = stack_pop(ctx->ovm_stack);
+
+  k = NULL;
+  w = get_window(ctx, state, name, -1, NULL, NULL);
+  if (w && !IS_NULL(key))
+    k = get_window_key(ctx, w, key, 0, FALSE);
+
+  if (IS_NULL(thres) || TYPE(thres) != T_INT)
+    ISSDL_RETURN_PARAM_ERROR(ctx, state);
+  else if (k && k->last_event == ctx->events
+           && k->before < INT(thres) && k->total >= INT(thres))
+    ISSDL_RETURN_TRUE(ctx, state);
+  else
+    ISSDL_RETURN_FALSE(ctx, state);
+
+  FREE_IF_NEEDED(name);
+  FREE_IF_NEEDED(key);
+  FREE_IF_NEEDED(thres);
+}
+
+
+void
+register_window_functions(orchids_t *ctx)
+{
+  register_lang_function(ctx, issdl_window_count, "window_count", 5,
+                         "count events per key in a time window");
+  register_lang_function(ctx, issdl_window_sum, "window_sum", 6,
+                         "sum values per key in a time window");
+  register_lang_function(ctx, issdl_window_distinct, "window_distinct", 6,
+                         "count distinct values per key in a time window");
+  register_lang_function(ctx, issdl_window_rate, "window_rate", 5,
+                         "rate of events per key in a time window");
+  register_lang_function(ctx, issdl_window_crossed, "window_crossed", 3,
+                         "test if the last event made a window reach a threshold");
+}
+
+
+static int
+fprintf_window(void *elmt, void *data)
+{
+  window_t *w = elmt;
+  FILE *fp = data;
+
+  fprintf(fp, "%40.40s | %8s | %6li | %5i | %8zu | %lu\n",
+          w->name, window_kind_g[w->kind], (long)w->width, w->nbuckets,
+          w->nkeys, w->evicted);
+
+  return (0);
+}
+
+
+void
+fprintf_windows(FILE *fp, orchids_t *ctx)
+{
+  fprintf(fp,
+          "-----------------------------------------+----------+--------+-------+----------+---------\n");
+  fprintf(fp,
+          "                             rule/window |     kind |  width |  bkts |     keys | evicted\n");
+  fprintf(fp,
+          "-----------------------------------------+----------+--------+-------+----------+---------\n");
+  strhash_walk(ctx->windows, fprintf_window, fp);
+  fprintf(fp,
+          "-----------------------------------------+----------+--------+-------+----------+---------\n");
+}
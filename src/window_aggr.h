@@ -0,0 +1,223 @@
+/**
+ ** @file window_aggr.h
+ ** Public definitions for window_aggr.c
+ **
+ ** @version 0.1
+ ** @ingroup core
+ **/
+
+/*
+ * See end of file for LICENSE and COPYRIGHT informations.
+ */
+
+#ifndef WINDOW_AGGR_H
+#define WINDOW_AGGR_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "orchids.h"
+#include "hash.h"
+#include "dtailq.h"
+
+/** Window counting events. */
+#define WINDOW_COUNT    0
+/** Window summing values. */
+#define WINDOW_SUM      1
+/** Window counting distinct values. */
+#define WINDOW_DISTINCT 2
+
+/** Maximum number of buckets of a window. */
+#define WINDOW_MAX_BUCKETS 3600
+/** Size of the buffer for window names (rule name/window name). */
+#define WINDOW_NAME_SZ 256
+
+
+typedef struct window_value_s window_value_t;
+typedef struct window_key_s window_key_t;
+typedef struct window_s window_t;
+
+/**
+ ** @struct window_value_s
+ **   A value seen for a key of a distinct-count window.
+ **/
+/**   @var window_value_s::slot
+ **     Time slot in which the value was last seen.
+ **/
+/**   @var window_value_s::lru
+ **     Values of the key, least recently seen first.
+ **/
+/**   @var window_value_s::len
+ **     Length of the value.
+ **/
+/**   @var window_value_s::data
+ **     The value bytes.
+ **/
+struct window_value_s
+{
+  time_t                        slot;
+  DTAILQ_ENTRY(window_value_t)  lru;
+  size_t                        len;
+  unsigned char                 data[];
+};
+
+
+/**
+ ** @struct window_key_s
+ **   Aggregate of one key of a window: a ring of bucket counters,
+ **   one per time slot.
+ **/
+/**   @var window_key_s::key
+ **     Key bytes (stored after the buckets).
+ **/
+/**   @var window_key_s::keylen
+ **     Length of the key.
+ **/
+/**   @var window_key_s::head
+ **     Time slot of the most recent bucket.
+ **/
+/**   @var window_key_s::total
+ **     Sum of the buckets (aggregate over the window).
+ **/
+/**   @var window_key_s::before
+ **     Aggregate before the last update, to detect threshold crossings.
+ **/
+/**   @var window_key_s::last_event
+ **     Serial number (ctx->events) of the last event added, so that
+ **     conditions evaluated by several threads count an event once.
+ **/
+/**   @var window_key_s::values
+ **     Values seen in the window (distinct-count windows only).
+ **/
+/**   @var window_key_s::values_lru
+ **     Values seen in the window, least recently seen first.
+ **/
+/**   @var window_key_s::lru
+ **     Keys of the window, least recently updated first.
+ **/
+/**   @var window_key_s::buckets
+ **     Bucket ring, indexed by time slot modulo the number of buckets.
+ **/
+struct window_key_s
+{
+  void                         *key;
+  size_t                        keylen;
+  time_t                        head;
+  long                          total;
+  long                          before;
+  unsigned int                  last_event;
+  hash_t                       *values;
+  DTAILQ_HEAD(window_values, window_value_t) values_lru;
+  DTAILQ_ENTRY(window_key_t)    lru;
+  long                          buckets[];
+};
+
+
+/**
+ ** @struct window_s
+ **   A keyed window aggregator, declared by its first use in a rule.
+ **/
+/**   @var window_s::name
+ **     Rule name and window name, separated by a slash.
+ **/
+/**   @var window_s::kind
+ **     WINDOW_COUNT, WINDOW_SUM or WINDOW_DISTINCT.
+ **/
+/**   @var window_s::width
+ **     Window width, in seconds.
+ **/
+/**   @var window_s::nbuckets
+ **     Number of buckets: 1 for a tumbling window, more for a sliding
+ **     one.
+ **/
+/**   @var window_s::slot_width
+ **     Width of a bucket, in seconds.
+ **/
+/**   @var window_s::keys
+ **     Keys of the window.
+ **/
+/**   @var window_s::lru
+ **     Keys, least recently updated first.
+ **/
+/**   @var window_s::nkeys
+ **     Number of keys.
+ **/
+/**   @var window_s::evicted
+ **     Number of keys evicted because the window had too many keys.
+ **/
+struct window_s
+{
+  char                         *name;
+  int                           kind;
+  time_t                        width;
+  int                           nbuckets;
+  time_t                        slot_width;
+  hash_t                       *keys;
+  DTAILQ_HEAD(window_keys, window_key_t) lru;
+  size_t                        nkeys;
+  unsigned long                 evicted;
+};
+
+
+/**
+ ** Register the window aggregation functions of the ISSDL language:
+ **   window_count(name, key, time, width, buckets),
+ **   window_sum(name, key, value, time, width, buckets),
+ **   window_distinct(name, key, value, time, width, buckets),
+ **   window_rate(name, key, time, width, buckets) and
+ **   window_crossed(name, key, threshold).
+ **
+ ** @param ctx Orchids application context.
+ **/
+void
+register_window_functions(orchids_t *ctx);
+
+
+/**
+ ** Print the window aggregators.
+ **
+ ** @param fp  Output stream.
+ ** @param ctx Orchids application context.
+ **/
+void
+fprintf_windows(FILE *fp, orchids_t *ctx);
+
+
+#endif /* WINDOW_AGGR_H */
+/*
+** Copyright (c) 2002-2005 by Julien OLIVAIN, Laboratoire Spécification
+** et Vérification (LSV), CNRS UMR 8643 & ENS Cachan.
+**
+** Julien OLIVAIN <julien.olivain@lsv.ens-cachan.fr>
+**
+** This software is a computer program whose purpose is to detect intrusions
+** in a computer network.
+**
+** This software is governed by the CeCILL license under French law and
+** abiding by the rules of distribution of free software.  You can use,
+** modify and/or redistribute the software under the terms of the CeCILL
+** license as circulated by CEA, CNRS and INRIA at the following URL
+** "http://www.cecill.info".
+**
+** As a counterpart to the access to the source code and rights to copy,
+** modify and redistribute granted by the license, users are provided
+** only with a limited warranty and the software's author, the holder of
+** the economic rights, and the successive licensors have only limited
+** liability.
+**
+** In this respect, the user's attention is drawn to the risks associated
+** with loading, using, modifying and/or developing or reproducing the
+** software by the user in light of its specific status of free software,
+** that may mean that it is complicated to manipulate, and that also
+** therefore means that it is reserved for developers and experienced
+** professionals having in-depth computer knowledge. Users are therefore
+** encouraged to load and test the software's suitability as regards
+** their requirements in conditions enabling the security of their
+** systems and/or data to be ensured and, more generally, to use and
+** operate it in the same conditions as regards security.
+**
+** The fact that you are presently reading this means that you have had
+** knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* End-of-file */